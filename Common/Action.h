@@ -11,10 +11,15 @@
 
 
 
+class PointerWrap;
+
 // Pretty much a Runnable. Similar to Action from JPCSP.
 class Action
 {
 public:
   virtual ~Action() {}
   virtual void run() = 0;
+  // Pending actions are part of save states, see __KernelRegisterActionType.
+  virtual void DoState(PointerWrap &p) = 0;
+  int actionTypeID;
 };
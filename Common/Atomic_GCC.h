@@ -76,6 +76,11 @@ inline void AtomicStoreRelease(volatile u32& dest, u32 value) {
 	__sync_lock_test_and_set(&dest, value); // TODO: Wrong! This function is has acquire semantics.
 }
 
+// Full barrier. Returns true if dest was comparand and is now value.
+inline bool AtomicCompareAndSwap(volatile u32& dest, u32 value, u32 comparand) {
+	return __sync_bool_compare_and_swap(&dest, comparand, value);
+}
+
 }
 
 // Old code kept here for reference in case we need the parts with __asm__ __volatile__.
@@ -80,6 +80,11 @@ inline void AtomicStoreRelease(volatile u32& dest, u32 value) {
 	dest = value; // 32-bit writes are always atomic.
 }
 
+// Full barrier. Returns true if dest was comparand and is now value.
+inline bool AtomicCompareAndSwap(volatile u32& dest, u32 value, u32 comparand) {
+	return InterlockedCompareExchange((volatile LONG*)&dest, (LONG)value, (LONG)comparand) == (LONG)comparand;
+}
+
 }
 
 #endif
@@ -49,7 +49,8 @@ static inline void do_cpuid(unsigned int *eax, unsigned int *ebx,
 		  "=S" (*ebx),
 		  "=c" (*ecx),
 		  "=d" (*edx)
-		: "a"  (*eax)
+		: "a"  (*eax),
+		  "c"  (*ecx)
 		: "rbx"
 		);
 #else
@@ -60,7 +61,8 @@ static inline void do_cpuid(unsigned int *eax, unsigned int *ebx,
 		  "=S" (*ebx),
 		  "=c" (*ecx),
 		  "=d" (*edx)
-		: "a"  (*eax)
+		: "a"  (*eax),
+		  "c"  (*ecx)
 		: "ebx"
 		);
 #endif
@@ -81,6 +83,20 @@ static void __cpuid(int info[4], int x)
 #endif
 }
 
+static void __cpuidex(int info[4], int x, int count)
+{
+#if defined __FreeBSD__
+	cpuid_count((unsigned int)x, (unsigned int)count, (unsigned int*)info);
+#else
+	unsigned int eax = x, ebx = 0, ecx = count, edx = 0;
+	do_cpuid(&eax, &ebx, &ecx, &edx);
+	info[0] = eax;
+	info[1] = ebx;
+	info[2] = ecx;
+	info[3] = edx;
+#endif
+}
+
 #endif
 
 #include "Common.h"
@@ -165,6 +181,10 @@ void CPUInfo::Detect()
 		if ((cpu_id[2] >> 28) & 1) bAVX = true;
 		if ((cpu_id[2] >> 25) & 1) bAES = true;
 	}
+	if (max_std_fn >= 7) {
+		__cpuidex(cpu_id, 0x00000007, 0);
+		if ((cpu_id[1] >> 29) & 1) bSHA = true;
+	}
 	if (max_ex_fn >= 0x80000004) {
 		// Extract brand string
 		__cpuid(cpu_id, 0x80000002);
@@ -228,6 +248,7 @@ std::string CPUInfo::Summarize()
 	if (HTT) sum += ", HTT";
 	if (bAVX) sum += ", AVX";
 	if (bAES) sum += ", AES";
+	if (bSHA) sum += ", SHA";
 	if (bLongMode) sum += ", 64-bit support";
 	return sum;
 }
@@ -53,6 +53,7 @@ struct CPUInfo
 	bool bSSE4A;
 	bool bAVX;
 	bool bAES;
+	bool bSHA;
 	bool bLAHFSAHF64;
 	bool bLongMode;
 
@@ -30,6 +30,8 @@
 #include <map>
 #include <vector>
 #include <deque>
+#include <list>
+#include <set>
 #include <string>
 
 #include "Common.h"
@@ -52,17 +54,33 @@ public:
 		MODE_VERIFY, // compare
 	};
 
+	enum Error {
+		ERROR_NONE = 0,
+		ERROR_WARNING = 1,
+		ERROR_FAILURE = 2,
+	};
+
 	u8 **ptr;
 	Mode mode;
+	Error error;
 
 public:
-	PointerWrap(u8 **ptr_, Mode mode_) : ptr(ptr_), mode(mode_) {}
-	PointerWrap(unsigned char **ptr_, int mode_) : ptr((u8**)ptr_), mode((Mode)mode_) {}
+	PointerWrap(u8 **ptr_, Mode mode_) : ptr(ptr_), mode(mode_), error(ERROR_NONE) {}
+	PointerWrap(unsigned char **ptr_, int mode_) : ptr((u8**)ptr_), mode((Mode)mode_), error(ERROR_NONE) {}
 
 	void SetMode(Mode mode_) {mode = mode_;}
 	Mode GetMode() const {return mode;}
 	u8 **GetPPtr() {return ptr;}
 
+	// Once a failure is flagged, the rest of the state is only measured, never applied.
+	void SetError(Error error_)
+	{
+		if (error < error_)
+			error = error_;
+		if (error > ERROR_WARNING)
+			mode = PointerWrap::MODE_MEASURE;
+	}
+
 	void DoVoid(void *data, int size)
 	{
 		switch (mode) {
@@ -75,8 +93,8 @@ public:
 		(*ptr) += size;
 	}
 
-	template<class T>
-	void Do(std::map<unsigned int, T> &x)
+	template<class K, class T>
+	void Do(std::map<K, T> &x)
 	{
 		unsigned int number = (unsigned int)x.size();
 		Do(number);
@@ -86,9 +104,9 @@ public:
 				x.clear();
 				while (number > 0)
 				{
-					unsigned int first = 0;
+					K first = K();
 					Do(first);
-					T second;
+					T second = T();
 					Do(second);
 					x[first] = second;
 					--number;
@@ -99,10 +117,11 @@ public:
 		case MODE_MEASURE:
 		case MODE_VERIFY:
 			{
-				typename std::map<unsigned int, T>::iterator itr = x.begin();
+				typename std::map<K, T>::iterator itr = x.begin();
 				while (number > 0)
 				{
-					Do(itr->first);
+					K first = itr->first;
+					Do(first);
 					Do(itr->second);
 					--number;
 					++itr;
@@ -112,6 +131,47 @@ public:
 		}
 	}
 
+	// Store maps of owned objects. T needs a default constructor and DoState(PointerWrap &).
+	template<class K, class T>
+	void Do(std::map<K, T *> &x)
+	{
+		unsigned int number = (unsigned int)x.size();
+		Do(number);
+		switch (mode) {
+		case MODE_READ:
+			{
+				for (typename std::map<K, T *>::iterator it = x.begin(), end = x.end(); it != end; ++it)
+					delete it->second;
+				x.clear();
+				while (number > 0)
+				{
+					K first = K();
+					Do(first);
+					T *second = new T();
+					second->DoState(*this);
+					x[first] = second;
+					--number;
+				}
+			}
+			break;
+		case MODE_WRITE:
+		case MODE_MEASURE:
+		case MODE_VERIFY:
+			{
+				typename std::map<K, T *>::iterator itr = x.begin();
+				while (number > 0)
+				{
+					K first = itr->first;
+					Do(first);
+					itr->second->DoState(*this);
+					--number;
+					++itr;
+				}
+			}
+			break;
+		}
+	}
+
 	// Store vectors.
 	template<class T>
 	void Do(std::vector<T> &x)
@@ -119,7 +179,51 @@ public:
 		u32 vec_size = (u32)x.size();
 		Do(vec_size);
 		x.resize(vec_size);
-		DoArray(&x[0], vec_size);
+		if (vec_size > 0)
+			DoArray(&x[0], vec_size);
+	}
+
+	// Store lists.
+	template<class T>
+	void Do(std::list<T> &x)
+	{
+		u32 list_size = (u32)x.size();
+		Do(list_size);
+		x.resize(list_size);
+		for (typename std::list<T>::iterator it = x.begin(), end = x.end(); it != end; ++it)
+			Do(*it);
+	}
+
+	// Store sets.
+	template<class T>
+	void Do(std::set<T> &x)
+	{
+		u32 set_size = (u32)x.size();
+		Do(set_size);
+		switch (mode) {
+		case MODE_READ:
+			{
+				x.clear();
+				for (u32 i = 0; i < set_size; i++)
+				{
+					T value = T();
+					Do(value);
+					x.insert(value);
+				}
+			}
+			break;
+		case MODE_WRITE:
+		case MODE_MEASURE:
+		case MODE_VERIFY:
+			{
+				for (typename std::set<T>::iterator it = x.begin(), end = x.end(); it != end; ++it)
+				{
+					T value = *it;
+					Do(value);
+				}
+			}
+			break;
+		}
 	}
 	
 	// Store deques.
@@ -248,8 +352,8 @@ public:
 		Do(cookie);
 		if(mode == PointerWrap::MODE_READ && cookie != arbitraryNumber)
 		{
-			PanicAlertT("Error: After \"%s\", found %d (0x%X) instead of save marker %d (0x%X). Aborting savestate load...", prevName, cookie, cookie, arbitraryNumber, arbitraryNumber);
-			mode = PointerWrap::MODE_MEASURE;
+			ERROR_LOG(COMMON, "After \"%s\", found %d (0x%X) instead of save marker %d (0x%X). Aborting savestate load...", prevName, cookie, cookie, arbitraryNumber, arbitraryNumber);
+			SetError(ERROR_FAILURE);
 		}
 	}
 };
@@ -34,6 +34,7 @@ enum {
 	D_CONFIG_IDX,
   F_CONFIG_IDX,
 	F_MAINLOG_IDX,
+	D_CACHE_IDX,
 	NUM_PATH_INDICES
 };
 
@@ -62,6 +62,17 @@ LogManager::LogManager()
 	m_Log[LogTypes::DYNA_REC]   = new LogContainer("Jit",			"JIT compiler");
 	m_Log[LogTypes::NETPLAY]    = new LogContainer("NET",			"Net play");
 
+	m_ring = new LogRecord[LOG_RING_SIZE];
+	for (u32 i = 0; i < LOG_RING_SIZE; ++i)
+		m_ring[i].sequence = i;
+	m_writePos = 0;
+	m_readPos = 0;
+	m_dropped = 0;
+	m_droppedReported = 0;
+	m_threadIdle = 0;
+	m_threadRunning = 0;
+	m_logThread = NULL;
+
 	// Remove file logging on small devices
 #if !defined(ANDROID) && !defined(IOS) && !defined(BLACKBERRY)
 	m_fileLog = new FileLogListener(File::GetUserPath(F_MAINLOG_IDX).c_str());
@@ -81,10 +92,14 @@ LogManager::LogManager()
 #endif
 #endif
 	}
+
+	SetAsync(true);
 }
 
 LogManager::~LogManager()
 {
+	SetAsync(false);
+
 	for (int i = 0; i < LogTypes::NUMBER_OF_LOGS; ++i)
 	{
 #if !defined(ANDROID) && !defined(IOS) && !defined(BLACKBERRY)
@@ -96,6 +111,7 @@ LogManager::~LogManager()
 
 	for (int i = 0; i < LogTypes::NUMBER_OF_LOGS; ++i)
 		delete m_Log[i];
+	delete [] m_ring;
 #if !defined(ANDROID) && !defined(IOS) && !defined(BLACKBERRY)
 	delete m_fileLog;
 	delete m_consoleLog;
@@ -126,25 +142,144 @@ void LogManager::LoadConfig(IniFile::Section *section)
 
 void LogManager::Log(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, const char *file, int line, const char *format, va_list args)
 {
-	char temp[MAX_MSGLEN];
-	char msg[MAX_MSGLEN * 2];
 	LogContainer *log = m_Log[type];
 	if (!log || !log->IsEnabled() || level > log->GetLevel() || ! log->HasListeners())
 		return;
 
-	CharArrayFromFormatV(temp, MAX_MSGLEN, format, args);
+	if (!m_threadRunning)
+	{
+		char temp[MAX_MSGLEN];
+		CharArrayFromFormatV(temp, MAX_MSGLEN, format, args);
+		Output(level, type, file, line, Common::Timer::GetTimeMsSinceJan1970(), temp);
+		return;
+	}
+
+	// Claim a slot. A slot is free for position pos when its sequence is pos.
+	u32 pos;
+	LogRecord *record;
+	for (;;)
+	{
+		pos = Common::AtomicLoad(m_writePos);
+		record = &m_ring[pos & (LOG_RING_SIZE - 1)];
+		u32 seq = Common::AtomicLoadAcquire(record->sequence);
+		if (seq == pos)
+		{
+			if (Common::AtomicCompareAndSwap(m_writePos, pos + 1, pos))
+				break;
+		}
+		else if ((s32)(seq - pos) < 0)
+		{
+			// The log thread hasn't freed this slot yet.
+			Common::AtomicIncrement(m_dropped);
+			return;
+		}
+	}
+
+	record->level = level;
+	record->type = type;
+	record->file = file;
+	record->line = line;
+	record->timestamp = Common::Timer::GetTimeMsSinceJan1970();
+	CharArrayFromFormatV(record->text, MAX_MSGLEN, format, args);
+
+	// Publish with a full barrier, so the idle check below can't be ordered before it.
+	Common::AtomicCompareAndSwap(record->sequence, pos + 1, pos);
+	if (Common::AtomicLoad(m_threadIdle))
+		m_logEvent.Set();
+}
+
+void LogManager::Output(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, const char *file, int line, u64 timestamp, const char *text)
+{
+	char msg[MAX_MSGLEN * 2];
+	LogContainer *log = m_Log[type];
 
 	static const char level_to_char[7] = "-NEWID";
 	char formattedTime[13];
-	Common::Timer::GetTimeFormatted(formattedTime);
+	Common::Timer::GetTimeFormatted(formattedTime, timestamp);
 	sprintf(msg, "%s %s:%u %c[%s]: %s\n",
 		formattedTime,
 		file, line, level_to_char[(int)level],
-		log->GetShortName(), temp);
+		log->GetShortName(), text);
 
 	log->Trigger(level, msg);
 }
 
+void LogManager::DrainRing()
+{
+	for (;;)
+	{
+		u32 pos = m_readPos;
+		LogRecord &record = m_ring[pos & (LOG_RING_SIZE - 1)];
+		if (Common::AtomicLoadAcquire(record.sequence) != pos + 1)
+			break;
+
+		Output(record.level, record.type, record.file, record.line, record.timestamp, record.text);
+		Common::AtomicStoreRelease(record.sequence, pos + LOG_RING_SIZE);
+		Common::AtomicStore(m_readPos, pos + 1);
+	}
+
+	u32 dropped = Common::AtomicLoad(m_dropped);
+	if (dropped != m_droppedReported)
+	{
+		char temp[MAX_MSGLEN];
+		sprintf(temp, "Log thread fell behind, %u messages dropped", dropped - m_droppedReported);
+		m_droppedReported = dropped;
+		Output(LogTypes::LWARNING, LogTypes::MASTER_LOG, __FILE__, __LINE__, Common::Timer::GetTimeMsSinceJan1970(), temp);
+	}
+}
+
+void LogManager::LogThread(LogManager *logManager)
+{
+	Common::SetCurrentThreadName("LogThread");
+
+	while (Common::AtomicLoadAcquire(logManager->m_threadRunning))
+	{
+		logManager->DrainRing();
+
+		// Announce we're about to sleep, then check again so a message
+		// published in between isn't left waiting for the next one.
+		Common::AtomicCompareAndSwap(logManager->m_threadIdle, 1, 0);
+		u32 pos = logManager->m_readPos;
+		if (Common::AtomicLoadAcquire(logManager->m_ring[pos & (LOG_RING_SIZE - 1)].sequence) != pos + 1 && logManager->m_threadRunning)
+			logManager->m_logEvent.Wait();
+		Common::AtomicStore(logManager->m_threadIdle, 0);
+	}
+}
+
+void LogManager::SetAsync(bool async)
+{
+	if (async == (m_threadRunning != 0))
+		return;
+
+	if (async)
+	{
+		m_threadRunning = 1;
+		m_logThread = new std::thread(&LogManager::LogThread, this);
+	}
+	else
+	{
+		Common::AtomicStoreRelease(m_threadRunning, 0);
+		m_logEvent.Set();
+		m_logThread->join();
+		delete m_logThread;
+		m_logThread = NULL;
+		// Anything that raced in after the thread's last pass.
+		DrainRing();
+	}
+}
+
+void LogManager::Flush()
+{
+	if (!m_threadRunning)
+		return;
+
+	while (Common::AtomicLoad(m_readPos) != Common::AtomicLoad(m_writePos))
+	{
+		m_logEvent.Set();
+		Common::SleepCurrentThread(1);
+	}
+}
+
 void LogManager::Init()
 {
 	m_logManager = new LogManager();
@@ -21,6 +21,7 @@
 #include "Log.h"
 #include "StringUtil.h"
 #include "Thread.h"
+#include "Atomic.h"
 #include "FileUtil.h"
 #include "IniFile.h"
 
@@ -29,6 +30,8 @@
 
 #define	MAX_MESSAGES 8000   
 #define MAX_MSGLEN  1024
+// Records buffered for the log thread. Must be a power of two.
+#define LOG_RING_SIZE 1024
 
 
 // pure virtual interface
@@ -101,14 +104,43 @@ class ConsoleListener;
 class LogManager : NonCopyable
 {
 private:
+	// One message waiting for the log thread. Callers only format the
+	// message body; the prefix and the listener fan-out happen on the thread.
+	struct LogRecord
+	{
+		volatile u32 sequence;
+		LogTypes::LOG_LEVELS level;
+		LogTypes::LOG_TYPE type;
+		const char *file;
+		int line;
+		u64 timestamp;
+		char text[MAX_MSGLEN];
+	};
+
 	LogContainer* m_Log[LogTypes::NUMBER_OF_LOGS];
 	FileLogListener *m_fileLog;
 	ConsoleListener *m_consoleLog;
 	DebuggerLogListener *m_debuggerLog;
 	static LogManager *m_logManager;  // Singleton. Ugh.
 
+	// Bounded multi-producer ring, drained by m_logThread.
+	LogRecord *m_ring;
+	volatile u32 m_writePos;
+	volatile u32 m_readPos;
+	volatile u32 m_dropped;
+	u32 m_droppedReported;
+	volatile u32 m_threadIdle;
+	volatile u32 m_threadRunning;
+	std::thread *m_logThread;
+	Common::Event m_logEvent;
+
 	LogManager();
 	~LogManager();
+
+	void Output(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, const char *file, int line, u64 timestamp, const char *text);
+	void DrainRing();
+	static void LogThread(LogManager *logManager);
+
 public:
 
 	static u32 GetMaxLevel() { return MAX_LOGLEVEL;	}
@@ -116,6 +148,14 @@ public:
 	void Log(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, 
 			 const char *file, int line, const char *fmt, va_list args);
 
+	// When async (the default), messages are handed to a background thread
+	// and dropped rather than blocking if it falls behind.
+	void SetAsync(bool async);
+	bool IsAsync() const { return m_threadRunning != 0; }
+	// Blocks until everything logged so far has reached the listeners.
+	void Flush();
+	u32 GetDroppedCount() const { return m_dropped; }
+
 	void SetLogLevel(LogTypes::LOG_TYPE type, LogTypes::LOG_LEVELS level)
 	{
 		m_Log[type]->SetLevel(level);
@@ -43,6 +43,26 @@ u32 Timer::GetTimeMs()
 #endif
 }
 
+u64 Timer::GetTimeNs()
+{
+#ifdef _WIN32
+	static u64 frequency = 0;
+	if (frequency == 0)
+		QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	u64 counter;
+	QueryPerformanceCounter((LARGE_INTEGER*)&counter);
+	return (u64)((double)counter * (1000000000.0 / (double)frequency));
+#elif defined(__APPLE__)
+	struct timeval t;
+	(void)gettimeofday(&t, NULL);
+	return (u64)t.tv_sec * 1000000000ULL + (u64)t.tv_usec * 1000ULL;
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (u64)t.tv_sec * 1000000000ULL + (u64)t.tv_nsec;
+#endif
+}
+
 // --------------------------------------------
 // Initiate, Start, Stop, and Update the time
 // --------------------------------------------
@@ -190,24 +210,33 @@ u64 Timer::GetLocalTimeSinceJan1970()
 // in the form 00:00:000.
 void Timer::GetTimeFormatted(char formattedTime[13])
 {
-	time_t sysTime;
+	GetTimeFormatted(formattedTime, GetTimeMsSinceJan1970());
+}
+
+void Timer::GetTimeFormatted(char formattedTime[13], u64 msSinceJan1970)
+{
+	time_t sysTime = (time_t)(msSinceJan1970 / 1000);
 	struct tm * gmTime;
 	char tmp[13];
 
-	time(&sysTime);
 	gmTime = localtime(&sysTime);
 
 	strftime(tmp, 6, "%M:%S", gmTime);
 
 	// Now tack on the milliseconds
+	sprintf(formattedTime, "%s:%03d", tmp, (int)(msSinceJan1970 % 1000));
+}
+
+u64 Timer::GetTimeMsSinceJan1970()
+{
 #ifdef _WIN32
 	struct timeb tp;
 	(void)::ftime(&tp);
-	sprintf(formattedTime, "%s:%03i", tmp, tp.millitm);
+	return (u64)tp.time * 1000 + tp.millitm;
 #else
 	struct timeval t;
 	(void)gettimeofday(&t, NULL);
-	sprintf(formattedTime, "%s:%03d", tmp, (int)(t.tv_usec / 1000));
+	return (u64)t.tv_sec * 1000 + t.tv_usec / 1000;
 #endif
 }
 
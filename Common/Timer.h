@@ -44,10 +44,15 @@ public:
 	static double GetDoubleTime();
 
   static void GetTimeFormatted(char formattedTime[13]);
+	// Same, for a timestamp taken earlier with GetTimeMsSinceJan1970().
+	static void GetTimeFormatted(char formattedTime[13], u64 msSinceJan1970);
+	static u64 GetTimeMsSinceJan1970();
 	std::string GetTimeElapsedFormatted() const;
 	u64 GetTimeElapsed();
 
 	static u32 GetTimeMs();
+	// Monotonic, for measuring short intervals.
+	static u64 GetTimeNs();
 
 private:
 	u64 m_LastTime;
@@ -49,8 +49,17 @@ void CConfig::Load(const char *iniFileName)
 	general->Get("IgnoreBadMemAccess", &bIgnoreBadMemAccess, true);
 	general->Get("CurrentDirectory", &currentDirectory, "");
 	general->Get("ShowDebuggerOnLoad", &bShowDebuggerOnLoad, false);
+	general->Get("CSOReadAhead", &bCSOReadAhead, true);
+	general->Get("UMDTimingModel", &bUMDTimingModel, false);
+	general->Get("ModuleCache", &bModuleCache, true);
+	general->Get("RewindFlipFrequency", &iRewindFlipFrequency, 0);
+	general->Get("RewindMemoryBudget", &iRewindMemoryBudget, 64);
+	general->Get("SpeedPercent", &iSpeedPercent, 100);
 	IniFile::Section *cpu = iniFile.GetOrCreateSection("CPU");
 	cpu->Get("Core", &iCpuCore, 0);
+	cpu->Get("FuncReplacements", &bFuncReplacements, true);
+	cpu->Get("FuncReplacementsDisabled", &sFuncReplacementsDisabled, "");
+	cpu->Get("FuncHashMap", &sFuncHashMap, "");
 
 	IniFile::Section *graphics = iniFile.GetOrCreateSection("Graphics");
 	graphics->Get("ShowFPSCounter", &bShowFPSCounter, false);
@@ -81,8 +90,17 @@ void CConfig::Save()
 		general->Set("IgnoreBadMemAccess", bIgnoreBadMemAccess);
 		general->Set("CurrentDirectory", currentDirectory);
 		general->Set("ShowDebuggerOnLoad", bShowDebuggerOnLoad);
+		general->Set("CSOReadAhead", bCSOReadAhead);
+		general->Set("UMDTimingModel", bUMDTimingModel);
+		general->Set("ModuleCache", bModuleCache);
+		general->Set("RewindFlipFrequency", iRewindFlipFrequency);
+		general->Set("RewindMemoryBudget", iRewindMemoryBudget);
+		general->Set("SpeedPercent", iSpeedPercent);
 		IniFile::Section *cpu = iniFile.GetOrCreateSection("CPU");
 		cpu->Set("Core", iCpuCore);
+		cpu->Set("FuncReplacements", bFuncReplacements);
+		cpu->Set("FuncReplacementsDisabled", sFuncReplacementsDisabled);
+		cpu->Set("FuncHashMap", sFuncHashMap);
 
 		IniFile::Section *graphics = iniFile.GetOrCreateSection("Graphics");
 		graphics->Set("ShowFPSCounter", bShowFPSCounter);
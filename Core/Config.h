@@ -43,6 +43,10 @@ public:
 	bool bIgnoreBadMemAccess;
 	bool bDisplayFramebuffer;
 	bool bBufferedRendering;
+	bool bCSOReadAhead;
+	bool bUMDTimingModel;
+	bool bModuleCache;
+	bool bFuncReplacements;  // native versions of memcpy etc, see ReplaceTables
 
 	bool bShowTouchControls;
 	bool bShowDebuggerOnLoad;
@@ -51,10 +55,15 @@ public:
 	bool bShowDebugStats;
 	int iWindowZoom;  // for Windows
 	int iCpuCore;
+	int iRewindFlipFrequency;  // frames between rewind snapshots, 0 to disable
+	int iRewindMemoryBudget;  // in MB, for the rewind deltas
+	int iSpeedPercent;  // 100 is real time, 0 runs unthrottled
 
 	std::string currentDirectory;
 	std::string memCardDirectory;
 	std::string flashDirectory;
+	std::string sFuncReplacementsDisabled;  // comma separated disc ids
+	std::string sFuncHashMap;  // optional, names functions in stripped games
 
 	void Load(const char *iniFileName = "ppsspp.ini");
 	void Save();
@@ -22,6 +22,7 @@
 #include "Core.h"
 #include "MemMap.h"
 #include "MIPS/MIPS.h"
+#include "SaveState.h"
 
 #include "Host.h"
 
@@ -95,6 +96,13 @@ reswitch:
 			Core_RunLoop();
 			break;
 
+		case CORE_NEXTFRAME:
+			// End of frame, nothing is mid-flight so this is where save states happen.
+			SaveState::Process();
+			if (coreState == CORE_NEXTFRAME)
+				coreState = CORE_RUNNING;
+			break;
+
 		// We should never get here on Android.
 		case CORE_STEPPING:
 			//1: wait for step command..
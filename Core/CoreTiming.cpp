@@ -21,6 +21,7 @@
 
 #include "MsgHandler.h"
 #include "StdMutex.h"
+#include "ChunkFile.h"
 #include "CoreTiming.h"
 #include "Core.h"
 #include "HLE/sceKernelThread.h"
@@ -50,12 +51,6 @@ struct BaseEvent
 //	Event *next;
 };
 
-template <class T>
-struct LinkedListItem : public T
-{
-	LinkedListItem<T> *next;
-};
-
 typedef LinkedListItem<BaseEvent> Event;
 
 Event *first;
@@ -506,6 +501,76 @@ void Idle(int maxIdle)
 	downcount -= cyclesDown;
 }
 
+void Event_DoState(PointerWrap &p, BaseEvent *ev)
+{
+	p.Do(*ev);
+}
+
+// Event type ids depend on registration order, which can differ between runs
+// (some modules register lazily). Remap them by name when loading.
+static void RemapEventTypes(PointerWrap &p, Event *ev, const std::vector<int> &remap)
+{
+	for (; ev; ev = ev->next)
+	{
+		if (ev->type < 0 || ev->type >= (int)remap.size() || remap[ev->type] < 0)
+		{
+			ERROR_LOG(CPU, "Savestate failure: unknown event type %d", ev->type);
+			p.SetError(PointerWrap::ERROR_FAILURE);
+			ev->type = 0;
+		}
+		else
+			ev->type = remap[ev->type];
+	}
+}
+
+void DoState(PointerWrap &p)
+{
+	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
+
+	if (p.mode != PointerWrap::MODE_READ)
+		MoveEvents();
+
+	int n = (int)event_types.size();
+	p.Do(n);
+	std::vector<int> remap(n, -1);
+	for (int i = 0; i < n; i++)
+	{
+		std::string name = i < (int)event_types.size() && event_types[i].name ? event_types[i].name : "";
+		p.Do(name);
+		if (p.mode == PointerWrap::MODE_READ)
+		{
+			for (int j = 0; j < (int)event_types.size(); j++)
+			{
+				if (event_types[j].name && name == event_types[j].name)
+				{
+					remap[i] = j;
+					break;
+				}
+			}
+			if (remap[i] < 0)
+				WARN_LOG(CPU, "Savestate: event type %s is not registered", name.c_str());
+		}
+	}
+
+	p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(first);
+	p.DoMarker("CoreTimingEvents");
+	p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoState>(tsFirst, &tsLast);
+	p.DoMarker("CoreTimingTsEvents");
+
+	if (p.mode == PointerWrap::MODE_READ)
+	{
+		RemapEventTypes(p, first, remap);
+		RemapEventTypes(p, tsFirst, remap);
+	}
+
+	p.Do(CPU_HZ);
+	p.Do(slicelength);
+	p.Do(globalTimer);
+	p.Do(idledCycles);
+	p.Do(downcount);
+	p.DoMarker("CoreTiming");
+}
+
 std::string GetScheduledEventsSummary()
 {
 	Event *ptr = first;
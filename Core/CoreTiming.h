@@ -35,6 +35,8 @@
 
 #include <string>
 
+class PointerWrap;
+
 //const int CPU_HZ = 222000000;
 extern int CPU_HZ;
 
@@ -103,6 +105,8 @@ namespace CoreTiming
 
 	std::string GetScheduledEventsSummary();
 
+	void DoState(PointerWrap &p);
+
 	void SetClockFrequencyMHz(int cpuMhz);
 	int GetClockFrequencyMHz();
 	extern int downcount;
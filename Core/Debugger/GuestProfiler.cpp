@@ -0,0 +1,283 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "../CoreTiming.h"
+#include "../MemMap.h"
+#include "../MIPS/MIPS.h"
+#include "../MIPS/JitCommon/JitCommon.h"
+#include "SymbolMap.h"
+#include "GuestProfiler.h"
+
+namespace GuestProfiler
+{
+
+enum
+{
+	MAX_STACK_DEPTH = 32,
+	// Prologues are short, don't scan whole functions for them.
+	MAX_PROLOGUE_SCAN = 64 * 4,
+};
+
+// Outermost function first. Entries are function start addresses, or the raw
+// address when no function is known.
+typedef std::vector<u32> Stack;
+
+static bool running = false;
+static bool countingBlocks = false;
+static std::map<Stack, u64> stackCycles;
+static std::map<u32, u64> blockInstructions;
+static u64 totalCycles = 0;
+static u32 numSamples = 0;
+
+static u32 FunctionStart(u32 address)
+{
+	int num = symbolMap.GetSymbolNum(address, ST_FUNCTION);
+	return num == -1 ? address : symbolMap.GetSymbolAddr(num);
+}
+
+static std::string FunctionName(u32 address)
+{
+	int num = symbolMap.GetSymbolNum(address, ST_FUNCTION);
+	if (num != -1 && symbolMap.GetSymbolAddr(num) == address)
+		return symbolMap.GetSymbolName(num);
+
+	char temp[16];
+	sprintf(temp, "%08x", address);
+	return temp;
+}
+
+// There are no frame pointers, so this follows each function's prologue instead:
+// addiu sp, sp, -size and sw ra, offset(sp). Anything else ends the walk.
+static void WalkStack(Stack &stack)
+{
+	u32 pc = currentMIPS->pc;
+	u32 sp = currentMIPS->r[MIPS_REG_SP];
+	bool top = true;
+
+	while (stack.size() < MAX_STACK_DEPTH)
+	{
+		int num = symbolMap.GetSymbolNum(pc, ST_FUNCTION);
+		if (num == -1)
+		{
+			stack.push_back(pc);
+			break;
+		}
+		u32 start = symbolMap.GetSymbolAddr(num);
+		stack.push_back(start);
+
+		u32 frameSize = 0;
+		bool savedRa = false;
+		s16 raOffset = 0;
+		for (u32 addr = start; addr < pc && addr < start + MAX_PROLOGUE_SCAN; addr += 4)
+		{
+			u32 op = Memory::Read_Instruction(addr);
+			if ((op & 0xFFFF0000) == 0x27BD0000 && (s16)(op & 0xFFFF) < 0)
+				frameSize = -(s16)(op & 0xFFFF);
+			else if ((op & 0xFFFF0000) == 0xAFBF0000)
+			{
+				savedRa = true;
+				raOffset = (s16)(op & 0xFFFF);
+			}
+		}
+
+		u32 ra;
+		if (savedRa && Memory::IsValidAddress(sp + raOffset))
+			ra = Memory::Read_U32(sp + raOffset);
+		else if (top && !savedRa)
+			ra = currentMIPS->r[MIPS_REG_RA];
+		else
+			break;
+
+		// ra points past the jal's delay slot.
+		if (ra < 8 || !Memory::IsValidAddress(ra - 8))
+			break;
+		pc = ra - 8;
+		sp += frameSize;
+		top = false;
+	}
+
+	std::reverse(stack.begin(), stack.end());
+}
+
+static void Sample(int cyclesExecuted)
+{
+	if (cyclesExecuted <= 0)
+		return;
+
+	Stack stack;
+	WalkStack(stack);
+	stackCycles[stack] += cyclesExecuted;
+	totalCycles += cyclesExecuted;
+	numSamples++;
+}
+
+void Start(bool countJitBlocks)
+{
+	running = true;
+	countingBlocks = countJitBlocks;
+	// Blocks compiled earlier have no counter.
+	if (countingBlocks && MIPSComp::jit)
+		MIPSComp::jit->ClearCache();
+	CoreTiming::RegisterAdvanceCallback(&Sample);
+}
+
+void Stop()
+{
+	if (!running)
+		return;
+	CoreTiming::RegisterAdvanceCallback(NULL);
+
+	if (countingBlocks && MIPSComp::jit)
+	{
+		JitBlockCache *blocks = MIPSComp::jit->GetBlockCache();
+		for (int i = 0; i < blocks->GetNumBlocks(); i++)
+		{
+			JitBlock *b = blocks->GetBlock(i);
+			AddBlockRuns(b->originalAddress, b->originalSize, b->runCount);
+			b->runCount = 0;
+		}
+	}
+
+	running = false;
+	countingBlocks = false;
+}
+
+bool IsRunning()
+{
+	return running;
+}
+
+bool IsCountingBlocks()
+{
+	return countingBlocks;
+}
+
+void Reset()
+{
+	stackCycles.clear();
+	blockInstructions.clear();
+	totalCycles = 0;
+	numSamples = 0;
+}
+
+void AddBlockRuns(u32 address, u32 numInstructions, int runCount)
+{
+	if (runCount > 0)
+		blockInstructions[FunctionStart(address)] += (u64)numInstructions * runCount;
+}
+
+struct FlatEntry
+{
+	u32 address;
+	u64 selfCycles;
+	u64 totalCycles;
+	u64 instructions;
+};
+
+static bool FlatEntryCompare(const FlatEntry &a, const FlatEntry &b)
+{
+	if (a.selfCycles != b.selfCycles)
+		return a.selfCycles > b.selfCycles;
+	return a.instructions > b.instructions;
+}
+
+bool WriteFlatProfile(const std::string &filename)
+{
+	std::map<u32, FlatEntry> functions;
+	for (std::map<Stack, u64>::iterator it = stackCycles.begin(); it != stackCycles.end(); ++it)
+	{
+		const Stack &stack = it->first;
+		// Recursion shouldn't count a function twice.
+		std::set<u32> seen;
+		for (size_t i = 0; i < stack.size(); i++)
+		{
+			FlatEntry &entry = functions[stack[i]];
+			entry.address = stack[i];
+			if (seen.insert(stack[i]).second)
+				entry.totalCycles += it->second;
+			if (i == stack.size() - 1)
+				entry.selfCycles += it->second;
+		}
+	}
+	for (std::map<u32, u64>::iterator it = blockInstructions.begin(); it != blockInstructions.end(); ++it)
+	{
+		FlatEntry &entry = functions[it->first];
+		entry.address = it->first;
+		entry.instructions = it->second;
+	}
+
+	std::vector<FlatEntry> entries;
+	for (std::map<u32, FlatEntry>::iterator it = functions.begin(); it != functions.end(); ++it)
+		entries.push_back(it->second);
+	std::sort(entries.begin(), entries.end(), FlatEntryCompare);
+
+	FILE *f = fopen(filename.c_str(), "w");
+	if (!f)
+	{
+		ERROR_LOG(CPU, "Unable to write guest profile to %s", filename.c_str());
+		return false;
+	}
+
+	fprintf(f, "# %llu guest cycles in %u samples\n", (unsigned long long)totalCycles, numSamples);
+	fprintf(f, "#  self%%        self   total%%       total  jit instrs  function\n");
+	double scale = totalCycles ? 100.0 / (double)totalCycles : 0.0;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const FlatEntry &e = entries[i];
+		fprintf(f, "%7.2f %11llu %7.2f %11llu %11llu  %s\n",
+			e.selfCycles * scale, (unsigned long long)e.selfCycles,
+			e.totalCycles * scale, (unsigned long long)e.totalCycles,
+			(unsigned long long)e.instructions, FunctionName(e.address).c_str());
+	}
+
+	fclose(f);
+	return true;
+}
+
+bool WriteCollapsedStacks(const std::string &filename)
+{
+	FILE *f = fopen(filename.c_str(), "w");
+	if (!f)
+	{
+		ERROR_LOG(CPU, "Unable to write guest stacks to %s", filename.c_str());
+		return false;
+	}
+
+	for (std::map<Stack, u64>::iterator it = stackCycles.begin(); it != stackCycles.end(); ++it)
+	{
+		const Stack &stack = it->first;
+		std::string line;
+		for (size_t i = 0; i < stack.size(); i++)
+		{
+			if (i != 0)
+				line += ';';
+			line += FunctionName(stack[i]);
+		}
+		fprintf(f, "%s %llu\n", line.c_str(), (unsigned long long)it->second);
+	}
+
+	fclose(f);
+	return true;
+}
+
+}	// namespace GuestProfiler
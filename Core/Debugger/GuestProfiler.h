@@ -0,0 +1,45 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+
+#include "../../Globals.h"
+
+// Samples where the game spends guest time. At the end of every CoreTiming slice
+// the current pc and a walked call stack get the slice's cycles. With the jit,
+// block entries can also be counted, which gives exact instruction counts.
+// Functions come from the symbol map, so either symbols or MIPSAnalyst's scan.
+namespace GuestProfiler
+{
+	// Call after PSP_Init, CoreTiming owns the hook.
+	void Start(bool countJitBlocks);
+	// Collects the jit block counts, safe to call more than once.
+	void Stop();
+	bool IsRunning();
+	bool IsCountingBlocks();
+	void Reset();
+
+	// The jit cache calls this before throwing blocks away.
+	void AddBlockRuns(u32 address, u32 numInstructions, int runCount);
+
+	// Self and total cycles per function, plus jit instruction counts if enabled.
+	bool WriteFlatProfile(const std::string &filename);
+	// One "outer;inner cycles" line per stack, as flamegraph.pl and similar tools expect.
+	bool WriteCollapsedStacks(const std::string &filename);
+};
@@ -27,15 +27,73 @@ const char *ElfReader::GetSectionName(int section)
 	if (sections[section].sh_type == SHT_NULL)
 		return 0;
 
-	int nameOffset = sections[section].sh_name;
+	u32 nameOffset = sections[section].sh_name;
+	u32 tableSize = sections[header->e_shstrndx].sh_size;
 	char *ptr = (char*)GetSectionDataPtr(header->e_shstrndx);
 
-	if (ptr)
+	// The name has to end inside the string table.
+	if (ptr && nameOffset < tableSize && memchr(ptr + nameOffset, 0, tableSize - nameOffset))
 		return ptr + nameOffset;
 	else
 		return 0;
 }
 
+// Everything LoadInto and LoadSymbols read through a file offset has to be inside the file.
+bool ElfReader::ValidateHeaders()
+{
+	if (!InFile(0, sizeof(Elf32_Ehdr)))
+	{
+		ERROR_LOG(LOADER, "ELF too small for its header: %i bytes", (int)size);
+		return false;
+	}
+
+	// The loader keeps segment addresses in a fixed array.
+	if (header->e_phnum > 32)
+	{
+		ERROR_LOG(LOADER, "ELF has too many segments: %i", (int)header->e_phnum);
+		return false;
+	}
+	if (!InFile(header->e_phoff, header->e_phnum * sizeof(Elf32_Phdr)) || !InFile(header->e_shoff, header->e_shnum * sizeof(Elf32_Shdr)))
+	{
+		ERROR_LOG(LOADER, "ELF segment or section table outside the file");
+		return false;
+	}
+	segments = (Elf32_Phdr *)(base + header->e_phoff);
+	sections = (Elf32_Shdr *)(base + header->e_shoff);
+
+	if (header->e_shnum != 0 && header->e_shstrndx >= header->e_shnum)
+	{
+		ERROR_LOG(LOADER, "ELF string section %i out of range", (int)header->e_shstrndx);
+		return false;
+	}
+
+	for (int i = 0; i < header->e_phnum; i++)
+	{
+		const Elf32_Phdr *p = &segments[i];
+		if (p->p_type == PT_LOAD && (!InFile(p->p_offset, p->p_filesz) || p->p_filesz > p->p_memsz))
+		{
+			ERROR_LOG(LOADER, "ELF segment %i outside the file: offset %08x, size %08x", i, (u32)p->p_offset, (u32)p->p_filesz);
+			return false;
+		}
+	}
+
+	for (int i = 0; i < header->e_shnum; i++)
+	{
+		const Elf32_Shdr *s = &sections[i];
+		if (s->sh_type != SHT_NOBITS && !InFile(s->sh_offset, s->sh_size))
+		{
+			ERROR_LOG(LOADER, "ELF section %i outside the file: offset %08x, size %08x", i, (u32)s->sh_offset, (u32)s->sh_size);
+			return false;
+		}
+		if ((s->sh_type == SHT_PSPREL || s->sh_type == SHT_REL) && (s->sh_info >= header->e_shnum || s->sh_link >= header->e_shnum))
+		{
+			ERROR_LOG(LOADER, "ELF relocation section %i refers to a missing section", i);
+			return false;
+		}
+	}
+	return true;
+}
+
 
 
 void addrToHiLo(u32 addr, u16 &hi, s16 &lo)
@@ -70,6 +128,9 @@ bool ElfReader::LoadInto(u32 loadAddress)
 		ptr++;
 	}*/
 
+	if (!ValidateHeaders())
+		return false;
+
 	sectionOffsets = new u32[GetNumSections()];
 	sectionAddrs = new u32[GetNumSections()];
 
@@ -109,7 +170,7 @@ bool ElfReader::LoadInto(u32 loadAddress)
 	DEBUG_LOG(LOADER,"%i segments:", header->e_phnum);
 
 	// First pass : Get the damn bits into RAM
-	u32 segmentVAddr[32];
+	u32 segmentVAddr[32] = {0};
 
 	u32 baseAddress = bRelocate?vaddr:0;
 	for (int i=0; i<header->e_phnum; i++)
@@ -127,6 +188,12 @@ bool ElfReader::LoadInto(u32 loadAddress)
 			u32 srcSize = p->p_filesz;
 			u32 dstSize = p->p_memsz;
 
+			if (dstSize != 0 && (!Memory::IsValidAddress(writeAddr) || !Memory::IsValidAddress(writeAddr + dstSize - 1) || writeAddr + dstSize < writeAddr))
+			{
+				ERROR_LOG(LOADER, "Segment %i doesn't fit in memory: %08x, size %08x", i, writeAddr, dstSize);
+				return false;
+			}
+
 			if (srcSize < dstSize)
 			{
 				memset(dst + srcSize, 0, dstSize - srcSize); //zero out bss
@@ -185,6 +252,16 @@ bool ElfReader::LoadInto(u32 loadAddress)
 
 			DEBUG_LOG(LOADER,"%s: Performing %i relocations on %s",name,numRelocs,GetSectionName(sectionToModify));
 
+			// HI relocs need the LO that follows them, so they wait here until it shows up.
+			// This keeps the whole table a single pass instead of a forward scan per HI.
+			struct PendingHI
+			{
+				u32 addr;
+				u32 op;
+				u32 relocateTo;
+			};
+			std::vector<PendingHI> pendingHI;
+
 			for (int r = 0; r < numRelocs; r++)
 			{
 				u32 info = rels[r].r_info;
@@ -198,7 +275,17 @@ bool ElfReader::LoadInto(u32 loadAddress)
 				//0 = code
 				//1 = data
 				
+				if (readwrite >= header->e_phnum || relative >= header->e_phnum)
+				{
+					ERROR_LOG(LOADER, "Relocation %i refers to a missing segment", r);
+					continue;
+				}
 				addr += segmentVAddr[readwrite];
+				if (!Memory::IsValidAddress(addr))
+				{
+					ERROR_LOG(LOADER, "Relocation %i outside memory: %08x", r, addr);
+					continue;
+				}
 				
 				u32 op = Memory::ReadUnchecked_U32(addr);
 
@@ -236,38 +323,29 @@ bool ElfReader::LoadInto(u32 loadAddress)
 						if (log)
 							DEBUG_LOG(LOADER,"HI reloc %08x", addr);
 
-						u32 cur = (op & 0xFFFF) << 16;
-						u16 hi = 0;
-						bool found = false;
-						for (int t = r + 1; t<numRelocs; t++)
-						{
-							if ((rels[t].r_info & 0xF) == R_MIPS16_LO) 
-							{
-								u32 corrLoAddr = rels[t].r_offset + segmentVAddr[readwrite];
-								if (log)
-								{
-									DEBUG_LOG(LOADER,"Corresponding lo found at %08x", corrLoAddr);
-								}
-
-								s16 lo = (s32)(s16)(u16)(Memory::ReadUnchecked_U32(corrLoAddr) & 0xFFFF); //signed??
-								cur += lo;
-								cur += relocateTo;
-								addrToHiLo(cur, hi, lo);
-								found = true;
-								break;
-							}
-						}
-						if (!found)
-							ERROR_LOG(LOADER, "R_MIPS16: not found");
-
-						op = (op & 0xFFFF0000) | (hi);
+						PendingHI pending = {addr, op, relocateTo};
+						pendingHI.push_back(pending);
 					}
-					break;
+					// Written once its LO is found.
+					continue;
 
 				case R_MIPS16_LO: //addiu part of lui-addiu pairs
 					{
 						if (log)
 							DEBUG_LOG(LOADER,"LO reloc %08x", addr);
+
+						// Resolve the HIs waiting for this LO, using its unrelocated immediate.
+						s16 lo = (s32)(s16)(u16)(op & 0xFFFF); //signed??
+						for (size_t h = 0; h < pendingHI.size(); h++)
+						{
+							u32 hiCur = ((pendingHI[h].op & 0xFFFF) << 16) + lo + pendingHI[h].relocateTo;
+							u16 hi;
+							s16 hiLo;
+							addrToHiLo(hiCur, hi, hiLo);
+							Memory::Write_U32((pendingHI[h].op & 0xFFFF0000) | hi, pendingHI[h].addr);
+						}
+						pendingHI.clear();
+
 						u32 cur = op & 0xFFFF;
 						cur += relocateTo;
 						cur &= 0xFFFF;
@@ -294,6 +372,13 @@ bool ElfReader::LoadInto(u32 loadAddress)
 				}
 				Memory::Write_U32(op, addr);
 			}
+
+			if (!pendingHI.empty())
+			{
+				ERROR_LOG(LOADER, "R_MIPS16: not found");
+				for (size_t h = 0; h < pendingHI.size(); h++)
+					Memory::Write_U32(pendingHI[h].op & 0xFFFF0000, pendingHI[h].addr);
+			}
 		}
 		else if (s->sh_type == SHT_REL)
 		{
@@ -343,11 +428,18 @@ bool ElfReader::LoadSymbols()
 	if (sec != -1)
 	{
 		int stringSection = sections[sec].sh_link;
+		if (stringSection >= GetNumSections())
+			return false;
 
 		const char *stringBase = (const char*)GetSectionDataPtr(stringSection);
+		u32 stringSize = sections[stringSection].sh_size;
+		if (!stringBase)
+			return false;
 
 		//We have a symbol table!
 		Elf32_Sym *symtab = (Elf32_Sym *)(GetSectionDataPtr(sec));
+		if (!symtab)
+			return false;
 
 		int numSymbols = sections[sec].sh_size / sizeof(Elf32_Sym);
 		
@@ -361,10 +453,17 @@ bool ElfReader::LoadSymbols()
 			int type = symtab[sym].st_info & 0xF;
 			int sectionIndex = symtab[sym].st_shndx;
 			int value = symtab[sym].st_value;
-			const char *name = stringBase + symtab[sym].st_name;
+			u32 nameOffset = symtab[sym].st_name;
+			if (nameOffset >= stringSize || !memchr(stringBase + nameOffset, 0, stringSize - nameOffset))
+				continue;
+			const char *name = stringBase + nameOffset;
 
 			if (bRelocate)
+			{
+				if (sectionIndex >= GetNumSections())
+					continue;
 				value += sectionAddrs[sectionIndex];
+			}
 			SymbolType symtype = ST_DATA;
 
 			switch (type)
@@ -34,6 +34,7 @@ class ElfReader
 {
 	char *base;
 	u32 *base32;
+	size_t size;
 	Elf32_Ehdr *header;
 	Elf32_Phdr *segments;
 	Elf32_Shdr *sections;
@@ -43,19 +44,24 @@ class ElfReader
 	u32 entryPoint;
 	u32 vaddr;
 public:
-	ElfReader(void *ptr)
+	// The headers aren't looked at until LoadInto, which checks them against size first.
+	ElfReader(void *ptr, size_t size_)
 	{
 		INFO_LOG(LOADER, "ElfReader: %p", ptr);
 		base = (char*)ptr;
 		base32 = (u32 *)ptr;
+		size = size_;
 		header = (Elf32_Ehdr*)ptr;
-		segments = (Elf32_Phdr *)(base + header->e_phoff);
-		sections = (Elf32_Shdr *)(base + header->e_shoff);
+		segments = 0;
+		sections = 0;
+		sectionOffsets = 0;
+		sectionAddrs = 0;
 	}
 
 	~ElfReader()
 	{
-
+		delete [] sectionOffsets;
+		delete [] sectionAddrs;
 	}
 
 	u32 Read32(int off)
@@ -117,4 +123,11 @@ public:
 	// More indepth stuff:)
 	bool LoadInto(u32 vaddr);
 	bool LoadSymbols();
+
+private:
+	bool InFile(u32 offset, u32 length)
+	{
+		return offset <= size && length <= size - offset;
+	}
+	bool ValidateHeaders();
 };
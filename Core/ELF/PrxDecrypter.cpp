@@ -3,9 +3,14 @@
 extern "C"
 {
 #include "ext/libkirk/kirk_engine.h"
+#include "ext/libkirk/AES.h"
+#include "ext/libkirk/SHA1.h"
 }
 
 #include "../../Globals.h"
+#ifndef ARM
+#include "Common/CPUDetect.h"
+#endif
 
 // Thank you PSARDUMPER & JPCSP keys
 
@@ -724,6 +729,10 @@ static int DecryptPRX2(const u8 *inbuf, u8 *outbuf, u32 size, u32 tag)
 
 int pspDecryptPRX(const u8 *inbuf, u8 *outbuf, u32 size)
 {
+#ifndef ARM
+	AES_set_hw_accel(cpu_info.bAES);
+	SHA_set_hw_accel(cpu_info.bSHA);
+#endif
 	kirk_init();
 	int retsize = DecryptPRX1(inbuf, outbuf, size, *(u32 *)&inbuf[0xD0]);
 
@@ -15,36 +15,177 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
-extern "C"
-{
-#include "zlib.h"
-};
-
 #include "BlockDevices.h"
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+// 1MB of decompressed blocks.
+const int CSO_CACHE_BLOCKS = 512;
+// How far ahead to decompress once reads look sequential, and how much to do per lock.
+const int CSO_READ_AHEAD_BLOCKS = 64;
+const int CSO_READ_AHEAD_CHUNK = 8;
 
 FileBlockDevice::FileBlockDevice(std::string _filename)
-: filename(_filename)
+: filename(_filename), filesize(0)
 {
-	f = fopen(_filename.c_str(), "rb");
-	fseek(f,0,SEEK_END);
-	filesize = ftell(f);
-	fseek(f,0,SEEK_SET);
+#ifdef _WIN32
+	hFile = CreateFileA(_filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (hFile != INVALID_HANDLE_VALUE && GetFileSizeEx(hFile, &size))
+		filesize = (size_t)size.QuadPart;
+#else
+	fd = open(_filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd != -1 && fstat(fd, &st) == 0)
+		filesize = (size_t)st.st_size;
+#endif
 }
 
 FileBlockDevice::~FileBlockDevice()
 {
-	fclose(f);
+#ifdef _WIN32
+	if (hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);
+#else
+	if (fd != -1)
+		close(fd);
+#endif
+}
+
+// Positional read, so concurrent readers never fight over a shared file offset.
+bool FileBlockDevice::ReadAt(u64 offset, size_t size, u8 *outPtr)
+{
+	while (size > 0)
+	{
+#ifdef _WIN32
+		OVERLAPPED ov = {0};
+		ov.Offset = (DWORD)offset;
+		ov.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		DWORD bytesRead = 0;
+		if (!::ReadFile(hFile, outPtr, chunk, &bytesRead, &ov) || bytesRead == 0)
+			return false;
+#else
+		ssize_t bytesRead = pread(fd, outPtr, size, (off_t)offset);
+		if (bytesRead < 0 && errno == EINTR)
+			continue;
+		if (bytesRead <= 0)
+			return false;
+#endif
+		offset += bytesRead;
+		outPtr += bytesRead;
+		size -= bytesRead;
+	}
+	return true;
 }
 
 bool FileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
 {
-	fseek(f, blockNumber * GetBlockSize(), SEEK_SET);
-	fread(outPtr, 2048, 1, f);
+	return ReadAt((u64)blockNumber * GetBlockSize(), GetBlockSize(), outPtr);
+}
+
+bool FileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+	return ReadAt((u64)minBlock * GetBlockSize(), (size_t)count * GetBlockSize(), outPtr);
+}
+
+MmapFileBlockDevice::MmapFileBlockDevice(std::string _filename)
+: filename(_filename), data(0), filesize(0)
+{
+#ifdef _WIN32
+	hMapping = NULL;
+	hFile = CreateFileA(_filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	LARGE_INTEGER size;
+	if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+		return;
+	filesize = (size_t)size.QuadPart;
+	hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMapping == NULL)
+		return;
+	data = (const u8 *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	fd = open(_filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) != 0 || st.st_size == 0)
+		return;
+	filesize = (size_t)st.st_size;
+	void *ptr = mmap(0, filesize, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		return;
+	data = (const u8 *)ptr;
+	// Directory walks and file loads jump around; explicit prefetch hints cover the streaming cases.
+	madvise(ptr, filesize, MADV_RANDOM);
+#endif
+
+	if (data == 0)
+		ERROR_LOG(LOADER, "Failed to map %s, falling back to reading", _filename.c_str());
+}
+
+MmapFileBlockDevice::~MmapFileBlockDevice()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (hMapping != NULL)
+		CloseHandle(hMapping);
+	if (hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);
+#else
+	if (data)
+		munmap((void *)data, filesize);
+	if (fd != -1)
+		close(fd);
+#endif
+}
+
+bool MmapFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
+{
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
+
+bool MmapFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+	u64 offset = (u64)minBlock * GetBlockSize();
+	size_t size = (size_t)count * GetBlockSize();
+	if (!data || offset + size > filesize)
+	{
+		ERROR_LOG(LOADER, "Reading blocks %08x-%08x past the end of %s", minBlock, minBlock + count - 1, filename.c_str());
+		return false;
+	}
+	memcpy(outPtr, data + offset, size);
 	return true;
 }
 
+void MmapFileBlockDevice::PrefetchBlocks(u32 minBlock, int count)
+{
+#ifndef _WIN32
+	u64 offset = (u64)minBlock * GetBlockSize();
+	if (!data || count <= 0 || offset >= filesize)
+		return;
+	size_t size = std::min((size_t)count * GetBlockSize(), (size_t)(filesize - offset));
+
+	// madvise wants a page aligned start.
+	size_t pageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+	size_t misalign = (size_t)offset & pageMask;
+	madvise((void *)(data + offset - misalign), size + misalign, MADV_WILLNEED);
+#endif
+}
+
 // .CSO format
 
 // complessed ISO(9660) header format
@@ -71,10 +212,59 @@ typedef struct ciso_header
 } CISO_H;
 
 
+BlockCache::BlockCache(int numSlots)
+: storage(numSlots * 2048), slots(numSlots)
+{
+	Clear();
+}
+
+void BlockCache::Clear()
+{
+	blockToSlot.clear();
+	lru.clear();
+	for (int i = 0; i < (int)slots.size(); i++)
+	{
+		slots[i].blockNumber = -1;
+		slots[i].lruPos = lru.insert(lru.end(), i);
+	}
+}
+
+const u8 *BlockCache::Lookup(int blockNumber)
+{
+	std::map<int, int>::iterator iter = blockToSlot.find(blockNumber);
+	if (iter == blockToSlot.end())
+		return 0;
+
+	Slot &slot = slots[iter->second];
+	lru.splice(lru.begin(), lru, slot.lruPos);
+	return &storage[iter->second * 2048];
+}
+
+void BlockCache::Insert(int blockNumber, const u8 *data)
+{
+	int slotIndex;
+	std::map<int, int>::iterator iter = blockToSlot.find(blockNumber);
+	if (iter != blockToSlot.end())
+		slotIndex = iter->second;
+	else
+	{
+		// Evict the least recently used.
+		slotIndex = lru.back();
+		if (slots[slotIndex].blockNumber != -1)
+			blockToSlot.erase(slots[slotIndex].blockNumber);
+		slots[slotIndex].blockNumber = blockNumber;
+		blockToSlot[blockNumber] = slotIndex;
+	}
+
+	lru.splice(lru.begin(), lru, slots[slotIndex].lruPos);
+	memcpy(&storage[slotIndex * 2048], data, 2048);
+}
+
 // TODO: Need much better error handling.
 
-CISOFileBlockDevice::CISOFileBlockDevice(std::string _filename)
-: filename(_filename)
+CISOFileBlockDevice::CISOFileBlockDevice(std::string _filename, bool useReadAhead)
+: filename(_filename), cache(CSO_CACHE_BLOCKS), nextSequentialBlock(0), readAheadThread(0),
+  readAheadStart(0), readAheadCount(0), readAheadExit(false)
 {
 	// CISO format is EXTREMELY crappy and incomplete. All tools make broken CISO.
 
@@ -110,66 +300,194 @@ CISOFileBlockDevice::CISOFileBlockDevice(std::string _filename)
 
 	index = new u32[indexSize];
 	fread(index, 4, indexSize, f);
+
+	// One inflate state for the life of the device, reset per block.
+	memset(&z, 0, sizeof(z));
+	zInitialized = inflateInit2(&z, -15) == Z_OK;
+	if (!zInitialized)
+		ERROR_LOG(LOADER, "inflateInit2 failed: %s", z.msg ? z.msg : "???");
+
+	if (useReadAhead)
+		readAheadThread = new std::thread(&CISOFileBlockDevice::ReadAheadThreadFunc, this);
 }
 
 CISOFileBlockDevice::~CISOFileBlockDevice()
 {
+	if (readAheadThread)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			readAheadExit = true;
+			readAheadCond.notify_one();
+		}
+		readAheadThread->join();
+		delete readAheadThread;
+	}
+
+	if (zInitialized)
+		inflateEnd(&z);
 	fclose(f);
 	delete [] index;
 }
 
-bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
+bool CISOFileBlockDevice::InflateBlock(const u8 *in, u32 inSize, u8 *outPtr, int blockNumber)
 {
-	u32 idx = index[blockNumber];
-	u32 idx2 = index[blockNumber+1];
-  u8 inbuffer[4096]; //too big
-  z_stream z;
-	
-	int plain = idx & 0x80000000;
-	
-	idx = (idx & 0x7FFFFFFF) << indexShift;
-	idx2 = (idx2 & 0x7FFFFFFF) << indexShift;
+	if (!zInitialized || inflateReset(&z) != Z_OK)
+	{
+		ERROR_LOG(LOADER, "block %d: inflate state unavailable", blockNumber);
+		return false;
+	}
 
-	u32 compressedReadPos = idx;
-	u32 compressedReadSize = idx2 - idx;
+	z.next_in = (Bytef *)in;
+	z.avail_in = inSize;
+	z.next_out = outPtr;
+	z.avail_out = blockSize;
 
-	fseek(f, compressedReadPos, SEEK_SET);
-	fread(inbuffer, compressedReadSize, 1, f);
+	int status = inflate(&z, Z_FINISH);
+	if (status != Z_STREAM_END)
+	{
+		ERROR_LOG(LOADER, "block %d:inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
+		return false;
+	}
+	if (z.avail_out != 0)
+	{
+		ERROR_LOG(LOADER, "block %d : block size error %d != %d\n", blockNumber, (int)(blockSize - z.avail_out), blockSize);
+		return false;
+	}
+	return true;
+}
 
-	if (plain)
+// Reads the compressed data for the whole range in one go, then inflates each block.
+// lock must be held.
+bool CISOFileBlockDevice::ReadUncachedBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	u32 firstPos = (index[minBlock] & 0x7FFFFFFF) << indexShift;
+	u32 lastPos = (index[minBlock + count] & 0x7FFFFFFF) << indexShift;
+	if (lastPos < firstPos)
 	{
-		memset(outPtr, 0, 2048);
-		memcpy(outPtr, inbuffer, compressedReadSize);
+		ERROR_LOG(LOADER, "block %d: bad CSO index", minBlock);
+		return false;
 	}
-	else
+
+	u32 readSize = lastPos - firstPos;
+	readBuffer.resize(std::max(readSize, 1U));
+	fseek(f, firstPos, SEEK_SET);
+	if (fread(&readBuffer[0], 1, readSize, f) != readSize)
+	{
+		ERROR_LOG(LOADER, "block %d: short read of %d bytes", minBlock, readSize);
+		return false;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		u32 block = minBlock + i;
+		u32 idx = index[block];
+		u32 pos = (idx & 0x7FFFFFFF) << indexShift;
+		u32 nextPos = (index[block + 1] & 0x7FFFFFFF) << indexShift;
+		const u8 *in = &readBuffer[pos - firstPos];
+		u8 *out = outPtr + i * blockSize;
+
+		if (idx & 0x80000000)
+		{
+			memset(out, 0, blockSize);
+			memcpy(out, in, std::min(nextPos - pos, blockSize));
+		}
+		else if (!InflateBlock(in, nextPos - pos, out, block))
+		{
+			memset(out, 0, blockSize);
+			return false;
+		}
+		cache.Insert(block, out);
+	}
+	return true;
+}
+
+bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
+{
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
+
+bool CISOFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+	if (minBlock + count > (u32)numBlocks)
 	{
-		memset(outPtr, 0, 2048);
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		if(inflateInit2(&z, -15) != Z_OK)
+		ERROR_LOG(LOADER, "CSO read of blocks %d-%d is past the end (%d)", minBlock, minBlock + count - 1, numBlocks);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	bool result = true;
+	int i = 0;
+	while (i < count)
+	{
+		const u8 *cached = cache.Lookup(minBlock + i);
+		if (cached)
 		{
-			ERROR_LOG(LOADER, "deflateInit ERROR : %s\n", (z.msg) ? z.msg : "???");
-			return 1;
+			memcpy(outPtr + i * blockSize, cached, blockSize);
+			i++;
+			continue;
 		}
-		z.avail_in = compressedReadSize;
-		z.next_out = outPtr;
-		z.avail_out = blockSize;
-		z.next_in = inbuffer;
-
-		int status = inflate(&z, Z_FULL_FLUSH);
-		if(status != Z_STREAM_END)
-			//if (status != Z_OK)
+
+		// Gather the run of misses so it becomes a single file read.
+		int run = 1;
+		while (i + run < count && !cache.Lookup(minBlock + i + run))
+			run++;
+		if (!ReadUncachedBlocks(minBlock + i, run, outPtr + i * blockSize))
+			result = false;
+		i += run;
+	}
+
+	if (readAheadThread && minBlock == nextSequentialBlock)
+	{
+		readAheadStart = minBlock + count;
+		readAheadCount = std::min(CSO_READ_AHEAD_BLOCKS, numBlocks - (int)readAheadStart);
+		readAheadCond.notify_one();
+	}
+	nextSequentialBlock = minBlock + count;
+	return result;
+}
+
+void CISOFileBlockDevice::ReadAheadThreadFunc(CISOFileBlockDevice *device)
+{
+	Common::SetCurrentThreadName("CSOReadAhead");
+	device->ReadAhead();
+}
+
+void CISOFileBlockDevice::ReadAhead()
+{
+	u8 temp[CSO_READ_AHEAD_CHUNK * 2048];
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (!readAheadExit)
+	{
+		if (readAheadCount <= 0)
 		{
-			ERROR_LOG(LOADER, "block %d:inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
-			return 1;
+			readAheadCond.wait(guard);
+			continue;
 		}
-		int cmp_size = blockSize - z.avail_out;
-		if (cmp_size != (int)blockSize)
+
+		// Decompress a chunk at a time, skipping anything already cached.
+		u32 start = readAheadStart;
+		while (readAheadCount > 0 && cache.Lookup(start))
 		{
-			ERROR_LOG(LOADER, "block %d : block size error %d != %d\n", blockNumber, cmp_size, blockSize);
-			return 1;
+			start++;
+			readAheadCount--;
 		}
+		int chunk = 0;
+		while (chunk < std::min(readAheadCount, CSO_READ_AHEAD_CHUNK) && !cache.Lookup(start + chunk))
+			chunk++;
+
+		if (chunk > 0)
+			ReadUncachedBlocks(start, chunk, temp);
+		readAheadStart = start + chunk;
+		readAheadCount -= chunk;
+
+		// Give the emulation thread a chance at the lock between chunks.
+		guard.unlock();
+		Common::YieldCPU();
+		guard.lock();
 	}
-	return true;
 }
@@ -24,18 +24,63 @@
 // with CISO images.
 
 #include "../../Globals.h"
+#include "../../Common/Thread.h"
 #include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+extern "C"
+{
+#include "zlib.h"
+};
 
 class BlockDevice
 {
 public:
 	virtual ~BlockDevice() {}
 	virtual bool ReadBlock(int blockNumber, u8 *outPtr) = 0;
+	// Reads count consecutive blocks into outPtr. Override to coalesce the reads.
+	virtual bool ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (!ReadBlock(minBlock + i, outPtr + i * GetBlockSize()))
+				return false;
+		}
+		return true;
+	}
+	// Hint that these blocks will be read soon. Devices that can prefetch cheaply override this.
+	virtual void PrefetchBlocks(u32 minBlock, int count) {}
 	int GetBlockSize() const { return 2048;}  // forced, it cannot be changed by subclasses
 	virtual int GetNumBlocks() = 0;
 };
 
 
+// Keeps the most recently used decompressed blocks around.
+class BlockCache
+{
+public:
+	BlockCache(int numSlots);
+	const u8 *Lookup(int blockNumber);
+	void Insert(int blockNumber, const u8 *data);
+	void Clear();
+
+private:
+	struct Slot
+	{
+		int blockNumber;
+		std::list<int>::iterator lruPos;
+	};
+
+	std::vector<u8> storage;
+	std::vector<Slot> slots;
+	std::map<int, int> blockToSlot;
+	// Front is most recently used.
+	std::list<int> lru;
+};
+
+
 class CISOFileBlockDevice : public BlockDevice
 {
 	std::string filename;
@@ -44,10 +89,31 @@ class CISOFileBlockDevice : public BlockDevice
 	int indexShift;
 	u32 blockSize;
 	int numBlocks;
+
+	// All below is protected by lock, since the read-ahead thread shares it.
+	std::mutex lock;
+	z_stream z;
+	bool zInitialized;
+	std::vector<u8> readBuffer;
+	BlockCache cache;
+	u32 nextSequentialBlock;
+
+	std::thread *readAheadThread;
+	std::condition_variable readAheadCond;
+	u32 readAheadStart;
+	int readAheadCount;
+	bool readAheadExit;
+
+	bool ReadUncachedBlocks(u32 minBlock, int count, u8 *outPtr);
+	bool InflateBlock(const u8 *in, u32 inSize, u8 *outPtr, int blockNumber);
+	static void ReadAheadThreadFunc(CISOFileBlockDevice *device);
+	void ReadAhead();
+
 public:
-	CISOFileBlockDevice(std::string _filename);
+	CISOFileBlockDevice(std::string _filename, bool useReadAhead = false);
 	~CISOFileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	int GetNumBlocks() { return numBlocks;}
 };
 
@@ -55,11 +121,44 @@ public:
 class FileBlockDevice : public BlockDevice
 {
 	std::string filename;
-	FILE *f;
+#ifdef _WIN32
+	void *hFile;
+#else
+	int fd;
+#endif
 	size_t filesize;
+
+	bool ReadAt(u64 offset, size_t size, u8 *outPtr);
 public:
 	FileBlockDevice(std::string _filename);
 	~FileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
+	int GetNumBlocks() {return (int)(filesize/GetBlockSize());}
+};
+
+
+// Maps the whole image read-only, so reads are just memcpy out of the page cache,
+// which is shared between all processes using the same image.
+// Only sensible on 64-bit hosts, where address space isn't a concern.
+class MmapFileBlockDevice : public BlockDevice
+{
+	std::string filename;
+#ifdef _WIN32
+	void *hFile;
+	void *hMapping;
+#else
+	int fd;
+#endif
+	const u8 *data;
+	size_t filesize;
+
+public:
+	MmapFileBlockDevice(std::string _filename);
+	~MmapFileBlockDevice();
+	bool IsMapped() const { return data != 0; }
+	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
+	void PrefetchBlocks(u32 minBlock, int count);
 	int GetNumBlocks() {return (int)(filesize/GetBlockSize());}
 };
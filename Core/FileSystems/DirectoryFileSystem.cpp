@@ -19,7 +19,11 @@
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
 #include <sys/stat.h>
+#include <cctype>
 #endif
 
 #include "FileUtil.h"
@@ -31,6 +35,88 @@ DirectoryFileSystem::DirectoryFileSystem(IHandleAllocator *_hAlloc, std::string
 	hAlloc = _hAlloc;
 }
 
+DirectoryFileSystem::~DirectoryFileSystem()
+{
+	// Whatever is still open belongs to nobody once we're unmounted.
+	for (EntryMap::iterator iter = entries.begin(); iter != entries.end(); ++iter)
+		CloseEntry(iter->second);
+}
+
+DirectoryFileSystem::OpenFileEntry *DirectoryFileSystem::GetEntry(u32 handle)
+{
+	// Map nodes stay put when others are added or removed, so the pointer outlives the lock.
+	std::lock_guard<std::mutex> guard(entriesLock);
+	EntryMap::iterator iter = entries.find(handle);
+	return iter != entries.end() ? &iter->second : 0;
+}
+
+void DirectoryFileSystem::CloseEntry(OpenFileEntry &entry)
+{
+#ifdef _WIN32
+	CloseHandle(entry.hFile);
+#else
+	close(entry.hFile);
+#endif
+}
+
+#ifndef _WIN32
+static std::string LowerCase(std::string str)
+{
+	for (size_t i = 0; i < str.size(); i++)
+		str[i] = tolower(str[i]);
+	return str;
+}
+
+const DirectoryFileSystem::NameMap &DirectoryFileSystem::GetDirNames(const std::string &path)
+{
+	// "dir" and "dir/" are the same listing.
+	std::string hostDir = path;
+	if (!hostDir.empty() && hostDir[hostDir.size() - 1] != '/')
+		hostDir += '/';
+
+	std::unordered_map<std::string, NameMap>::iterator iter = dirCache.find(hostDir);
+	if (iter != dirCache.end())
+		return iter->second;
+
+	NameMap &names = dirCache[hostDir];
+	DIR *dir = opendir(hostDir.c_str());
+	if (dir)
+	{
+		while (struct dirent *ent = readdir(dir))
+		{
+			std::string name = ent->d_name;
+			std::string lower = LowerCase(name);
+			// If two names only differ in case, prefer the one that's already lowercase.
+			if (names.find(lower) == names.end() || name == lower)
+				names[lower] = name;
+		}
+		closedir(dir);
+	}
+	return names;
+}
+
+const DirectoryFileSystem::StatCacheEntry &DirectoryFileSystem::GetCachedStat(const std::string &hostPath)
+{
+	std::unordered_map<std::string, StatCacheEntry>::iterator iter = statCache.find(hostPath);
+	if (iter != statCache.end())
+		return iter->second;
+
+	StatCacheEntry &entry = statCache[hostPath];
+	struct stat st;
+	entry.exists = stat(hostPath.c_str(), &st) == 0;
+	entry.isDirectory = entry.exists && S_ISDIR(st.st_mode);
+	entry.size = entry.exists ? (s64)st.st_size : 0;
+	return entry;
+}
+
+// Anything that changes the directory tree just drops everything, those are rare.
+void DirectoryFileSystem::InvalidateCaches()
+{
+	dirCache.clear();
+	statCache.clear();
+}
+#endif
+
 std::string DirectoryFileSystem::GetLocalPath(std::string localpath)
 {
 	if (localpath.empty())
@@ -45,14 +131,48 @@ std::string DirectoryFileSystem::GetLocalPath(std::string localpath)
 		if (localpath[i] == '/')
 			localpath[i] = '\\';
 	}
-#endif
 	return basePath + localpath;
+#else
+	// Match each component against the real names on disk, ignoring case.
+	// Once a component doesn't exist the rest is kept as given, e.g. for files about to be created.
+	std::string result = basePath;
+	bool resolving = true;
+	size_t start = 0;
+	while (start < localpath.size())
+	{
+		size_t end = localpath.find('/', start);
+		if (end == std::string::npos)
+			end = localpath.size();
+
+		std::string name = localpath.substr(start, end - start);
+		if (!name.empty())
+		{
+			if (resolving)
+			{
+				const NameMap &names = GetDirNames(result);
+				NameMap::const_iterator iter = names.find(LowerCase(name));
+				if (iter != names.end())
+					name = iter->second;
+				else
+					resolving = false;
+			}
+			result += name;
+			if (end < localpath.size())
+				result += '/';
+		}
+		start = end + 1;
+	}
+	return result;
+#endif
 }
 
 
 bool DirectoryFileSystem::MkDir(const std::string &dirname)
 {
 	std::string fullName = GetLocalPath(dirname);
+#ifndef _WIN32
+	InvalidateCaches();
+#endif
 
 	return File::CreateFullPath(fullName);
 
@@ -61,6 +181,9 @@ bool DirectoryFileSystem::MkDir(const std::string &dirname)
 bool DirectoryFileSystem::RmDir(const std::string &dirname)
 {
 	std::string fullName = GetLocalPath(dirname);
+#ifndef _WIN32
+	InvalidateCaches();
+#endif
 /*#ifdef _WIN32
 	return RemoveDirectory(fullName.c_str()) == TRUE;
 #else
@@ -84,6 +207,7 @@ bool DirectoryFileSystem::RenameFile(const std::string &from, const std::string
 #ifdef _WIN32
 	return MoveFile(fullFrom.c_str(), fullTo.c_str()) == TRUE;
 #else
+	InvalidateCaches();
 	return 0 == rename(fullFrom.c_str(), fullTo.c_str());
 #endif
 }
@@ -94,6 +218,7 @@ bool DirectoryFileSystem::DeleteFile(const std::string &filename)
 #ifdef _WIN32
 	return DeleteFile(fullName.c_str()) == TRUE;
 #else
+	InvalidateCaches();
 	return 0 == unlink(fullName.c_str());
 #endif
 }
@@ -120,7 +245,7 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access)
 		desired   |= GENERIC_WRITE;
 		sharemode |= FILE_SHARE_WRITE;
 	}
-	if (access & FILEACCESS_CREATE)
+	if ((access & FILEACCESS_CREATE) && !(access & FILEACCESS_REOPEN))
 	{
 		openmode = OPEN_ALWAYS;
 	}
@@ -131,8 +256,26 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access)
 	entry.hFile = CreateFile(fullName.c_str(), desired, sharemode, 0, openmode, 0, 0);
 	bool success = entry.hFile != INVALID_HANDLE_VALUE;
 #else
-  entry.hFile = fopen(fullName.c_str(), access & FILEACCESS_WRITE ? "wb" : "rb");
-  bool success = entry.hFile != 0;
+	int flags = O_RDONLY;
+	if (access & FILEACCESS_WRITE)
+	{
+		// Same as the old "wb": create, and truncate unless appending.
+		flags = (access & FILEACCESS_READ) ? O_RDWR : O_WRONLY;
+		if (!(access & FILEACCESS_REOPEN))
+		{
+			flags |= O_CREAT;
+			if (!(access & FILEACCESS_APPEND))
+				flags |= O_TRUNC;
+		}
+	}
+	entry.hFile = open(fullName.c_str(), flags, 0666);
+	bool success = entry.hFile != -1;
+	entry.seekPos = 0;
+	entry.hostPath = fullName;
+	if (success && (flags & O_CREAT))
+		InvalidateCaches();
+	if (success && (access & FILEACCESS_APPEND))
+		entry.seekPos = lseek(entry.hFile, 0, SEEK_END);
 #endif
 
 	if (!success)
@@ -146,6 +289,7 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access)
 	else
 	{
 		u32 newHandle = hAlloc->GetNewHandle();
+		std::lock_guard<std::mutex> guard(entriesLock);
 		entries[newHandle] = entry;
 
 		return newHandle;
@@ -154,16 +298,23 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access)
 
 void DirectoryFileSystem::CloseFile(u32 handle)
 {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry entry;
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> guard(entriesLock);
+		EntryMap::iterator iter = entries.find(handle);
+		if (iter != entries.end())
+		{
+			entry = iter->second;
+			entries.erase(iter);
+			found = true;
+		}
+	}
+
+	if (found)
 	{
 		hAlloc->FreeHandle(handle);
-#ifdef _WIN32
-		CloseHandle((*iter).second.hFile);
-#else
-    fclose((*iter).second.hFile);
-#endif
-		entries.erase(iter);
+		CloseEntry(entry);
 	}
 	else
 	{
@@ -174,20 +325,24 @@ void DirectoryFileSystem::CloseFile(u32 handle)
 
 bool DirectoryFileSystem::OwnsHandle(u32 handle)
 {
-	EntryMap::iterator iter = entries.find(handle);
-	return (iter != entries.end());
+	return GetEntry(handle) != 0;
 }
 
 size_t DirectoryFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry *e = GetEntry(handle);
+	if (e)
 	{
     size_t bytesRead;
 #ifdef _WIN32
-		::ReadFile(iter->second.hFile, (LPVOID)pointer, (DWORD)size, (LPDWORD)&bytesRead, 0);
+		::ReadFile(e->hFile, (LPVOID)pointer, (DWORD)size, (LPDWORD)&bytesRead, 0);
 #else
-    bytesRead = fread(pointer, 1, size, iter->second.hFile);
+		ssize_t result;
+		do
+			result = pread(e->hFile, pointer, (size_t)size, (off_t)e->seekPos);
+		while (result < 0 && errno == EINTR);
+		bytesRead = result < 0 ? 0 : (size_t)result;
+		e->seekPos += bytesRead;
 #endif
 		return bytesRead;
 	}
@@ -201,14 +356,20 @@ size_t DirectoryFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 
 size_t DirectoryFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size) 
 {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry *e = GetEntry(handle);
+	if (e)
 	{
 		size_t bytesWritten;
 #ifdef _WIN32
-		::WriteFile(iter->second.hFile, (LPVOID)pointer, (DWORD)size, (LPDWORD)&bytesWritten, 0);
+		::WriteFile(e->hFile, (LPVOID)pointer, (DWORD)size, (LPDWORD)&bytesWritten, 0);
 #else
-    bytesWritten = fwrite(pointer, 1, size, iter->second.hFile);
+		ssize_t result;
+		do
+			result = pwrite(e->hFile, pointer, (size_t)size, (off_t)e->seekPos);
+		while (result < 0 && errno == EINTR);
+		bytesWritten = result < 0 ? 0 : (size_t)result;
+		e->seekPos += bytesWritten;
+		statCache.erase(e->hostPath);
 #endif
 		return bytesWritten;
 	}
@@ -222,8 +383,8 @@ size_t DirectoryFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size)
 
 size_t DirectoryFileSystem::SeekFile(u32 handle, s32 position, FileMove type) 
 {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry *e = GetEntry(handle);
+	if (e)
 	{
 #ifdef _WIN32
 		DWORD moveMethod = 0;
@@ -233,17 +394,22 @@ size_t DirectoryFileSystem::SeekFile(u32 handle, s32 position, FileMove type)
 		case FILEMOVE_CURRENT: moveMethod = FILE_CURRENT; break;
 		case FILEMOVE_END: moveMethod = FILE_END; break;
 		}
-		DWORD newPos = SetFilePointer((*iter).second.hFile, (LONG)position, 0, moveMethod);
+		DWORD newPos = SetFilePointer(e->hFile, (LONG)position, 0, moveMethod);
     return newPos;
 #else
-    int moveMethod = 0;
-    switch (type) {
-    case FILEMOVE_BEGIN: moveMethod = SEEK_SET; break;
-    case FILEMOVE_CURRENT: moveMethod = SEEK_CUR; break;
-    case FILEMOVE_END: moveMethod = SEEK_END; break;
-    }
-    fseek(iter->second.hFile, position, moveMethod);
-		return ftell(iter->second.hFile);
+		// Reads and writes are positional, so the position lives here rather than in the descriptor.
+		switch (type) {
+		case FILEMOVE_BEGIN: e->seekPos = position; break;
+		case FILEMOVE_CURRENT: e->seekPos += position; break;
+		case FILEMOVE_END:
+			{
+				struct stat st;
+				if (fstat(e->hFile, &st) == 0)
+					e->seekPos = st.st_size + position;
+			}
+			break;
+		}
+		return (size_t)e->seekPos;
 #endif
 	}
 	else
@@ -261,21 +427,25 @@ PSPFileInfo DirectoryFileSystem::GetFileInfo(std::string filename)
 	
 
 	std::string fullName = GetLocalPath(filename);
+#ifdef _WIN32
 	if (!File::Exists(fullName)) {
 		return x;
 	}
-	x.type = File::IsDirectory(fullName) ? FILETYPE_NORMAL : FILETYPE_DIRECTORY;
+	x.type = File::IsDirectory(fullName) ? FILETYPE_DIRECTORY : FILETYPE_NORMAL;
 	x.exists = true;
 
-#ifdef _WIN32
-
 	WIN32_FILE_ATTRIBUTE_DATA data;
 	GetFileAttributesEx(fullName.c_str(), GetFileExInfoStandard, &data);
 
 	x.size = data.nFileSizeLow | ((u64)data.nFileSizeHigh<<32);
 #else
-	x.size = File::GetSize(fullName);
-	//TODO
+	const StatCacheEntry &st = GetCachedStat(fullName);
+	if (!st.exists) {
+		return x;
+	}
+	x.type = st.isDirectory ? FILETYPE_DIRECTORY : FILETYPE_NORMAL;
+	x.exists = true;
+	x.size = st.size;
 #endif
 
 	return x;
@@ -318,6 +488,22 @@ std::vector<PSPFileInfo> DirectoryFileSystem::GetDirListing(std::string path)
 		if (!retval)
 			break;
 	}
+#else
+	std::string localPath = GetLocalPath(path);
+	if (!localPath.empty() && localPath[localPath.size() - 1] != '/')
+		localPath += '/';
+
+	const NameMap &names = GetDirNames(localPath);
+	for (NameMap::const_iterator iter = names.begin(); iter != names.end(); ++iter)
+	{
+		const StatCacheEntry &st = GetCachedStat(localPath + iter->second);
+		PSPFileInfo entry;
+		entry.type = st.isDirectory ? FILETYPE_DIRECTORY : FILETYPE_NORMAL;
+		entry.size = iter->second == ".." ? 4096 : st.size;
+		entry.name = iter->second;
+		entry.exists = st.exists;
+		myVector.push_back(entry);
+	}
 #endif
 	return myVector;
 }
@@ -20,9 +20,11 @@
 // TODO: Remove the Windows-specific code, FILE is fine there too.
 
 #include <map>
+#include <unordered_map>
 #include <string>
 
 #include "../Core/FileSystems/FileSystem.h"
+#include "../../Common/StdMutex.h"
 
 #ifdef _WIN32
 typedef void * HANDLE;
@@ -36,21 +38,47 @@ class DirectoryFileSystem : public IFileSystem
 #ifdef _WIN32
 		HANDLE hFile;
 #else
-		FILE *hFile;
+		int hFile;
+		s64 seekPos;
+		std::string hostPath;
 #endif
 	};
 
 	typedef std::map<u32,OpenFileEntry> EntryMap;
 	EntryMap entries;
+	// Only held to look up entries, reads and writes on them run unlocked on the I/O thread.
+	std::mutex entriesLock;
 	std::string basePath;
 	IHandleAllocator *hAlloc;
 
+#ifndef _WIN32
+	// The host filesystem is case sensitive but PSP paths aren't, so keep each host directory's
+	// listing keyed by lowercased name, and the stat results we've looked at.  Both caches are
+	// keyed by resolved host path.  NameMap stays ordered, GetDirListing returns it sorted.
+	typedef std::map<std::string, std::string> NameMap;
+	std::unordered_map<std::string, NameMap> dirCache;
+
+	struct StatCacheEntry
+	{
+		bool exists;
+		bool isDirectory;
+		s64 size;
+	};
+	std::unordered_map<std::string, StatCacheEntry> statCache;
+
+	const NameMap &GetDirNames(const std::string &hostDir);
+	const StatCacheEntry &GetCachedStat(const std::string &hostPath);
+	void InvalidateCaches();
+#endif
 
   // In case of Windows: Translate slashes, etc.
 	std::string GetLocalPath(std::string localpath);
+	OpenFileEntry *GetEntry(u32 handle);
+	static void CloseEntry(OpenFileEntry &entry);
 
 public:
 	DirectoryFileSystem(IHandleAllocator *_hAlloc, std::string _basePath);
+	~DirectoryFileSystem();
 	std::vector<PSPFileInfo> GetDirListing(std::string path);
 	u32      OpenFile(std::string filename, FileAccess access);
 	void     CloseFile(u32 handle);
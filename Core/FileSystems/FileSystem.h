@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../../Globals.h"
+#include "ChunkFile.h"
 #include <string>
 
 enum FileAccess
@@ -26,7 +27,9 @@ enum FileAccess
 	FILEACCESS_READ=1,
 	FILEACCESS_WRITE=2,
 	FILEACCESS_APPEND=4,
-	FILEACCESS_CREATE=8
+	FILEACCESS_CREATE=8,
+	// Opening again a file that was open when a state was saved: never create or truncate.
+	FILEACCESS_REOPEN=16,
 };
 
 enum FileMove
@@ -65,6 +68,19 @@ struct PSPFileInfo
 	bool isOnSectorSystem;
 	u32 startSector;
 	u32 numSectors;
+
+	void DoState(PointerWrap &p)
+	{
+		p.Do(name);
+		p.Do(size);
+		p.Do(access);
+		p.Do(exists);
+		p.Do(type);
+		p.Do(isOnSectorSystem);
+		p.Do(startSector);
+		p.Do(numSectors);
+		p.DoMarker("PSPFileInfo");
+	}
 };
 
 
@@ -20,8 +20,12 @@
 #include "ISOFileSystem.h"
 #include <cstring>
 #include <cstdio>
+#include <cctype>
+#include <algorithm>
 
 const int sectorSize = 2048;
+// How far past a sequential file read to ask the block device to prefetch.
+const int prefetchSectors = 128;
 
 static bool parseLBN(std::string filename, u32 *sectorStart, u32 *readSize)
 {
@@ -143,6 +147,7 @@ ISOFileSystem::ISOFileSystem(IHandleAllocator *_hAlloc, BlockDevice *_blockDevic
 	u32 rootSize = desc.root.dataLengthLE;
 
 	ReadDirectory(rootSector, rootSize, treeroot);
+	BuildPathIndex();
 }
 
 ISOFileSystem::~ISOFileSystem()
@@ -150,6 +155,13 @@ ISOFileSystem::~ISOFileSystem()
 	delete blockDevice;
 }
 
+ISOFileSystem::OpenFileEntry *ISOFileSystem::GetEntry(u32 handle)
+{
+	std::lock_guard<std::mutex> guard(entriesLock);
+	EntryMap::iterator iter = entries.find(handle);
+	return iter != entries.end() ? &iter->second : 0;
+}
+
 void ISOFileSystem::ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root)
 {
 	u8 buffer[2048];
@@ -227,60 +239,143 @@ nextblock:
 
 }
 
-ISOFileSystem::TreeEntry *ISOFileSystem::GetFromPath(std::string path)
+static inline u32 HashPath(const char *path, size_t len)
 {
-	if (path.length() == 0)
+	// FNV-1a
+	u32 hash = 2166136261U;
+	for (size_t i = 0; i < len; i++)
 	{
-		//Ah, the device!	"umd0:"
-		return &entireISO;
+		hash ^= (u8)path[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+// Lowercases path into out and canonicalizes it: no leading, trailing or doubled slashes,
+// "." dropped and ".." resolved. Returns the length, or -1 if it doesn't fit.
+static int NormalizePath(const std::string &path, char *out, int outSize)
+{
+	int len = 0;
+	size_t i = 0, n = path.size();
+	while (i < n)
+	{
+		while (i < n && path[i] == '/')
+			i++;
+		size_t start = i;
+		while (i < n && path[i] != '/')
+			i++;
+		int compLen = (int)(i - start);
+		if (compLen == 0)
+			break;
+		if (compLen == 1 && path[start] == '.')
+			continue;
+		if (compLen == 2 && path[start] == '.' && path[start + 1] == '.')
+		{
+			while (len > 0 && out[len - 1] != '/')
+				len--;
+			if (len > 0)
+				len--;
+			continue;
+		}
+
+		if (len + (len ? 1 : 0) + compLen > outSize)
+			return -1;
+		if (len)
+			out[len++] = '/';
+		for (int j = 0; j < compLen; j++)
+			out[len++] = tolower(path[start + j]);
 	}
+	return len;
+}
 
-	if (path.substr(0,2) == "./")
-		path.erase(0,2);
+void ISOFileSystem::IndexDirectory(TreeEntry *dir, const std::string &prefix, std::vector<std::pair<std::string, TreeEntry *> > &paths)
+{
+	for (size_t i = 0; i < dir->children.size(); i++)
+	{
+		TreeEntry *e = dir->children[i];
+		if (e->name == "." || e->name == "..")
+			continue;
 
-	if (path[0] == '/')
-		path.erase(0,1);
+		std::string path = prefix.empty() ? e->name : prefix + "/" + e->name;
+		for (size_t j = 0; j < path.size(); j++)
+			path[j] = tolower(path[j]);
+		paths.push_back(std::make_pair(path, e));
+		if (e->isDirectory)
+			IndexDirectory(e, path, paths);
+	}
+}
 
-	TreeEntry *e = treeroot;
-	if (path.length() == 0)
-		return e;
+void ISOFileSystem::BuildPathIndex()
+{
+	std::vector<std::pair<std::string, TreeEntry *> > paths;
+	IndexDirectory(treeroot, "", paths);
 
-	while (true)
+	// Keep the load factor at or below one half.
+	size_t tableSize = 16;
+	while (tableSize < paths.size() * 2)
+		tableSize *= 2;
+
+	PathIndexSlot empty = {0, 0, 0, 0};
+	pathIndex.assign(tableSize, empty);
+	pathPool.clear();
+
+	for (size_t i = 0; i < paths.size(); i++)
 	{
-		TreeEntry *ne = 0;
-		std::string name = "";
-		if (path.length()>0)
+		const std::string &path = paths[i].first;
+		u32 hash = HashPath(path.c_str(), path.size());
+		size_t slot = hash & (tableSize - 1);
+		bool duplicate = false;
+		while (pathIndex[slot].entry)
 		{
-			for (size_t i=0; i<e->children.size(); i++)
+			const PathIndexSlot &other = pathIndex[slot];
+			if (other.hash == hash && other.pathLength == path.size() && !memcmp(&pathPool[other.pathOffset], path.c_str(), path.size()))
 			{
-				std::string n = e->children[i]->name;
-				std::string curPath = path.substr(0, path.find_first_of('/'));
-				if (curPath == n)
-				{
-					//yay we got it
-					ne = e->children[i];
-					name = n;
-					break;
-				}
+				duplicate = true;
+				break;
 			}
+			slot = (slot + 1) & (tableSize - 1);
 		}
-		if (ne)
-		{
-			e = ne;
-			size_t l = name.length();
-			path.erase(0, l);
-			if (path.length() == 0 || (path.length()==1 && path[0] == '/'))
-				return e;
-			path.erase(0, 1);
-			while (path[0] == '/')
-				path.erase(0, 1);
-		}
-		else
+		// Like the old linear scan, the first entry with a given name wins.
+		if (duplicate)
+			continue;
+
+		pathIndex[slot].hash = hash;
+		pathIndex[slot].pathOffset = (u32)pathPool.size();
+		pathIndex[slot].pathLength = (u32)path.size();
+		pathIndex[slot].entry = paths[i].second;
+		pathPool.insert(pathPool.end(), path.begin(), path.end());
+	}
+
+	DEBUG_LOG(FILESYS, "Indexed %d paths in a %d slot table", (int)paths.size(), (int)tableSize);
+}
+
+ISOFileSystem::TreeEntry *ISOFileSystem::GetFromPath(const std::string &path)
+{
+	if (path.length() == 0)
+	{
+		//Ah, the device!	"umd0:"
+		return &entireISO;
+	}
+
+	char normalized[1024];
+	int len = NormalizePath(path, normalized, sizeof(normalized));
+	if (len == 0)
+		return treeroot;
+
+	if (len > 0 && !pathIndex.empty())
+	{
+		u32 hash = HashPath(normalized, len);
+		size_t mask = pathIndex.size() - 1;
+		for (size_t slot = hash & mask; pathIndex[slot].entry; slot = (slot + 1) & mask)
 		{
-			ERROR_LOG(FILESYS,"File %s not found", path.c_str());
-			return 0;
+			const PathIndexSlot &s = pathIndex[slot];
+			if (s.hash == hash && s.pathLength == (u32)len && !memcmp(&pathPool[s.pathOffset], normalized, len))
+				return s.entry;
 		}
 	}
+
+	ERROR_LOG(FILESYS,"File %s not found", path.c_str());
+	return 0;
 }
 
 u32 ISOFileSystem::OpenFile(std::string filename, FileAccess access)
@@ -307,6 +402,7 @@ u32 ISOFileSystem::OpenFile(std::string filename, FileAccess access)
 		entry.isRawSector = true;
 		entry.sectorStart = sectorStart;
 		entry.openSize = readSize;
+		std::lock_guard<std::mutex> guard(entriesLock);
 		entries[newHandle] = entry;
 		return newHandle;
 	}
@@ -327,19 +423,21 @@ u32 ISOFileSystem::OpenFile(std::string filename, FileAccess access)
 	entry.seekPos = 0;
 
 	u32 newHandle = hAlloc->GetNewHandle();
+	std::lock_guard<std::mutex> guard(entriesLock);
 	entries[newHandle] = entry;
 	return newHandle;
 }
 
 void ISOFileSystem::CloseFile(u32 handle)
 {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	bool found;
 	{
-		//CloseHandle((*iter).second.hFile);
-		hAlloc->FreeHandle(handle);
-		entries.erase(iter);
+		std::lock_guard<std::mutex> guard(entriesLock);
+		found = entries.erase(handle) != 0;
 	}
+
+	if (found)
+		hAlloc->FreeHandle(handle);
 	else
 	{
 		//This shouldn't happen...
@@ -349,25 +447,22 @@ void ISOFileSystem::CloseFile(u32 handle)
 
 bool ISOFileSystem::OwnsHandle(u32 handle)
 {
-	EntryMap::iterator iter = entries.find(handle);
-	return (iter != entries.end());
+	return GetEntry(handle) != 0;
 }
 
 size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry *entry = GetEntry(handle);
+	if (entry)
 	{
-		OpenFileEntry &e = iter->second;
+		OpenFileEntry &e = *entry;
 		
 		if (e.file != 0 && e.file->isBlockSectorMode)
 		{
 			// Whole sectors! Shortcut to this simple code.
-			for (int i = 0; i < size; i++)
-			{
-				blockDevice->ReadBlock(e.seekPos, pointer + i * 2048);
-				e.seekPos++;
-			}
+			blockDevice->ReadBlocks(e.seekPos, (int)size, pointer);
+			e.seekPos += (unsigned int)size;
+			blockDevice->PrefetchBlocks(e.seekPos, prefetchSectors);
 			return (size_t)size;
 		}
 
@@ -395,13 +490,14 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 		//okay, we have size and position, let's rock
 
 		u32 totalRead = 0;
-		int secNum = positionOnIso / 2048;
+		u32 secNum = positionOnIso / 2048;
 		int posInSector = positionOnIso & 2047;
-		s64 remain = size;		
+		s64 remain = size;
 
 		u8 theSector[2048];
 
-		while (remain > 0)
+		// Unaligned head goes through the bounce buffer.
+		if (posInSector != 0 && remain > 0)
 		{
 			blockDevice->ReadBlock(secNum, theSector);
 			size_t bytesToCopy = 2048 - posInSector;
@@ -412,9 +508,37 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 			totalRead += (u32)bytesToCopy;
 			pointer += bytesToCopy;
 			remain -= bytesToCopy;
-			posInSector = 0;
 			secNum++;
 		}
+
+		// Whole sectors land directly in the destination with a single range read.
+		int middleSectors = (int)(remain / 2048);
+		if (middleSectors > 0)
+		{
+			blockDevice->ReadBlocks(secNum, middleSectors, pointer);
+			size_t bytesRead = (size_t)middleSectors * 2048;
+			totalRead += (u32)bytesRead;
+			pointer += bytesRead;
+			remain -= bytesRead;
+			secNum += middleSectors;
+		}
+
+		// And the partial tail.
+		if (remain > 0)
+		{
+			blockDevice->ReadBlock(secNum, theSector);
+			memcpy(pointer, theSector, (size_t)remain);
+			totalRead += (u32)remain;
+		}
+
+		// Files are usually read front to back, so warm up what's likely next.
+		if (!e.isRawSector)
+		{
+			u32 fileEndSector = (u32)((e.file->startingPosition + e.file->size + 2047) / 2048);
+			u32 nextSector = (positionOnIso + (u32)size) / 2048;
+			if (nextSector < fileEndSector)
+				blockDevice->PrefetchBlocks(nextSector, std::min((int)(fileEndSector - nextSector), prefetchSectors));
+		}
 		e.seekPos += (unsigned int)size;
 		return totalRead;
 	}
@@ -434,10 +558,10 @@ size_t ISOFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size)
 
 size_t ISOFileSystem::SeekFile(u32 handle, s32 position, FileMove type) 
 {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry *entry = GetEntry(handle);
+	if (entry)
 	{
-		OpenFileEntry &e = iter->second;
+		OpenFileEntry &e = *entry;
 		switch (type)
 		{
 		case FILEMOVE_BEGIN:
@@ -21,6 +21,7 @@
 #include <string>
 
 #include "FileSystem.h"
+#include "../../Common/StdMutex.h"
 
 #include "BlockDevices.h"
 
@@ -59,14 +60,31 @@ class ISOFileSystem : public IFileSystem
 
 	typedef std::map<u32,OpenFileEntry> EntryMap;
 	EntryMap entries;
+	// Only held to look up entries, the reads run unlocked on the I/O thread.
+	std::mutex entriesLock;
 	IHandleAllocator *hAlloc;
 	TreeEntry *treeroot;
 	BlockDevice *blockDevice;
 
 	TreeEntry entireISO;
 
+	// Flat open addressing hash from lowercased full path to entry, built once at mount.
+	// The paths themselves are packed into pathPool.
+	struct PathIndexSlot
+	{
+		u32 hash;
+		u32 pathOffset;
+		u32 pathLength;
+		TreeEntry *entry;
+	};
+	std::vector<PathIndexSlot> pathIndex;
+	std::vector<char> pathPool;
+
 	void ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root);
-	TreeEntry *GetFromPath(std::string path);
+	void BuildPathIndex();
+	void IndexDirectory(TreeEntry *dir, const std::string &prefix, std::vector<std::pair<std::string, TreeEntry *> > &paths);
+	TreeEntry *GetFromPath(const std::string &path);
+	OpenFileEntry *GetEntry(u32 handle);
 
 public:
 	ISOFileSystem(IHandleAllocator *_hAlloc, BlockDevice *_blockDevice);
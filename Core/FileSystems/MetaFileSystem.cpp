@@ -20,6 +20,7 @@
 
 IFileSystem *MetaFileSystem::GetHandleOwner(u32 handle)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	for (size_t i = 0; i < fileSystems.size(); i++)
 	{
 		if (fileSystems[i].system->OwnsHandle(handle))
@@ -31,34 +32,120 @@ IFileSystem *MetaFileSystem::GetHandleOwner(u32 handle)
 
 bool MetaFileSystem::MapFilePath(std::string inpath, std::string &outpath, IFileSystem **system)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	// host0 HACK
 	// need to figure out what to do about xxx:./... paths - is there a current dir per drive?
 	if (!inpath.compare(0, 8, "host0:./"))
 		inpath = currentDirectory + inpath.substr(7);
 
-	for (size_t i = 0; i < fileSystems.size(); i++)
+	if (mountTrie.empty())
+		return false;
+
+	// Walk the trie as far as the path goes, remembering the first mount point passed.
+	const MountTrieNode *match = 0;
+	int node = 0;
+	for (size_t i = 0; i < inpath.size() && !match; i++)
 	{
-		int prefLen = fileSystems[i].prefix.size();
-		if (fileSystems[i].prefix == inpath.substr(0,prefLen))
+		const std::vector<std::pair<char, int> > &children = mountTrie[node].children;
+		int next = -1;
+		for (size_t c = 0; c < children.size(); c++)
 		{
-			outpath = inpath.substr(prefLen);
-			*system = fileSystems[i].system;
-			return true;
+			if (children[c].first == inpath[i])
+			{
+				next = children[c].second;
+				break;
+			}
 		}
+		if (next < 0)
+			break;
+		node = next;
+		if (mountTrie[node].system)
+			match = &mountTrie[node];
+	}
+
+	if (!match)
+		return false;
+
+	outpath = inpath.substr(match->prefixLength);
+	*system = match->system;
+	return true;
+}
+
+void MetaFileSystem::AddToMountTrie(const std::string &prefix, IFileSystem *system)
+{
+	if (mountTrie.empty())
+		mountTrie.push_back(MountTrieNode());
+
+	int node = 0;
+	for (size_t i = 0; i < prefix.size(); i++)
+	{
+		int next = -1;
+		for (size_t c = 0; c < mountTrie[node].children.size(); c++)
+		{
+			if (mountTrie[node].children[c].first == prefix[i])
+			{
+				next = mountTrie[node].children[c].second;
+				break;
+			}
+		}
+		if (next < 0)
+		{
+			next = (int)mountTrie.size();
+			mountTrie.push_back(MountTrieNode());
+			mountTrie[node].children.push_back(std::make_pair(prefix[i], next));
+		}
+		node = next;
+	}
+
+	// Keep the first mount of a prefix, as the old linear scan did.
+	if (!mountTrie[node].system)
+	{
+		mountTrie[node].system = system;
+		mountTrie[node].prefixLength = (int)prefix.size();
 	}
-	return false;
 }
 
 void MetaFileSystem::Mount(std::string prefix, IFileSystem *system)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	System x;
 	x.prefix=prefix;
 	x.system=system;
 	fileSystems.push_back(x);
+	AddToMountTrie(prefix, system);
+}
+
+// Doesn't delete the system, that's up to whoever mounted it.
+void MetaFileSystem::Unmount(IFileSystem *system)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+	for (size_t i = 0; i < fileSystems.size(); )
+	{
+		if (fileSystems[i].system == system)
+			fileSystems.erase(fileSystems.begin() + i);
+		else
+			i++;
+	}
+
+	mountTrie.clear();
+	for (size_t i = 0; i < fileSystems.size(); i++)
+		AddToMountTrie(fileSystems[i].prefix, fileSystems[i].system);
+}
+
+IFileSystem *MetaFileSystem::GetSystem(const std::string &prefix)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+	for (size_t i = 0; i < fileSystems.size(); i++)
+	{
+		if (fileSystems[i].prefix == prefix)
+			return fileSystems[i].system;
+	}
+	return 0;
 }
 
 void MetaFileSystem::UnmountAll()
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	current = 6;
 
 	// Ownership is a bit convoluted. Let's just delete everything once.
@@ -74,11 +161,13 @@ void MetaFileSystem::UnmountAll()
 	}
 
 	fileSystems.clear();
+	mountTrie.clear();
 	currentDirectory = "";
 }
 
 u32 MetaFileSystem::OpenFile(std::string filename, FileAccess access)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	if (filename.find(':') == std::string::npos)
 	{
@@ -98,6 +187,7 @@ u32 MetaFileSystem::OpenFile(std::string filename, FileAccess access)
 
 PSPFileInfo MetaFileSystem::GetFileInfo(std::string filename)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	if (filename.find(':') == std::string::npos)
 	{
@@ -128,6 +218,7 @@ bool stringEndsWith (std::string const &fullString, std::string const &ending)
 
 std::vector<PSPFileInfo> MetaFileSystem::GetDirListing(std::string path)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	if (path.find(':') == std::string::npos)
 	{
@@ -151,6 +242,7 @@ std::vector<PSPFileInfo> MetaFileSystem::GetDirListing(std::string path)
 
 bool MetaFileSystem::MkDir(const std::string &dirname)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(dirname, of, &system))
@@ -165,6 +257,7 @@ bool MetaFileSystem::MkDir(const std::string &dirname)
 
 bool MetaFileSystem::RmDir(const std::string &dirname)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(dirname, of, &system))
@@ -179,6 +272,7 @@ bool MetaFileSystem::RmDir(const std::string &dirname)
 
 bool MetaFileSystem::RenameFile(const std::string &from, const std::string &to)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	std::string rf;
 	IFileSystem *system;
@@ -194,6 +288,7 @@ bool MetaFileSystem::RenameFile(const std::string &from, const std::string &to)
 
 bool MetaFileSystem::DeleteFile(const std::string &filename)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(filename, of, &system))
@@ -208,11 +303,14 @@ bool MetaFileSystem::DeleteFile(const std::string &filename)
 
 void MetaFileSystem::CloseFile(u32 handle)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
 	if (sys)
 		sys->CloseFile(handle);
 }
 
+// Only the owner lookup is locked, so a read on the I/O thread doesn't hold up the emulator's
+// own file calls.  The systems guard their open handles themselves.
 size_t MetaFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 {
 	IFileSystem *sys = GetHandleOwner(handle);
@@ -222,8 +320,10 @@ size_t MetaFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 		return 0;
 }
 
+// Writes also drop cached file info that path lookups share, so they stay under the lock.
 size_t MetaFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size)
 {
+	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
 	if (sys)
 		return sys->WriteFile(handle,pointer,size);
@@ -240,3 +340,9 @@ size_t MetaFileSystem::SeekFile(u32 handle, s32 position, FileMove type)
 		return 0;
 }
 
+void MetaFileSystem::DoState(PointerWrap &p)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+	p.Do(currentDirectory);
+	p.DoMarker("MetaFileSystem");
+}
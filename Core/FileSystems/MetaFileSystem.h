@@ -18,6 +18,7 @@
 #pragma once
 
 #include "FileSystem.h"
+#include "../../Common/StdMutex.h"
 
 class MetaFileSystem : public IHandleAllocator, public IFileSystem
 {
@@ -29,6 +30,8 @@ public:
 
 	void Mount(std::string prefix, IFileSystem *system);
 	void Unmount(IFileSystem *system);
+	// The system mounted at exactly this prefix, or 0.
+	IFileSystem *GetSystem(const std::string &prefix);
 
 	// Effectively "Shutdown".
 	void UnmountAll();
@@ -52,7 +55,11 @@ public:
 		return SeekFile(handle, 0, FILEMOVE_CURRENT);
 	}
 
-	virtual void ChDir(std::string dir) {currentDirectory = dir;}
+	virtual void ChDir(std::string dir)
+	{
+		std::lock_guard<std::recursive_mutex> guard(lock);
+		currentDirectory = dir;
+	}
 
 	virtual bool MkDir(const std::string &dirname);
 	virtual bool RmDir(const std::string &dirname);
@@ -62,8 +69,13 @@ public:
 	// TODO: void IoCtl(...)
 
 	void SetCurrentDirectory(const std::string &dir) {
+		std::lock_guard<std::recursive_mutex> guard(lock);
 		currentDirectory = dir;
 	}
+
+	// Open files are restored by their FileNodes, only the current directory lives here.
+	void DoState(PointerWrap &p);
+
 private:
 	u32 current;
 	struct System
@@ -73,5 +85,19 @@ private:
 	};
 	std::vector<System> fileSystems;
 
+	// Prefix trie over the mount points, so resolving a path is one walk over its device name.
+	struct MountTrieNode
+	{
+		MountTrieNode() : system(0), prefixLength(0) {}
+		IFileSystem *system;
+		int prefixLength;
+		std::vector<std::pair<char, int> > children;
+	};
+	std::vector<MountTrieNode> mountTrie;
+	void AddToMountTrie(const std::string &prefix, IFileSystem *system);
+
 	std::string currentDirectory;
+
+	// The async I/O worker thread calls in here too.
+	std::recursive_mutex lock;
 };
@@ -0,0 +1,168 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "StdMutex.h"
+#include "Thread.h"
+#include "Timer.h"
+
+#include "Config.h"
+#include "FramePacer.h"
+
+namespace FramePacer
+{
+
+// OS sleeps can overshoot by about this much, the rest of the wait is a spin.
+static const u64 SPIN_MARGIN_NS = 2000000;
+static const u64 MAX_SLEEP_NS = 100000000;
+// Don't try to catch up after a long stall, just start pacing from now.
+static const int MAX_FRAMES_BEHIND = 4;
+
+static Mode mode = PACE_NORMAL;
+// Set by SetMode, so Init doesn't replace it from the config again.
+static bool modeSet = false;
+static bool unthrottleHeld = false;
+static u64 nextDeadline = 0;
+static u64 lastFrameEnd = 0;
+
+static std::mutex statsLock;
+static Stats stats;
+static double totalFrameMs = 0.0;
+
+static void SleepNs(u64 ns)
+{
+#ifdef _WIN32
+	Sleep((DWORD)(ns / 1000000));
+#else
+	usleep((useconds_t)(ns / 1000));
+#endif
+}
+
+static void WaitUntil(u64 deadline)
+{
+	u64 now;
+	while ((now = Common::Timer::GetTimeNs()) + SPIN_MARGIN_NS < deadline)
+	{
+		u64 ns = deadline - now - SPIN_MARGIN_NS;
+		SleepNs(ns > MAX_SLEEP_NS ? MAX_SLEEP_NS : ns);
+	}
+	while (Common::Timer::GetTimeNs() < deadline)
+		Common::YieldCPU();
+}
+
+static int HistogramBucket(u64 ns)
+{
+	u64 ms = ns / 1000000;
+	return ms >= NUM_HISTOGRAM_BUCKETS ? NUM_HISTOGRAM_BUCKETS - 1 : (int)ms;
+}
+
+void Init()
+{
+	// Asks for 1 ms sleeps on Windows.
+	Common::Timer::IncreaseResolution();
+	if (!modeSet)
+		mode = g_Config.iSpeedPercent <= 0 ? PACE_UNTHROTTLED : PACE_NORMAL;
+	unthrottleHeld = false;
+	nextDeadline = 0;
+	lastFrameEnd = 0;
+	ResetStats();
+}
+
+void Shutdown()
+{
+	Common::Timer::RestoreResolution();
+}
+
+void SetMode(Mode newMode)
+{
+	mode = newMode;
+	modeSet = true;
+	nextDeadline = 0;
+}
+
+Mode GetMode()
+{
+	return mode;
+}
+
+void SetUnthrottleHeld(bool held)
+{
+	if (unthrottleHeld && !held)
+		nextDeadline = 0;
+	unthrottleHeld = held;
+}
+
+void EndFrame(double frameMs)
+{
+	u64 workEnd = Common::Timer::GetTimeNs();
+	bool late = false;
+
+	if (mode == PACE_NORMAL && !unthrottleHeld && g_Config.iSpeedPercent > 0)
+	{
+		u64 period = (u64)(frameMs * 1000000.0 * 100.0 / g_Config.iSpeedPercent);
+		if (nextDeadline == 0 || workEnd > nextDeadline + period * MAX_FRAMES_BEHIND)
+			nextDeadline = workEnd + period;
+		else
+		{
+			late = workEnd > nextDeadline;
+			WaitUntil(nextDeadline);
+			nextDeadline += period;
+		}
+	}
+
+	u64 frameEnd = Common::Timer::GetTimeNs();
+	if (lastFrameEnd != 0)
+	{
+		u64 frameNs = frameEnd - lastFrameEnd;
+		u64 workNs = workEnd - lastFrameEnd;
+		double thisFrameMs = frameNs / 1000000.0;
+
+		std::lock_guard<std::mutex> guard(statsLock);
+		stats.numFrames++;
+		if (late)
+			stats.numLateFrames++;
+		totalFrameMs += thisFrameMs;
+		stats.averageFrameMs = totalFrameMs / stats.numFrames;
+		if (thisFrameMs > stats.worstFrameMs)
+			stats.worstFrameMs = thisFrameMs;
+		stats.frameTimeHistogram[HistogramBucket(frameNs)]++;
+		stats.workTimeHistogram[HistogramBucket(workNs)]++;
+	}
+	lastFrameEnd = frameEnd;
+}
+
+void GetStats(Stats &out)
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+	out = stats;
+}
+
+void ResetStats()
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+	memset(&stats, 0, sizeof(stats));
+	totalFrameMs = 0.0;
+}
+
+}	// namespace FramePacer
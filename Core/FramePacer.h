@@ -0,0 +1,68 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../Globals.h"
+
+// Keeps emulated frames in step with real time, on any platform.
+// Sleeps most of the way to each frame's deadline and spins the rest.
+namespace FramePacer
+{
+	enum Mode
+	{
+		// Paced at g_Config.iSpeedPercent of the PSP's speed.
+		PACE_NORMAL,
+		// As fast as possible, for benchmarks and fast forward.
+		PACE_UNTHROTTLED,
+	};
+
+	enum
+	{
+		// 1 ms per bucket, the last one also holds anything slower.
+		NUM_HISTOGRAM_BUCKETS = 50,
+	};
+
+	struct Stats
+	{
+		u32 numFrames;
+		// Frames that finished after their deadline, in PACE_NORMAL.
+		u32 numLateFrames;
+		double averageFrameMs;
+		double worstFrameMs;
+		// Time from one frame to the next, including pacing.
+		u32 frameTimeHistogram[NUM_HISTOGRAM_BUCKETS];
+		// Time spent emulating each frame, before pacing.
+		u32 workTimeHistogram[NUM_HISTOGRAM_BUCKETS];
+	};
+
+	void Init();
+	void Shutdown();
+
+	// Kept across Init, otherwise the mode follows g_Config.iSpeedPercent.
+	void SetMode(Mode mode);
+	Mode GetMode();
+	// Temporary override on top of the mode, like holding a fast forward key.
+	void SetUnthrottleHeld(bool held);
+
+	// Called by the emulator at the end of each frame, waits until the next one is due.
+	void EndFrame(double frameMs);
+
+	// Safe to call from any thread.
+	void GetStats(Stats &stats);
+	void ResetStats();
+};
@@ -17,7 +17,10 @@
 
 #include "HLE.h"
 #include <map>
+#include <algorithm>
+#include "Timer.h"
 #include "../MemMap.h"
+#include "../CoreTiming.h"
 
 #include "HLETables.h"
 #include "../System.h"
@@ -26,6 +29,7 @@
 #include "sceAudio.h"
 #include "sceKernelMemory.h"
 #include "sceKernelThread.h"
+#include "ReplaceTables.h"
 #include "../MIPS/MIPSCodeUtils.h"
 
 enum
@@ -47,14 +51,24 @@ static std::vector<Syscall> unresolvedSyscalls;
 static int hleAfterSyscall = HLE_AFTER_NOTHING;
 static char hleAfterSyscallReschedReason[512];
 
+// Indexed like moduleDB, filled in lazily while profiling.
+static std::vector<std::vector<HLEProfileEntry> > hleProfile;
+static bool hleProfilerEnabled = false;
+static std::map<int, s64> hleProfileCallbackStarts;
+static u32 hleProfileCallbackCount;
+static u64 hleProfileCallbackCycles;
+
 void HLEInit()
 {
 	RegisterAllModules();
+	Replacement_Init();
 }
 
 void HLEShutdown()
 {
 	moduleDB.clear();
+	hleProfileCallbackStarts.clear();
+	Replacement_Shutdown();
 }
 
 void RegisterModule(const char *name, int numFunctions, const HLEFunction *funcTable)
@@ -247,6 +261,142 @@ inline void hleFinishSyscall()
 	hleAfterSyscallReschedReason[0] = 0;
 }
 
+void hleProfilerEnable(bool enable)
+{
+	hleProfilerEnabled = enable;
+	if (!enable)
+		hleProfileCallbackStarts.clear();
+}
+
+bool hleProfilerIsEnabled()
+{
+	return hleProfilerEnabled;
+}
+
+void hleProfilerReset()
+{
+	hleProfile.clear();
+	hleProfileCallbackStarts.clear();
+	hleProfileCallbackCount = 0;
+	hleProfileCallbackCycles = 0;
+}
+
+static bool hleProfileEntryCompare(const HLEProfileEntry &a, const HLEProfileEntry &b)
+{
+	return a.hostNs > b.hostNs;
+}
+
+void hleProfilerGetEntries(std::vector<HLEProfileEntry> &entries)
+{
+	entries.clear();
+	for (size_t i = 0; i < hleProfile.size(); i++)
+	{
+		for (size_t j = 0; j < hleProfile[i].size(); j++)
+		{
+			if (hleProfile[i][j].calls != 0)
+				entries.push_back(hleProfile[i][j]);
+		}
+	}
+	std::sort(entries.begin(), entries.end(), hleProfileEntryCompare);
+}
+
+u32 hleProfilerGetCallbackCount()
+{
+	return hleProfileCallbackCount;
+}
+
+u64 hleProfilerGetCallbackCycles()
+{
+	return hleProfileCallbackCycles;
+}
+
+void hleProfilerCallbackStart(int callId)
+{
+	if (hleProfilerEnabled)
+		hleProfileCallbackStarts[callId] = CoreTiming::GetTicks();
+}
+
+void hleProfilerCallbackEnd(int callId)
+{
+	if (!hleProfilerEnabled)
+		return;
+	std::map<int, s64>::iterator it = hleProfileCallbackStarts.find(callId);
+	if (it == hleProfileCallbackStarts.end())
+		return;
+	hleProfileCallbackCount++;
+	hleProfileCallbackCycles += CoreTiming::GetTicks() - it->second;
+	hleProfileCallbackStarts.erase(it);
+}
+
+bool hleProfilerDump(const std::string &filename)
+{
+	FILE *f = fopen(filename.c_str(), "w");
+	if (!f)
+	{
+		ERROR_LOG(HLE, "Unable to write syscall profile to %s", filename.c_str());
+		return false;
+	}
+
+	std::vector<HLEProfileEntry> entries;
+	hleProfilerGetEntries(entries);
+
+	bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+	if (csv)
+	{
+		// Syscalls run in no guest time, only the callbacks row has cycles.
+		fprintf(f, "module,function,calls,host_ns,reschedules,cycles\n");
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			const HLEProfileEntry &e = entries[i];
+			fprintf(f, "%s,%s,%u,%llu,%u,\n", e.module, e.name, e.calls, (unsigned long long)e.hostNs, e.reschedules);
+		}
+		fprintf(f, "[callbacks],,%u,,,%llu\n", hleProfileCallbackCount, (unsigned long long)hleProfileCallbackCycles);
+	}
+	else
+	{
+		fprintf(f, "{\n\t\"callbacks\": {\"count\": %u, \"cycles\": %llu},\n", hleProfileCallbackCount, (unsigned long long)hleProfileCallbackCycles);
+		fprintf(f, "\t\"functions\": [\n");
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			const HLEProfileEntry &e = entries[i];
+			fprintf(f, "\t\t{\"module\": \"%s\", \"function\": \"%s\", \"calls\": %u, \"host_ns\": %llu, \"reschedules\": %u}%s\n",
+				e.module, e.name, e.calls, (unsigned long long)e.hostNs, e.reschedules, i + 1 < entries.size() ? "," : "");
+		}
+		fprintf(f, "\t]\n}\n");
+	}
+
+	fclose(f);
+	return true;
+}
+
+static void CallSyscallProfiled(int modulenum, int funcnum, HLEFunc func)
+{
+	if (hleProfile.size() < moduleDB.size())
+		hleProfile.resize(moduleDB.size());
+	std::vector<HLEProfileEntry> &moduleProfile = hleProfile[modulenum];
+	if (moduleProfile.empty())
+	{
+		const HLEModule &module = moduleDB[modulenum];
+		moduleProfile.resize(module.numFunctions);
+		for (int i = 0; i < module.numFunctions; i++)
+		{
+			HLEProfileEntry entry = {module.name, module.funcTable[i].name, 0, 0, 0};
+			moduleProfile[i] = entry;
+		}
+	}
+
+	u64 start = Common::Timer::GetTimeNs();
+	func();
+
+	HLEProfileEntry &entry = moduleProfile[funcnum];
+	entry.calls++;
+	if ((hleAfterSyscall & (HLE_AFTER_RESCHED | HLE_AFTER_RESCHED_CALLBACKS)) != 0)
+		entry.reschedules++;
+	if (hleAfterSyscall != HLE_AFTER_NOTHING)
+		hleFinishSyscall();
+	entry.hostNs += Common::Timer::GetTimeNs() - start;
+}
+
 void CallSyscall(u32 op)
 {
 	u32 callno = (op >> 6) & 0xFFFFF; //20 bits
@@ -261,6 +411,12 @@ void CallSyscall(u32 op)
 	HLEFunc func = moduleDB[modulenum].funcTable[funcnum].func;
 	if (func)
 	{
+		if (hleProfilerEnabled)
+		{
+			CallSyscallProfiled(modulenum, funcnum, func);
+			return;
+		}
+
 		func();
 
 		if (hleAfterSyscall != HLE_AFTER_NOTHING)
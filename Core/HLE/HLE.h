@@ -84,13 +84,33 @@ void hleReSchedule(bool callbacks, const char *reason);
 
 void HLEInit();
 void HLEShutdown();
+
+// Per HLE function call counts and host time. Off by default, and costs a single
+// check per syscall when off. Entries survive HLEShutdown so they can be dumped at exit.
+struct HLEProfileEntry
+{
+	const char *module;
+	const char *name;
+	u32 calls;
+	u32 reschedules;
+	u64 hostNs;
+};
+
+void hleProfilerEnable(bool enable);
+bool hleProfilerIsEnabled();
+void hleProfilerReset();
+// Only functions that were called, most expensive first.
+void hleProfilerGetEntries(std::vector<HLEProfileEntry> &entries);
+// Guest cycles from entering a callback (or other mips call) until it returns.
+u32 hleProfilerGetCallbackCount();
+u64 hleProfilerGetCallbackCycles();
+void hleProfilerCallbackStart(int callId);
+void hleProfilerCallbackEnd(int callId);
+// Writes CSV if the filename ends in .csv, JSON otherwise.
+bool hleProfilerDump(const std::string &filename);
 u32 GetNibByName(const char *module, const char *function);
 u32 GetSyscallOp(const char *module, u32 nib);
 void WriteSyscall(const char *module, u32 nib, u32 address);
 void CallSyscall(u32 op);
 void ResolveSyscall(const char *moduleName, u32 nib, u32 address);
 
-// Need to be able to save entire kernel state
-int GetStateSize();
-void SaveState(u8 *ptr);
-void LoadState(const u8 *ptr);
@@ -0,0 +1,363 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+
+#include "FileUtil.h"
+
+#include "HLE.h"
+#include "../Config.h"
+#include "../CoreTiming.h"
+#include "../MemMap.h"
+#include "../MIPS/MIPS.h"
+#include "../MIPS/MIPSAnalyst.h"
+#include "../MIPS/JitCommon/JitCommon.h"
+#include "../Debugger/SymbolMap.h"
+#include "ReplaceTables.h"
+
+static std::string replacementDiscID;
+
+// Returns a host pointer if the whole range is valid guest memory.
+static u8 *GetRange(u32 address, u32 size)
+{
+	if (size == 0 || !Memory::IsValidAddress(address) || !Memory::IsValidAddress(address + size - 1))
+		return NULL;
+	return Memory::GetPointer(address);
+}
+
+// Cycle costs below roughly match the SDK's own loops, so timing doesn't change much
+// when replacements are turned on or off.
+
+static int Replace_memcpy()
+{
+	u32 destPtr = currentMIPS->r[MIPS_REG_A0];
+	u32 srcPtr = currentMIPS->r[MIPS_REG_A1];
+	u32 bytes = currentMIPS->r[MIPS_REG_A2];
+	u8 *dst = GetRange(destPtr, bytes);
+	const u8 *src = GetRange(srcPtr, bytes);
+	if (dst && src)
+	{
+		// Games occasionally rely on a forward copy smearing overlapping data.
+		if (dst > src && dst < src + bytes)
+		{
+			for (u32 i = 0; i < bytes; i++)
+				dst[i] = src[i];
+		}
+		else
+			memmove(dst, src, bytes);
+	}
+	currentMIPS->r[MIPS_REG_V0] = destPtr;
+	return 10 + bytes / 4;
+}
+
+static int Replace_memmove()
+{
+	u32 destPtr = currentMIPS->r[MIPS_REG_A0];
+	u32 srcPtr = currentMIPS->r[MIPS_REG_A1];
+	u32 bytes = currentMIPS->r[MIPS_REG_A2];
+	u8 *dst = GetRange(destPtr, bytes);
+	const u8 *src = GetRange(srcPtr, bytes);
+	if (dst && src)
+		memmove(dst, src, bytes);
+	currentMIPS->r[MIPS_REG_V0] = destPtr;
+	return 10 + bytes / 4;
+}
+
+static int Replace_memset()
+{
+	u32 destPtr = currentMIPS->r[MIPS_REG_A0];
+	u8 value = (u8)currentMIPS->r[MIPS_REG_A1];
+	u32 bytes = currentMIPS->r[MIPS_REG_A2];
+	u8 *dst = GetRange(destPtr, bytes);
+	if (dst)
+		memset(dst, value, bytes);
+	currentMIPS->r[MIPS_REG_V0] = destPtr;
+	return 10 + bytes / 4;
+}
+
+// Guest strings are read byte by byte so we never run off the end of memory.
+static int Replace_strlen()
+{
+	u32 ptr = currentMIPS->r[MIPS_REG_A0];
+	u32 len = 0;
+	while (Memory::IsValidAddress(ptr + len) && Memory::Read_U8(ptr + len) != 0)
+		len++;
+	currentMIPS->r[MIPS_REG_V0] = len;
+	return 10 + len * 2;
+}
+
+static int Replace_strcpy()
+{
+	u32 destPtr = currentMIPS->r[MIPS_REG_A0];
+	u32 srcPtr = currentMIPS->r[MIPS_REG_A1];
+	u32 len = 0;
+	while (Memory::IsValidAddress(srcPtr + len) && Memory::IsValidAddress(destPtr + len))
+	{
+		u8 c = Memory::Read_U8(srcPtr + len);
+		Memory::Write_U8(c, destPtr + len);
+		len++;
+		if (c == 0)
+			break;
+	}
+	currentMIPS->r[MIPS_REG_V0] = destPtr;
+	return 10 + len * 3;
+}
+
+static int CompareStrings(u32 a, u32 b, u32 maxLen, u32 &len)
+{
+	for (len = 0; len < maxLen; len++)
+	{
+		if (!Memory::IsValidAddress(a + len) || !Memory::IsValidAddress(b + len))
+			return 0;
+		u8 ca = Memory::Read_U8(a + len);
+		u8 cb = Memory::Read_U8(b + len);
+		if (ca != cb)
+			return (int)ca - (int)cb;
+		if (ca == 0)
+			return 0;
+	}
+	return 0;
+}
+
+static int Replace_strcmp()
+{
+	u32 len;
+	currentMIPS->r[MIPS_REG_V0] = CompareStrings(currentMIPS->r[MIPS_REG_A0], currentMIPS->r[MIPS_REG_A1], 0xFFFFFFFF, len);
+	return 10 + len * 3;
+}
+
+static int Replace_strncmp()
+{
+	u32 len;
+	currentMIPS->r[MIPS_REG_V0] = CompareStrings(currentMIPS->r[MIPS_REG_A0], currentMIPS->r[MIPS_REG_A1], currentMIPS->r[MIPS_REG_A2], len);
+	return 10 + len * 3;
+}
+
+// Index is the value of the emuhack, so only ever append.
+static const ReplacementTableEntry entries[] =
+{
+	{"memcpy", &Replace_memcpy},
+	{"memmove", &Replace_memmove},
+	{"memset", &Replace_memset},
+	{"strlen", &Replace_strlen},
+	{"strcpy", &Replace_strcpy},
+	{"strcmp", &Replace_strcmp},
+	{"strncmp", &Replace_strncmp},
+};
+
+int Replacement_GetNumEntries()
+{
+	return ARRAY_SIZE(entries);
+}
+
+const ReplacementTableEntry *Replacement_GetEntry(int index)
+{
+	if (index < 0 || index >= Replacement_GetNumEntries())
+		return NULL;
+	return &entries[index];
+}
+
+// Known code for the plain libc routines, so they get named (and replaced) in stripped games
+// without a FuncHashMap.  Unlike the hash maps, which ignore immediates, a scanned function
+// has to match every word: a loop with another stride or offset isn't memcpy.
+static const u32 seedMemcpy[] =
+{
+	0x10c00008, // beqz  a2, +8
+	0x00801021, // move  v0, a0
+	0x00801821, // move  v1, a0
+	0x90a80000, // lbu   t0, 0(a1)
+	0x24c6ffff, // addiu a2, a2, -1
+	0xa0680000, // sb    t0, 0(v1)
+	0x24a50001, // addiu a1, a1, 1
+	0x14c0fffb, // bnez  a2, -5
+	0x24630001, // addiu v1, v1, 1
+	0x03e00008, // jr    ra
+	0x00000000, // nop
+};
+
+static const u32 seedMemset[] =
+{
+	0x10c00006, // beqz  a2, +6
+	0x00801021, // move  v0, a0
+	0x00801821, // move  v1, a0
+	0x24c6ffff, // addiu a2, a2, -1
+	0xa0650000, // sb    a1, 0(v1)
+	0x14c0fffd, // bnez  a2, -3
+	0x24630001, // addiu v1, v1, 1
+	0x03e00008, // jr    ra
+	0x00000000, // nop
+};
+
+static const u32 seedStrlen[] =
+{
+	0x80830000, // lb    v1, 0(a0)
+	0x10600006, // beqz  v1, +6
+	0x00001021, // move  v0, zero
+	0x24420001, // addiu v0, v0, 1
+	0x00821821, // addu  v1, a0, v0
+	0x80630000, // lb    v1, 0(v1)
+	0x1460fffc, // bnez  v1, -4
+	0x00000000, // nop
+	0x03e00008, // jr    ra
+	0x00000000, // nop
+};
+
+struct SeedFunction
+{
+	const char *name;
+	const u32 *code;
+	int count;
+};
+
+static const SeedFunction seedFunctions[] =
+{
+	{"memcpy", seedMemcpy, ARRAY_SIZE(seedMemcpy)},
+	{"memset", seedMemset, ARRAY_SIZE(seedMemset)},
+	{"strlen", seedStrlen, ARRAY_SIZE(seedStrlen)},
+};
+
+static bool MatchesSeed(u32 addr, u32 size, const SeedFunction &seed)
+{
+	if (size != (u32)seed.count * 4 || !Memory::IsValidAddress(addr) || !Memory::IsValidAddress(addr + size - 1))
+		return false;
+	for (int i = 0; i < seed.count; i++)
+	{
+		if (Memory::Read_U32(addr + i * 4) != seed.code[i])
+			return false;
+	}
+	return true;
+}
+
+// Only functions the scanner found get renamed, real symbols are left alone.
+static void NameSeedFunctions(u32 textStart, u32 textSize)
+{
+	for (int i = 0; i < symbolMap.GetNumSymbols(); i++)
+	{
+		u32 addr = symbolMap.GetSymbolAddr(i);
+		if (addr < textStart || addr >= textStart + textSize)
+			continue;
+		if (strncmp(symbolMap.GetSymbolName(i), "z_un_", 5) != 0)
+			continue;
+
+		for (size_t j = 0; j < ARRAY_SIZE(seedFunctions); j++)
+		{
+			if (MatchesSeed(addr, symbolMap.GetSymbolSize(i), seedFunctions[j]))
+			{
+				symbolMap.SetSymbolName(i, seedFunctions[j].name);
+				break;
+			}
+		}
+	}
+}
+
+static int GetReplacementIndex(const char *name)
+{
+	for (int i = 0; i < Replacement_GetNumEntries(); i++)
+	{
+		if (!strcmp(entries[i].name, name))
+			return i;
+	}
+	return -1;
+}
+
+void Replacement_Init()
+{
+	replacementDiscID.clear();
+}
+
+void Replacement_Shutdown()
+{
+	replacementDiscID.clear();
+}
+
+void Replacement_SetDiscID(const std::string &discID)
+{
+	replacementDiscID = discID;
+}
+
+static bool Replacement_IsEnabled()
+{
+	if (!g_Config.bFuncReplacements)
+		return false;
+	if (replacementDiscID.empty())
+		return true;
+
+	// Comma separated disc ids, for games that break with it.
+	const std::string &list = g_Config.sFuncReplacementsDisabled;
+	size_t pos = 0;
+	while (pos <= list.size())
+	{
+		size_t end = list.find(',', pos);
+		if (end == std::string::npos)
+			end = list.size();
+		if (list.compare(pos, end - pos, replacementDiscID) == 0)
+			return false;
+		pos = end + 1;
+	}
+	return true;
+}
+
+void Replacement_ApplyToModule(u32 textStart, u32 textSize)
+{
+	if (!Replacement_IsEnabled())
+		return;
+
+	// Names scanned functions that match known code or a known hash.  The file goes last, so it wins.
+	NameSeedFunctions(textStart, textSize);
+	if (!g_Config.sFuncHashMap.empty() && File::Exists(g_Config.sFuncHashMap))
+		MIPSAnalyst::LoadHashMap(g_Config.sFuncHashMap.c_str());
+
+	int replaced = 0;
+	for (int i = 0; i < symbolMap.GetNumSymbols(); i++)
+	{
+		u32 addr = symbolMap.GetSymbolAddr(i);
+		if (addr < textStart || addr >= textStart + textSize)
+			continue;
+		if (symbolMap.GetSymbolNum(addr, ST_FUNCTION) != i)
+			continue;
+
+		int index = GetReplacementIndex(symbolMap.GetSymbolName(i));
+		if (index < 0)
+			continue;
+
+		u32 op = Memory::Read_U32(addr);
+		if (MIPS_IS_EMUHACK(op))
+			continue;
+		Memory::Write_U32(MIPS_MAKE_EMUHACK(EMUOP_CALL_REPLACEMENT, index), addr);
+		DEBUG_LOG(HLE, "Replaced %s at %08x", entries[index].name, addr);
+		replaced++;
+	}
+
+	if (replaced)
+		INFO_LOG(HLE, "Replaced %i functions with native versions", replaced);
+}
+
+void Replacement_Call(u32 op)
+{
+	const ReplacementTableEntry *entry = Replacement_GetEntry(op & MIPS_EMUHACK_VALUE_MASK);
+	if (!entry)
+	{
+		ERROR_LOG(HLE, "Bad replacement function op %08x at %08x", op, currentMIPS->pc);
+		currentMIPS->pc += 4;
+		return;
+	}
+
+	int cycles = entry->replaceFunc();
+	CoreTiming::downcount -= cycles;
+	// Same as the jr ra the guest function would have ended with.
+	currentMIPS->pc = currentMIPS->r[MIPS_REG_RA];
+}
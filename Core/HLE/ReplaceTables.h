@@ -0,0 +1,52 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+
+#include "../../Globals.h"
+
+// Native replacements for well known guest functions (memcpy and friends).
+// Functions are recognized by name, either from the module's symbols or from
+// a function hash map (see MIPSAnalyst::LoadHashMap), and their first instruction
+// is overwritten with an EMUOP_CALL_REPLACEMENT emuhack.
+
+// Returns the number of cycles the guest function would have taken.
+typedef int (*ReplaceFunc)();
+
+struct ReplacementTableEntry
+{
+	const char *name;
+	ReplaceFunc replaceFunc;
+};
+
+void Replacement_Init();
+void Replacement_Shutdown();
+
+// The per game opt-out is keyed on this, set when PARAM.SFO is read.
+void Replacement_SetDiscID(const std::string &discID);
+
+// Called after a module is loaded and its functions are known.
+void Replacement_ApplyToModule(u32 textStart, u32 textSize);
+
+// Runs the replacement for an EMUOP_CALL_REPLACEMENT op and returns to the caller.
+// Used by both the interpreter and the jit.
+void Replacement_Call(u32 op);
+
+int Replacement_GetNumEntries();
+const ReplacementTableEntry *Replacement_GetEntry(int index);
@@ -78,6 +78,29 @@ void __AudioInit()
 		chans[i].clear();
 }
 
+void __AudioDoState(PointerWrap &p)
+{
+	section.lock();
+
+	p.Do(mixFrequency);
+	outAudioQueue.DoState(p);
+
+	int chanCount = (int)ARRAYSIZE(chans);
+	p.Do(chanCount);
+	if (chanCount != (int)ARRAYSIZE(chans))
+	{
+		ERROR_LOG(HLE, "Savestate failure: different number of audio channels.");
+		p.SetError(p.ERROR_FAILURE);
+		section.unlock();
+		return;
+	}
+	for (int i = 0; i < chanCount; ++i)
+		chans[i].DoState(p);
+
+	section.unlock();
+	p.DoMarker("sceAudio");
+}
+
 void __AudioShutdown()
 {
 	for (int i = 0; i < 8; i++)
@@ -76,6 +76,20 @@ struct AudioChannel
 		sampleCount = 0;
     sampleQueue.clear();
   }
+
+	void DoState(PointerWrap &p)
+	{
+		p.Do(reserved);
+		p.Do(sampleAddress);
+		p.Do(sampleCount);
+		p.Do(dataLen);
+		p.Do(leftVolume);
+		p.Do(rightVolume);
+		p.Do(format);
+		p.Do(waitingThread);
+		sampleQueue.DoState(p);
+		p.DoMarker("AudioChannel");
+	}
 };
 
 extern AudioChannel chans[8];
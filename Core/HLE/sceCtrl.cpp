@@ -18,6 +18,7 @@
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "../CoreTiming.h"
+#include "../Replay.h"
 #include "StdMutex.h"
 #include "sceCtrl.h"
 #include "sceDisplay.h"
@@ -83,6 +84,8 @@ void __CtrlUpdateLatch()
 {
 	std::lock_guard<std::recursive_mutex> guard(ctrlMutex);
 
+	Replay::ProcessCtrl(ctrlCurrent.buttons, ctrlCurrent.analog);
+
 	u32 changed = ctrlCurrent.buttons ^ ctrlOldButtons;
 	latch.btnMake |= ctrlCurrent.buttons & changed;
 	latch.btnBreak |= ctrlOldButtons & changed;
@@ -122,6 +125,9 @@ u32 __CtrlPeekButtons()
 {
 	std::lock_guard<std::recursive_mutex> guard(ctrlMutex);
 
+	// The host can change ctrlCurrent at any time, the last sample is repeatable.
+	if (Replay::IsActive())
+		return ctrlOldButtons;
 	return ctrlCurrent.buttons;
 }
 
@@ -253,6 +259,22 @@ void __CtrlInit()
 		memcpy(&ctrlBufs[i], &ctrlCurrent, sizeof(_ctrl_data));
 }
 
+void __CtrlDoState(PointerWrap &p)
+{
+	std::lock_guard<std::recursive_mutex> guard(ctrlMutex);
+
+	p.Do(analogEnabled);
+	p.Do(ctrlLatchBufs);
+	p.Do(ctrlOldButtons);
+	p.DoArray(ctrlBufs, NUM_CTRL_BUFFERS);
+	p.Do(ctrlCurrent);
+	p.Do(ctrlBuf);
+	p.Do(ctrlBufRead);
+	p.Do(latch);
+	p.Do(waitingThreads);
+	p.DoMarker("sceCtrl");
+}
+
 void sceCtrlInit()
 {
 	__CtrlInit();
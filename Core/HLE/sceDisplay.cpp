@@ -21,7 +21,6 @@
 // TODO: Move the relevant parts into common. Don't want the core
 // to be dependent on "native", I think. Or maybe should get rid of common
 // and move everything into native...
-#include "base/timeutil.h"
 
 #include "Thread.h"
 #include "../Core/CoreTiming.h"
@@ -32,6 +31,8 @@
 #include "../Config.h"
 #include "../System.h"
 #include "../Core/Core.h"
+#include "../Core/FramePacer.h"
+#include "../Core/Replay.h"
 #include "sceDisplay.h"
 #include "sceKernel.h"
 #include "sceKernelThread.h"
@@ -103,6 +104,8 @@ void __DisplayInit()
 	framebuf.pspFramebufFormat = PSP_DISPLAY_PIXEL_FORMAT_8888;
 	framebuf.pspFramebufLinesize = 480; // ??
 
+	FramePacer::Init();
+
 	enterVblankEvent = CoreTiming::RegisterEvent("EnterVBlank", &hleEnterVblank);
 	leaveVblankEvent = CoreTiming::RegisterEvent("LeaveVBlank", &hleLeaveVblank);
 
@@ -113,8 +116,26 @@ void __DisplayInit()
 	InitGfxState();
 }
 
+void __DisplayDoState(PointerWrap &p)
+{
+	p.Do(framebuf);
+	p.Do(latchedFramebuf);
+	p.Do(framebufIsLatched);
+	p.Do(hCount);
+	p.Do(hCountTotal);
+	p.Do(vCount);
+	p.Do(isVblank);
+	p.Do(hasSetMode);
+	p.Do(vblankWaitingThreads);
+
+	if (p.mode == p.MODE_READ)
+		gpu->SetDisplayFramebuffer(framebuf.topaddr, framebuf.pspFramebufLinesize, framebuf.pspFramebufFormat);
+	p.DoMarker("sceDisplay");
+}
+
 void __DisplayShutdown()
 {
+	FramePacer::Shutdown();
 	ShutdownGfxState();
 }
 
@@ -140,6 +161,8 @@ void hleEnterVblank(u64 userdata, int cyclesLate)
 
 	isVblank = 1;
 
+	Replay::ProcessVblank();
+
 	// Fire the vblank listeners before we wake threads.
 	__DisplayFireVblank();
 
@@ -174,9 +197,12 @@ void hleEnterVblank(u64 userdata, int cyclesLate)
 	if (g_Config.bShowDebugStats)
 	{
 		gpu->UpdateStats();
+		FramePacer::Stats pacerStats;
+		FramePacer::GetStats(pacerStats);
 		char stats[512];
 		sprintf(stats,
 			"Frames: %i\n"
+			"Frame time: %0.2f ms avg, %0.2f ms worst, %i late\n"
 			"Draw calls: %i\n"
 			"Vertices Transformed: %i\n"
 			"Textures active: %i\n"
@@ -184,6 +210,9 @@ void hleEnterVblank(u64 userdata, int cyclesLate)
 			"Fragment shaders loaded: %i\n"
 			"Combined shaders loaded: %i\n",
 			gpuStats.numFrames,
+			pacerStats.averageFrameMs,
+			pacerStats.worstFrameMs,
+			pacerStats.numLateFrames,
 			gpuStats.numDrawCalls,
 			gpuStats.numVertsTransformed,
 			gpuStats.numTextures,
@@ -204,20 +233,11 @@ void hleEnterVblank(u64 userdata, int cyclesLate)
 
 	host->EndFrame();
 
+	// Best place to throttle the frame rate on non vsynced platforms is probably here.
 #ifdef _WIN32
-	static double lastFrameTime = 0.0;
-	// Best place to throttle the frame rate on non vsynced platforms is probably here. Let's try it.
-	time_update();
-	if (lastFrameTime == 0.0)
-		lastFrameTime = time_now_d();
-	if (!GetAsyncKeyState(VK_TAB)) {
-		while (time_now_d() < lastFrameTime + 1.0 / 60.0f) {
-			Common::SleepCurrentThread(1);
-			time_update();
-		}
-		lastFrameTime = time_now_d();
-	}
+	FramePacer::SetUnthrottleHeld(GetAsyncKeyState(VK_TAB) != 0);
 #endif
+	FramePacer::EndFrame(frameMs);
 
 	host->BeginFrame();
 	gpu->BeginFrame();
@@ -225,11 +245,9 @@ void hleEnterVblank(u64 userdata, int cyclesLate)
 	shaderManager.DirtyShader();
 	shaderManager.DirtyUniform(DIRTY_ALL);
 
-	// Tell the emu core that it's time to stop emulating
-	// Win32 doesn't need this.
-#ifndef _WIN32
+	// Tell the emu core that it's time to stop emulating.
+	// This is also the safe point where pending save states get processed.
 	coreState = CORE_NEXTFRAME;
-#endif
 }
 
 
@@ -18,6 +18,7 @@
 #pragma once
 
 void __DisplayInit();
+void __DisplayDoState(PointerWrap &p);
 
 void Register_sceDisplay();
 
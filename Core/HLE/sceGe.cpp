@@ -33,6 +33,16 @@ void __GeInit()
 	state = 0;
 }
 
+void __GeDoState(PointerWrap &p)
+{
+	p.Do(state);
+	p.Do(gstate);
+	p.Do(gstate_c);
+
+	gpu->DoState(p);
+	p.DoMarker("sceGe");
+}
+
 void __GeShutdown()
 {
 
@@ -20,8 +20,14 @@
 #undef DeleteFile
 #endif
 
+#include <deque>
+#include <map>
+
+#include "../../Common/Thread.h"
 #include "../System.h"
 #include "../Config.h"
+#include "../CoreTiming.h"
+#include "../Replay.h"
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "../HW/MemoryStick.h"
@@ -44,8 +50,6 @@
 
 /*
 
-TODO: async io is missing features!
-
 flash0: - fat access - system file volume
 flash1: - fat access - configuration file volume
 flashfat#: this too
@@ -82,9 +86,14 @@ const std::string &EmuDebugOutput() {
 	return emuDebugOutput;
 }
 
-typedef u32 (*DeferredAction)(SceUID id, int param);
-DeferredAction defAction = 0;
-u32 defParam;
+void ClearEmuDebugOutput() {
+	emuDebugOutput.clear();
+}
+
+// Rough UMD drive characteristics, used when g_Config.bUMDTimingModel is on.
+const int UMD_SEEK_US = 20000;
+const int UMD_OPEN_US = 5000;
+const int UMD_BYTES_PER_SECOND = 1400 * 1024;
 
 #define SCE_STM_FDIR 0x1000
 #define SCE_STM_FREG 0x2000
@@ -125,11 +134,14 @@ struct dirent {
 };
 #endif
 
+static void __IoWaitIdle();
+
 class FileNode : public KernelObject {
 public:
-	FileNode() : callbackID(0), callbackArg(0), asyncResult(0), pendingAsyncResult(false), sectorBlockMode(false) {}
+	FileNode() : handle(0), openAccess(FILEACCESS_NONE), callbackID(0), callbackArg(0), asyncResult(0), pendingAsyncResult(false), closePending(false), sectorBlockMode(false), onUMD(false), umdSequential(false) {}
 	~FileNode() {
-		pspFileSystem.CloseFile(handle);
+		if (handle != 0)
+			pspFileSystem.CloseFile(handle);
 	}
 	const char *GetName() {return fullpath.c_str();}
 	const char *GetTypeName() {return "OpenFile";}
@@ -137,23 +149,217 @@ public:
 		sprintf(ptr, "Seekpos: %08x", (u32)pspFileSystem.GetSeekPos(handle));
 	}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_BADF; }
-	int GetIDType() const { return 0; }
+	static int GetStaticIDType() { return PPSSPP_KERNEL_TMID_File; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_File; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		// The I/O thread may be moving the seek position.
+		__IoWaitIdle();
+
+		p.Do(fullpath);
+		p.Do(openAccess);
+		p.Do(callbackID);
+		p.Do(callbackArg);
+		p.Do(asyncResult);
+		p.Do(pendingAsyncResult);
+		p.Do(closePending);
+		p.Do(sectorBlockMode);
+		p.Do(onUMD);
+		p.Do(umdSequential);
+		p.Do(waitingThreads);
+
+		// Host handles don't survive, so reopen the file and seek back to where we were.
+		bool isOpen = handle != 0;
+		u32 seekPos = isOpen ? (u32)pspFileSystem.GetSeekPos(handle) : 0;
+		p.Do(isOpen);
+		p.Do(seekPos);
+		if (p.mode == p.MODE_READ && isOpen)
+		{
+			handle = pspFileSystem.OpenFile(fullpath, (FileAccess)(openAccess | FILEACCESS_REOPEN));
+			if (handle == 0) {
+				WARN_LOG(HLE, "Save state: unable to reopen %s", fullpath.c_str());
+			} else {
+				pspFileSystem.SeekFile(handle, (s32)seekPos, FILEMOVE_BEGIN);
+			}
+		}
+		p.DoMarker("FileNode");
+	}
 
 	std::string fullpath;
 	u32 handle;
+	FileAccess openAccess;
 
 	u32 callbackID;
 	u32 callbackArg;
 
-	u32 asyncResult;
+	s64 asyncResult;
 
 	bool pendingAsyncResult;
+	// An async close finished; the node goes away once the result has been collected.
+	bool closePending;
 	bool sectorBlockMode;
+
+	bool onUMD;
+	bool umdSequential;
+
+	std::vector<SceUID> waitingThreads;
 };
 
-void __IoInit() {
-	INFO_LOG(HLE, "Starting up I/O...");
+enum IoAsyncOp {
+	IOASYNC_OPEN,
+	IOASYNC_READ,
+	IOASYNC_WRITE,
+	IOASYNC_SEEK,
+	IOASYNC_CLOSE,
+};
+
+// Handed to the I/O thread. It never touches guest memory or kernel objects,
+// reads land in buffer and are copied out when the completion event fires.
+struct IoAsyncRequest {
+	SceUID id;
+	IoAsyncOp op;
+	u32 handle;
+	std::string filename;
+	FileAccess access;
+	u32 dataAddr;
+	s64 size;  // Offset for seeks.
+	FileMove whence;
+	int latencyCycles;
+	std::vector<u8> buffer;
+	s64 result;
+};
+
+static std::thread *ioThread = 0;
+static std::mutex ioLock;
+static std::condition_variable ioCond;
+static std::deque<IoAsyncRequest *> ioPending;
+static std::map<SceUID, IoAsyncRequest *> ioCompleted;
+static std::condition_variable ioIdleCond;
+static bool ioBusy = false;
+static bool ioThreadExit = false;
+static int asyncNotifyEvent = -1;
+static SceUID lastUMDFile = 0;
+
+void __IoAsyncNotify(u64 userdata, int cyclesLate);
+
+static void __IoRunAsync(IoAsyncRequest *req) {
+	switch (req->op) {
+	case IOASYNC_OPEN:
+		req->handle = pspFileSystem.OpenFile(req->filename, req->access);
+		req->result = req->handle == 0 ? (s64)ERROR_ERRNO_FILE_NOT_FOUND : req->id;
+		break;
+	case IOASYNC_READ:
+		req->buffer.resize((size_t)req->size);
+		req->result = req->size <= 0 ? 0 : (s64)pspFileSystem.ReadFile(req->handle, &req->buffer[0], req->size);
+		break;
+	case IOASYNC_WRITE:
+		req->result = req->buffer.empty() ? 0 : (s64)pspFileSystem.WriteFile(req->handle, &req->buffer[0], req->buffer.size());
+		break;
+	case IOASYNC_SEEK:
+		req->result = (s64)pspFileSystem.SeekFile(req->handle, (s32)req->size, req->whence);
+		break;
+	case IOASYNC_CLOSE:
+		pspFileSystem.CloseFile(req->handle);
+		req->result = 0;
+		break;
+	}
+}
+
+static void __IoThreadFunc(void *) {
+	Common::SetCurrentThreadName("IoAsyncThread");
+
+	std::unique_lock<std::mutex> guard(ioLock);
+	while (true) {
+		while (ioPending.empty() && !ioThreadExit)
+			ioCond.wait(guard);
+		if (ioThreadExit)
+			break;
+
+		IoAsyncRequest *req = ioPending.front();
+		ioPending.pop_front();
+		ioBusy = true;
+
+		guard.unlock();
+		__IoRunAsync(req);
+		guard.lock();
+
+		ioCompleted[req->id] = req;
+		CoreTiming::ScheduleEvent_Threadsafe(req->latencyCycles, asyncNotifyEvent, req->id);
+		ioBusy = false;
+		ioIdleCond.notify_all();
+	}
+}
+
+// Blocks until the I/O thread has finished everything queued so far.
+// Only called from the emu thread, so nothing new can be queued meanwhile.
+static void __IoWaitIdle() {
+	std::unique_lock<std::mutex> guard(ioLock);
+	while (ioThread != 0 && (ioBusy || !ioPending.empty()))
+		ioIdleCond.wait(guard);
+}
+
+static int __IoAsyncLatency(FileNode *f, IoAsyncOp op, s64 size) {
+	if (!g_Config.bUMDTimingModel || !f->onUMD)
+		return 0;
+
+	int us = 0;
+	switch (op) {
+	case IOASYNC_OPEN:
+		us = UMD_OPEN_US;
+		break;
+	case IOASYNC_READ:
+		// Continuing a read of the same file doesn't need the head to move.
+		if (!f->umdSequential || lastUMDFile != f->GetUID())
+			us += UMD_SEEK_US;
+		us += (int)(size * 1000000 / UMD_BYTES_PER_SECOND);
+		lastUMDFile = f->GetUID();
+		break;
+	default:
+		break;
+	}
+
+	f->umdSequential = op == IOASYNC_READ;
+	return (int)usToCycles(us);
+}
+
+static void __IoQueueAsync(FileNode *f, IoAsyncRequest *req) {
+	req->id = f->GetUID();
+	req->latencyCycles = __IoAsyncLatency(f, req->op, req->size);
+	f->pendingAsyncResult = true;
 
+	{
+		std::lock_guard<std::mutex> guard(ioLock);
+		ioPending.push_back(req);
+		ioCond.notify_one();
+	}
+
+	// The completion is scheduled from the I/O thread, at whatever guest time it finishes.
+	if (Replay::IsActive())
+		__IoWaitIdle();
+}
+
+static FileAccess __IoModeToAccess(int mode) {
+	int access = FILEACCESS_NONE;
+	if (mode & O_RDONLY)
+		access |= FILEACCESS_READ;
+	if (mode & O_WRONLY)
+		access |= FILEACCESS_WRITE;
+	if (mode & O_APPEND)
+		access |= FILEACCESS_APPEND;
+	if (mode & O_CREAT)
+		access |= FILEACCESS_CREATE;
+	return (FileAccess) access;
+}
+
+static bool __IoIsUMDPath(const std::string &filename) {
+	std::string lower = filename.substr(0, 4);
+	for (size_t i = 0; i < lower.size(); i++)
+		lower[i] = tolower(lower[i]);
+	return lower.compare(0, 3, "umd") == 0 || lower == "disc";
+}
+
+static void __IoMountMemstickAndFlash(bool mountFlash) {
 #ifdef _WIN32
 
 	char path_buffer[_MAX_PATH], drive[_MAX_DRIVE] ,dir[_MAX_DIR], file[_MAX_FNAME], ext[_MAX_EXT];
@@ -179,20 +385,135 @@ void __IoInit() {
 	std::string flashpath = g_Config.flashDirectory;
 #endif
 
-	DirectoryFileSystem *memstick;
-	DirectoryFileSystem *flash;
-
-	memstick = new DirectoryFileSystem(&pspFileSystem, memstickpath);
-	flash = new DirectoryFileSystem(&pspFileSystem, flashpath);
+	DirectoryFileSystem *memstick = new DirectoryFileSystem(&pspFileSystem, memstickpath);
 	pspFileSystem.Mount("ms0:", memstick);
 	pspFileSystem.Mount("fatms0:", memstick);
 	pspFileSystem.Mount("fatms:", memstick);
-	pspFileSystem.Mount("flash0:", flash);
-	pspFileSystem.Mount("flash1:", flash);
+	if (mountFlash) {
+		DirectoryFileSystem *flash = new DirectoryFileSystem(&pspFileSystem, flashpath);
+		pspFileSystem.Mount("flash0:", flash);
+		pspFileSystem.Mount("flash1:", flash);
+	}
+}
+
+void __IoInit() {
+	INFO_LOG(HLE, "Starting up I/O...");
+	emuDebugOutput.clear();
+
+	// They stay mounted across a loadexec, the first mount of a prefix wins anyway.
+	if (!pspFileSystem.GetSystem("ms0:"))
+		__IoMountMemstickAndFlash(true);
+
+	asyncNotifyEvent = CoreTiming::RegisterEvent("IoAsyncNotify", __IoAsyncNotify);
+	lastUMDFile = 0;
+	ioThreadExit = false;
+	ioThread = new std::thread(__IoThreadFunc, (void *)0);
+}
+
+void __IoRemountMemstick() {
+	__IoWaitIdle();
+
+	IFileSystem *memstick = pspFileSystem.GetSystem("ms0:");
+	if (memstick) {
+		// Closes whatever the last run left open on it.
+		pspFileSystem.Unmount(memstick);
+		delete memstick;
+	}
+	__IoMountMemstickAndFlash(false);
+}
+
+void __IoBeforeFork() {
+	__IoWaitIdle();
+	ioLock.lock();
+}
+
+void __IoAfterFork(bool child) {
+	if (child && ioThread) {
+		// Only the forking thread exists in the child. The old thread object is
+		// left alone, there's nothing to join.
+		ioThread = new std::thread(__IoThreadFunc, (void *)0);
+	}
+	ioLock.unlock();
+}
+
+void __IoDoState(PointerWrap &p) {
+	__IoWaitIdle();
+
+	// Finished requests still have their notify event scheduled, which CoreTiming saves.
+	std::lock_guard<std::mutex> guard(ioLock);
+	if (p.mode == p.MODE_READ) {
+		for (std::map<SceUID, IoAsyncRequest *>::iterator it = ioCompleted.begin(); it != ioCompleted.end(); ++it) {
+			// Nobody waited for the open, so the handle was never handed to its node.
+			if (it->second->op == IOASYNC_OPEN && it->second->handle != 0)
+				pspFileSystem.CloseFile(it->second->handle);
+			delete it->second;
+		}
+		ioCompleted.clear();
+	}
+
+	u32 count = (u32)ioCompleted.size();
+	p.Do(count);
+	std::map<SceUID, IoAsyncRequest *>::iterator it = ioCompleted.begin();
+	for (u32 i = 0; i < count; i++) {
+		IoAsyncRequest *req = p.mode == p.MODE_READ ? new IoAsyncRequest() : (it++)->second;
+		p.Do(req->id);
+		p.Do(req->op);
+		p.Do(req->filename);
+		p.Do(req->access);
+		p.Do(req->dataAddr);
+		p.Do(req->buffer);
+		p.Do(req->result);
+
+		if (p.mode == p.MODE_READ) {
+			req->handle = 0;
+			u32 error;
+			FileNode *f = kernelObjects.Get<FileNode>(req->id, error);
+			if (req->op == IOASYNC_OPEN && req->result > 0)
+				req->handle = pspFileSystem.OpenFile(req->filename, (FileAccess)(req->access | FILEACCESS_REOPEN));
+			else if (req->op == IOASYNC_CLOSE && f && f->handle != 0) {
+				// It was closed already, but the node reopened it while loading.
+				pspFileSystem.CloseFile(f->handle);
+			}
+			ioCompleted[req->id] = req;
+		}
+	}
+
+	p.Do(lastUMDFile);
+	p.DoMarker("sceIo");
 }
 
 void __IoShutdown() {
+	if (ioThread) {
+		// Let queued requests finish, so writes aren't lost, before stopping the thread.
+		__IoWaitIdle();
+		{
+			std::lock_guard<std::mutex> guard(ioLock);
+			ioThreadExit = true;
+			ioCond.notify_one();
+		}
+		ioThread->join();
+		delete ioThread;
+		ioThread = 0;
+	}
 
+	for (size_t i = 0; i < ioPending.size(); i++)
+		delete ioPending[i];
+	ioPending.clear();
+	for (std::map<SceUID, IoAsyncRequest *>::iterator it = ioCompleted.begin(); it != ioCompleted.end(); ++it) {
+		// Nothing will pick up a handle opened after the game last looked, and a closed one
+		// mustn't be closed again by its FileNode.
+		IoAsyncRequest *req = it->second;
+		if (req->op == IOASYNC_OPEN && req->handle != 0)
+			pspFileSystem.CloseFile(req->handle);
+		if (req->op == IOASYNC_CLOSE) {
+			u32 error;
+			FileNode *f = kernelObjects.Get<FileNode>(req->id, error);
+			if (f)
+				f->handle = 0;
+		}
+		delete req;
+	}
+	ioCompleted.clear();
 }
 
 u32 sceIoAssign(const char *aliasname, const char *physname, const char *devname, u32 flag) {
@@ -216,14 +537,80 @@ u32 sceKernelStderr() {
 	return 2;
 }
 
-void __IoCompleteAsyncIO(SceUID id) {
+// Hands the result of the last async operation to the game.
+static void __IoCollectAsyncResult(SceUID id, FileNode *f, u32 address) {
+	if (Memory::IsValidAddress(address))
+		Memory::Write_U64((u64) f->asyncResult, address);
+	if (f->closePending)
+		kernelObjects.Destroy<FileNode>(id);
+}
+
+// Runs on the CPU thread once the I/O thread is done with a request.
+void __IoAsyncNotify(u64 userdata, int cyclesLate) {
+	SceUID id = (SceUID) userdata;
+
+	IoAsyncRequest *req = 0;
+	{
+		std::lock_guard<std::mutex> guard(ioLock);
+		std::map<SceUID, IoAsyncRequest *>::iterator it = ioCompleted.find(id);
+		if (it == ioCompleted.end())
+			return;
+		req = it->second;
+		ioCompleted.erase(it);
+	}
+
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
-	if (f) {
-		if (f->callbackID) {
-			// __KernelNotifyCallbackType(THREAD_CALLBACK_IO, __KernelGetCurThread(), f->callbackID, f->callbackArg);
-		}
+	if (!f) {
+		if (req->op == IOASYNC_OPEN && req->handle != 0)
+			pspFileSystem.CloseFile(req->handle);
+		delete req;
+		return;
+	}
+
+	switch (req->op) {
+	case IOASYNC_OPEN:
+		f->handle = req->handle;
+		break;
+	case IOASYNC_READ:
+		if (req->result > 0 && Memory::IsValidAddress(req->dataAddr))
+			Memory::Memcpy(req->dataAddr, &req->buffer[0], (u32) req->result);
+		break;
+	case IOASYNC_CLOSE:
+		f->handle = 0;
+		f->closePending = true;
+		break;
+	default:
+		break;
 	}
+
+	f->asyncResult = req->result;
+	f->pendingAsyncResult = false;
+	delete req;
+
+	DEBUG_LOG(HLE, "Async I/O on %i complete: %i", id, (int) f->asyncResult);
+
+	if (f->callbackID)
+		__KernelNotifyCallback(THREAD_CALLBACK_IO, f->callbackID, f->callbackArg);
+
+	std::vector<SceUID> waiting;
+	waiting.swap(f->waitingThreads);
+	bool collected = false;
+	for (size_t i = 0; i < waiting.size(); i++) {
+		SceUID threadID = waiting[i];
+		// Make sure it didn't get woken or something.
+		if (__KernelGetWaitID(threadID, WAITTYPE_IO, error) != id)
+			continue;
+
+		u32 address = __KernelGetWaitValue(threadID, error);
+		if (Memory::IsValidAddress(address))
+			Memory::Write_U64((u64) f->asyncResult, address);
+		__KernelResumeThreadFromWait(threadID, 0);
+		collected = true;
+	}
+
+	if (collected && f->closePending)
+		kernelObjects.Destroy<FileNode>(id);
 }
 
 void __IoGetStat(SceIoStat *stat, PSPFileInfo &info) {
@@ -264,13 +651,17 @@ u32 sceIoRead(int id, u32 data_addr, int size) {
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f) {
+		if (f->pendingAsyncResult) {
+			ERROR_LOG(HLE, "sceIoRead(%d): async operation still pending", id);
+			return SCE_KERNEL_ERROR_ASYNC_BUSY;
+		}
 		if (data_addr) {
 			u8 *data = (u8*) Memory::GetPointer(data_addr);
 			f->asyncResult = (u32) pspFileSystem.ReadFile(f->handle, data,
 					size);
-			DEBUG_LOG(HLE, "%i=sceIoRead(%d, %08x , %i)", f->asyncResult, id,
+			DEBUG_LOG(HLE, "%i=sceIoRead(%d, %08x , %i)", (u32) f->asyncResult, id,
 					data_addr, size);
-			return f->asyncResult;
+			return (u32) f->asyncResult;
 		} else {
 			ERROR_LOG(HLE, "sceIoRead Reading into zero pointer");
 			return -1;
@@ -300,9 +691,13 @@ u32 sceIoWrite(int id, void *data_ptr, int size) //(int fd, void *data, int size
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f) {
+		if (f->pendingAsyncResult) {
+			ERROR_LOG(HLE, "sceIoWrite(%d): async operation still pending", id);
+			return SCE_KERNEL_ERROR_ASYNC_BUSY;
+		}
 		u8 *data = (u8*) data_ptr;
 		f->asyncResult = (u32) pspFileSystem.WriteFile(f->handle, data, size);
-		return f->asyncResult;
+		return (u32) f->asyncResult;
 	} else {
 		ERROR_LOG(HLE, "sceIoWrite ERROR: no file open");
 		return error;
@@ -313,6 +708,10 @@ s64 sceIoLseek(int id, s64 offset, int whence) {
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f) {
+		if (f->pendingAsyncResult) {
+			ERROR_LOG(HLE, "sceIoLseek(%d): async operation still pending", id);
+			return SCE_KERNEL_ERROR_ASYNC_BUSY;
+		}
 		FileMove seek = FILEMOVE_BEGIN;
 		switch (whence) {
 		case 0:
@@ -327,7 +726,8 @@ s64 sceIoLseek(int id, s64 offset, int whence) {
 
 		f->asyncResult = (u32) pspFileSystem.SeekFile(f->handle, (s32) offset,
 				seek);
-		DEBUG_LOG(HLE, "%i = sceIoLseek(%d,%i,%i)", f->asyncResult, id,
+		f->umdSequential = false;
+		DEBUG_LOG(HLE, "%i = sceIoLseek(%d,%i,%i)", (u32) f->asyncResult, id,
 				(int) offset, whence);
 		return f->asyncResult;
 	} else {
@@ -342,6 +742,10 @@ u32 sceIoLseek32(int id, int offset, int whence) {
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f) {
 		DEBUG_LOG(HLE, "sceIoLseek32(%d,%08x,%i)", id, (int) offset, whence);
+		if (f->pendingAsyncResult) {
+			ERROR_LOG(HLE, "sceIoLseek32(%d): async operation still pending", id);
+			return SCE_KERNEL_ERROR_ASYNC_BUSY;
+		}
 
 		FileMove seek = FILEMOVE_BEGIN;
 		switch (whence) {
@@ -357,7 +761,8 @@ u32 sceIoLseek32(int id, int offset, int whence) {
 
 		f->asyncResult = (u32) pspFileSystem.SeekFile(f->handle, (s32) offset,
 				seek);
-		return f->asyncResult;
+		f->umdSequential = false;
+		return (u32) f->asyncResult;
 	} else {
 		ERROR_LOG(HLE, "sceIoLseek32 ERROR: no file open");
 		return error;
@@ -366,17 +771,7 @@ u32 sceIoLseek32(int id, int offset, int whence) {
 
 u32 sceIoOpen(const char* filename, int mode) {
 	//memory stick filename
-	int access = FILEACCESS_NONE;
-	if (mode & O_RDONLY)
-		access |= FILEACCESS_READ;
-	if (mode & O_WRONLY)
-		access |= FILEACCESS_WRITE;
-	if (mode & O_APPEND)
-		access |= FILEACCESS_APPEND;
-	if (mode & O_CREAT)
-		access |= FILEACCESS_CREATE;
-
-	u32 h = pspFileSystem.OpenFile(filename, (FileAccess) access);
+	u32 h = pspFileSystem.OpenFile(filename, __IoModeToAccess(mode));
 	if (h == 0)
 	{
 		ERROR_LOG(HLE,
@@ -388,14 +783,22 @@ u32 sceIoOpen(const char* filename, int mode) {
 	FileNode *f = new FileNode();
 	SceUID id = kernelObjects.Create(f);
 	f->handle = h;
+	f->openAccess = __IoModeToAccess(mode);
 	f->fullpath = filename;
 	f->asyncResult = id;
+	f->onUMD = __IoIsUMDPath(filename);
 	DEBUG_LOG(HLE, "%i=sceIoOpen(%s, %08x)", id, filename, mode);
 	return id;
 }
 
 u32 sceIoClose(int id) {
 	DEBUG_LOG(HLE, "sceIoClose(%d)", id);
+	u32 error;
+	FileNode *f = kernelObjects.Get < FileNode > (id, error);
+	if (f && f->pendingAsyncResult) {
+		ERROR_LOG(HLE, "sceIoClose(%d): async operation still pending", id);
+		return SCE_KERNEL_ERROR_ASYNC_BUSY;
+	}
 	return kernelObjects.Destroy < FileNode > (id);
 }
 
@@ -663,27 +1066,67 @@ void sceIoChangeAsyncPriority()
 	RETURN(0);
 }
 
-u32 __IoClose(SceUID id, int param)
+// Common checks for starting an async operation on a file.
+static FileNode *__IoGetAsyncFile(int id, const char *func, u32 &error) {
+	FileNode *f = kernelObjects.Get < FileNode > (id, error);
+	if (!f) {
+		ERROR_LOG(HLE, "%s(%d): bad file", func, id);
+		return 0;
+	}
+	if (f->pendingAsyncResult || f->closePending) {
+		ERROR_LOG(HLE, "%s(%d): async operation still pending", func, id);
+		error = SCE_KERNEL_ERROR_ASYNC_BUSY;
+		return 0;
+	}
+	return f;
+}
+
+u32 sceIoCloseAsync(int id)
 {
-	DEBUG_LOG(HLE, "Deferred IoClose(%d)", id);
-	__IoCompleteAsyncIO(id);
-	return kernelObjects.Destroy < FileNode > (id);
+	DEBUG_LOG(HLE, "sceIoCloseAsync(%d)", id);
+	u32 error;
+	FileNode *f = __IoGetAsyncFile(id, "sceIoCloseAsync", error);
+	if (!f)
+		return error;
+
+	IoAsyncRequest *req = new IoAsyncRequest();
+	req->op = IOASYNC_CLOSE;
+	req->handle = f->handle;
+	req->size = 0;
+	__IoQueueAsync(f, req);
+	return 0;
 }
 
-//TODO Not really sure if this should be wrapped nor how
-void sceIoCloseAsync()
+static u32 __IoSeekAsync(int id, s64 offset, int whence, const char *func)
 {
-	DEBUG_LOG(HLE, "sceIoCloseAsync(%d)", PARAM(0));
-	//sceIoClose();
-	defAction = &__IoClose;
-	RETURN(0);
+	u32 error;
+	FileNode *f = __IoGetAsyncFile(id, func, error);
+	if (!f)
+		return error;
+
+	IoAsyncRequest *req = new IoAsyncRequest();
+	req->op = IOASYNC_SEEK;
+	req->handle = f->handle;
+	req->size = offset;
+	switch (whence) {
+	case 1:
+		req->whence = FILEMOVE_CURRENT;
+		break;
+	case 2:
+		req->whence = FILEMOVE_END;
+		break;
+	default:
+		req->whence = FILEMOVE_BEGIN;
+		break;
+	}
+	__IoQueueAsync(f, req);
+	return 0;
 }
 
 u32 sceIoLseekAsync(int id, s64 offset, int whence)
 {
-	sceIoLseek(id, offset, whence);
-	__IoCompleteAsyncIO(id);
-	return 0;
+	DEBUG_LOG(HLE, "sceIoLseekAsync(%d, %i, %i)", id, (int) offset, whence);
+	return __IoSeekAsync(id, offset, whence, "sceIoLseekAsync");
 }
 
 u32 sceIoSetAsyncCallback(int id, u32 clbckId, u32 clbckArg)
@@ -707,38 +1150,97 @@ u32 sceIoSetAsyncCallback(int id, u32 clbckId, u32 clbckArg)
 
 u32 sceIoLseek32Async(int id, int offset, int whence)
 {
-	DEBUG_LOG(HLE, "sceIoLseek32Async(%d) sorta implemented", id);
-	sceIoLseek32(id, offset, whence);
-	__IoCompleteAsyncIO(id);
-	return 0;
+	DEBUG_LOG(HLE, "sceIoLseek32Async(%d, %08x, %i)", id, offset, whence);
+	return __IoSeekAsync(id, offset, whence, "sceIoLseek32Async");
 }
 
-void sceIoOpenAsync(const char *filename, int mode)
+u32 sceIoOpenAsync(const char *filename, int mode)
 {
-	DEBUG_LOG(HLE, "sceIoOpenAsync() sorta implemented");
-    RETURN(sceIoOpen(filename, mode));
-//	__IoCompleteAsyncIO(currentMIPS->r[2]);	// The return value
-	// We have to return a UID here, which may have been destroyed when we reach Wait if it failed.
-	// Now that we're just faking it, we just don't RETURN(0) here.
+	// The UID has to be handed out right away, the open itself happens on the I/O thread.
+	FileNode *f = new FileNode();
+	SceUID id = kernelObjects.Create(f);
+	f->openAccess = __IoModeToAccess(mode);
+	f->fullpath = filename;
+	f->asyncResult = id;
+	f->onUMD = __IoIsUMDPath(filename);
+	DEBUG_LOG(HLE, "%i=sceIoOpenAsync(%s, %08x)", id, filename, mode);
+
+	IoAsyncRequest *req = new IoAsyncRequest();
+	req->op = IOASYNC_OPEN;
+	req->filename = filename;
+	req->access = __IoModeToAccess(mode);
+	req->handle = 0;
+	req->size = 0;
+	__IoQueueAsync(f, req);
+	return id;
 }
 
 u32 sceIoReadAsync(int id, u32 data_addr, int size)
 {
-	DEBUG_LOG(HLE, "sceIoReadAsync(%d)", id);
-	sceIoRead(id, data_addr, size);
-	__IoCompleteAsyncIO(id);
+	DEBUG_LOG(HLE, "sceIoReadAsync(%d, %08x, %i)", id, data_addr, size);
+	u32 error;
+	FileNode *f = __IoGetAsyncFile(id, "sceIoReadAsync", error);
+	if (!f)
+		return error;
+	if (!Memory::IsValidAddress(data_addr) || size < 0) {
+		ERROR_LOG(HLE, "sceIoReadAsync(%d): bad buffer %08x (%i bytes)", id, data_addr, size);
+		return -1;
+	}
+
+	IoAsyncRequest *req = new IoAsyncRequest();
+	req->op = IOASYNC_READ;
+	req->handle = f->handle;
+	req->dataAddr = data_addr;
+	req->size = size;
+	__IoQueueAsync(f, req);
+	return 0;
+}
+
+u32 sceIoWriteAsync(int id, u32 data_addr, int size)
+{
+	DEBUG_LOG(HLE, "sceIoWriteAsync(%d, %08x, %i)", id, data_addr, size);
+	u32 error;
+	FileNode *f = __IoGetAsyncFile(id, "sceIoWriteAsync", error);
+	if (!f)
+		return error;
+	if (!Memory::IsValidAddress(data_addr) || size < 0) {
+		ERROR_LOG(HLE, "sceIoWriteAsync(%d): bad buffer %08x (%i bytes)", id, data_addr, size);
+		return -1;
+	}
+
+	// Snapshot the data now, the game is free to reuse the buffer once we return.
+	IoAsyncRequest *req = new IoAsyncRequest();
+	req->op = IOASYNC_WRITE;
+	req->handle = f->handle;
+	req->size = size;
+	const u8 *data = Memory::GetPointer(data_addr);
+	req->buffer.assign(data, data + size);
+	__IoQueueAsync(f, req);
 	return 0;
 }
 
-u32 sceIoGetAsyncStat(int id, u32 address, u32 uknwn)
+u32 sceIoGetAsyncStat(int id, u32 poll, u32 address)
 {
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f)
 	{
-		Memory::Write_U64(f->asyncResult, address);
-		DEBUG_LOG(HLE, "%i = sceIoGetAsyncStat(%i, %i, %08x) (HACK)",
-				(u32) f->asyncResult, id, address, uknwn);
+		if (f->pendingAsyncResult)
+		{
+			if (poll)
+			{
+				DEBUG_LOG(HLE, "1 = sceIoGetAsyncStat(%i, %i, %08x): not done yet", id, poll, address);
+				return 1;
+			}
+			DEBUG_LOG(HLE, "sceIoGetAsyncStat(%i, %i, %08x): waiting", id, poll, address);
+			f->waitingThreads.push_back(__KernelGetCurThread());
+			__KernelWaitCurThread(WAITTYPE_IO, id, address, 0, false);
+			return 0;
+		}
+
+		DEBUG_LOG(HLE, "%i = sceIoGetAsyncStat(%i, %i, %08x)",
+				(u32) f->asyncResult, id, poll, address);
+		__IoCollectAsyncResult(id, f, address);
 		return 0; //completed
 	}
 	else
@@ -752,14 +1254,15 @@ void sceIoWaitAsync(int id, u32 address, u32 uknwn) {
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f) {
-		u64 res = f->asyncResult;
-		if (defAction) {
-			res = defAction(id, defParam);
-			defAction = 0;
+		if (f->pendingAsyncResult) {
+			DEBUG_LOG(HLE, "sceIoWaitAsync(%i, %08x): waiting", id, address);
+			f->waitingThreads.push_back(__KernelGetCurThread());
+			__KernelWaitCurThread(WAITTYPE_IO, id, address, 0, false);
+			return;
 		}
-		Memory::Write_U64(res, address);
-		DEBUG_LOG(HLE, "%i = sceIoWaitAsync(%i, %08x) (HACK)", (u32) res, id,
-				uknwn);
+		DEBUG_LOG(HLE, "%i = sceIoWaitAsync(%i, %08x)", (u32) f->asyncResult, id,
+				address);
+		__IoCollectAsyncResult(id, f, address);
 		RETURN(0); //completed
 	} else {
 		ERROR_LOG(HLE, "ERROR - sceIoWaitAsync waiting for invalid id %i", id);
@@ -768,22 +1271,24 @@ void sceIoWaitAsync(int id, u32 address, u32 uknwn) {
 }
 
 void sceIoWaitAsyncCB(int id, u32 address) {
-	// Should process callbacks here
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f) {
-		u64 res = f->asyncResult;
-		if (defAction) {
-			res = defAction(id, defParam);
-			defAction = 0;
+		if (f->pendingAsyncResult) {
+			DEBUG_LOG(HLE, "sceIoWaitAsyncCB(%i, %08x): waiting", id, address);
+			f->waitingThreads.push_back(__KernelGetCurThread());
+			__KernelWaitCurThread(WAITTYPE_IO, id, address, 0, true);
+			return;
 		}
-		Memory::Write_U64(res, address);
-		DEBUG_LOG(HLE, "%i = sceIoWaitAsyncCB(%i, %08x) (HACK)", (u32) res, id,
+		DEBUG_LOG(HLE, "%i = sceIoWaitAsyncCB(%i, %08x)", (u32) f->asyncResult, id,
 				address);
+		__IoCollectAsyncResult(id, f, address);
 		RETURN(0); //completed
+		hleCheckCurrentCallbacks();
 	} else {
 		ERROR_LOG(HLE, "ERROR - sceIoWaitAsyncCB waiting for invalid id %i",
 				id);
+		RETURN(-1);
 	}
 }
 
@@ -791,14 +1296,13 @@ u32 sceIoPollAsync(int id, u32 address) {
 	u32 error;
 	FileNode *f = kernelObjects.Get < FileNode > (id, error);
 	if (f) {
-		u64 res = f->asyncResult;
-		if (defAction) {
-			res = defAction(id, defParam);
-			defAction = 0;
+		if (f->pendingAsyncResult) {
+			DEBUG_LOG(HLE, "1 = sceIoPollAsync(%i, %08x): not done yet", id, address);
+			return 1;
 		}
-		Memory::Write_U64(res, address);
-		DEBUG_LOG(HLE, "%i = sceIoPollAsync(%i, %08x) (HACK)", (u32) res, id,
+		DEBUG_LOG(HLE, "%i = sceIoPollAsync(%i, %08x)", (u32) f->asyncResult, id,
 				address);
+		__IoCollectAsyncResult(id, f, address);
 		return 0; //completed
 	} else {
 		ERROR_LOG(HLE, "ERROR - sceIoPollAsync waiting for invalid id %i", id);
@@ -811,13 +1315,37 @@ public:
 	const char *GetName() {return name.c_str();}
 	const char *GetTypeName() {return "DirListing";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_BADF; }
-	int GetIDType() const { return 0; }
+	static int GetStaticIDType() { return PPSSPP_KERNEL_TMID_DirList; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_DirList; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(name);
+		p.Do(index);
+
+		int count = (int)listing.size();
+		p.Do(count);
+		listing.resize(count);
+		for (int i = 0; i < count; ++i)
+			listing[i].DoState(p);
+		p.DoMarker("DirListing");
+	}
 
 	std::string name;
 	std::vector<PSPFileInfo> listing;
 	int index;
 };
 
+KernelObject *__KernelFileNodeObject()
+{
+	return new FileNode;
+}
+
+KernelObject *__KernelDirListingObject()
+{
+	return new DirListing;
+}
+
 u32 sceIoDopen(const char *path) {
 	DEBUG_LOG(HLE, "sceIoDopen(\"%s\")", path);
 
@@ -888,7 +1416,7 @@ const HLEFunction IoFileMgrForUser[] = {
 	{ 0xe8bc6571, 0, "sceIoCancel" },
 	{ 0xb293727f, sceIoChangeAsyncPriority, "sceIoChangeAsyncPriority" },
 	{ 0x810C4BC3, &WrapU_I<sceIoClose>, "sceIoClose" }, //(int fd);
-	{ 0xff5940b6, sceIoCloseAsync, "sceIoCloseAsync" },
+	{ 0xff5940b6, &WrapU_I<sceIoCloseAsync>, "sceIoCloseAsync" },
 	{ 0x54F5FB11, &WrapU_CIUIUI<sceIoDevctl>, "sceIoDevctl" }, //(const char *name int cmd, void *arg, size_t arglen, void *buf, size_t *buflen);
 	{ 0xcb05f8d6, &WrapU_IUU<sceIoGetAsyncStat>, "sceIoGetAsyncStat" },
 	{ 0x27EB27B8, &WrapI64_II64I<sceIoLseek>, "sceIoLseek" }, //(int fd, int offset, int whence);
@@ -896,7 +1424,7 @@ const HLEFunction IoFileMgrForUser[] = {
 	{ 0x1b385d8f, &WrapU_III<sceIoLseek32Async>, "sceIoLseek32Async" },
 	{ 0x71b19e77, &WrapU_II64I<sceIoLseekAsync>, "sceIoLseekAsync" },
 	{ 0x109F50BC, &WrapU_CI<sceIoOpen>, "sceIoOpen" }, //(const char* file, int mode);
-	{ 0x89AA9906, &WrapV_CI<sceIoOpenAsync>, "sceIoOpenAsync" },
+	{ 0x89AA9906, &WrapU_CI<sceIoOpenAsync>, "sceIoOpenAsync" },
 	{ 0x06A70004, &WrapU_CI<sceIoMkdir>, "sceIoMkdir" }, //(const char *dir, int mode);
 	{ 0x3251ea56, &WrapU_IU<sceIoPollAsync>, "sceIoPollAsync" },
 	{ 0x6A638D83, &WrapU_IUI<sceIoRead>, "sceIoRead" }, //(int fd, void *data, int size);
@@ -908,7 +1436,7 @@ const HLEFunction IoFileMgrForUser[] = {
 	{ 0xab96437f, sceIoSync, "sceIoSync" },
 	{ 0x6d08a871, 0, "sceIoUnassign" },
 	{ 0x42EC03AC, &WrapU_IVI<sceIoWrite>, "sceIoWrite" }, //(int fd, void *data, int size);
-	{ 0x0facab19, 0, "sceIoWriteAsync" },
+	{ 0x0facab19, &WrapU_IUI<sceIoWriteAsync>, "sceIoWriteAsync" },
 	{ 0x35dbd746, &WrapV_IU<sceIoWaitAsyncCB>, "sceIoWaitAsyncCB" },
 	{ 0xe23eec33, &WrapV_IUU<sceIoWaitAsync>, "sceIoWaitAsync" }, 
 };
@@ -19,11 +19,22 @@
 
 #include <string>
 #include "HLE.h"
+#include "sceKernel.h"
 
 void __IoInit();
+void __IoDoState(PointerWrap &p);
 void __IoShutdown();
+// Swaps ms0: for a fresh mount, dropping any host files left open on it.
+void __IoRemountMemstick();
+// fork() only copies the calling thread, call these around it so the child gets
+// its own I/O thread.  The child must not run __IoShutdown, just exit.
+void __IoBeforeFork();
+void __IoAfterFork(bool child);
+KernelObject *__KernelFileNodeObject();
+KernelObject *__KernelDirListingObject();
 
 void Register_IoFileMgrForUser();
 void Register_StdioForUser();
 
 const std::string &EmuDebugOutput();
+void ClearEmuDebugOutput();
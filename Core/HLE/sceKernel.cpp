@@ -38,6 +38,7 @@
 #include "sceKernelInterrupt.h"
 #include "sceKernelThread.h"
 #include "sceKernelMemory.h"
+#include "sceKernelModule.h"
 #include "sceKernelMutex.h"
 #include "sceKernelMbx.h"
 #include "sceKernelMsgPipe.h"
@@ -46,7 +47,10 @@
 #include "sceKernelEventFlag.h"
 #include "sceKernelVTimer.h"
 #include "sceKernelTime.h"
+#include "sceMpeg.h"
 #include "scePower.h"
+#include "scePsmf.h"
+#include "sceSas.h"
 #include "sceUtility.h"
 #include "sceUmd.h"
 #include "sceSsl.h"
@@ -84,6 +88,8 @@ void __KernelInit()
 	__UmdInit();
 	__CtrlInit();
 	__SslInit();
+	__MpegInit();
+	__PsmfInit();
 
 	// "Internal" PSP libraries
 	__PPGeInit();
@@ -101,13 +107,16 @@ void __KernelShutdown()
 	}
 	kernelObjects.List();
 	INFO_LOG(HLE, "Shutting down kernel - %i kernel objects alive", kernelObjects.GetCount());
+	// The async I/O thread has to be done with the files before their FileNodes close them.
+	__IoShutdown();
 	kernelObjects.Clear();
 
 	__PPGeShutdown();
 
+	__PsmfShutdown();
+	__MpegShutdown();
 	__GeShutdown();
 	__AudioShutdown();
-	__IoShutdown();
 	__InterruptsShutdown();
 	__KernelThreadingShutdown();
 	__KernelMemoryShutdown();
@@ -118,6 +127,37 @@ void __KernelShutdown()
 	kernelRunning = false;
 }
 
+void __KernelDoState(PointerWrap &p)
+{
+	// Objects first: on load, clearing the old ones frees their memory blocks, which
+	// must happen before the allocators are restored.
+	kernelObjects.DoState(p);
+	p.DoMarker("KernelObjects");
+
+	__KernelMemoryDoState(p);
+	__KernelThreadingDoState(p);
+	__InterruptsDoState(p);
+	__KernelMutexDoState(p);
+	__KernelSemaDoState(p);
+	__KernelEventFlagDoState(p);
+	__KernelModuleDoState(p);
+
+	__IoDoState(p);
+	__AudioDoState(p);
+	__DisplayDoState(p);
+	__GeDoState(p);
+	__PowerDoState(p);
+	__UmdDoState(p);
+	__CtrlDoState(p);
+	__MpegDoState(p);
+	__PsmfDoState(p);
+	__SasDoState(p);
+
+	// Last, so that events registered lazily by the modules above can be matched up.
+	CoreTiming::DoState(p);
+	p.DoMarker("Kernel");
+}
+
 bool __KernelIsRunning() {
 	return kernelRunning;
 }
@@ -125,9 +165,7 @@ bool __KernelIsRunning() {
 void sceKernelExitGame()
 {
 	INFO_LOG(HLE,"sceKernelExitGame");
-	if (PSP_CoreParameter().headLess)
-		exit(0);
-	else
+	if (!PSP_CoreParameter().headLess)
 		PanicAlert("Game exited");
 	Core_Stop();
 }
@@ -135,9 +173,7 @@ void sceKernelExitGame()
 void sceKernelExitGameWithStatus()
 {
 	INFO_LOG(HLE,"sceKernelExitGameWithStatus");
-	if (PSP_CoreParameter().headLess)
-		exit(0);
-	else
+	if (!PSP_CoreParameter().headLess)
 		PanicAlert("Game exited (with status)");
 	Core_Stop();
 }
@@ -198,36 +234,102 @@ KernelObjectPool kernelObjects;
 
 KernelObjectPool::KernelObjectPool()
 {
-	memset(occupied, 0, sizeof(bool)*maxCount);
+	memset(slots, 0, sizeof(slots));
+	ResetFreeList();
 }
 
-SceUID KernelObjectPool::Create(KernelObject *obj, int rangeBottom, int rangeTop)
+void KernelObjectPool::ResetFreeList()
 {
-	if (rangeTop > maxCount)
-		rangeTop = maxCount;
-	for (int i = rangeBottom; i < rangeTop; i++)
+	count = 0;
+	typeLists.clear();
+	freeHead = -1;
+	freeTail = -1;
+	// The first few are reserved, as before.
+	for (int i = maxCount - 1; i >= firstIndex; i--)
 	{
-		if (!occupied[i])
-		{
-			occupied[i] = true;
-			pool[i] = obj;
-			pool[i]->uid = i + handleOffset;
-			return i + handleOffset;
-		}
+		slots[i].nextFree = freeHead;
+		freeHead = i;
+		if (freeTail == -1)
+			freeTail = i;
 	}
-	_dbg_assert_(HLE, 0);
-	return 0;
 }
 
-bool KernelObjectPool::IsValid(SceUID handle)
+SceUID KernelObjectPool::Create(KernelObject *obj)
+{
+	int index = freeHead;
+	if (index == -1)
+	{
+		_dbg_assert_(HLE, 0);
+		return 0;
+	}
+	freeHead = slots[index].nextFree;
+	if (freeHead == -1)
+		freeTail = -1;
+
+	Slot &slot = slots[index];
+	slot.obj = obj;
+	slot.type = obj->GetIDType();
+	slot.nextFree = -1;
+
+	std::map<int, TypeList>::iterator it = typeLists.find(slot.type);
+	if (it == typeLists.end())
+	{
+		TypeList list = {index, index};
+		typeLists[slot.type] = list;
+		slot.typePrev = -1;
+	}
+	else
+	{
+		slot.typePrev = it->second.last;
+		slots[it->second.last].typeNext = index;
+		it->second.last = index;
+	}
+	slot.typeNext = -1;
+	count++;
+
+	obj->uid = (slot.generation << handleGenShift) | (index + handleOffset);
+	return obj->uid;
+}
+
+void KernelObjectPool::Free(int index)
 {
-	int index = handle - handleOffset;
-	if (index < 0)
-		return false;
-	if (index >= maxCount)
-		return false;
+	Slot &slot = slots[index];
 
-	return occupied[index];
+	TypeList &list = typeLists[slot.type];
+	if (slot.typePrev != -1)
+		slots[slot.typePrev].typeNext = slot.typeNext;
+	else
+		list.first = slot.typeNext;
+	if (slot.typeNext != -1)
+		slots[slot.typeNext].typePrev = slot.typePrev;
+	else
+		list.last = slot.typePrev;
+	if (list.first == -1)
+		typeLists.erase(slot.type);
+
+	slot.obj = NULL;
+	slot.generation = (slot.generation + 1) & handleGenMask;
+	count--;
+
+	// Reuse the oldest free slot first, so stale handles stay invalid as long as possible.
+	slot.nextFree = -1;
+	if (freeTail != -1)
+		slots[freeTail].nextFree = index;
+	else
+		freeHead = index;
+	freeTail = index;
+}
+
+int KernelObjectPool::ListIDType(int type, SceUID *uids, int max) const
+{
+	int total = 0;
+	for (int i = FirstOfType(type); i != -1; i = slots[i].typeNext)
+	{
+		if (total < max)
+			uids[total] = slots[i].obj->GetUID();
+		total++;
+	}
+	return total;
 }
 
 void KernelObjectPool::Clear()
@@ -235,48 +337,138 @@ void KernelObjectPool::Clear()
 	for (int i=0; i<maxCount; i++)
 	{
 		//brutally clear everything, no validation
-		if (occupied[i])
-			delete pool[i];
-		occupied[i]=false;
+		if (slots[i].obj)
+			delete slots[i].obj;
 	}
-	memset(pool, 0, sizeof(KernelObject*)*maxCount);
+	memset(slots, 0, sizeof(slots));
+	ResetFreeList();
 }
 
 KernelObject *&KernelObjectPool::operator [](SceUID handle)
 {
-	_dbg_assert_msg_(HLE, IsValid(handle), "GRABBING UNALLOCED KERNEL OBJ");
-	return pool[handle - handleOffset];
+	int index = SlotIndex(handle);
+	_dbg_assert_msg_(HLE, index != -1, "GRABBING UNALLOCED KERNEL OBJ");
+	if (index == -1)
+	{
+		static KernelObject *invalid;
+		invalid = 0;
+		return invalid;
+	}
+	return slots[index].obj;
 }
 
 void KernelObjectPool::List()
 {
 	for (int i = 0; i < maxCount; i++)
 	{
-		if (occupied[i])
+		KernelObject *obj = slots[i].obj;
+		if (obj)
 		{
 			char buffer[256];
-			if (pool[i])
-			{
-				pool[i]->GetQuickInfo(buffer,256);
-			}
-			else
+			obj->GetQuickInfo(buffer,256);
+			INFO_LOG(HLE, "KO %i: %s \"%s\": %s", obj->GetUID(), obj->GetTypeName(), obj->GetName(), buffer);
+		}
+	}
+}
+
+void KernelObjectPool::DoState(PointerWrap &p)
+{
+	int _maxCount = maxCount;
+	p.Do(_maxCount);
+
+	if (_maxCount != maxCount)
+	{
+		ERROR_LOG(HLE, "Unable to load state: different kernel object storage.");
+		p.SetError(p.ERROR_FAILURE);
+		return;
+	}
+
+	if (p.mode == p.MODE_READ)
+		Clear();
+
+	// The free list order and generations decide future UIDs, so keep them exact.
+	p.Do(freeHead);
+	p.Do(freeTail);
+	p.Do(count);
+	for (int i = 0; i < maxCount; ++i)
+	{
+		Slot &slot = slots[i];
+		bool occupied = slot.obj != NULL;
+		p.Do(occupied);
+		p.Do(slot.generation);
+		p.Do(slot.nextFree);
+		p.Do(slot.typePrev);
+		p.Do(slot.typeNext);
+		if (!occupied)
+			continue;
+
+		if (p.mode == p.MODE_READ)
+		{
+			p.Do(slot.type);
+			slot.obj = CreateByIDType(slot.type);
+
+			// Already logged an error.
+			if (slot.obj == NULL)
 			{
-				strcpy(buffer,"WTF? Zero Pointer");
+				// Don't leave dangling entries that would get deleted later.
+				Clear();
+				p.SetError(p.ERROR_FAILURE);
+				return;
 			}
-			INFO_LOG(HLE, "KO %i: %s \"%s\": %s", i + handleOffset, pool[i]->GetTypeName(), pool[i]->GetName(), buffer);
+
+			slot.obj->uid = (slot.generation << handleGenShift) | (i + handleOffset);
 		}
+		else
+			p.Do(slot.type);
+		slot.obj->DoState(p);
 	}
+	p.Do(typeLists);
+	p.DoMarker("KernelObjectPool");
 }
 
-int KernelObjectPool::GetCount()
+KernelObject *KernelObjectPool::CreateByIDType(int type)
 {
-	int count = 0;
-	for (int i=0; i<maxCount; i++)
+	// Used for save states.  This is ugly, but what other way is there?
+	switch (type)
 	{
-		if (occupied[i])
-			count++;
+	case SCE_KERNEL_TMID_Alarm:
+		ERROR_LOG(HLE, "Unable to load state: alarms are not implemented.");
+		return NULL;
+	case SCE_KERNEL_TMID_EventFlag:
+		return __KernelEventFlagObject();
+	case SCE_KERNEL_TMID_Mbox:
+		return __KernelMbxObject();
+	case SCE_KERNEL_TMID_Fpl:
+		return __KernelMemoryFPLObject();
+	case SCE_KERNEL_TMID_Vpl:
+		return __KernelMemoryVPLObject();
+	case PPSSPP_KERNEL_TMID_PMB:
+		return __KernelMemoryPMBObject();
+	case PPSSPP_KERNEL_TMID_Module:
+		return __KernelModuleObject();
+	case SCE_KERNEL_TMID_Mpipe:
+		return __KernelMsgPipeObject();
+	case SCE_KERNEL_TMID_Mutex:
+		return __KernelMutexObject();
+	case SCE_KERNEL_TMID_LwMutex:
+		return __KernelLwMutexObject();
+	case SCE_KERNEL_TMID_Semaphore:
+		return __KernelSemaphoreObject();
+	case SCE_KERNEL_TMID_Callback:
+		return __KernelCallbackObject();
+	case SCE_KERNEL_TMID_Thread:
+		return __KernelThreadObject();
+	case SCE_KERNEL_TMID_VTimer:
+		return __KernelVTimerObject();
+	case PPSSPP_KERNEL_TMID_File:
+		return __KernelFileNodeObject();
+	case PPSSPP_KERNEL_TMID_DirList:
+		return __KernelDirListingObject();
+
+	default:
+		ERROR_LOG(HLE, "Unable to load state: could not find object type %d.", type);
+		return NULL;
 	}
-	return count;
 }
 
 void sceKernelIcacheInvalidateAll()
@@ -382,7 +574,7 @@ const HLEFunction ThreadManForUser[] =
 	{0x840E8133,sceKernelWaitThreadEndCB,"sceKernelWaitThreadEndCB"},
 	{0xd13bde95,sceKernelCheckThreadStack,"sceKernelCheckThreadStack"},
 
-	{0x94416130,0,"sceKernelGetThreadmanIdList"},
+	{0x94416130,WrapU_UUUU<sceKernelGetThreadmanIdList>,"sceKernelGetThreadmanIdList"},
 	{0x57CF62DD,sceKernelGetThreadmanIdType,"sceKernelGetThreadmanIdType"},
 
 	{0x20fff560,sceKernelCreateVTimer,"sceKernelCreateVTimer"},
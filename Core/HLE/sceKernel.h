@@ -18,7 +18,9 @@
 #pragma once
 
 #include "../../Globals.h"
+#include "../../Common/ChunkFile.h"
 #include <cstring>
+#include <map>
 
 enum
 {
@@ -242,6 +244,12 @@ enum TMIDPurpose
 	SCE_KERNEL_TMID_DelayThread = 65,
 	SCE_KERNEL_TMID_SuspendThread = 66,
 	SCE_KERNEL_TMID_DormantThread = 67,
+
+	// Not official, but need ids for save states.
+	PPSSPP_KERNEL_TMID_Module = 0x100001,
+	PPSSPP_KERNEL_TMID_PMB = 0x100002,
+	PPSSPP_KERNEL_TMID_File = 0x100003,
+	PPSSPP_KERNEL_TMID_DirList = 0x100004,
 };
 
 typedef int SceUID;
@@ -263,6 +271,7 @@ struct SceKernelLoadExecParam
 
 void __KernelInit();
 void __KernelShutdown();
+void __KernelDoState(PointerWrap &p);
 bool __KernelIsRunning();
 bool __KernelLoadExec(const char *filename, SceKernelLoadExecParam *param);
 
@@ -310,9 +319,13 @@ public:
 	// Implement this in all subclasses:
 	// static u32 GetMissingErrorCode()
 
-	// Future
-	// void Serialize(ChunkFile)
-	// void DeSerialize(ChunkFile)
+	// Objects that can't be saved fail the whole state; every type that can
+	// live in the pool must override this and be listed in CreateByIDType().
+	virtual void DoState(PointerWrap &p)
+	{
+		ERROR_LOG(HLE, "Unable to save state: bad kernel object.");
+		p.SetError(p.ERROR_FAILURE);
+	}
 };
 
 
@@ -321,10 +334,8 @@ public:
 	KernelObjectPool();
 	~KernelObjectPool() {}
 
-	// Allocates a UID within the range and inserts the object into the map.
-	SceUID Create(KernelObject *obj, int rangeBottom = 16, int rangeTop = 0x7fffffff);
-
-	// TODO: How will we ever save/restore this pool?
+	// Allocates a UID from the free list and inserts the object into the pool.
+	SceUID Create(KernelObject *obj);
 
 	template <class T>
 	u32 Destroy(SceUID handle)
@@ -332,50 +343,47 @@ public:
 		u32 error;
 		if (Get<T>(handle, error))
 		{
-			occupied[handle-handleOffset] = false;
-			delete pool[handle-handleOffset];
+			int index = SlotIndex(handle);
+			KernelObject *obj = slots[index].obj;
+			Free(index);
+			delete obj;
 		}
 		return error;
 	};
 
-	bool IsValid(SceUID handle);
+	bool IsValid(SceUID handle) const
+	{
+		return SlotIndex(handle) != -1;
+	}
 
+	// Type checked through the objects' GetStaticIDType(), no RTTI.
 	template <class T>
 	T* Get(SceUID handle, u32 &outError)
 	{
-		if (handle < handleOffset || handle >= handleOffset+maxCount || !occupied[handle-handleOffset])
+		int index = SlotIndex(handle);
+		if (index == -1)
 		{
 			ERROR_LOG(HLE, "Kernel: Bad object handle %i (%08x)", handle, handle);
 			outError = T::GetMissingErrorCode(); // ?
 			return 0;
 		}
-		else
+		else if (slots[index].type != T::GetStaticIDType())
 		{
-			T* t = dynamic_cast<T*>(pool[handle - handleOffset]);
-			if (t == 0)
-			{
-				ERROR_LOG(HLE, "Kernel: Wrong type object %i (%08x)", handle, handle);
-				outError = T::GetMissingErrorCode(); //FIX
-				return 0;
-			}
-			outError = SCE_KERNEL_ERROR_OK;
-			return t;
+			ERROR_LOG(HLE, "Kernel: Wrong type object %i (%08x)", handle, handle);
+			outError = T::GetMissingErrorCode(); //FIX
+			return 0;
 		}
+		outError = SCE_KERNEL_ERROR_OK;
+		return static_cast<T *>(slots[index].obj);
 	}
 	template <class T>
 	T* GetByModuleByEntryAddr(u32 entryAddr)
 	{
-		for (int i=0; i <4096; i++)
+		for (int i = FirstOfType(T::GetStaticIDType()); i != -1; i = slots[i].typeNext)
 		{
-			T* t = dynamic_cast<T*>(pool[i]);
-
-			if (t)
-			{
-				if (t->nm.entry_addr == entryAddr)
-				{
-					return t;
-				}
-			}
+			T* t = static_cast<T *>(slots[i].obj);
+			if (t->nm.entry_addr == entryAddr)
+				return t;
 		}
 		return 0;
 	}
@@ -384,20 +392,77 @@ public:
 
 	bool GetIDType(SceUID handle, int *type) const
 	{
-		KernelObject *t = pool[handle - handleOffset];
-		*type = t->GetIDType();
+		int index = SlotIndex(handle);
+		if (index == -1)
+			return false;
+		*type = slots[index].type;
 		return true;
 	}
 
+	// Fills uids with up to max objects of the type, in creation order. Returns the total.
+	int ListIDType(int type, SceUID *uids, int max) const;
+
 	KernelObject *&operator [](SceUID handle);
 	void List();
 	void Clear();
-	int GetCount();
+	int GetCount() const { return count; }
+
+	void DoState(PointerWrap &p);
+	static KernelObject *CreateByIDType(int type);
 
 private:
-	enum {maxCount=4096, handleOffset=0x100};
-	KernelObject *pool[maxCount];
-	bool occupied[maxCount];
+	// UIDs are (generation << handleGenShift) | (handleOffset + index), so a stale
+	// UID of a deleted object doesn't match whatever reuses its slot.
+	enum {
+		maxCount = 4096,
+		handleOffset = 0x100,
+		firstIndex = 16,
+		handleGenShift = 13,
+		handleIndexMask = (1 << handleGenShift) - 1,
+		handleGenMask = 0x3FFFF,
+	};
+
+	struct Slot
+	{
+		KernelObject *obj;
+		int type;
+		u32 generation;
+		// Free list when unused, list of objects of the same type when used.
+		int nextFree;
+		int typePrev;
+		int typeNext;
+	};
+
+	int SlotIndex(SceUID handle) const
+	{
+		int index = (handle & handleIndexMask) - handleOffset;
+		if (handle < 0 || index < 0 || index >= maxCount || !slots[index].obj)
+			return -1;
+		if (((u32)handle >> handleGenShift) != slots[index].generation)
+			return -1;
+		return index;
+	}
+
+	int FirstOfType(int type) const
+	{
+		std::map<int, TypeList>::const_iterator it = typeLists.find(type);
+		return it == typeLists.end() ? -1 : it->second.first;
+	}
+
+	void Free(int index);
+	void ResetFreeList();
+
+	struct TypeList
+	{
+		int first;
+		int last;
+	};
+
+	Slot slots[maxCount];
+	int freeHead;
+	int freeTail;
+	int count;
+	std::map<int, TypeList> typeLists;
 };
 
 extern KernelObjectPool kernelObjects;
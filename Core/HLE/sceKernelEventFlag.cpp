@@ -61,8 +61,16 @@ public:
 	static u32 GetMissingErrorCode() {
 		return SCE_KERNEL_ERROR_UNKNOWN_EVFID;
 	}
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_EventFlag; }
 	int GetIDType() const { return SCE_KERNEL_TMID_EventFlag; }
 
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nef);
+		p.Do(waitingThreads);
+		p.DoMarker("EventFlag");
+	}
+
 	NativeEventFlag nef;
 	std::vector<EventFlagTh> waitingThreads;
 };
@@ -99,6 +107,20 @@ void __KernelEventFlagInit()
 	eventFlagInitComplete = true;
 }
 
+void __KernelEventFlagDoState(PointerWrap &p)
+{
+	bool initComplete = eventFlagInitComplete;
+	p.Do(initComplete);
+	if (p.mode == p.MODE_READ && initComplete && !eventFlagInitComplete)
+		__KernelEventFlagInit();
+	p.DoMarker("sceKernelEventFlag");
+}
+
+KernelObject *__KernelEventFlagObject()
+{
+	return new EventFlag;
+}
+
 bool __KernelEventFlagMatches(u32 *pattern, u32 bits, u8 wait, u32 outAddr)
 {
 	if ((wait & PSP_EVENT_WAITOR)
@@ -180,7 +180,18 @@ public:
 		// RA is already taken care of
 	}
 
+	void DoState(PointerWrap &p)
+	{
+		p.Do(enabled);
+		p.Do(intrNumber);
+		p.Do(number);
+		p.Do(handlerAddress);
+		p.Do(handlerArg);
+		p.DoMarker("SubIntrHandler");
+	}
+
 	bool enabled;
+	int intrNumber;
 	int number;
 	u32 handlerAddress;
 	u32 handlerArg;
@@ -231,6 +242,32 @@ public:
 		}
 	}
 
+	void DoState(PointerWrap &p)
+	{
+		int count = (int)subIntrHandlers.size();
+		p.Do(count);
+		if (p.mode == p.MODE_READ)
+		{
+			subIntrHandlers.clear();
+			for (int i = 0; i < count; ++i)
+			{
+				int subIntrNum = 0;
+				p.Do(subIntrNum);
+				subIntrHandlers[subIntrNum].DoState(p);
+			}
+		}
+		else
+		{
+			for (std::map<int, SubIntrHandler>::iterator iter = subIntrHandlers.begin(); iter != subIntrHandlers.end(); ++iter)
+			{
+				int subIntrNum = iter->first;
+				p.Do(subIntrNum);
+				iter->second.DoState(p);
+			}
+		}
+		p.DoMarker("IntrHandler");
+	}
+
 private:
 	std::map<int, SubIntrHandler> subIntrHandlers;
 };
@@ -251,6 +288,13 @@ public:
 		__KernelLoadContext(&savedCpu);
 	}
 
+	void DoState(PointerWrap &p)
+	{
+		p.Do(insideInterrupt);
+		p.Do(savedCpu);
+		p.DoMarker("InterruptState");
+	}
+
 	bool insideInterrupt;
 	ThreadContext savedCpu;
 //	Action afterInterruptAction;
@@ -262,6 +306,51 @@ public:
 InterruptState intState;
 IntrHandler intrHandlers[PSP_NUMBER_INTERRUPTS];
 
+void __InterruptsDoState(PointerWrap &p)
+{
+	intState.DoState(p);
+	for (int i = 0; i < PSP_NUMBER_INTERRUPTS; ++i)
+		intrHandlers[i].DoState(p);
+
+	// Pending interrupts point at their handler, so store which one it was instead.
+	int numPending = (int)pendingInterrupts.size();
+	p.Do(numPending);
+	if (p.mode == p.MODE_READ)
+		pendingInterrupts.clear();
+	std::list<PendingInterrupt>::iterator it = pendingInterrupts.begin();
+	for (int i = 0; i < numPending; ++i)
+	{
+		PendingInterrupt pend;
+		int intrNumber = 0, subIntrNumber = 0;
+		if (p.mode != p.MODE_READ)
+		{
+			pend = *it++;
+			SubIntrHandler *handler = (SubIntrHandler *)pend.handler;
+			intrNumber = handler->intrNumber;
+			subIntrNumber = handler->number;
+		}
+		p.Do(intrNumber);
+		p.Do(subIntrNumber);
+		p.Do(pend.arg);
+		p.Do(pend.hasArg);
+		if (p.mode == p.MODE_READ)
+		{
+			pend.handler = intrNumber >= 0 && intrNumber < PSP_NUMBER_INTERRUPTS ? intrHandlers[intrNumber].get(subIntrNumber) : 0;
+			if (pend.handler == 0)
+			{
+				ERROR_LOG(HLE, "Save state: pending interrupt %i/%i has no handler", intrNumber, subIntrNumber);
+				p.SetError(p.ERROR_FAILURE);
+				return;
+			}
+			pendingInterrupts.push_back(pend);
+		}
+	}
+
+	p.Do(interruptsEnabled);
+	p.Do(inInterrupt);
+	p.DoMarker("sceKernelInterrupt");
+}
+
 // http://forums.ps2dev.org/viewtopic.php?t=5687
 
 // http://www.google.se/url?sa=t&rct=j&q=&esrc=s&source=web&cd=7&ved=0CFYQFjAG&url=http%3A%2F%2Fdev.psnpt.com%2Fredmine%2Fprojects%2Fuofw%2Frepository%2Frevisions%2F65%2Fraw%2Ftrunk%2Finclude%2Finterruptman.h&ei=J4pCUKvyK4nl4QSu-YC4Cg&usg=AFQjCNFxJcgzQnv6dK7aiQlht_BM9grfQQ&sig2=GGk5QUEWI6qouYDoyE07YQ
@@ -335,6 +424,7 @@ u32 sceKernelRegisterSubIntrHandler(u32 intrNumber, u32 subIntrNumber, u32 handl
 		return -1;
 
 	SubIntrHandler subIntrHandler;
+	subIntrHandler.intrNumber = intrNumber;
 	subIntrHandler.number = subIntrNumber;
 	subIntrHandler.enabled = false;
 	subIntrHandler.handlerAddress = handler;
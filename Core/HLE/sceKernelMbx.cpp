@@ -40,6 +40,7 @@ struct Mbx : public KernelObject
 	const char *GetName() {return nmb.name;}
 	const char *GetTypeName() {return "Mbx";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MBXID; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Mbox; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Mbox; }
 
 	void AddWaitingThread(SceUID id, u32 addr)
@@ -61,12 +62,25 @@ struct Mbx : public KernelObject
 		}
 	}
 
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nmb);
+		p.Do(waitingThreads);
+		p.Do(messageQueue);
+		p.DoMarker("Mbx");
+	}
+
 	NativeMbx nmb;
 
 	std::vector<std::pair<SceUID, u32> > waitingThreads;
 	std::vector<u32> messageQueue;
 };
 
+KernelObject *__KernelMbxObject()
+{
+	return new Mbx;
+}
+
 SceUID sceKernelCreateMbx(const char *name, int memoryPartition, SceUInt attr, int size, u32 optAddr)
 {
 	DEBUG_LOG(HLE, "sceKernelCreateMbx(%s, %i, %08x, %i, %08x)", name, memoryPartition, attr, size, optAddr);
@@ -34,6 +34,8 @@ struct SceKernelMbxInfo
 	u32 topPacketAddr;
 };
 
+KernelObject *__KernelMbxObject();
+
 SceUID sceKernelCreateMbx(const char *name, int memoryPartition, SceUInt attr, int size, u32 optAddr);
 int sceKernelDeleteMbx(SceUID id);
 void sceKernelSendMbx(SceUID id, u32 addPacketAddr);
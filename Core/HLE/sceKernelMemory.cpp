@@ -19,6 +19,7 @@
 #include "../System.h"
 #include "../MIPS/MIPS.h"
 #include "../MemMap.h"
+#include "ChunkFile.h"
 
 #include "sceKernel.h"
 #include "sceKernelThread.h"
@@ -49,9 +50,16 @@ struct NativeFPL
 //FPL - Fixed Length Dynamic Memory Pool - every item has the same length
 struct FPL : KernelObject
 {
+	FPL() : blocks(NULL) {}
+	~FPL() {
+		if (blocks != NULL) {
+			delete [] blocks;
+		}
+	}
 	const char *GetName() {return nf.name;}
 	const char *GetTypeName() {return "FPL";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_FPLID; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Fpl; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Fpl; }
 	NativeFPL nf;
 	bool *blocks;
@@ -79,6 +87,19 @@ struct FPL : KernelObject
 		}
 		return false;
 	}
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nf);
+		if (p.mode == p.MODE_READ)
+		{
+			delete [] blocks;
+			blocks = new bool[nf.numBlocks];
+		}
+		p.DoArray(blocks, nf.numBlocks);
+		p.Do(address);
+		p.DoMarker("FPL");
+	}
 };
 
 struct SceKernelVplInfo
@@ -96,12 +117,22 @@ struct VPL : KernelObject
 	const char *GetName() {return nv.name;}
 	const char *GetTypeName() {return "VPL";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_VPLID; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Vpl; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Vpl; }
 	SceKernelVplInfo nv;
 	u32 size;
 	bool *freeBlocks;
 	u32 address;
 	BlockAllocator alloc;
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nv);
+		p.Do(size);
+		p.Do(address);
+		alloc.DoState(p);
+		p.DoMarker("VPL");
+	}
 };
 
 void __KernelMemoryInit()
@@ -111,6 +142,13 @@ void __KernelMemoryInit()
 	INFO_LOG(HLE, "Kernel and user memory pools initialized");
 }
 
+void __KernelMemoryDoState(PointerWrap &p)
+{
+	kernelMemory.DoState(p);
+	userMemory.DoState(p);
+	p.DoMarker("sceKernelMemory");
+}
+
 void __KernelMemoryShutdown()
 {
 	INFO_LOG(HLE,"Shutting down user memory pool: ");
@@ -344,8 +382,10 @@ public:
 		sprintf(ptr, "MemPart: %08x - %08x	size: %08x", address, address + sz, sz);
 	}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MPPID; }	/// ????
-	int GetIDType() const { return 0; }
+	static int GetStaticIDType() { return PPSSPP_KERNEL_TMID_PMB; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_PMB; }
 
+	PartitionMemoryBlock() : alloc(NULL), address((u32)-1) {}
 	PartitionMemoryBlock(BlockAllocator *_alloc, u32 size, bool fromEnd)
 	{
 		alloc = _alloc;
@@ -354,15 +394,43 @@ public:
 	}
 	~PartitionMemoryBlock()
 	{
-		alloc->Free(address);
+		if (alloc != NULL && IsValid())
+			alloc->Free(address);
 	}
 	bool IsValid() {return address != (u32)-1;}
+
+	virtual void DoState(PointerWrap &p)
+	{
+		// The allocators are saved separately, so just remember which one owns us.
+		bool isKernel = alloc == &kernelMemory;
+		p.Do(isKernel);
+		if (p.mode == p.MODE_READ)
+			alloc = isKernel ? &kernelMemory : &userMemory;
+		p.Do(address);
+		p.DoArray(name, sizeof(name));
+		p.DoMarker("PMB");
+	}
 	BlockAllocator *alloc;
 	u32 address;
 	char name[32];
 };
 
 
+KernelObject *__KernelMemoryFPLObject()
+{
+	return new FPL;
+}
+
+KernelObject *__KernelMemoryVPLObject()
+{
+	return new VPL;
+}
+
+KernelObject *__KernelMemoryPMBObject()
+{
+	return new PartitionMemoryBlock;
+}
+
 void sceKernelMaxFreeMemSize() 
 {
 	// TODO: Fudge factor improvement
@@ -19,6 +19,9 @@
 
 #include "../Util/BlockAllocator.h"
 
+class PointerWrap;
+class KernelObject;
+
 
 //todo: "real" memory block allocator, 
 // have elf loader grab its memory block first to avoid overwriting,
@@ -29,7 +32,11 @@ extern BlockAllocator userMemory;
 extern BlockAllocator kernelMemory;
 
 void __KernelMemoryInit();
+void __KernelMemoryDoState(PointerWrap &p);
 void __KernelMemoryShutdown();
+KernelObject *__KernelMemoryFPLObject();
+KernelObject *__KernelMemoryVPLObject();
+KernelObject *__KernelMemoryPMBObject();
 
 void sceKernelCreateVpl();
 void sceKernelDeleteVpl();
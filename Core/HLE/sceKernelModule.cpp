@@ -15,13 +15,22 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
-#include <fstream>
 #include <algorithm>
+#include <ctime>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "HLE.h"
 #include "Common/Action.h"
 #include "Common/FileUtil.h"
+#include "Common/CommonPaths.h"
+#include "Common/Hash.h"
+#include "Common/Timer.h"
 #include "../Host.h"
+#include "../Config.h"
 #include "../MIPS/MIPS.h"
 #include "../MIPS/MIPSAnalyst.h"
 #include "../ELF/ElfReader.h"
@@ -39,11 +48,17 @@
 #include "sceKernelModule.h"
 #include "sceKernelThread.h"
 #include "sceKernelMemory.h"
+#include "ReplaceTables.h"
 
 enum {
 	PSP_THREAD_ATTR_USER = 0x80000000
 };
 
+// Bigger than any PSP has memory for.
+static const u32 MAX_MODULE_SIZE = 0x4000000;
+
+ModuleLoadStats moduleLoadStats;
+
 static const char *blacklistedModules[] = {
 	"sceATRAC3plus_Library",
 	"sceFont_Library",
@@ -117,7 +132,15 @@ public:
 			nm.entry_addr);
 	}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MODULE; }
-	int GetIDType() const { return 0; }
+	static int GetStaticIDType() { return PPSSPP_KERNEL_TMID_Module; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_Module; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nm);
+		p.Do(memoryBlockAddr);
+		p.DoMarker("Module");
+	}
 
 	NativeModule nm;
 
@@ -160,8 +183,107 @@ static SceUID mainModuleID;	// hack
 // STATE END
 //////////////////////////////////////////////////////////////////////////
 
-Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *error_string)
+void __KernelModuleDoState(PointerWrap &p)
+{
+	p.Do(mainModuleID);
+	p.DoMarker("sceKernelModule");
+}
+
+KernelObject *__KernelModuleObject()
+{
+	return new Module;
+}
+
+// Decrypted ~PSP images are kept on disk, keyed by a hash of the encrypted file,
+// so booting the same game again skips the kirk decryption entirely.
+struct ModuleCacheHeader
+{
+	u32 magic;
+	u32 version;
+	u32 inSize;
+	u32 outSize;
+	u64 inHash;
+	u32 outChecksum;
+	u32 reserved;
+};
+
+static const u32 MODULE_CACHE_MAGIC = 0x4d444350;  // "PCDM"
+static const u32 MODULE_CACHE_VERSION = 1;
+
+static std::string __KernelModuleCachePath(u64 inHash, u32 inSize)
+{
+	char name[64];
+	sprintf(name, "%016llx_%08x.prx", (unsigned long long)inHash, inSize);
+	return File::GetUserPath(D_CACHE_IDX) + "Modules" DIR_SEP + name;
+}
+
+static int __KernelReadModuleCache(u64 inHash, u32 inSize, u8 *out, u32 outCapacity)
+{
+	std::string path = __KernelModuleCachePath(inHash, inSize);
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f)
+		return -1;
+
+	ModuleCacheHeader header;
+	int result = -1;
+	if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == MODULE_CACHE_MAGIC && header.version == MODULE_CACHE_VERSION &&
+		header.inSize == inSize && header.inHash == inHash && header.outSize <= outCapacity)
+	{
+		if (fread(out, 1, header.outSize, f) == header.outSize && HashAdler32(out, header.outSize) == header.outChecksum)
+			result = (int)header.outSize;
+	}
+	fclose(f);
+
+	if (result < 0)
+		WARN_LOG(LOADER, "Ignoring bad module cache entry %s", path.c_str());
+	return result;
+}
+
+static void __KernelWriteModuleCache(u64 inHash, u32 inSize, const u8 *out, u32 outSize)
+{
+	std::string path = __KernelModuleCachePath(inHash, inSize);
+	File::CreateFullPath(File::GetUserPath(D_CACHE_IDX) + "Modules" DIR_SEP);
+
+	// Write to a temporary and rename, so parallel runs never see half a file.
+	// Forked test workers share the time and often the heap layout, hence the pid.
+#ifdef _WIN32
+	u32 pid = (u32)GetCurrentProcessId();
+#else
+	u32 pid = (u32)getpid();
+#endif
+	char suffix[32];
+	sprintf(suffix, ".%u.%08x.tmp", pid, (u32)(size_t)out ^ (u32)time(0));
+	std::string tempPath = path + suffix;
+	FILE *f = fopen(tempPath.c_str(), "wb");
+	if (!f)
+		return;
+
+	ModuleCacheHeader header;
+	header.magic = MODULE_CACHE_MAGIC;
+	header.version = MODULE_CACHE_VERSION;
+	header.inSize = inSize;
+	header.outSize = outSize;
+	header.inHash = inHash;
+	header.outChecksum = HashAdler32(out, outSize);
+	header.reserved = 0;
+
+	bool success = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(out, 1, outSize, f) == outSize;
+	fclose(f);
+
+	if (!success || !File::Rename(tempPath, path))
+		File::Delete(tempPath);
+}
+
+Module *__KernelLoadELFFromPtr(const u8 *ptr, size_t size, u32 loadAddress, std::string *error_string)
 {
+	u64 loadStart = Common::Timer::GetTimeNs();
+	if (size < 4)
+	{
+		ERROR_LOG(LOADER, "Module too small: %i bytes", (int)size);
+		*error_string = "File corrupt";
+		return 0;
+	}
+
 	Module *module = new Module;
 	kernelObjects.Create(module);
 
@@ -172,14 +294,54 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 		INFO_LOG(HLE, "Decrypting ~PSP file");
 		PSP_Header *head = (PSP_Header*)ptr;
 		const u8 *in = ptr;
-		u32 size = head->elf_size;
-		if (head->psp_size > size)
+		// The decrypter reads the whole header and comp_size bytes after it, then writes psp_size bytes.
+		if (size < sizeof(PSP_Header) || head->psp_size < sizeof(PSP_Header) || head->psp_size > size ||
+			head->comp_size < 0 || (u32)head->comp_size > head->psp_size - sizeof(PSP_Header) || head->elf_size > MAX_MODULE_SIZE)
 		{
-			size = head->psp_size;
+			ERROR_LOG(LOADER, "Bad ~PSP header: file %i bytes, psp_size %08x, elf_size %08x, comp_size %08x", (int)size, head->psp_size, head->elf_size, head->comp_size);
+			*error_string = "File corrupt";
+			kernelObjects.Destroy<Module>(module->GetUID());
+			return 0;
 		}
-		newptr = new u8[head->elf_size + head->psp_size];
+		u32 outCapacity = head->elf_size + head->psp_size;
+		newptr = new u8[outCapacity];
 		ptr = newptr;
-		pspDecryptPRX(in, (u8*)ptr, head->psp_size);
+		size = 0;
+
+		u64 decryptStart = Common::Timer::GetTimeNs();
+		u64 inHash = 0;
+		int cached = -1;
+		if (g_Config.bModuleCache)
+		{
+			inHash = GetMurmurHash3(in, head->psp_size, 0);
+			cached = __KernelReadModuleCache(inHash, head->psp_size, newptr, outCapacity);
+		}
+
+		if (cached >= 0)
+		{
+			INFO_LOG(HLE, "Using cached decrypted module");
+			memset(newptr + cached, 0, outCapacity - cached);
+			size = cached;
+			moduleLoadStats.cacheHits++;
+		}
+		else
+		{
+			int decryptedSize = pspDecryptPRX(in, newptr, head->psp_size);
+			if (decryptedSize > 0 && (u32)decryptedSize <= outCapacity)
+				size = decryptedSize;
+			if (g_Config.bModuleCache && size >= 4 && *(u32*)newptr == 0x464c457f)
+				__KernelWriteModuleCache(inHash, head->psp_size, newptr, (u32)size);
+		}
+		moduleLoadStats.decryptNs += Common::Timer::GetTimeNs() - decryptStart;
+
+		if (size < 4)
+		{
+			ERROR_LOG(LOADER, "Unable to decrypt module");
+			*error_string = "File corrupt";
+			delete [] newptr;
+			kernelObjects.Destroy<Module>(module->GetUID());
+			return 0;
+		}
 	}
 
 	if (*(u32*)ptr == 0x4543537e) { // "~SCE"
@@ -205,7 +367,7 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 		return 0;
 	}
 	// Open ELF reader
-	ElfReader reader((void*)ptr);
+	ElfReader reader((void*)ptr, size);
 
 	if (!reader.LoadInto(loadAddress))
 	{
@@ -245,11 +407,25 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 	};
 
 	SectionID sceModuleInfoSection = reader.GetSectionByName(".rodata.sceModuleInfo");
-	PspModuleInfo *modinfo;
+	u32 modinfoAddr;
 	if (sceModuleInfoSection != -1)
-		modinfo = (PspModuleInfo *)Memory::GetPointer(reader.GetSectionAddr(sceModuleInfoSection));
+		modinfoAddr = reader.GetSectionAddr(sceModuleInfoSection);
+	else if (reader.GetNumSegments() > 0)
+		modinfoAddr = reader.GetVaddr() + (reader.GetSegmentPaddr(0) & 0x7FFFFFFF) - reader.GetSegmentOffset(0);
 	else
-		modinfo = (PspModuleInfo *)Memory::GetPointer(reader.GetVaddr() + (reader.GetSegmentPaddr(0) & 0x7FFFFFFF) - reader.GetSegmentOffset(0));
+		modinfoAddr = 0;
+	if (!Memory::IsValidAddress(modinfoAddr) || !Memory::IsValidAddress(modinfoAddr + sizeof(PspModuleInfo) - 1))
+	{
+		ERROR_LOG(LOADER, "Module info outside memory: %08x", modinfoAddr);
+		*error_string = "File corrupt";
+		if (newptr)
+		{
+			delete [] newptr;
+		}
+		kernelObjects.Destroy<Module>(module->GetUID());
+		return 0;
+	}
+	PspModuleInfo *modinfo = (PspModuleInfo *)Memory::GetPointer(modinfoAddr);
 
 	// Check for module blacklist - we don't allow games to load these modules from disc
 	// as we have HLE implementations and the originals won't run in the emu because they
@@ -289,6 +465,8 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 		{
 			dontadd = true;
 		}
+
+		Replacement_ApplyToModule(textStart, textSize);
 	}
 
 	module->nm.gp_value = modinfo->gp;
@@ -409,82 +587,59 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 	{
 		delete [] newptr;
 	}
+	moduleLoadStats.modulesLoaded++;
+	moduleLoadStats.loadNs += Common::Timer::GetTimeNs() - loadStart;
 	return module;
 }
 
-bool __KernelLoadPBP(const char *filename, std::string *error_string)
+// Reads only the executable part of a file: the DATA.PSP entry of a PBP, or the whole file otherwise.
+static u8 *__KernelReadExecutable(const char *filename, size_t &size, std::string *error_string)
 {
-	static const char *FileNames[] =
-	{
-		"PARAM.SFO", "ICON0.PNG", "ICON1.PMF", "UNKNOWN.PNG",
-		"PIC1.PNG", "SND0.AT3", "UNKNOWN.PSP", "UNKNOWN.PSAR"
-	};
-
-	std::ifstream in(filename, std::ios::binary);
-
-	char temp[4];
-	in.read(temp,4);
-
-	if (memcmp(temp,"\0PBP",4) != 0)
+	PSPFileInfo info = pspFileSystem.GetFileInfo(filename);
+	u32 handle = info.exists ? pspFileSystem.OpenFile(filename, FILEACCESS_READ) : 0;
+	if (handle == 0)
 	{
-		//This is not a valid file!
-		ERROR_LOG(LOADER,"%s is not a valid homebrew PSP1.0 PBP",filename);
-		*error_string = "Not a valid homebrew PBP";
-		return false;
+		*error_string = "File not found";
+		return 0;
 	}
 
-	u32 version, offset0, offsets[16];
-	int numfiles;
-
-	in.read((char*)&version,4);
-
-	in.read((char*)&offset0,4);
-	numfiles = (offset0 - 8) / 4;
-	offsets[0] = offset0;
-	for (int i = 1; i < numfiles; i++)
-		in.read((char*)&offsets[i], 4);
+	s64 start = 0;
+	s64 end = info.size;
 
-	// The 6th is always the executable?
-	in.seekg(offsets[5]);
-	//in.read((char*)&id,4);
+	// PBP header: magic, version, then the offsets of the 8 entries. DATA.PSP is the 7th.
+	u8 header[0x28];
+	if (info.size >= (s64)sizeof(header) && pspFileSystem.ReadFile(handle, header, sizeof(header)) == sizeof(header) && !memcmp(header, "\0PBP", 4))
 	{
-		u8 *temp = new u8[1024*1024*8];
-		in.read((char*)temp, 1024*1024*8);
-		Module *module = __KernelLoadELFFromPtr(temp, PSP_GetDefaultLoadAddress(), error_string);
-		if (!module)
-			return false;
-		mipsr4k.pc = module->nm.entry_addr;
-		delete [] temp;
+		u32 offsets[8];
+		memcpy(offsets, header + 8, sizeof(offsets));
+		start = offsets[6];
+		if (offsets[7] > offsets[6] && offsets[7] <= info.size)
+			end = offsets[7];
+		DEBUG_LOG(LOADER, "PBP %s: executable at %08x-%08x", filename, (u32)start, (u32)end);
 	}
-	in.close();
-	return true;
-}
 
-Module *__KernelLoadModule(u8 *fileptr, SceKernelLMOption *options, std::string *error_string)
-{
-	Module *module = 0;
-	// Check for PBP
-	if (memcmp(fileptr, "\0PBP", 4) == 0)
+	if (start >= end)
 	{
-		// PBP!
-		u32 version;
-		memcpy(&version, fileptr + 4, 4);
-		u32 offset0, offsets[16];
-		int numfiles;
-
-		memcpy(&offset0, fileptr + 8, 4);
-		numfiles = (offset0 - 8)/4;
-		offsets[0] = offset0;
-		for (int i = 1; i < numfiles; i++)
-			memcpy(&offsets[i], fileptr + 12 + 4*i, 4);
-		module = __KernelLoadELFFromPtr(fileptr + offsets[5], PSP_GetDefaultLoadAddress(), error_string);
+		ERROR_LOG(LOADER, "%s has no executable data", filename);
+		*error_string = "File corrupt";
+		pspFileSystem.CloseFile(handle);
+		return 0;
 	}
-	else
+
+	size = (size_t)(end - start);
+	u8 *data = new u8[size];
+	pspFileSystem.SeekFile(handle, (s32)start, FILEMOVE_BEGIN);
+	size_t bytesRead = pspFileSystem.ReadFile(handle, data, size);
+	pspFileSystem.CloseFile(handle);
+
+	if (bytesRead != size)
 	{
-		module = __KernelLoadELFFromPtr(fileptr, PSP_GetDefaultLoadAddress(), error_string);
+		ERROR_LOG(LOADER, "Short read of %s: %i of %i bytes", filename, (int)bytesRead, (int)size);
+		*error_string = "File corrupt";
+		delete [] data;
+		return 0;
 	}
-
-	return module;
+	return data;
 }
 
 void __KernelStartModule(Module *m, int args, const char *argp, SceKernelSMOption *options)
@@ -516,16 +671,16 @@ bool __KernelLoadExec(const char *filename, SceKernelLoadExecParam *param, std::
 		__KernelShutdown();
 
 	__KernelInit();
-	
-	PSPFileInfo info = pspFileSystem.GetFileInfo(filename);
-
-	u32 handle = pspFileSystem.OpenFile(filename, FILEACCESS_READ);
-
-	u8 *temp = new u8[(int)info.size + 0x1000000];
 
-	pspFileSystem.ReadFile(handle, temp, (size_t)info.size);
+	size_t size;
+	u8 *temp = __KernelReadExecutable(filename, size, error_string);
+	if (!temp) {
+		ERROR_LOG(LOADER, "Failed to read %s", filename);
+		return false;
+	}
 
-	Module *module = __KernelLoadModule(temp, 0, error_string);
+	Module *module = __KernelLoadELFFromPtr(temp, size, PSP_GetDefaultLoadAddress(), error_string);
+	delete [] temp;
 
 	if (!module) {
 		ERROR_LOG(LOADER, "Failed to load module %s", filename);
@@ -536,10 +691,6 @@ bool __KernelLoadExec(const char *filename, SceKernelLoadExecParam *param, std::
 
 	INFO_LOG(LOADER, "Module entry: %08x", mipsr4k.pc);
 
-	delete [] temp;
-
-	pspFileSystem.CloseFile(handle);
-
 	SceKernelSMOption option;
 	option.size = sizeof(SceKernelSMOption);
 	option.attribute = PSP_THREAD_ATTR_USER;
@@ -617,12 +768,12 @@ u32 sceKernelLoadModule(const char *name, u32 flags)
 	}
 
 	Module *module = 0;
-	u8 *temp = new u8[(int)size];
-	u32 handle = pspFileSystem.OpenFile(name, FILEACCESS_READ);
-	pspFileSystem.ReadFile(handle, temp, (size_t)size);
-	module = __KernelLoadELFFromPtr(temp, 0, &error_string);
-	delete [] temp;
-	pspFileSystem.CloseFile(handle);
+	size_t readSize;
+	u8 *temp = __KernelReadExecutable(name, readSize, &error_string);
+	if (temp) {
+		module = __KernelLoadELFFromPtr(temp, readSize, 0, &error_string);
+		delete [] temp;
+	}
 
 	if (!module) {
 		// Module was blacklisted or couldn't be decrypted, which means it's a kernel module we don't want to run.
@@ -650,6 +801,11 @@ public:
 	Module *module_;
 	u32 retValAddr;
 	virtual void run();
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(retValAddr);
+		p.DoMarker("AfterModuleEntryCall");
+	}
 };
 
 void AfterModuleEntryCall::run() {
@@ -21,6 +21,18 @@
 #include "HLE.h"
 
 u32 __KernelGetModuleGP(SceUID module);
+void __KernelModuleDoState(PointerWrap &p);
+KernelObject *__KernelModuleObject();
 bool __KernelLoadExec(const char *filename, SceKernelLoadExecParam *param, std::string *error_string);
 
+// Running totals, never reset. Only modules that loaded successfully are counted.
+struct ModuleLoadStats
+{
+	u32 modulesLoaded;
+	u32 cacheHits;
+	u64 decryptNs;
+	u64 loadNs;
+};
+extern ModuleLoadStats moduleLoadStats;
+
 void Register_ModuleMgrForUser();
@@ -54,8 +54,28 @@ struct MsgPipe : public KernelObject
 	const char *GetName() {return nmp.name;}
 	const char *GetTypeName() {return "MsgPipe";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MPPID; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Mpipe; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Mpipe; }
 
+	MsgPipe() : buffer(0) {}
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nmp);
+		p.Do(sendWaitingThreads);
+		p.Do(receiveWaitingThreads);
+
+		// The pipe's buffer is host memory, so it has to go in the state too.
+		if (p.mode == p.MODE_READ)
+		{
+			delete [] buffer;
+			buffer = nmp.bufSize != 0 ? new u8[nmp.bufSize] : 0;
+		}
+		if (buffer != 0)
+			p.DoArray(buffer, nmp.bufSize);
+		p.DoMarker("MsgPipe");
+	}
+
 	NativeMsgPipe nmp;
 
 	std::vector<MsgPipeWaitingThread> sendWaitingThreads;
@@ -153,6 +173,11 @@ struct MsgPipe : public KernelObject
 	u8 *buffer;
 };
 
+KernelObject *__KernelMsgPipeObject()
+{
+	return new MsgPipe;
+}
+
 void sceKernelCreateMsgPipe()
 {
 	const char *name = Memory::GetCharPointer(PARAM(0));
@@ -61,7 +61,16 @@ struct Mutex : public KernelObject
 	const char *GetName() {return nm.name;}
 	const char *GetTypeName() {return "Mutex";}
 	static u32 GetMissingErrorCode() { return PSP_MUTEX_ERROR_NO_SUCH_MUTEX; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Mutex; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Mutex; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nm);
+		p.Do(waitingThreads);
+		p.DoMarker("Mutex");
+	}
+
 	NativeMutex nm;
 	std::vector<SceUID> waitingThreads;
 };
@@ -102,7 +111,16 @@ struct LwMutex : public KernelObject
 	const char *GetName() {return nm.name;}
 	const char *GetTypeName() {return "LwMutex";}
 	static u32 GetMissingErrorCode() { return PSP_LWMUTEX_ERROR_NO_SUCH_LWMUTEX; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_LwMutex; }
 	int GetIDType() const { return SCE_KERNEL_TMID_LwMutex; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nm);
+		p.Do(waitingThreads);
+		p.DoMarker("LwMutex");
+	}
+
 	NativeLwMutex nm;
 	std::vector<SceUID> waitingThreads;
 };
@@ -125,6 +143,30 @@ void __KernelMutexInit()
 	mutexInitComplete = true;
 }
 
+void __KernelMutexDoState(PointerWrap &p)
+{
+	bool initComplete = mutexInitComplete;
+	p.Do(initComplete);
+	if (p.mode == p.MODE_READ && initComplete && !mutexInitComplete)
+		__KernelMutexInit();
+
+	std::vector<std::pair<SceUID, SceUID> > heldLocks(mutexHeldLocks.begin(), mutexHeldLocks.end());
+	p.Do(heldLocks);
+	if (p.mode == p.MODE_READ)
+		mutexHeldLocks = MutexMap(heldLocks.begin(), heldLocks.end());
+	p.DoMarker("sceKernelMutex");
+}
+
+KernelObject *__KernelMutexObject()
+{
+	return new Mutex;
+}
+
+KernelObject *__KernelLwMutexObject()
+{
+	return new LwMutex;
+}
+
 void __KernelMutexAcquireLock(Mutex *mutex, int count, SceUID thread)
 {
 #if _DEBUG
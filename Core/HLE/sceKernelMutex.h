@@ -34,4 +34,8 @@ int sceKernelUnlockLwMutex(u32 workareaPtr, int count);
 
 void __KernelMutexTimeout(u64 userdata, int cyclesLate);
 void __KernelLwMutexTimeout(u64 userdata, int cyclesLate);
-void __KernelMutexThreadEnd(SceUID thread);
\ No newline at end of file
+void __KernelMutexThreadEnd(SceUID thread);
+
+void __KernelMutexDoState(PointerWrap &p);
+KernelObject *__KernelMutexObject();
+KernelObject *__KernelLwMutexObject();
\ No newline at end of file
@@ -55,8 +55,16 @@ struct Semaphore : public KernelObject
 	const char *GetTypeName() {return "Semaphore";}
 
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_SEMID; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Semaphore; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Semaphore; }
 
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(ns);
+		p.Do(waitingThreads);
+		p.DoMarker("Semaphore");
+	}
+
 	NativeSemaphore ns;
 	std::vector<SceUID> waitingThreads;
 };
@@ -70,6 +78,21 @@ void __KernelSemaInit()
 	semaInitComplete = true;
 }
 
+void __KernelSemaDoState(PointerWrap &p)
+{
+	// The timeout event is registered lazily, make sure it exists before CoreTiming loads.
+	bool initComplete = semaInitComplete;
+	p.Do(initComplete);
+	if (p.mode == p.MODE_READ && initComplete && !semaInitComplete)
+		__KernelSemaInit();
+	p.DoMarker("sceKernelSema");
+}
+
+KernelObject *__KernelSemaphoreObject()
+{
+	return new Semaphore;
+}
+
 // Returns whether the thread should be removed.
 bool __KernelUnlockSemaForThread(Semaphore *s, SceUID threadID, u32 &error, int result, bool &wokeThreads)
 {
@@ -27,3 +27,6 @@ int sceKernelWaitSema(SceUID semaid, int signal, u32 timeoutPtr);
 int sceKernelWaitSemaCB(SceUID semaid, int signal, u32 timeoutPtr);
 
 void __KernelSemaTimeout(u64 userdata, int cycleslate);
+
+void __KernelSemaDoState(PointerWrap &p);
+KernelObject *__KernelSemaphoreObject();
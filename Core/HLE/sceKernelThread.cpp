@@ -15,10 +15,15 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
 #include <set>
 #include <map>
 #include <queue>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include "HLE.h"
 #include "HLETables.h"
 #include "../MIPS/MIPSInt.h"
@@ -74,6 +79,7 @@ const char *waitTypeStrings[] =
   "Mutex",
   "LwMutex",
   "Ctrl",
+  "Io",
 };
 
 struct SceKernelSysClock {
@@ -113,8 +119,21 @@ public:
 	}
 
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_CBID; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Callback; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Callback; }
 
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nc);
+		p.Do(savedPC);
+		p.Do(savedRA);
+		p.Do(savedV0);
+		p.Do(savedV1);
+		p.Do(savedIdRegister);
+		p.Do(forceDelete);
+		p.DoMarker("Callback");
+	}
+
 	NativeCallback nc;
 
 	u32 savedPC;
@@ -188,6 +207,7 @@ public:
   
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_THID; }
   
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_Thread; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Thread; }
 
 	bool AllocateStack(u32 &stackSize)
@@ -233,14 +253,12 @@ public:
 		}
 	}
 
-	Thread() : stackBlock(0)
+	Thread() : stackBlock(0), readyQueued(false), readyPriority(0), readyPrev(0), readyNext(0),
+		waitListed(false), waitListKey(0), waitPrev(0), waitNext(0)
 	{
 	}
 
-	~Thread()
-	{
-		FreeStack();
-	}
+	~Thread();
 
 	ActionAfterMipsCall *getRunningCallbackAction();
 	void setReturnValue(u32 retval);
@@ -255,6 +273,28 @@ public:
 	bool isReady() const { return (nt.status & THREADSTATUS_DORMANT) != 0; }
 	bool isWaiting() const { return (nt.status & THREADSTATUS_WAIT) != 0; }
 	bool isSuspended() const { return (nt.status & THREADSTATUS_SUSPEND) != 0; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nt);
+		p.Do(waitInfo);
+		p.Do(sleeping);
+		p.Do(moduleId);
+		p.Do(isProcessingCallbacks);
+		p.Do(currentCallbackId);
+		p.Do(context);
+
+		for (int i = 0; i < THREAD_CALLBACK_NUM_TYPES; i++)
+		{
+			p.Do(registeredCallbacks[i]);
+			p.Do(readyCallbacks[i]);
+		}
+
+		p.Do(pendingMipsCalls);
+		// The stack itself lives in guest memory, and the allocators are saved separately.
+		p.Do(stackBlock);
+		p.DoMarker("Thread");
+	}
 	
 	NativeThread nt;
 
@@ -273,6 +313,174 @@ public:
 	std::list<int> pendingMipsCalls;
 
 	u32 stackBlock;
+
+	// Links for threadReadyQueue, not saved (the queue order is).
+	bool readyQueued;
+	int readyPriority;
+	Thread *readyPrev;
+	Thread *readyNext;
+
+	// Links for the wait list of whatever __KernelTriggerWait key this thread waits on.
+	bool waitListed;
+	u64 waitListKey;
+	Thread *waitPrev;
+	Thread *waitNext;
+};
+
+// All threads that could run but aren't, by priority, FIFO within each priority.
+// The current thread isn't in it unless it yielded.
+class ThreadReadyQueue
+{
+public:
+	ThreadReadyQueue()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		memset(heads, 0, sizeof(heads));
+		memset(tails, 0, sizeof(tails));
+		memset(bitmap, 0, sizeof(bitmap));
+	}
+
+	void push_back(Thread *t)
+	{
+		int prio = clampPriority(t->nt.currentPriority);
+		t->readyQueued = true;
+		t->readyPriority = prio;
+		t->readyNext = 0;
+		t->readyPrev = tails[prio];
+		if (tails[prio])
+			tails[prio]->readyNext = t;
+		else
+			heads[prio] = t;
+		tails[prio] = t;
+		bitmap[prio >> 5] |= 0x80000000 >> (prio & 31);
+	}
+
+	void push_front(Thread *t)
+	{
+		int prio = clampPriority(t->nt.currentPriority);
+		t->readyQueued = true;
+		t->readyPriority = prio;
+		t->readyPrev = 0;
+		t->readyNext = heads[prio];
+		if (heads[prio])
+			heads[prio]->readyPrev = t;
+		else
+			tails[prio] = t;
+		heads[prio] = t;
+		bitmap[prio >> 5] |= 0x80000000 >> (prio & 31);
+	}
+
+	void remove(Thread *t)
+	{
+		if (!t->readyQueued)
+			return;
+
+		int prio = t->readyPriority;
+		if (t->readyPrev)
+			t->readyPrev->readyNext = t->readyNext;
+		else
+			heads[prio] = t->readyNext;
+		if (t->readyNext)
+			t->readyNext->readyPrev = t->readyPrev;
+		else
+			tails[prio] = t->readyPrev;
+		if (!heads[prio])
+			bitmap[prio >> 5] &= ~(0x80000000 >> (prio & 31));
+
+		t->readyQueued = false;
+		t->readyPrev = 0;
+		t->readyNext = 0;
+	}
+
+	// Lower numbers are better, -1 if empty.
+	int highestPriority() const
+	{
+		for (int i = 0; i < NUM_WORDS; i++)
+		{
+			if (bitmap[i] != 0)
+				return (i << 5) + countLeadingZeros(bitmap[i]);
+		}
+		return -1;
+	}
+
+	Thread *pop_first()
+	{
+		int prio = highestPriority();
+		if (prio < 0)
+			return 0;
+		Thread *t = heads[prio];
+		remove(t);
+		return t;
+	}
+
+	// Only returns a thread if it's strictly better than priority.
+	Thread *pop_first_better(int priority)
+	{
+		int prio = highestPriority();
+		if (prio < 0 || prio >= clampPriority(priority))
+			return 0;
+		Thread *t = heads[prio];
+		remove(t);
+		return t;
+	}
+
+	bool empty(int priority) const
+	{
+		return heads[clampPriority(priority)] == 0;
+	}
+
+	// Moves the first thread of this priority to the back.
+	void rotate(int priority)
+	{
+		int prio = clampPriority(priority);
+		Thread *t = heads[prio];
+		if (t && t != tails[prio])
+		{
+			remove(t);
+			push_back(t);
+		}
+	}
+
+	void getAll(std::vector<Thread *> &threads) const
+	{
+		for (int prio = 0; prio < NUM_PRIORITIES; prio++)
+		{
+			for (Thread *t = heads[prio]; t; t = t->readyNext)
+				threads.push_back(t);
+		}
+	}
+
+private:
+	enum
+	{
+		NUM_PRIORITIES = 128,
+		NUM_WORDS = NUM_PRIORITIES / 32,
+	};
+
+	static int clampPriority(int prio)
+	{
+		return prio < 0 ? 0 : (prio >= NUM_PRIORITIES ? NUM_PRIORITIES - 1 : prio);
+	}
+
+	static int countLeadingZeros(u32 v)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, v);
+		return 31 - (int)index;
+#else
+		return __builtin_clz(v);
+#endif
+	}
+
+	Thread *heads[NUM_PRIORITIES];
+	Thread *tails[NUM_PRIORITIES];
+	// Priority p is bit (31 - p % 32) of word p / 32, so the best priority is found with clz.
+	u32 bitmap[NUM_WORDS];
 };
 
 void __KernelExecuteMipsCallOnCurrentThread(int callId, bool reschedAfter);
@@ -294,6 +502,15 @@ u32 threadReturnHackAddr;
 u32 cbReturnHackAddr;
 u32 intReturnHackAddr;
 std::vector<Thread *> threadqueue; //Change to SceUID
+ThreadReadyQueue threadReadyQueue;
+
+// Threads waiting on each (WaitType, id), in the order they started waiting.
+struct ThreadWaitList
+{
+	Thread *head;
+	Thread *tail;
+};
+std::map<u64, ThreadWaitList> threadWaitLists;
 std::vector<ThreadCallback> threadEndListeners;
 
 SceUID threadIdleID[2];
@@ -306,10 +523,88 @@ bool dispatchEnabled = true;
 // This seems nasty
 SceUID curModule;
 
+// Factories for the Action subclasses that can be pending in a MipsCall, indexed by
+// actionTypeID. Registration order must not change between runs, save states depend on it.
+std::vector<ActionCreator> actionTypes;
+int actionAfterMipsCall;
+int actionAfterCallback;
+
 //////////////////////////////////////////////////////////////////////////
 //STATE END
 //////////////////////////////////////////////////////////////////////////
 
+static inline u64 __KernelWaitListKey(WaitType type, int id)
+{
+	return ((u64)(u32)type << 32) | (u32)id;
+}
+
+static void __KernelUnlinkWait(Thread *thread)
+{
+	if (!thread->waitListed)
+		return;
+
+	std::map<u64, ThreadWaitList>::iterator list = threadWaitLists.find(thread->waitListKey);
+	if (list != threadWaitLists.end())
+	{
+		if (thread->waitPrev)
+			thread->waitPrev->waitNext = thread->waitNext;
+		else
+			list->second.head = thread->waitNext;
+		if (thread->waitNext)
+			thread->waitNext->waitPrev = thread->waitPrev;
+		else
+			list->second.tail = thread->waitPrev;
+		if (!list->second.head)
+			threadWaitLists.erase(list);
+	}
+
+	thread->waitListed = false;
+	thread->waitPrev = 0;
+	thread->waitNext = 0;
+}
+
+static void __KernelLinkWait(Thread *thread, u64 key)
+{
+	__KernelUnlinkWait(thread);
+
+	ThreadWaitList &list = threadWaitLists[key];
+	thread->waitListed = true;
+	thread->waitListKey = key;
+	thread->waitNext = 0;
+	thread->waitPrev = list.tail;
+	if (list.tail)
+		list.tail->waitNext = thread;
+	else
+		list.head = thread;
+	list.tail = thread;
+}
+
+Thread::~Thread()
+{
+	threadReadyQueue.remove(this);
+	__KernelUnlinkWait(this);
+	FreeStack();
+}
+
+static bool __KernelThreadIsRunnable(Thread *thread)
+{
+	return (thread->nt.status & (THREADSTATUS_RUNNING | THREADSTATUS_READY)) != 0;
+}
+
+// All status changes go through here to keep threadReadyQueue in sync.
+static void __KernelSetThreadStatus(Thread *thread, int status)
+{
+	thread->nt.status = status;
+
+	if (status & (THREADSTATUS_DORMANT | THREADSTATUS_DEAD))
+		__KernelUnlinkWait(thread);
+
+	if (!__KernelThreadIsRunnable(thread))
+		threadReadyQueue.remove(thread);
+	else if (!thread->readyQueued && thread != currentThread)
+		threadReadyQueue.push_back(thread);
+}
+
 
 // TODO: Should move to this wrapper so we can keep the current thread as a SceUID instead
 // of a dangerous raw pointer.
@@ -329,6 +624,9 @@ u32 __KernelInterruptReturnAddress()
 
 void hleScheduledWakeup(u64 userdata, int cyclesLate);
 
+Action *__KernelCreateActionAfterMipsCall();
+Action *__KernelCreateActionAfterCallback();
+
 void __KernelThreadingInit()
 {
   u32 blockSize = 4 * 4 + 4 * 2 * 3;  // One 16-byte thread plus 3 8-byte "hacks"
@@ -358,6 +656,9 @@ void __KernelThreadingInit()
 
 	eventScheduledWakeup = CoreTiming::RegisterEvent("ScheduledWakeup", &hleScheduledWakeup);
 
+	actionAfterMipsCall = __KernelRegisterActionType(__KernelCreateActionAfterMipsCall);
+	actionAfterCallback = __KernelRegisterActionType(__KernelCreateActionAfterCallback);
+
   // Create the two idle threads, as well. With the absolute minimal possible priority.
   // 4096 stack size - don't know what the right value is. Hm, if callbacks are ever to run on these threads...
   __KernelResetThread(__KernelCreateThread(threadIdleID[0], 0, "idle0", idleThreadHackAddr, 0x7f, 4096, PSP_THREAD_ATTR_KERNEL));
@@ -367,6 +668,132 @@ void __KernelThreadingInit()
   __KernelListenThreadEnd(__KernelCancelWakeup);
 }
 
+void __KernelDoStateAction(PointerWrap &p, Action *&action);
+
+class MipsCallManager;
+extern MipsCallManager mipsCalls;
+void __KernelMipsCallsDoState(PointerWrap &p);
+
+void __KernelThreadingDoState(PointerWrap &p)
+{
+	p.Do(g_inCbCount);
+	p.Do(idleThreadHackAddr);
+	p.Do(threadReturnHackAddr);
+	p.Do(cbReturnHackAddr);
+	p.Do(intReturnHackAddr);
+	p.DoArray(threadIdleID, ARRAYSIZE(threadIdleID));
+	p.Do(dispatchEnabled);
+	p.Do(curModule);
+
+	// Threads are owned by kernelObjects, which is restored first, so just keep their ids.
+	u32 error;
+	SceUID currentThreadID = currentThread ? currentThread->GetUID() : 0;
+	p.Do(currentThreadID);
+	std::vector<SceUID> queue;
+	for (size_t i = 0; i < threadqueue.size(); i++)
+		queue.push_back(threadqueue[i]->GetUID());
+	p.Do(queue);
+	std::vector<Thread *> readyThreads;
+	threadReadyQueue.getAll(readyThreads);
+	std::vector<SceUID> readyQueue;
+	for (size_t i = 0; i < readyThreads.size(); i++)
+		readyQueue.push_back(readyThreads[i]->GetUID());
+	p.Do(readyQueue);
+
+	u32 numWaitLists = (u32)threadWaitLists.size();
+	p.Do(numWaitLists);
+	std::map<u64, ThreadWaitList>::iterator waitList = threadWaitLists.begin();
+	if (p.mode == p.MODE_READ)
+		threadWaitLists.clear();
+	for (u32 i = 0; i < numWaitLists; i++)
+	{
+		u64 key = 0;
+		std::vector<SceUID> waiting;
+		if (p.mode != p.MODE_READ)
+		{
+			key = waitList->first;
+			for (Thread *t = waitList->second.head; t; t = t->waitNext)
+				waiting.push_back(t->GetUID());
+			++waitList;
+		}
+		p.Do(key);
+		p.Do(waiting);
+		if (p.mode == p.MODE_READ)
+		{
+			for (size_t j = 0; j < waiting.size(); j++)
+			{
+				Thread *t = kernelObjects.Get<Thread>(waiting[j], error);
+				if (t)
+					__KernelLinkWait(t, key);
+			}
+		}
+	}
+
+	if (p.mode == p.MODE_READ)
+	{
+		currentThread = currentThreadID == 0 ? NULL : kernelObjects.Get<Thread>(currentThreadID, error);
+		threadqueue.clear();
+		for (size_t i = 0; i < queue.size(); i++)
+		{
+			Thread *t = kernelObjects.Get<Thread>(queue[i], error);
+			if (t)
+				threadqueue.push_back(t);
+		}
+		threadReadyQueue.clear();
+		for (size_t i = 0; i < readyQueue.size(); i++)
+		{
+			Thread *t = kernelObjects.Get<Thread>(readyQueue[i], error);
+			if (t)
+				threadReadyQueue.push_back(t);
+		}
+	}
+
+	__KernelMipsCallsDoState(p);
+	p.DoMarker("sceKernelThread");
+}
+
+int __KernelRegisterActionType(ActionCreator creator)
+{
+	actionTypes.push_back(creator);
+	// Zero means "no action" in save states.
+	return (int)actionTypes.size();
+}
+
+Action *__KernelCreateAction(int actionType)
+{
+	if (actionType <= 0 || actionType > (int)actionTypes.size())
+	{
+		ERROR_LOG(HLE, "Unknown action type %d", actionType);
+		return NULL;
+	}
+
+	Action *a = actionTypes[actionType - 1]();
+	a->actionTypeID = actionType;
+	return a;
+}
+
+// Saves an optional owned action as its type id followed by its state.
+void __KernelDoStateAction(PointerWrap &p, Action *&action)
+{
+	int actionType = action ? action->actionTypeID : 0;
+	p.Do(actionType);
+	if (p.mode == p.MODE_READ)
+	{
+		action = NULL;
+		if (actionType != 0)
+		{
+			action = __KernelCreateAction(actionType);
+			if (!action)
+			{
+				p.SetError(p.ERROR_FAILURE);
+				return;
+			}
+		}
+	}
+	if (action)
+		action->DoState(p);
+}
+
 void __KernelListenThreadEnd(ThreadCallback callback)
 {
 	threadEndListeners.push_back(callback);
@@ -391,7 +818,7 @@ void __KernelStartIdleThreads()
     t->nt.gpreg = __KernelGetModuleGP(curModule);
     t->context.r[MIPS_REG_GP] = t->nt.gpreg;
     //t->context.pc += 4;  // ADJUSTPC
-    t->nt.status = THREADSTATUS_READY;
+    __KernelSetThreadStatus(t, THREADSTATUS_READY);
   }
 }
 
@@ -416,6 +843,9 @@ void __KernelThreadingShutdown()
 	currentThread = 0;
 	intReturnHackAddr = 0;
 	threadqueue.clear();
+	threadReadyQueue.clear();
+	threadWaitLists.clear();
+	actionTypes.clear();
 }
 
 const char *__KernelGetThreadName(SceUID threadID)
@@ -538,6 +968,74 @@ void sceKernelGetThreadmanIdType()
   }
 }
 
+static bool __KernelThreadMatchesIdListType(Thread *t, int type)
+{
+	switch (type)
+	{
+	case SCE_KERNEL_TMID_SleepThread:
+		return (t->nt.status & THREADSTATUS_WAIT) != 0 && t->nt.waitType == WAITTYPE_SLEEP;
+	case SCE_KERNEL_TMID_DelayThread:
+		return (t->nt.status & THREADSTATUS_WAIT) != 0 && t->nt.waitType == WAITTYPE_DELAY;
+	case SCE_KERNEL_TMID_SuspendThread:
+		return (t->nt.status & THREADSTATUS_SUSPEND) != 0;
+	case SCE_KERNEL_TMID_DormantThread:
+		return (t->nt.status & THREADSTATUS_DORMANT) != 0;
+	default:
+		return true;
+	}
+}
+
+u32 sceKernelGetThreadmanIdList(u32 type, u32 readBufPtr, u32 readBufSize, u32 idCountPtr)
+{
+	if (readBufSize >= 0x8000000)
+	{
+		ERROR_LOG(HLE, "sceKernelGetThreadmanIdList(%i, %08x, %i, %08x): invalid size", type, readBufPtr, readBufSize, idCountPtr);
+		return SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	}
+	if (!Memory::IsValidAddress(readBufPtr))
+	{
+		ERROR_LOG(HLE, "sceKernelGetThreadmanIdList(%i, %08x, %i, %08x): invalid pointer", type, readBufPtr, readBufSize, idCountPtr);
+		return SCE_KERNEL_ERROR_ILLEGAL_ADDR;
+	}
+
+	std::vector<SceUID> uids;
+	if (type >= SCE_KERNEL_TMID_SleepThread && type <= SCE_KERNEL_TMID_DormantThread)
+	{
+		int total = kernelObjects.ListIDType(SCE_KERNEL_TMID_Thread, NULL, 0);
+		std::vector<SceUID> threads(total);
+		if (total > 0)
+			kernelObjects.ListIDType(SCE_KERNEL_TMID_Thread, &threads[0], total);
+		for (int i = 0; i < total; i++)
+		{
+			u32 error;
+			Thread *t = kernelObjects.Get<Thread>(threads[i], error);
+			if (t && __KernelThreadMatchesIdListType(t, type))
+				uids.push_back(threads[i]);
+		}
+	}
+	else if (type >= SCE_KERNEL_TMID_Thread && type <= SCE_KERNEL_TMID_LwMutex)
+	{
+		int total = kernelObjects.ListIDType(type, NULL, 0);
+		uids.resize(total);
+		if (total > 0)
+			kernelObjects.ListIDType(type, &uids[0], total);
+	}
+	else
+	{
+		ERROR_LOG(HLE, "sceKernelGetThreadmanIdList(%i, %08x, %i, %08x): invalid type", type, readBufPtr, readBufSize, idCountPtr);
+		return SCE_KERNEL_ERROR_ILLEGAL_TYPE;
+	}
+
+	u32 written = std::min((u32)uids.size(), readBufSize);
+	for (u32 i = 0; i < written; i++)
+		Memory::Write_U32(uids[i], readBufPtr + i * 4);
+	if (Memory::IsValidAddress(idCountPtr))
+		Memory::Write_U32((u32)uids.size(), idCountPtr);
+
+	DEBUG_LOG(HLE, "sceKernelGetThreadmanIdList(%i, %08x, %i, %08x): %i ids", type, readBufPtr, readBufSize, idCountPtr, (int)uids.size());
+	return 0;
+}
+
 // Saves the current CPU context
 void __KernelSaveContext(ThreadContext *ctx)
 {
@@ -628,9 +1126,13 @@ bool __KernelTriggerWait(WaitType type, int id, bool useRetVal, int retVal, bool
 {
 	bool doneAnything = false;
 
-	for (std::vector<Thread *>::iterator iter = threadqueue.begin(); iter != threadqueue.end(); iter++)
+	// Only the threads that waited on this.  Resuming unlinks them, so grab next first.
+	std::map<u64, ThreadWaitList>::iterator list = threadWaitLists.find(__KernelWaitListKey(type, id));
+	Thread *next = list == threadWaitLists.end() ? 0 : list->second.head;
+	while (next)
 	{
-		Thread *t = *iter;
+		Thread *t = next;
+		next = t->waitNext;
 		if (t->isWaitingFor(type, id))
 		{
 			// This thread was waiting for the triggered object.
@@ -645,10 +1147,14 @@ bool __KernelTriggerWait(WaitType type, int id, bool useRetVal, int retVal, bool
 	{
 		if (!dontSwitch)
 		{
-			// TODO: time waster
+			// The reason is only ever used for debug logging.
+#if MAX_LOGLEVEL >= DEBUG_LEVEL
 			char temp[256];
 			sprintf(temp, "resumed from wait %s", waitTypeStrings[(int)type]);
 			hleReSchedule(temp);
+#else
+			hleReSchedule("resumed from wait");
+#endif
 		}
 	}
 	return true;
@@ -673,6 +1179,7 @@ void __KernelWaitCurThread(WaitType type, SceUID waitID, u32 waitValue, u32 time
 
 	currentThread->nt.waitID = waitID;
 	currentThread->nt.waitType = type;
+	__KernelLinkWait(currentThread, __KernelWaitListKey(type, waitID));
 	__KernelChangeThreadState(currentThread, THREADSTATUS_WAIT);
 	currentThread->nt.numReleases++;
 	currentThread->waitInfo.waitValue = waitValue;
@@ -681,11 +1188,13 @@ void __KernelWaitCurThread(WaitType type, SceUID waitID, u32 waitValue, u32 time
 	// TODO: Remove this once all callers are cleaned up.
 	RETURN(0); //pretend all went OK
 
-	// TODO: time waster
+#if MAX_LOGLEVEL >= DEBUG_LEVEL
 	char temp[256];
 	sprintf(temp, "started wait %s", waitTypeStrings[(int)type]);
-  
 	hleReSchedule(processCallbacks, temp);
+#else
+	hleReSchedule(processCallbacks, "started wait");
+#endif
 	// TODO: Remove thread from Ready queue?
 }
 
@@ -719,41 +1228,13 @@ void __KernelRemoveFromThreadQueue(Thread *t)
 }
 
 Thread *__KernelNextThread() {
-	// round-robin scheduler
-	// seems to work ?
-  // not accurate!
-	int bestthread = -1;
-	int prio = 0xffffff;
-
-	int next = 0;
-	for (size_t i = 0; i < threadqueue.size(); i++)
-	{
-		if (currentThread == threadqueue[i])
-		{
-			next = (int)i;
-			break;
-		}
-	}
-
-	for (size_t i = 0; i < threadqueue.size(); i++)
+	// Like the PSP, a thread keeps running until it waits, yields, or a better priority is ready.
+	if (currentThread && !currentThread->readyQueued && __KernelThreadIsRunnable(currentThread))
 	{
-		next = (next + 1) % threadqueue.size();
-
-		Thread *t = threadqueue[next];
-		if (t->nt.currentPriority < prio)
-		{
-			if (t->nt.status & THREADSTATUS_READY)
-			{
-				bestthread = next;
-				prio = t->nt.currentPriority;
-			}
-		}
+		Thread *better = threadReadyQueue.pop_first_better(currentThread->nt.currentPriority);
+		return better ? better : currentThread;
 	}
-
-	if (bestthread != -1)
-		return threadqueue[bestthread];
-	else
-		return 0;
+	return threadReadyQueue.pop_first();
 }
 
 void __KernelReSchedule(const char *reason)
@@ -883,6 +1364,16 @@ void __KernelResetThread(Thread *t)
 	t->AllocateStack(t->nt.stackSize);  // can change the stacksize!
 }
 
+KernelObject *__KernelThreadObject()
+{
+	return new Thread;
+}
+
+KernelObject *__KernelCallbackObject()
+{
+	return new Callback;
+}
+
 Thread *__KernelCreateThread(SceUID &id, SceUID moduleId, const char *name, u32 entryPoint, u32 priority, int stacksize, u32 attr)
 {
 	Thread *t = new Thread;
@@ -922,7 +1413,7 @@ void __KernelSetupRootThread(SceUID moduleID, int args, const char *argp, int pr
 	SceUID id;
 	currentThread = __KernelCreateThread(id, moduleID, "root", currentMIPS->pc, prio, stacksize, attr);
 	__KernelResetThread(currentThread);
-	currentThread->nt.status = THREADSTATUS_READY; // do not schedule
+	__KernelSetThreadStatus(currentThread, THREADSTATUS_READY); // do not schedule
 
 	strcpy(currentThread->nt.name, "root");
 
@@ -972,7 +1463,7 @@ int sceKernelStartThread(SceUID threadToStartID, u32 argSize, u32 argBlockPtr)
 
 		__KernelResetThread(startThread);
 
-		startThread->nt.status = THREADSTATUS_READY;
+		__KernelSetThreadStatus(startThread, THREADSTATUS_READY);
 		u32 sp = startThread->context.r[MIPS_REG_SP];
 		if (argBlockPtr && argSize > 0)
 		{
@@ -1047,7 +1538,7 @@ void __KernelReturnFromThread()
 	}
 
 	currentThread->nt.exitStatus = currentThread->context.r[2];
-	currentThread->nt.status = THREADSTATUS_DORMANT;
+	__KernelSetThreadStatus(currentThread, THREADSTATUS_DORMANT);
 	__KernelFireThreadEnd(currentThread);
 
 	// TODO: Need to remove the thread from any ready queues.
@@ -1063,7 +1554,7 @@ void __KernelReturnFromThread()
 void sceKernelExitThread()
 {
 	ERROR_LOG(HLE,"sceKernelExitThread FAKED");
-	currentThread->nt.status = THREADSTATUS_DORMANT;
+	__KernelSetThreadStatus(currentThread, THREADSTATUS_DORMANT);
 	currentThread->nt.exitStatus = PARAM(0);
 	__KernelFireThreadEnd(currentThread);
 
@@ -1078,7 +1569,7 @@ void sceKernelExitThread()
 void _sceKernelExitThread()
 {
   ERROR_LOG(HLE,"_sceKernelExitThread FAKED");
-  currentThread->nt.status = THREADSTATUS_DORMANT;
+  __KernelSetThreadStatus(currentThread, THREADSTATUS_DORMANT);
   currentThread->nt.exitStatus = PARAM(0);
   __KernelFireThreadEnd(currentThread);
 
@@ -1098,7 +1589,7 @@ void sceKernelExitDeleteThread()
   if (t)
   {
     ERROR_LOG(HLE,"sceKernelExitDeleteThread()");
-    currentThread->nt.status = THREADSTATUS_DORMANT;
+    __KernelSetThreadStatus(currentThread, THREADSTATUS_DORMANT);
     currentThread->nt.exitStatus = PARAM(0);
 	__KernelFireThreadEnd(currentThread);
 		//userMemory.Free(currentThread->stackBlock);
@@ -1136,7 +1627,21 @@ u32 sceKernelResumeDispatchThread(u32 suspended)
 
 void sceKernelRotateThreadReadyQueue()
 {
-	DEBUG_LOG(HLE,"sceKernelRotateThreadReadyQueue : rescheduling");
+	int priority = PARAM(0);
+	DEBUG_LOG(HLE,"sceKernelRotateThreadReadyQueue(%x)", priority);
+	if (priority == 0)
+		priority = currentThread->nt.currentPriority;
+
+	// If it's our own priority, we go to the back and the next one in line runs.
+	if (priority == currentThread->nt.currentPriority && !currentThread->readyQueued && __KernelThreadIsRunnable(currentThread))
+	{
+		if (!threadReadyQueue.empty(priority))
+			threadReadyQueue.push_back(currentThread);
+	}
+	else
+		threadReadyQueue.rotate(priority);
+
+	RETURN(0);
 	hleReSchedule("rotatethreadreadyqueue");
 }
 
@@ -1202,7 +1707,7 @@ int sceKernelTerminateThread(u32 threadID)
 		Thread *t = kernelObjects.Get<Thread>(threadID, error);
 		if (t)
 		{
-			t->nt.status = THREADSTATUS_DORMANT;
+			__KernelSetThreadStatus(t, THREADSTATUS_DORMANT);
 			__KernelFireThreadEnd(t);
 			__KernelTriggerWait(WAITTYPE_THREADEND, threadID);
 		}
@@ -1260,8 +1765,14 @@ void sceKernelChangeThreadPriority()
 	if (thread)
 	{
 		DEBUG_LOG(HLE,"sceKernelChangeThreadPriority(%i, %i)", id, PARAM(1));
+		// Moves to the back of the new priority.
+		bool queued = thread->readyQueued;
+		threadReadyQueue.remove(thread);
 		thread->nt.currentPriority = PARAM(1);
+		if (queued)
+			threadReadyQueue.push_back(thread);
 		RETURN(0);
+		hleReSchedule("change thread priority");
 	}
 	else
 	{
@@ -1550,6 +2061,39 @@ public:
 		calls_.erase(id);
 		return temp;
 	}
+	void clear() {
+		for (std::map<int, MipsCall *>::iterator it = calls_.begin(), end = calls_.end(); it != end; ++it) {
+			delete it->second->doAfter;
+			delete it->second;
+		}
+		calls_.clear();
+		idGen_ = 0;
+	}
+
+	void DoState(PointerWrap &p) {
+		if (p.mode == p.MODE_READ)
+			clear();
+		p.Do(idGen_);
+
+		u32 count = (u32)calls_.size();
+		p.Do(count);
+		if (p.mode == p.MODE_READ) {
+			for (u32 i = 0; i < count; i++) {
+				int id = 0;
+				p.Do(id);
+				MipsCall *call = new MipsCall();
+				call->DoState(p);
+				calls_[id] = call;
+			}
+		} else {
+			for (std::map<int, MipsCall *>::iterator it = calls_.begin(), end = calls_.end(); it != end; ++it) {
+				int id = it->first;
+				p.Do(id);
+				it->second->DoState(p);
+			}
+		}
+		p.DoMarker("MipsCallManager");
+	}
 
 private:
 	int genId() { return ++idGen_; }
@@ -1559,11 +2103,56 @@ private:
 
 MipsCallManager mipsCalls;
 
+void __KernelMipsCallsDoState(PointerWrap &p)
+{
+	mipsCalls.DoState(p);
+}
+
+void MipsCall::DoState(PointerWrap &p)
+{
+	p.Do(entryPoint);
+	p.Do(cbId);
+	p.DoArray(args, ARRAYSIZE(args));
+	p.Do(numArgs);
+	p.Do(savedIdRegister);
+	p.Do(savedRa);
+	p.Do(savedPc);
+	p.Do(savedV0);
+	p.Do(savedV1);
+	p.Do(returnVoid);
+	p.Do(savedId);
+	p.Do(reschedAfter);
+	__KernelDoStateAction(p, doAfter);
+	if (p.mode == p.MODE_READ)
+		tag = "callAddress";
+	p.DoMarker("MipsCall");
+}
 
 class ActionAfterMipsCall : public Action
 {
 public:
+	ActionAfterMipsCall() : thread(NULL), chainedAction(NULL) {}
 	virtual void run();
+
+	virtual void DoState(PointerWrap &p)
+	{
+		SceUID threadID = thread ? thread->GetUID() : 0;
+		p.Do(threadID);
+		if (p.mode == p.MODE_READ)
+		{
+			u32 error;
+			thread = threadID == 0 ? NULL : kernelObjects.Get<Thread>(threadID, error);
+		}
+
+		p.Do(status);
+		p.Do(waitType);
+		p.Do(waitID);
+		p.Do(waitInfo);
+		p.Do(isProcessingCallbacks);
+		__KernelDoStateAction(p, chainedAction);
+		p.DoMarker("ActionAfterMipsCall");
+	}
+
 	Thread *thread;
 
 	// Saved thread state
@@ -1577,7 +2166,7 @@ public:
 };
 
 void ActionAfterMipsCall::run() {
-	thread->nt.status = status;
+	__KernelSetThreadStatus(thread, status);
 	thread->nt.waitType = waitType;
 	thread->nt.waitID = waitID;
 	thread->waitInfo = waitInfo;
@@ -1632,6 +2221,8 @@ void Thread::setReturnValue(u32 retval)
 
 void Thread::resumeFromWait()
 {
+	__KernelUnlinkWait(this);
+
 	// Do we need to "inject" it?
 	ActionAfterMipsCall *action = getRunningCallbackAction();
 	if (action)
@@ -1646,10 +2237,11 @@ void Thread::resumeFromWait()
 	}
 	else
 	{
-		this->nt.status &= ~THREADSTATUS_WAIT;
+		int status = this->nt.status & ~THREADSTATUS_WAIT;
 		// TODO: What if DORMANT or DEAD?
-		if (!(this->nt.status & THREADSTATUS_WAITSUSPEND))
-			this->nt.status = THREADSTATUS_READY;
+		if (!(status & THREADSTATUS_WAITSUSPEND))
+			status = THREADSTATUS_READY;
+		__KernelSetThreadStatus(this, status);
 
 		// Non-waiting threads do not process callbacks.
 		this->isProcessingCallbacks = false;
@@ -1700,11 +2292,18 @@ ThreadWaitInfo Thread::getWaitInfo()
 
 void __KernelSwitchContext(Thread *target, const char *reason) 
 {
+	Thread *oldThread = currentThread;
 	if (currentThread)  // It might just have been deleted.
 	{
 		__KernelSaveContext(&currentThread->context);
 		DEBUG_LOG(HLE,"Context saved (%s): %i - %s - pc: %08x", reason, currentThread->GetUID(), currentThread->GetName(), currentMIPS->pc);
 	}
+
+	threadReadyQueue.remove(target);
+	// A preempted thread goes first in line for its priority, one that yielded is already queued.
+	if (oldThread && oldThread != target && !oldThread->readyQueued && __KernelThreadIsRunnable(oldThread))
+		threadReadyQueue.push_front(oldThread);
+
 	currentThread = target;
 	__KernelLoadContext(&currentThread->context);
 	DEBUG_LOG(HLE,"Context loaded (%s): %i - %s - pc: %08x", reason, currentThread->GetUID(), currentThread->GetName(), currentMIPS->pc);
@@ -1728,7 +2327,7 @@ void __KernelChangeThreadState(Thread *thread, ThreadStatus newStatus) {
 	// TODO: JPSCP has many conditions here, like removing wait timeout actions etc.
 	// if (thread->nt.status == THREADSTATUS_WAIT && newStatus != THREADSTATUS_WAITSUSPEND) {
 
-	thread->nt.status = newStatus;
+	__KernelSetThreadStatus(thread, newStatus);
 
 	if (newStatus == THREADSTATUS_WAIT) {
 		if (thread->nt.waitType == WAITTYPE_NONE) {
@@ -1747,7 +2346,7 @@ bool __CanExecuteCallbackNow(Thread *thread) {
 void __KernelCallAddress(Thread *thread, u32 entryPoint, Action *afterAction, bool returnVoid, std::vector<int> args, bool reschedAfter)
 {
 	if (thread) {
-		ActionAfterMipsCall *after = new ActionAfterMipsCall();
+		ActionAfterMipsCall *after = (ActionAfterMipsCall *) __KernelCreateAction(actionAfterMipsCall);
 		after->chainedAction = afterAction;
 		after->thread = thread;
 		after->status = thread->nt.status;
@@ -1791,6 +2390,17 @@ void __KernelCallAddress(Thread *thread, u32 entryPoint, Action *afterAction, bo
 	}
 }
 	
+void __KernelDirectMipsCall(u32 entryPoint, Action *afterAction, bool returnVoid, std::vector<int> args, bool reschedAfter)
+{
+	__KernelCallAddress(__GetCurrentThread(), entryPoint, afterAction, returnVoid, args, reschedAfter);
+}
+
+void __KernelSetMipsCallReturnValue(u32 retval)
+{
+	if (currentThread)
+		currentThread->setReturnValue(retval);
+}
+
 void __KernelExecuteMipsCallOnCurrentThread(int callId, bool reschedAfter)
 {
 	if (g_inCbCount > 0) {
@@ -1821,6 +2431,7 @@ void __KernelExecuteMipsCallOnCurrentThread(int callId, bool reschedAfter)
 	}
 
 	g_inCbCount++;
+	hleProfilerCallbackStart(callId);
 }
 
 void __KernelReturnFromMipsCall()
@@ -1829,15 +2440,18 @@ void __KernelReturnFromMipsCall()
 	if (currentMIPS->r[MIPS_REG_CALL_ID] != callId)
 		WARN_LOG(HLE, "__KernelReturnFromMipsCall(): s0 is %08x != %08x", currentMIPS->r[MIPS_REG_CALL_ID], callId);
 
-	MipsCall *call = mipsCalls.pop(callId);
+	MipsCall *call = mipsCalls.get(callId);
+	hleProfilerCallbackEnd(callId);
 
 	// Value returned by the callback function
 	u32 retVal = currentMIPS->r[MIPS_REG_V0];
 	DEBUG_LOG(HLE,"__KernelReturnFromMipsCall(), returned %08x", retVal);
 
 	// Should also save/restore wait state here.
+	// The call is still registered so the action can change what it returns.
 	if (call->doAfter)
 		call->doAfter->run();
+	mipsCalls.pop(callId);
 
 	currentMIPS->pc = call->savedPc;
 	currentMIPS->r[MIPS_REG_RA] = call->savedRa;
@@ -1883,11 +2497,33 @@ bool __KernelExecutePendingMipsCalls(bool reschedAfter)
 class ActionAfterCallback : public Action
 {
 public:
-	ActionAfterCallback(SceUID cbId_) : cbId(cbId_) {}
+	ActionAfterCallback() : cbId(-1) {}
 	virtual void run();
+
+	void setCallback(SceUID cbId_)
+	{
+		cbId = cbId_;
+	}
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(cbId);
+		p.DoMarker("ActionAfterCallback");
+	}
+
 	SceUID cbId;
 };
 
+Action *__KernelCreateActionAfterMipsCall()
+{
+	return new ActionAfterMipsCall();
+}
+
+Action *__KernelCreateActionAfterCallback()
+{
+	return new ActionAfterCallback();
+}
+
 // Executes the callback, when it next is context switched to.
 void __KernelRunCallbackOnThread(SceUID cbId, Thread *thread, bool reschedAfter)
 {
@@ -1912,7 +2548,8 @@ void __KernelRunCallbackOnThread(SceUID cbId, Thread *thread, bool reschedAfter)
 	cb->nc.notifyCount = 0;
 	cb->nc.notifyArg = 0;
 
-	Action *action = new ActionAfterCallback(cbId);
+	ActionAfterCallback *action = (ActionAfterCallback *) __KernelCreateAction(actionAfterCallback);
+	action->setCallback(cbId);
 	__KernelCallAddress(thread, cb->nc.entrypoint, action, false, args, reschedAfter);
 }
 
@@ -52,6 +52,7 @@ int sceKernelTerminateThread(u32 threadID);
 void sceKernelWaitThreadEndCB();
 void sceKernelGetThreadExitStatus();
 void sceKernelGetThreadmanIdType();
+u32 sceKernelGetThreadmanIdList(u32 type, u32 readBufPtr, u32 readBufSize, u32 idCountPtr);
 
 
 enum WaitType //probably not the real values
@@ -72,6 +73,7 @@ enum WaitType //probably not the real values
 	WAITTYPE_MUTEX = 13,
 	WAITTYPE_LWMUTEX = 14,
 	WAITTYPE_CTRL = 15,
+	WAITTYPE_IO = 16,
 	// Remember to update sceKernelThread.cpp's waitTypeStrings to match.
 };
 
@@ -96,7 +98,10 @@ struct ThreadContext
 // Internal API, used by implementations of kernel functions
 
 void __KernelThreadingInit();
+void __KernelThreadingDoState(PointerWrap &p);
 void __KernelThreadingShutdown();
+KernelObject *__KernelThreadObject();
+KernelObject *__KernelCallbackObject();
 
 void __KernelScheduleWakeup(int usFromNow, int threadnumber);
 SceUID __KernelGetCurThread();
@@ -190,7 +195,22 @@ struct MipsCall {
 	const char *tag;
 	u32 savedId;
 	bool reschedAfter;
+
+	void DoState(PointerWrap &p);
 };
+
+// Actions pending in a MipsCall are saved by type id, so every Action subclass
+// that can be pending must register a factory at init time (in a fixed order.)
+typedef Action *(*ActionCreator)();
+int __KernelRegisterActionType(ActionCreator creator);
+Action *__KernelCreateAction(int actionType);
+
+// Calls into game code on the current thread, then runs afterAction (may be NULL) when it returns.
+// The syscall's return value has to be set before this, since v0 is restored afterwards.
+void __KernelDirectMipsCall(u32 entryPoint, Action *afterAction, bool returnVoid, std::vector<int> args, bool reschedAfter);
+// From the Action of a direct call, sets what the interrupted HLE function returns.
+void __KernelSetMipsCallReturnValue(u32 retval);
+
 enum ThreadStatus
 {
 	THREADSTATUS_RUNNING = 1,
@@ -28,6 +28,7 @@ struct VTimer : public KernelObject
 	const char *GetName() {return name;}
 	const char *GetTypeName() {return "VTimer";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_VTID; }
+	static int GetStaticIDType() { return SCE_KERNEL_TMID_VTimer; }
 	int GetIDType() const { return SCE_KERNEL_TMID_VTimer; }
 
 	SceSize 	size;
@@ -37,8 +38,25 @@ struct VTimer : public KernelObject
 	u32 handler;
 	u64 handlerTime;
 	u32 argument;
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(size);
+		p.DoArray(name, sizeof(name));
+		p.Do(startTime);
+		p.Do(running);
+		p.Do(handler);
+		p.Do(handlerTime);
+		p.Do(argument);
+		p.DoMarker("VTimer");
+	}
 };
 
+KernelObject *__KernelVTimerObject()
+{
+	return new VTimer;
+}
+
 void sceKernelCreateVTimer()
 {
 	DEBUG_LOG(HLE,"sceKernelCreateVTimer");
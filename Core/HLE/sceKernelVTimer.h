@@ -17,6 +17,8 @@
 
 #pragma once
 
+KernelObject *__KernelVTimerObject();
+
 void sceKernelCreateVTimer();
 void sceKernelStartVTimer();
 void sceKernelSetVTimerHandler();
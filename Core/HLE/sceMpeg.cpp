@@ -15,227 +15,1164 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+// The ringbuffer and the PS demuxer are real, so games get correctly paced access units
+// with proper timestamps out of sceMpegGetAvcAu. Each AU goes to the MediaEngine's decode
+// thread as soon as it's demuxed, sceMpegAvcDecode only waits for the picture.
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
 #include "sceMpeg.h"
 #include "HLE.h"
+#include "../../Common/Action.h"
+#include "../../Common/ChunkFile.h"
+#include "sceKernelThread.h"
+#include "../HW/MediaEngine.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+enum {
+	ERROR_MPEG_BAD_VERSION = 0x80610002,
+	ERROR_MPEG_NO_MEMORY = 0x80610022,
+	ERROR_MPEG_INVALID_ADDR = 0x80610103,
+	ERROR_MPEG_INVALID_VALUE = 0x806101fe,
+	ERROR_MPEG_NO_DATA = 0x80618001,
+};
+
+const int MPEG_MEMSIZE = 0x10000;
+const int MPEG_PACKET_SIZE = 2048;
+const int MPEG_PACKET_OVERHEAD = 104;
+const int MPEG_YCBCR_HEADER_SIZE = 128;
+const u32 PSMF_MAGIC = 0x464D5350;
+const int PSMF_STREAM_OFFSET_OFFSET = 0x08;
+const int PSMF_STREAM_SIZE_OFFSET = 0x0C;
+
+// One frame at 29.97 fps in 90kHz ticks.
+const u64 MPEG_PTS_FRAME_INCREMENT = 3003;
+
+enum MpegStreamType {
+	MPEG_AVC_STREAM = 0,
+	MPEG_ATRAC_STREAM = 1,
+	MPEG_PCM_STREAM = 2,
+};
+
+enum MpegPixelMode {
+	MPEG_PIXEL_MODE_565 = 0,
+	MPEG_PIXEL_MODE_5551 = 1,
+	MPEG_PIXEL_MODE_4444 = 2,
+	MPEG_PIXEL_MODE_8888 = 3,
+};
+
+// Real PSP struct, don't change the fields
+struct SceMpegRingBuffer {
+	int packets;
+	int packetsRead;
+	int packetsWritten;
+	int packetsFree;
+	int packetSize;
+	u32 data;
+	u32 callback_addr;
+	u32 callback_args;
+	u32 dataUpperBound;
+	int semaID;
+	u32 mpeg;
+};
+
+// Real PSP struct, timestamps are stored high word first.
+struct SceMpegAu {
+	u32 ptsHi;
+	u32 ptsLo;
+	u32 dtsHi;
+	u32 dtsLo;
+	u32 esBuffer;
+	u32 esSize;
+};
+
+struct MpegTimestamp {
+	u64 esOffset;
+	u64 pts;
+};
+
+struct MpegContext {
+	MpegContext() : ringbufferAddr(0), videoWidth(480), videoHeight(272),
+		pixelMode(MPEG_PIXEL_MODE_8888), nextStreamId(0), esBufAllocated(false),
+		esBase(0), esReadPos(0), lastPts(0) {
+		ClearFrame();
+		decoder = new MediaEngine(videoWidth, videoHeight);
+	}
+
+	~MpegContext() {
+		delete decoder;
+	}
+
+	void ClearFrame() {
+		frameY.assign(videoWidth * videoHeight, 16);
+		frameCb.assign(videoWidth * videoHeight / 4, 128);
+		frameCr.assign(videoWidth * videoHeight / 4, 128);
+	}
+
+	void Flush() {
+		videoEs.clear();
+		timestamps.clear();
+		currentAu.clear();
+		esBase = 0;
+		esReadPos = 0;
+		decoder->Flush();
+	}
+
+	bool DemuxPacket(const u8 *pack);
+	bool NextAu(u64 &pts);
+
+	void DoState(PointerWrap &p) {
+		p.Do(ringbufferAddr);
+		p.Do(videoWidth);
+		p.Do(videoHeight);
+		p.Do(pixelMode);
+		p.Do(nextStreamId);
+		p.Do(esBufAllocated);
+		p.Do(videoEs);
+		p.Do(timestamps);
+		p.Do(esBase);
+		u64 readPos = esReadPos;
+		p.Do(readPos);
+		esReadPos = (size_t)readPos;
+		p.Do(lastPts);
+		p.Do(currentAu);
+		// The decoder's reference pictures aren't saved, it picks up again at the next IDR.
+		if (p.mode != p.MODE_READ)
+			decoder->TakeFrame(frameY, frameCb, frameCr);
+		p.Do(frameY);
+		p.Do(frameCb);
+		p.Do(frameCr);
+		if (p.mode == p.MODE_READ)
+			decoder->SubmitAu(currentAu);
+		p.DoMarker("MpegContext");
+	}
+
+	u32 ringbufferAddr;
+	int videoWidth;
+	int videoHeight;
+	int pixelMode;
+	int nextStreamId;
+	bool esBufAllocated;
+
+	// Video elementary stream, demuxed but not yet split into access units.
+	std::vector<u8> videoEs;
+	std::vector<MpegTimestamp> timestamps;
+	u64 esBase;
+	size_t esReadPos;
+	u64 lastPts;
+
+	// The access unit handed out by the last sceMpegGetAvcAu.
+	std::vector<u8> currentAu;
+
+	// Last decoded picture, planar 4:2:0.
+	std::vector<u8> frameY;
+	std::vector<u8> frameCb;
+	std::vector<u8> frameCr;
+
+	MediaEngine *decoder;
+};
+
+static std::map<u32, MpegContext *> mpegMap;
+
+static inline u32 ReadBE32(const u8 *p) {
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline u64 ReadPESTimestamp(const u8 *p) {
+	return ((u64)((p[0] >> 1) & 7) << 30) | (p[1] << 22) | ((p[2] >> 1) << 15) | (p[3] << 7) | (p[4] >> 1);
+}
+
+static MpegContext *getMpegCtx(u32 mpegAddr) {
+	if (!Memory::IsValidAddress(mpegAddr))
+		return 0;
+	std::map<u32, MpegContext *>::iterator iter = mpegMap.find(Memory::Read_U32(mpegAddr));
+	if (iter == mpegMap.end())
+		return 0;
+	return iter->second;
+}
+
+// Each ringbuffer packet is a single MPEG-2 program stream pack.
+bool MpegContext::DemuxPacket(const u8 *pack)
+{
+	if (ReadBE32(pack) != 0x000001BA)
+		return false;
+	int pos = 14 + (pack[13] & 7);
+
+	while (pos + 6 <= MPEG_PACKET_SIZE)
+	{
+		u32 startCode = ReadBE32(pack + pos);
+		if ((startCode & 0xFFFFFF00) != 0x00000100)
+			break;
+		int length = (pack[pos + 4] << 8) | pack[pos + 5];
+		int end = std::min(pos + 6 + length, MPEG_PACKET_SIZE);
+
+		int streamId = startCode & 0xFF;
+		if ((streamId & 0xF0) == 0xE0 && pos + 9 <= end)
+		{
+			int headerLength = pack[pos + 8];
+			int payload = pos + 9 + headerLength;
+			if ((pack[pos + 7] & 0x80) && pos + 14 <= end)
+			{
+				MpegTimestamp ts;
+				ts.esOffset = esBase + videoEs.size();
+				ts.pts = ReadPESTimestamp(pack + pos + 9);
+				timestamps.push_back(ts);
+			}
+			if (payload < end)
+				videoEs.insert(videoEs.end(), pack + payload, pack + end);
+		}
+		// Audio (0xBD), padding and system headers are skipped.
+		pos = end;
+	}
+	return true;
+}
+
+static int FindAccessUnitDelimiter(const std::vector<u8> &es, size_t start)
+{
+	for (size_t i = start; i + 4 <= es.size(); i++)
+	{
+		if (es[i] == 0 && es[i + 1] == 0 && es[i + 2] == 1 && (es[i + 3] & 0x1F) == 9)
+			return (int)i;
+	}
+	return -1;
+}
+
+// Splits the next access unit off the elementary stream, if a whole one is buffered.
+bool MpegContext::NextAu(u64 &pts)
+{
+	int first = FindAccessUnitDelimiter(videoEs, esReadPos);
+	if (first < 0)
+		return false;
+	int next = FindAccessUnitDelimiter(videoEs, first + 4);
+	if (next < 0)
+		return false;
+
+	currentAu.assign(videoEs.begin() + first, videoEs.begin() + next);
+
+	u64 auStart = esBase + first;
+	u64 auEnd = esBase + next;
+	pts = lastPts + MPEG_PTS_FRAME_INCREMENT;
+	size_t used = 0;
+	while (used < timestamps.size() && timestamps[used].esOffset < auEnd)
+	{
+		if (timestamps[used].esOffset <= auStart || used == 0)
+			pts = timestamps[used].pts;
+		used++;
+	}
+	timestamps.erase(timestamps.begin(), timestamps.begin() + used);
+	lastPts = pts;
+
+	esReadPos = next;
+	// Compact once in a while rather than shifting the buffer for every AU.
+	if (esReadPos > 0x10000)
+	{
+		videoEs.erase(videoEs.begin(), videoEs.begin() + esReadPos);
+		esBase += esReadPos;
+		esReadPos = 0;
+	}
+	return true;
+}
+
+// BT.601 limited range, with coefficients in 3.13 fixed point and the inputs scaled by 8
+// so that a 16x16->high 16 multiply gives the result directly. The scalar and SSE2
+// paths produce identical output.
+enum {
+	CSC_Y = 9535,
+	CSC_RV = 13074,
+	CSC_GV = 6660,
+	CSC_GU = 3203,
+	CSC_BU = 16531,
+};
+
+static inline u8 ClampColor(int c) {
+	return c < 0 ? 0 : (c > 255 ? 255 : c);
+}
+
+static inline int MulHigh(int a, int b) {
+	return (a * b) >> 16;
+}
+
+// Converts one row to ABGR8888.
+static void ConvertYCbCrRow(const u8 *y, const u8 *cb, const u8 *cr, u32 *out, int width)
+{
+	int x = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i yOffset = _mm_set1_epi16(16);
+	const __m128i cOffset = _mm_set1_epi16(128);
+	const __m128i alpha = _mm_set1_epi16(0xFF);
+	for (; x + 8 <= width; x += 8)
+	{
+		__m128i yv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y + x)), zero);
+		// Four chroma samples, doubled up to cover eight pixels.
+		__m128i u = _mm_cvtsi32_si128(*(const int *)(cb + x / 2));
+		__m128i v = _mm_cvtsi32_si128(*(const int *)(cr + x / 2));
+		u = _mm_unpacklo_epi8(_mm_unpacklo_epi8(u, u), zero);
+		v = _mm_unpacklo_epi8(_mm_unpacklo_epi8(v, v), zero);
+
+		yv = _mm_slli_epi16(_mm_sub_epi16(yv, yOffset), 3);
+		u = _mm_slli_epi16(_mm_sub_epi16(u, cOffset), 3);
+		v = _mm_slli_epi16(_mm_sub_epi16(v, cOffset), 3);
+
+		__m128i yy = _mm_mulhi_epi16(yv, _mm_set1_epi16(CSC_Y));
+		__m128i r = _mm_add_epi16(yy, _mm_mulhi_epi16(v, _mm_set1_epi16(CSC_RV)));
+		__m128i g = _mm_sub_epi16(yy, _mm_mulhi_epi16(v, _mm_set1_epi16(CSC_GV)));
+		g = _mm_sub_epi16(g, _mm_mulhi_epi16(u, _mm_set1_epi16(CSC_GU)));
+		__m128i b = _mm_add_epi16(yy, _mm_mulhi_epi16(u, _mm_set1_epi16(CSC_BU)));
+
+		// Saturate to bytes and interleave to R, G, B, A in memory order.
+		__m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+		__m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(alpha, alpha));
+		_mm_storeu_si128((__m128i *)(out + x), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i *)(out + x + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+#endif
+	for (; x < width; x++)
+	{
+		int yv = (y[x] - 16) << 3;
+		int u = (cb[x / 2] - 128) << 3;
+		int v = (cr[x / 2] - 128) << 3;
+		int yy = MulHigh(yv, CSC_Y);
+		u8 r = ClampColor(yy + MulHigh(v, CSC_RV));
+		u8 g = ClampColor(yy - MulHigh(v, CSC_GV) - MulHigh(u, CSC_GU));
+		u8 b = ClampColor(yy + MulHigh(u, CSC_BU));
+		out[x] = 0xFF000000 | (b << 16) | (g << 8) | r;
+	}
+}
+
+static void ConvertRowToPixelMode(const u32 *src, u8 *dest, int width, int pixelMode)
+{
+	if (pixelMode == MPEG_PIXEL_MODE_8888)
+	{
+		memcpy(dest, src, width * 4);
+		return;
+	}
+
+	u16 *dest16 = (u16 *)dest;
+	for (int x = 0; x < width; x++)
+	{
+		u32 c = src[x];
+		u32 r = c & 0xFF, g = (c >> 8) & 0xFF, b = (c >> 16) & 0xFF;
+		switch (pixelMode)
+		{
+		case MPEG_PIXEL_MODE_565:
+			dest16[x] = (r >> 3) | ((g >> 2) << 5) | ((b >> 3) << 11);
+			break;
+		case MPEG_PIXEL_MODE_5551:
+			dest16[x] = (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10) | 0x8000;
+			break;
+		case MPEG_PIXEL_MODE_4444:
+		default:
+			dest16[x] = (r >> 4) | ((g >> 4) << 4) | ((b >> 4) << 8) | 0xF000;
+			break;
+		}
+	}
+}
+
+// Converts a rectangle of a planar 4:2:0 picture into a PSP framebuffer.
+static void ConvertYCbCrToFramebuffer(const u8 *y, const u8 *cb, const u8 *cr, int srcWidth,
+		int x, int yStart, int width, int height, u32 destAddr, int frameWidth, int pixelMode)
+{
+	int bpp = pixelMode == MPEG_PIXEL_MODE_8888 ? 4 : 2;
+	u64 destEnd = (u64)destAddr + (u64)(yStart + height) * frameWidth * bpp;
+	if (frameWidth <= 0 || x + width > frameWidth || destEnd > 0xFFFFFFFFULL || !Memory::IsValidAddress(destAddr) || !Memory::IsValidAddress((u32)destEnd - 1))
+	{
+		ERROR_LOG(HLE, "Mpeg: bad colour conversion destination %08x", destAddr);
+		return;
+	}
+
+	// Keep chroma aligned with luma.
+	x &= ~1;
+	std::vector<u32> row(width);
+	for (int line = yStart; line < yStart + height; line++)
+	{
+		const u8 *yRow = y + line * srcWidth + x;
+		const u8 *cbRow = cb + (line / 2) * (srcWidth / 2) + x / 2;
+		const u8 *crRow = cr + (line / 2) * (srcWidth / 2) + x / 2;
+		ConvertYCbCrRow(yRow, cbRow, crRow, &row[0], width);
+		u8 *dest = Memory::GetPointer(destAddr + (line * frameWidth + x) * bpp);
+		ConvertRowToPixelMode(&row[0], dest, width, pixelMode);
+	}
+}
+
+static void WriteAuTimestamps(u32 auAddr, u64 pts, u64 dts)
+{
+	if (!Memory::IsValidAddress(auAddr))
+		return;
+	Memory::Write_U32((u32)(pts >> 32), auAddr);
+	Memory::Write_U32((u32)pts, auAddr + 4);
+	Memory::Write_U32((u32)(dts >> 32), auAddr + 8);
+	Memory::Write_U32((u32)dts, auAddr + 12);
+}
+
+// Pulls as many whole packets as needed out of the ringbuffer to complete the next AU.
+static bool __MpegReadAvcAu(MpegContext *ctx, u64 &pts)
+{
+	if (ctx->NextAu(pts))
+		return true;
+	if (!Memory::IsValidAddress(ctx->ringbufferAddr))
+		return false;
+
+	SceMpegRingBuffer ringbuffer;
+	Memory::ReadStruct(ctx->ringbufferAddr, &ringbuffer);
+	if (ringbuffer.packets <= 0)
+		return false;
+
+	bool found = false;
+	while (!found && ringbuffer.packetsRead < ringbuffer.packetsWritten)
+	{
+		u32 packetAddr = ringbuffer.data + (ringbuffer.packetsRead % ringbuffer.packets) * MPEG_PACKET_SIZE;
+		if (!Memory::IsValidAddress(packetAddr))
+			break;
+		if (!ctx->DemuxPacket(Memory::GetPointer(packetAddr)))
+			WARN_LOG(HLE, "Mpeg: skipping packet without a pack header at %08x", packetAddr);
+		ringbuffer.packetsRead++;
+		ringbuffer.packetsFree++;
+		found = ctx->NextAu(pts);
+	}
+	Memory::WriteStruct(ctx->ringbufferAddr, &ringbuffer);
+	return found;
+}
+
+Action *__MpegCreatePostPutAction();
+static int actionPostPut;
+
+void __MpegInit()
+{
+	actionPostPut = __KernelRegisterActionType(__MpegCreatePostPutAction);
+}
+
+void __MpegDoState(PointerWrap &p)
+{
+	p.Do(mpegMap);
+	p.DoMarker("sceMpeg");
+}
+
+void __MpegBeforeFork()
+{
+	for (std::map<u32, MpegContext *>::iterator it = mpegMap.begin(), end = mpegMap.end(); it != end; ++it)
+		it->second->decoder->BeforeFork();
+}
+
+void __MpegAfterFork(bool child)
+{
+	for (std::map<u32, MpegContext *>::iterator it = mpegMap.begin(), end = mpegMap.end(); it != end; ++it)
+		it->second->decoder->AfterFork(child);
+}
+
+void __MpegShutdown()
+{
+	for (std::map<u32, MpegContext *>::iterator it = mpegMap.begin(), end = mpegMap.end(); it != end; ++it)
+		delete it->second;
+	mpegMap.clear();
+}
 
 void sceMpegInit()
 {
-	WARN_LOG(HLE, "HACK sceMpegInit(...)");
+	DEBUG_LOG(HLE, "sceMpegInit()");
 	RETURN(0);
 }
+
 void sceMpegCreate()
 {
-	WARN_LOG(HLE, "HACK sceMpegCreate(...)");
+	u32 mpegAddr = PARAM(0);
+	u32 dataPtr = PARAM(1);
+	u32 size = PARAM(2);
+	u32 ringbufferAddr = PARAM(3);
+	u32 frameWidth = PARAM(4);
+
+	if (size < MPEG_MEMSIZE)
+	{
+		WARN_LOG(HLE, "sceMpegCreate(%08x, %08x, %i, %08x, %i): not enough memory", mpegAddr, dataPtr, size, ringbufferAddr, frameWidth);
+		RETURN(ERROR_MPEG_NO_MEMORY);
+		return;
+	}
+	if (!Memory::IsValidAddress(mpegAddr) || !Memory::IsValidAddress(dataPtr))
+	{
+		ERROR_LOG(HLE, "sceMpegCreate(%08x, %08x, %i, %08x, %i): bad address", mpegAddr, dataPtr, size, ringbufferAddr, frameWidth);
+		RETURN(ERROR_MPEG_INVALID_ADDR);
+		return;
+	}
+
+	// The handle points into the game provided work area, which holds a small header.
+	u32 mpegHandle = dataPtr + 0x30;
+	Memory::Write_U32(mpegHandle, mpegAddr);
+	Memory::Memcpy(mpegHandle, "LIBMPEG\0", 8);
+	Memory::Memcpy(mpegHandle + 8, "001\0", 4);
+	Memory::Write_U32(-1, mpegHandle + 12);
+	Memory::Write_U32(ringbufferAddr, mpegHandle + 16);
+
+	if (Memory::IsValidAddress(ringbufferAddr))
+	{
+		Memory::Write_U32(mpegAddr, ringbufferAddr + offsetof(SceMpegRingBuffer, mpeg));
+		Memory::Write_U32(Memory::Read_U32(ringbufferAddr + offsetof(SceMpegRingBuffer, dataUpperBound)), mpegHandle + 20);
+	}
+
+	MpegContext *ctx = mpegMap[mpegHandle];
+	delete ctx;
+	ctx = new MpegContext();
+	ctx->ringbufferAddr = ringbufferAddr;
+	mpegMap[mpegHandle] = ctx;
+
+	INFO_LOG(HLE, "sceMpegCreate(%08x, %08x, %i, %08x, %i)", mpegAddr, dataPtr, size, ringbufferAddr, frameWidth);
 	RETURN(0);
 }
+
+void sceMpegDelete()
+{
+	u32 mpegAddr = PARAM(0);
+	DEBUG_LOG(HLE, "sceMpegDelete(%08x)", mpegAddr);
+	if (Memory::IsValidAddress(mpegAddr))
+	{
+		std::map<u32, MpegContext *>::iterator iter = mpegMap.find(Memory::Read_U32(mpegAddr));
+		if (iter != mpegMap.end())
+		{
+			delete iter->second;
+			mpegMap.erase(iter);
+		}
+	}
+	RETURN(0);
+}
+
 void sceMpegInitAu()
 {
-	WARN_LOG(HLE, "HACK sceMpegInitAu(...)");
+	u32 mpeg = PARAM(0);
+	u32 bufferAddr = PARAM(1);
+	u32 auPointer = PARAM(2);
+	DEBUG_LOG(HLE, "sceMpegInitAu(%08x, %08x, %08x)", mpeg, bufferAddr, auPointer);
+
+	if (Memory::IsValidAddress(auPointer))
+	{
+		SceMpegAu au;
+		au.ptsHi = au.ptsLo = -1;
+		au.dtsHi = au.dtsLo = -1;
+		au.esBuffer = bufferAddr;
+		au.esSize = 0;
+		Memory::WriteStruct(auPointer, &au);
+	}
 	RETURN(0);
 }
 
 void sceMpegQueryMemSize()
 {
-	WARN_LOG(HLE, "HACK sceMpegQueryMemSize(...)");
-	RETURN(0x10000);	// 64K
+	DEBUG_LOG(HLE, "sceMpegQueryMemSize(%i)", PARAM(0));
+	RETURN(MPEG_MEMSIZE);
 }
 
 void sceMpegRingbufferQueryMemSize()
 {
 	int packets = PARAM(0);
-	WARN_LOG(HLE, "HACK sceMpegRingbufferQueryMemSize(...)");
-	RETURN(packets * (104 + 2048));
+	DEBUG_LOG(HLE, "sceMpegRingbufferQueryMemSize(%i)", packets);
+	RETURN(packets * (MPEG_PACKET_OVERHEAD + MPEG_PACKET_SIZE));
 }
 
 void sceMpegRingbufferConstruct()
 {
-	WARN_LOG(HLE, "HACK sceMpegRingbufferConstruct(...)");
+	u32 ringbufferAddr = PARAM(0);
+	int numPackets = PARAM(1);
+	u32 data = PARAM(2);
+	int size = PARAM(3);
+	u32 callbackAddr = PARAM(4);
+	u32 callbackArg = PARAM(5);
+
+	DEBUG_LOG(HLE, "sceMpegRingbufferConstruct(%08x, %i, %08x, %i, %08x, %08x)", ringbufferAddr, numPackets, data, size, callbackAddr, callbackArg);
+	if (!Memory::IsValidAddress(ringbufferAddr))
+	{
+		RETURN(ERROR_MPEG_INVALID_ADDR);
+		return;
+	}
+
+	SceMpegRingBuffer ringbuffer;
+	ringbuffer.packets = numPackets;
+	ringbuffer.packetsRead = 0;
+	ringbuffer.packetsWritten = 0;
+	ringbuffer.packetsFree = numPackets;
+	ringbuffer.packetSize = MPEG_PACKET_SIZE;
+	ringbuffer.data = data;
+	ringbuffer.callback_addr = callbackAddr;
+	ringbuffer.callback_args = callbackArg;
+	ringbuffer.dataUpperBound = data + numPackets * MPEG_PACKET_SIZE;
+	ringbuffer.semaID = -1;
+	ringbuffer.mpeg = 0;
+	Memory::WriteStruct(ringbufferAddr, &ringbuffer);
 	RETURN(0);
 }
 
-void sceMpegRegistStream() 
+void sceMpegRingbufferDestruct()
 {
-	WARN_LOG(HLE, "HACK sceMpegRegistStream(...)");
+	DEBUG_LOG(HLE, "sceMpegRingbufferDestruct(%08x)", PARAM(0));
 	RETURN(0);
 }
 
-void sceMpegUnRegistStream() 
+class PostPutAction : public Action
 {
-	WARN_LOG(HLE, "HACK sceMpegRegistStream(...)");
-	RETURN(0);
+public:
+	PostPutAction() {}
+	void setRingAddr(u32 ringAddr) {
+		ringAddr_ = ringAddr;
+	}
+	void run();
+	void DoState(PointerWrap &p) {
+		p.Do(ringAddr_);
+		p.DoMarker("PostPutAction");
+	}
+private:
+	u32 ringAddr_;
+};
+
+Action *__MpegCreatePostPutAction()
+{
+	return new PostPutAction;
 }
 
-void sceMpegGetAtracAu() 
+void PostPutAction::run()
 {
-	WARN_LOG(HLE, "HACK sceMpegGetAtracAu(...)");
-	RETURN(0);
+	SceMpegRingBuffer ringbuffer;
+	Memory::ReadStruct(ringAddr_, &ringbuffer);
+
+	int packetsAdded = currentMIPS->r[MIPS_REG_V0];
+	if (packetsAdded > 0)
+	{
+		if (packetsAdded > ringbuffer.packetsFree)
+		{
+			WARN_LOG(HLE, "sceMpegRingbufferPut clamping packetsAdded %i to %i", packetsAdded, ringbuffer.packetsFree);
+			packetsAdded = ringbuffer.packetsFree;
+		}
+		ringbuffer.packetsWritten += packetsAdded;
+		ringbuffer.packetsFree -= packetsAdded;
+	}
+	DEBUG_LOG(HLE, "sceMpegRingbufferPut callback returned %i", (int)currentMIPS->r[MIPS_REG_V0]);
+	Memory::WriteStruct(ringAddr_, &ringbuffer);
+
+	// Errors from the callback are passed on as they are.
+	__KernelSetMipsCallReturnValue(packetsAdded);
 }
 
-void sceMpegQueryPcmEsSize() 
+void sceMpegRingbufferPut()
 {
-	WARN_LOG(HLE, "HACK sceMpegQueryPcmEsSize(...)");
-	RETURN(0);
+	u32 ringbufferAddr = PARAM(0);
+	int numPackets = PARAM(1);
+	int available = PARAM(2);
+
+	if (!Memory::IsValidAddress(ringbufferAddr))
+	{
+		ERROR_LOG(HLE, "sceMpegRingbufferPut(%08x, %i, %i): bad ringbuffer", ringbufferAddr, numPackets, available);
+		RETURN(ERROR_MPEG_INVALID_ADDR);
+		return;
+	}
+
+	SceMpegRingBuffer ringbuffer;
+	Memory::ReadStruct(ringbufferAddr, &ringbuffer);
+
+	numPackets = std::min(numPackets, available);
+	numPackets = std::min(numPackets, ringbuffer.packetsFree);
+	if (numPackets <= 0 || ringbuffer.packets <= 0)
+	{
+		DEBUG_LOG(HLE, "sceMpegRingbufferPut(%08x, %i, %i): nothing to do", ringbufferAddr, PARAM(1), available);
+		RETURN(0);
+		return;
+	}
+
+	// The callback only gets contiguous space, the game calls again for the rest.
+	int writeOffset = ringbuffer.packetsWritten % ringbuffer.packets;
+	numPackets = std::min(numPackets, ringbuffer.packets - writeOffset);
+
+	DEBUG_LOG(HLE, "sceMpegRingbufferPut(%08x, %i, %i): calling %08x", ringbufferAddr, numPackets, available, ringbuffer.callback_addr);
+
+	std::vector<int> args;
+	args.push_back(ringbuffer.data + writeOffset * MPEG_PACKET_SIZE);
+	args.push_back(numPackets);
+	args.push_back(ringbuffer.callback_args);
+	PostPutAction *action = (PostPutAction *) __KernelCreateAction(actionPostPut);
+	action->setRingAddr(ringbufferAddr);
+	__KernelDirectMipsCall(ringbuffer.callback_addr, action, false, args, false);
 }
 
-void sceMpegQueryAtracEsSize() 
+void sceMpegRingbufferAvailableSize()
 {
-	WARN_LOG(HLE, "HACK sceMpegQueryAtracEsSize(...)");
-	RETURN(0);
+	u32 ringbufferAddr = PARAM(0);
+	if (!Memory::IsValidAddress(ringbufferAddr))
+	{
+		ERROR_LOG(HLE, "sceMpegRingbufferAvailableSize(%08x): bad ringbuffer", ringbufferAddr);
+		RETURN(ERROR_MPEG_INVALID_ADDR);
+		return;
+	}
+	SceMpegRingBuffer ringbuffer;
+	Memory::ReadStruct(ringbufferAddr, &ringbuffer);
+	DEBUG_LOG(HLE, "%i=sceMpegRingbufferAvailableSize(%08x)", ringbuffer.packetsFree, ringbufferAddr);
+	RETURN(ringbuffer.packetsFree);
 }
 
-void sceMpegChangeGetAuMode() 
+void sceMpegRingbufferQueryPackNum()
 {
-	WARN_LOG(HLE, "HACK sceMpegChangeGetAuMode(...)");
-	RETURN(0);
+	int memorySize = PARAM(0);
+	DEBUG_LOG(HLE, "sceMpegRingbufferQueryPackNum(%i)", memorySize);
+	RETURN(memorySize / (MPEG_PACKET_SIZE + MPEG_PACKET_OVERHEAD));
 }
 
-void sceMpegQueryStreamOffset() 
+void sceMpegRegistStream()
 {
-	WARN_LOG(HLE, "HACK sceMpegQueryStreamOffset(...)");
-	RETURN(0);
+	u32 mpeg = PARAM(0);
+	int streamType = PARAM(1);
+	int streamNum = PARAM(2);
+
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (!ctx)
+	{
+		WARN_LOG(HLE, "sceMpegRegistStream(%08x, %i, %i): bad mpeg handle", mpeg, streamType, streamNum);
+		RETURN(-1);
+		return;
+	}
+
+	int sid = ctx->nextStreamId++;
+	DEBUG_LOG(HLE, "%i=sceMpegRegistStream(%08x, %i, %i)", sid, mpeg, streamType, streamNum);
+	RETURN(sid);
 }
 
-void sceMpegGetPcmAu() 
+void sceMpegUnRegistStream()
 {
-	WARN_LOG(HLE, "HACK sceMpegGetPcmAu(...)");
+	DEBUG_LOG(HLE, "sceMpegUnRegistStream(%08x, %i)", PARAM(0), PARAM(1));
 	RETURN(0);
 }
 
-void sceMpegRingbufferQueryPackNum() 
+void sceMpegQueryStreamOffset()
 {
-	WARN_LOG(HLE, "HACK sceMpegRingbufferQueryPackNum(...)");
+	u32 mpeg = PARAM(0);
+	u32 bufferAddr = PARAM(1);
+	u32 offsetAddr = PARAM(2);
+
+	if (!Memory::IsValidAddress(bufferAddr) || !Memory::IsValidAddress(offsetAddr))
+	{
+		ERROR_LOG(HLE, "sceMpegQueryStreamOffset(%08x, %08x, %08x): bad address", mpeg, bufferAddr, offsetAddr);
+		RETURN(ERROR_MPEG_INVALID_ADDR);
+		return;
+	}
+
+	const u8 *header = Memory::GetPointer(bufferAddr);
+	if (Memory::Read_U32(bufferAddr) != PSMF_MAGIC)
+	{
+		WARN_LOG(HLE, "sceMpegQueryStreamOffset(%08x, %08x, %08x): bad PSMF magic", mpeg, bufferAddr, offsetAddr);
+		Memory::Write_U32(0, offsetAddr);
+		RETURN(ERROR_MPEG_INVALID_VALUE);
+		return;
+	}
+	if (header[4] != '0' || header[5] != '0' || header[6] != '1' || header[7] < '2' || header[7] > '5')
+	{
+		WARN_LOG(HLE, "sceMpegQueryStreamOffset(%08x, %08x, %08x): bad version", mpeg, bufferAddr, offsetAddr);
+		Memory::Write_U32(0, offsetAddr);
+		RETURN(ERROR_MPEG_BAD_VERSION);
+		return;
+	}
+
+	u32 offset = ReadBE32(header + PSMF_STREAM_OFFSET_OFFSET);
+	if ((offset & 0x7FF) != 0 || offset > 0x10000)
+	{
+		Memory::Write_U32(0, offsetAddr);
+		RETURN(ERROR_MPEG_INVALID_VALUE);
+		return;
+	}
+
+	// This is the only place the game shows us the header, so grab the picture size here.
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (ctx && header[0x80] == 0 && header[0x81] > 0 && (header[0x82] & 0xF0) == 0xE0)
+	{
+		int width = header[0x82 + 12] * 16;
+		int height = header[0x82 + 13] * 16;
+		if (width > 0 && height > 0 && (width != ctx->videoWidth || height != ctx->videoHeight))
+		{
+			ctx->videoWidth = width;
+			ctx->videoHeight = height;
+			ctx->ClearFrame();
+		}
+	}
+
+	DEBUG_LOG(HLE, "sceMpegQueryStreamOffset(%08x, %08x, %08x): offset %08x", mpeg, bufferAddr, offsetAddr, offset);
+	Memory::Write_U32(offset, offsetAddr);
 	RETURN(0);
 }
 
-void sceMpegFlushAllStream() 
+void sceMpegQueryStreamSize()
 {
-	WARN_LOG(HLE, "HACK sceMpegFlushAllStream(...)");
+	u32 bufferAddr = PARAM(0);
+	u32 sizeAddr = PARAM(1);
+
+	if (!Memory::IsValidAddress(bufferAddr) || !Memory::IsValidAddress(sizeAddr))
+	{
+		ERROR_LOG(HLE, "sceMpegQueryStreamSize(%08x, %08x): bad address", bufferAddr, sizeAddr);
+		RETURN(ERROR_MPEG_INVALID_ADDR);
+		return;
+	}
+
+	u32 size = ReadBE32(Memory::GetPointer(bufferAddr + PSMF_STREAM_SIZE_OFFSET));
+	if ((size & 0x7FF) != 0)
+	{
+		Memory::Write_U32(0, sizeAddr);
+		RETURN(ERROR_MPEG_INVALID_VALUE);
+		return;
+	}
+
+	DEBUG_LOG(HLE, "sceMpegQueryStreamSize(%08x, %08x): size %08x", bufferAddr, sizeAddr, size);
+	Memory::Write_U32(size, sizeAddr);
 	RETURN(0);
 }
 
-void sceMpegMallocAvcEsBuf() 
+void sceMpegFlushAllStream()
 {
-	WARN_LOG(HLE, "HACK sceMpegMallocAvcEsBuf(...)");
+	u32 mpeg = PARAM(0);
+	DEBUG_LOG(HLE, "sceMpegFlushAllStream(%08x)", mpeg);
+
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (ctx)
+	{
+		ctx->Flush();
+		if (Memory::IsValidAddress(ctx->ringbufferAddr))
+		{
+			SceMpegRingBuffer ringbuffer;
+			Memory::ReadStruct(ctx->ringbufferAddr, &ringbuffer);
+			ringbuffer.packetsRead = ringbuffer.packetsWritten;
+			ringbuffer.packetsFree = ringbuffer.packets;
+			Memory::WriteStruct(ctx->ringbufferAddr, &ringbuffer);
+		}
+	}
 	RETURN(0);
 }
 
-void sceMpegAvcCopyYCbCr() 
+void sceMpegMallocAvcEsBuf()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcCopyYCbCr(...)");
+	u32 mpeg = PARAM(0);
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (!ctx)
+	{
+		WARN_LOG(HLE, "sceMpegMallocAvcEsBuf(%08x): bad mpeg handle", mpeg);
+		RETURN(0);
+		return;
+	}
+
+	DEBUG_LOG(HLE, "sceMpegMallocAvcEsBuf(%08x)", mpeg);
+	// There's only the one.
+	RETURN(ctx->esBufAllocated ? 0 : 1);
+	ctx->esBufAllocated = true;
+}
+
+void sceMpegFreeAvcEsBuf()
+{
+	u32 mpeg = PARAM(0);
+	DEBUG_LOG(HLE, "sceMpegFreeAvcEsBuf(%08x, %i)", mpeg, PARAM(1));
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (ctx)
+		ctx->esBufAllocated = false;
 	RETURN(0);
 }
 
-void sceMpegFreeAvcEsBuf() 
+void sceMpegGetAvcAu()
 {
-	WARN_LOG(HLE, "HACK sceMpegFreeAvcEsBuf(...)");
+	u32 mpeg = PARAM(0);
+	u32 streamId = PARAM(1);
+	u32 auAddr = PARAM(2);
+	u32 attrAddr = PARAM(3);
+
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (!ctx)
+	{
+		WARN_LOG(HLE, "sceMpegGetAvcAu(%08x, %08x, %08x, %08x): bad mpeg handle", mpeg, streamId, auAddr, attrAddr);
+		RETURN(-1);
+		return;
+	}
+
+	u64 pts;
+	if (!__MpegReadAvcAu(ctx, pts))
+	{
+		DEBUG_LOG(HLE, "sceMpegGetAvcAu(%08x, %08x, %08x, %08x): no data", mpeg, streamId, auAddr, attrAddr);
+		RETURN(ERROR_MPEG_NO_DATA);
+		return;
+	}
+
+	// Every AU is decoded, skipped frames are still needed as references.
+	ctx->decoder->SubmitAu(ctx->currentAu);
+
+	WriteAuTimestamps(auAddr, pts, pts);
+	if (Memory::IsValidAddress(auAddr))
+		Memory::Write_U32((u32)ctx->currentAu.size(), auAddr + offsetof(SceMpegAu, esSize));
+	if (Memory::IsValidAddress(attrAddr))
+		Memory::Write_U32(1, attrAddr);
+
+	DEBUG_LOG(HLE, "sceMpegGetAvcAu(%08x, %08x, %08x, %08x): pts %i, %i bytes", mpeg, streamId, auAddr, attrAddr, (int)pts, (int)ctx->currentAu.size());
 	RETURN(0);
 }
 
-void sceMpegAtracDecode() 
+void sceMpegGetAtracAu()
 {
-	WARN_LOG(HLE, "HACK sceMpegAtracDecode(...)");
+	u32 mpeg = PARAM(0);
+	u32 auAddr = PARAM(2);
+	WARN_LOG(HLE, "HACK sceMpegGetAtracAu(%08x, %08x, %08x, %08x)", mpeg, PARAM(1), auAddr, PARAM(3));
+
+	// Audio isn't demuxed yet, keep it in step with the video.
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (ctx)
+		WriteAuTimestamps(auAddr, ctx->lastPts, ctx->lastPts);
 	RETURN(0);
 }
 
-void sceMpegAvcDecodeStop() 
+void sceMpegQueryPcmEsSize()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcDecodeStop(...)");
+	WARN_LOG(HLE, "HACK sceMpegQueryPcmEsSize(...)");
 	RETURN(0);
 }
 
-void sceMpegAvcDecodeMode() 
+void sceMpegQueryAtracEsSize()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcDecodeMode(...)");
+	WARN_LOG(HLE, "HACK sceMpegQueryAtracEsSize(...)");
 	RETURN(0);
 }
 
-void sceMpegAvcDecode() 
+void sceMpegChangeGetAuMode()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcDecode(...)");
+	WARN_LOG(HLE, "HACK sceMpegChangeGetAuMode(...)");
 	RETURN(0);
 }
 
-void sceMpegAvcCsc() 
+void sceMpegGetPcmAu()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcCsc(...)");
+	WARN_LOG(HLE, "HACK sceMpegGetPcmAu(...)");
 	RETURN(0);
 }
 
-void sceMpegAvcDecodeStopYCbCr() 
+void sceMpegAvcCopyYCbCr()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcDecodeStopYCbCr(...)");
+	WARN_LOG(HLE, "HACK sceMpegAvcCopyYCbCr(...)");
 	RETURN(0);
 }
 
-void sceMpegRingbufferDestruct() 
+void sceMpegAtracDecode()
 {
-	WARN_LOG(HLE, "HACK sceMpegRingbufferDestruct(...)");
+	WARN_LOG(HLE, "HACK sceMpegAtracDecode(...)");
 	RETURN(0);
 }
 
-void sceMpegAvcDecodeYCbCr() 
+void sceMpegAvcDecodeMode()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcDecodeYCbCr(...)");
+	u32 mpeg = PARAM(0);
+	u32 modeAddr = PARAM(1);
+
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (!ctx || !Memory::IsValidAddress(modeAddr))
+	{
+		WARN_LOG(HLE, "sceMpegAvcDecodeMode(%08x, %08x): bad arguments", mpeg, modeAddr);
+		RETURN(-1);
+		return;
+	}
+
+	int pixelMode = Memory::Read_U32(modeAddr + 4);
+	DEBUG_LOG(HLE, "sceMpegAvcDecodeMode(%08x, %08x): pixel mode %i", mpeg, modeAddr, pixelMode);
+	if (pixelMode >= MPEG_PIXEL_MODE_565 && pixelMode <= MPEG_PIXEL_MODE_8888)
+		ctx->pixelMode = pixelMode;
 	RETURN(0);
 }
 
-void sceMpegRingbufferPut() 
+void sceMpegAvcDecode()
 {
-	WARN_LOG(HLE, "HACK sceMpegRingbufferPut(...)");
+	u32 mpeg = PARAM(0);
+	u32 auAddr = PARAM(1);
+	int frameWidth = PARAM(2);
+	u32 bufferAddr = PARAM(3);
+	u32 initAddr = PARAM(4);
+
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (!ctx || !Memory::IsValidAddress(bufferAddr))
+	{
+		WARN_LOG(HLE, "sceMpegAvcDecode(%08x, %08x, %i, %08x, %08x): bad arguments", mpeg, auAddr, frameWidth, bufferAddr, initAddr);
+		RETURN(-1);
+		return;
+	}
+
+	DEBUG_LOG(HLE, "sceMpegAvcDecode(%08x, %08x, %i, %08x, %08x): %i bytes", mpeg, auAddr, frameWidth, bufferAddr, initAddr, (int)ctx->currentAu.size());
+
+	// The AU went to the decoder in sceMpegGetAvcAu. If nothing new came out, show the last picture again.
+	ctx->decoder->TakeFrame(ctx->frameY, ctx->frameCb, ctx->frameCr);
+	ctx->currentAu.clear();
+
+	u32 buffer = Memory::Read_U32(bufferAddr);
+	ConvertYCbCrToFramebuffer(&ctx->frameY[0], &ctx->frameCb[0], &ctx->frameCr[0], ctx->videoWidth,
+		0, 0, ctx->videoWidth, ctx->videoHeight, buffer, frameWidth, ctx->pixelMode);
+
+	if (Memory::IsValidAddress(initAddr))
+		Memory::Write_U32(1, initAddr);
 	RETURN(0);
 }
 
-void sceMpegAvcInitYCbCr() 
+void sceMpegAvcDecodeStop()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcInitYCbCr(...)");
+	u32 mpeg = PARAM(0);
+	u32 statusAddr = PARAM(3);
+	DEBUG_LOG(HLE, "sceMpegAvcDecodeStop(%08x, %i, %08x, %08x)", mpeg, PARAM(1), PARAM(2), statusAddr);
+	if (Memory::IsValidAddress(statusAddr))
+		Memory::Write_U32(0, statusAddr);
 	RETURN(0);
 }
 
-void sceMpegAvcQueryYCbCrSize() 
+void sceMpegAvcQueryYCbCrSize()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcQueryYCbCrSize(...)");
+	u32 mpeg = PARAM(0);
+	int mode = PARAM(1);
+	int width = PARAM(2);
+	int height = PARAM(3);
+	u32 resultAddr = PARAM(4);
+
+	if ((width & 15) != 0 || (height & 15) != 0 || width > 480 || height > 272 || !Memory::IsValidAddress(resultAddr))
+	{
+		WARN_LOG(HLE, "sceMpegAvcQueryYCbCrSize(%08x, %i, %i, %i, %08x): bad arguments", mpeg, mode, width, height, resultAddr);
+		RETURN(ERROR_MPEG_INVALID_VALUE);
+		return;
+	}
+
+	// A small header, then the Y, Cb and Cr planes.
+	int size = (width / 2) * (height / 2) * 6 + MPEG_YCBCR_HEADER_SIZE;
+	DEBUG_LOG(HLE, "sceMpegAvcQueryYCbCrSize(%08x, %i, %i, %i, %08x): %i", mpeg, mode, width, height, resultAddr, size);
+	Memory::Write_U32(size, resultAddr);
 	RETURN(0);
 }
 
-void sceMpegRingbufferAvailableSize() 
+void sceMpegAvcInitYCbCr()
 {
-	WARN_LOG(HLE, "HACK sceMpegRingbufferAvailableSize(...)");
+	u32 mpeg = PARAM(0);
+	int mode = PARAM(1);
+	int width = PARAM(2);
+	int height = PARAM(3);
+	u32 ycbcrAddr = PARAM(4);
+
+	int planeSize = width * height;
+	if (width <= 0 || height <= 0 || !Memory::IsValidAddress(ycbcrAddr) || !Memory::IsValidAddress(ycbcrAddr + MPEG_YCBCR_HEADER_SIZE + planeSize * 3 / 2 - 1))
+	{
+		WARN_LOG(HLE, "sceMpegAvcInitYCbCr(%08x, %i, %i, %i, %08x): bad arguments", mpeg, mode, width, height, ycbcrAddr);
+		RETURN(ERROR_MPEG_INVALID_VALUE);
+		return;
+	}
+
+	DEBUG_LOG(HLE, "sceMpegAvcInitYCbCr(%08x, %i, %i, %i, %08x)", mpeg, mode, width, height, ycbcrAddr);
+	Memory::Memset(ycbcrAddr, 0, MPEG_YCBCR_HEADER_SIZE);
+	Memory::Write_U32(width, ycbcrAddr);
+	Memory::Write_U32(height, ycbcrAddr + 4);
+	Memory::Memset(ycbcrAddr + MPEG_YCBCR_HEADER_SIZE, 16, planeSize);
+	Memory::Memset(ycbcrAddr + MPEG_YCBCR_HEADER_SIZE + planeSize, 128, planeSize / 2);
 	RETURN(0);
 }
 
-void sceMpegAvcDecodeDetail() 
+void sceMpegAvcDecodeYCbCr()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcDecodeDetail(...)");
+	u32 mpeg = PARAM(0);
+	u32 auAddr = PARAM(1);
+	u32 bufferAddr = PARAM(2);
+	u32 initAddr = PARAM(3);
+
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (!ctx || !Memory::IsValidAddress(bufferAddr))
+	{
+		WARN_LOG(HLE, "sceMpegAvcDecodeYCbCr(%08x, %08x, %08x, %08x): bad arguments", mpeg, auAddr, bufferAddr, initAddr);
+		RETURN(-1);
+		return;
+	}
+
+	DEBUG_LOG(HLE, "sceMpegAvcDecodeYCbCr(%08x, %08x, %08x, %08x): %i bytes", mpeg, auAddr, bufferAddr, initAddr, (int)ctx->currentAu.size());
+
+	ctx->decoder->TakeFrame(ctx->frameY, ctx->frameCb, ctx->frameCr);
+	ctx->currentAu.clear();
+
+	u32 ycbcrAddr = Memory::Read_U32(bufferAddr);
+	int width = Memory::IsValidAddress(ycbcrAddr) ? Memory::Read_U32(ycbcrAddr) : 0;
+	int height = Memory::IsValidAddress(ycbcrAddr) ? Memory::Read_U32(ycbcrAddr + 4) : 0;
+	if (width == ctx->videoWidth && height == ctx->videoHeight)
+	{
+		int planeSize = width * height;
+		u32 planes = ycbcrAddr + MPEG_YCBCR_HEADER_SIZE;
+		Memory::Memcpy(planes, &ctx->frameY[0], planeSize);
+		Memory::Memcpy(planes + planeSize, &ctx->frameCb[0], planeSize / 4);
+		Memory::Memcpy(planes + planeSize + planeSize / 4, &ctx->frameCr[0], planeSize / 4);
+	}
+
+	if (Memory::IsValidAddress(initAddr))
+		Memory::Write_U32(1, initAddr);
 	RETURN(0);
 }
 
-void sceMpegAvcDecodeFlush() 
+void sceMpegAvcDecodeStopYCbCr()
 {
-	WARN_LOG(HLE, "HACK sceMpegAvcDecodeFlush(...)");
+	u32 statusAddr = PARAM(2);
+	DEBUG_LOG(HLE, "sceMpegAvcDecodeStopYCbCr(%08x, %08x, %08x)", PARAM(0), PARAM(1), statusAddr);
+	if (Memory::IsValidAddress(statusAddr))
+		Memory::Write_U32(0, statusAddr);
 	RETURN(0);
 }
 
-void sceMpegFinish() 
+void sceMpegAvcCsc()
 {
-	WARN_LOG(HLE, "HACK sceMpegFinish(...)");
+	u32 mpeg = PARAM(0);
+	u32 sourceAddr = PARAM(1);
+	u32 rangeAddr = PARAM(2);
+	int frameWidth = PARAM(3);
+	u32 destAddr = PARAM(4);
+
+	MpegContext *ctx = getMpegCtx(mpeg);
+	if (!ctx || !Memory::IsValidAddress(sourceAddr) || !Memory::IsValidAddress(rangeAddr))
+	{
+		WARN_LOG(HLE, "sceMpegAvcCsc(%08x, %08x, %08x, %i, %08x): bad arguments", mpeg, sourceAddr, rangeAddr, frameWidth, destAddr);
+		RETURN(-1);
+		return;
+	}
+
+	int width = Memory::Read_U32(sourceAddr);
+	int height = Memory::Read_U32(sourceAddr + 4);
+	int rangeX = Memory::Read_U32(rangeAddr);
+	int rangeY = Memory::Read_U32(rangeAddr + 4);
+	int rangeWidth = Memory::Read_U32(rangeAddr + 8);
+	int rangeHeight = Memory::Read_U32(rangeAddr + 12);
+
+	// The planes come straight after the header, so the whole picture has to be in memory.
+	u64 sourceEnd = (u64)sourceAddr + MPEG_YCBCR_HEADER_SIZE + (u64)(u32)width * (u32)height * 3 / 2;
+	if (width <= 0 || height <= 0 || (width & 1) != 0 || sourceEnd > 0xFFFFFFFFULL || !Memory::IsValidAddress((u32)sourceEnd - 1))
+	{
+		WARN_LOG(HLE, "sceMpegAvcCsc(%08x, %08x, %08x, %i, %08x): bad source %ix%i", mpeg, sourceAddr, rangeAddr, frameWidth, destAddr, width, height);
+		RETURN(ERROR_MPEG_INVALID_VALUE);
+		return;
+	}
+
+	// Written this way round so huge values can't overflow.
+	if (rangeX < 0 || rangeY < 0 || rangeWidth <= 0 || rangeHeight <= 0 || rangeWidth > width - rangeX || rangeHeight > height - rangeY || frameWidth <= 0 || rangeWidth > frameWidth - rangeX)
+	{
+		WARN_LOG(HLE, "sceMpegAvcCsc(%08x, %08x, %08x, %i, %08x): bad range", mpeg, sourceAddr, rangeAddr, frameWidth, destAddr);
+		RETURN(ERROR_MPEG_INVALID_VALUE);
+		return;
+	}
+
+	DEBUG_LOG(HLE, "sceMpegAvcCsc(%08x, %08x, %08x, %i, %08x): %ix%i at %i,%i", mpeg, sourceAddr, rangeAddr, frameWidth, destAddr, rangeWidth, rangeHeight, rangeX, rangeY);
+
+	int planeSize = width * height;
+	const u8 *y = Memory::GetPointer(sourceAddr + MPEG_YCBCR_HEADER_SIZE);
+	ConvertYCbCrToFramebuffer(y, y + planeSize, y + planeSize + planeSize / 4, width,
+		rangeX, rangeY, rangeWidth, rangeHeight, destAddr, frameWidth, ctx->pixelMode);
 	RETURN(0);
 }
 
-void sceMpegDelete() 
+void sceMpegAvcDecodeDetail()
 {
-	WARN_LOG(HLE, "HACK sceMpegDelete(...)");
+	WARN_LOG(HLE, "HACK sceMpegAvcDecodeDetail(...)");
 	RETURN(0);
 }
 
-void sceMpegGetAvcAu() 
+void sceMpegAvcDecodeFlush()
 {
-	WARN_LOG(HLE, "HACK sceMpegGetAvcAu(...)");
+	DEBUG_LOG(HLE, "sceMpegAvcDecodeFlush(%08x)", PARAM(0));
 	RETURN(0);
 }
 
-void sceMpegQueryStreamSize() 
+void sceMpegFinish()
 {
-	WARN_LOG(HLE, "HACK sceMpegQueryStreamSize(...)");
+	DEBUG_LOG(HLE, "sceMpegFinish()");
 	RETURN(0);
 }
 
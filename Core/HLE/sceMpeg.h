@@ -17,5 +17,13 @@
 
 #pragma once
 
+class PointerWrap;
+
 void Register_sceMpeg();
-void Register_sceMp3();
\ No newline at end of file
+void Register_sceMp3();
+
+void __MpegInit();
+void __MpegDoState(PointerWrap &p);
+void __MpegBeforeFork();
+void __MpegAfterFork(bool child);
+void __MpegShutdown();
@@ -34,6 +34,12 @@ void __PowerInit() {
 	memset(powerCbSlots, 0, sizeof(powerCbSlots));
 }
 
+void __PowerDoState(PointerWrap &p) {
+	p.DoArray(powerCbSlots, numberOfCBPowerSlots);
+	p.Do(volatileMemLocked);
+	p.DoMarker("scePower");
+}
+
 int scePowerGetBatteryLifePercent() {
 	DEBUG_LOG(HLE, "100=scePowerGetBatteryLifePercent");
 	return 100;
@@ -18,6 +18,7 @@
 #pragma once
 
 void __PowerInit();
+void __PowerDoState(PointerWrap &p);
 
 void Register_scePower();
 void Register_sceSuspendForUser();
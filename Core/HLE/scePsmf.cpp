@@ -15,71 +15,562 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <map>
+#include <vector>
+
 #include "HLE.h"
+#include "ChunkFile.h"
 
 #include "scePsmf.h"
 
 // "Go Sudoku" is a good way to test this code...
 
-struct PsmfData {
-  u32 version;
-  u32 unknown[3];
-  u32 numStreams;
-  u32 unknown2[5];
+enum {
+	ERROR_PSMF_NOT_FOUND = 0x80615025,
+	ERROR_PSMF_INVALID_ID = 0x80615100,
+	ERROR_PSMF_INVALID_VALUE = 0x806151fe,
+	ERROR_PSMF_INVALID_PSMF = 0x80615501,
+};
+
+// The header is big endian, all offsets are from the start of the file.
+const u32 PSMF_MAGIC = 0x464D5350;
+const int PSMF_STREAM_OFFSET_OFFSET = 0x08;
+const int PSMF_STREAM_SIZE_OFFSET = 0x0C;
+const int PSMF_FIRST_TIMESTAMP_OFFSET = 0x54;
+const int PSMF_LAST_TIMESTAMP_OFFSET = 0x5A;
+const int PSMF_NUMBER_STREAMS_OFFSET = 0x80;
+const int PSMF_FIRST_STREAM_OFFSET = 0x82;
+const int PSMF_STREAM_ENTRY_SIZE = 0x10;
+const int PSMF_EP_ENTRY_SIZE = 10;
+
+const int PSMF_VIDEO_STREAM_ID = 0xE0;
+const int PSMF_AUDIO_STREAM_ID = 0xBD;
+
+enum PsmfStreamType {
+	PSMF_AVC_STREAM = 0,
+	PSMF_ATRAC_STREAM = 1,
+	PSMF_PCM_STREAM = 2,
+	PSMF_DATA_STREAM = 3,
+	PSMF_AUDIO_STREAM = 15,
+};
+
+struct PsmfStream {
+	int type;
+	int channel;
+};
+
+struct PsmfEntry {
+	int index;
+	int picOffset;
+	u32 pts;
+	u32 offset;
+};
+
+// Host side view of a parsed PSMF header. The guest only holds the address of the
+// struct it passed to scePsmfSetPsmf, which is what we key these on.
+class Psmf {
+public:
+	Psmf() : currentStream(-1) {}
+	bool Parse(u32 data);
+
+	int FindStream(int type, int typeNum) const;
+	int CountStreams(int type) const;
+
+	void DoState(PointerWrap &p) {
+		p.Do(version);
+		p.Do(headerSize);
+		p.Do(streamOffset);
+		p.Do(streamSize);
+		p.Do(presentationStartTime);
+		p.Do(presentationEndTime);
+		p.Do(videoWidth);
+		p.Do(videoHeight);
+		p.Do(audioChannels);
+		p.Do(audioFrequency);
+		p.Do(streams);
+		p.Do(EPMap);
+		p.Do(currentStream);
+		p.DoMarker("Psmf");
+	}
+
+	u32 version;
+	u32 headerSize;
+	u32 streamOffset;
+	u32 streamSize;
+	u32 presentationStartTime;
+	u32 presentationEndTime;
+
+	int videoWidth;
+	int videoHeight;
+	int audioChannels;
+	int audioFrequency;
+
+	std::vector<PsmfStream> streams;
+	std::vector<PsmfEntry> EPMap;
+	int currentStream;
 };
 
+static std::map<u32, Psmf *> psmfMap;
+
+static inline u32 ReadBE32(const u8 *p) {
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline u32 ReadBE16(const u8 *p) {
+	return (p[0] << 8) | p[1];
+}
+
+// Timestamps are 90kHz ticks, stored as 6 big endian bytes. Only the low 32 bits matter.
+static inline u32 ReadTimestamp(const u8 *p) {
+	return ReadBE32(p + 2);
+}
+
+bool Psmf::Parse(u32 data)
+{
+	if (!Memory::IsValidAddress(data) || Memory::Read_U32(data) != PSMF_MAGIC)
+		return false;
+	headerSize = 0x800;
+	if (!Memory::IsValidAddress(data + headerSize - 1))
+		return false;
+
+	const u8 *ptr = Memory::GetPointer(data);
+	// The version is ASCII, like "0015".
+	version = (ptr[4] - '0') * 1000 + (ptr[5] - '0') * 100 + (ptr[6] - '0') * 10 + (ptr[7] - '0');
+	streamOffset = ReadBE32(ptr + PSMF_STREAM_OFFSET_OFFSET);
+	streamSize = ReadBE32(ptr + PSMF_STREAM_SIZE_OFFSET);
+	presentationStartTime = ReadTimestamp(ptr + PSMF_FIRST_TIMESTAMP_OFFSET);
+	presentationEndTime = ReadTimestamp(ptr + PSMF_LAST_TIMESTAMP_OFFSET);
+
+	videoWidth = 480;
+	videoHeight = 272;
+	audioChannels = 2;
+	audioFrequency = 2;
+
+	// The stream table is part of the header, whatever the count claims.
+	int numStreams = ReadBE16(ptr + PSMF_NUMBER_STREAMS_OFFSET);
+	const int maxStreams = (headerSize - PSMF_FIRST_STREAM_OFFSET) / PSMF_STREAM_ENTRY_SIZE;
+	if (numStreams > maxStreams)
+	{
+		WARN_LOG(HLE, "Psmf: %i streams don't fit in the header, only reading %i", numStreams, maxStreams);
+		numStreams = maxStreams;
+	}
+	streams.clear();
+	EPMap.clear();
+	for (int i = 0; i < numStreams; i++)
+	{
+		const u8 *entry = ptr + PSMF_FIRST_STREAM_OFFSET + i * PSMF_STREAM_ENTRY_SIZE;
+		int streamId = entry[0];
+		int privateStreamId = entry[1];
+
+		PsmfStream stream;
+		if ((streamId & 0xF0) == PSMF_VIDEO_STREAM_ID)
+		{
+			stream.type = PSMF_AVC_STREAM;
+			stream.channel = streamId & 0x0F;
+
+			u32 EPMapOffset = ReadBE32(entry + 4);
+			u32 EPMapEntries = ReadBE32(entry + 8);
+			videoWidth = entry[12] * 16;
+			videoHeight = entry[13] * 16;
+
+			u64 EPMapEnd = (u64)data + EPMapOffset + (u64)EPMapEntries * PSMF_EP_ENTRY_SIZE;
+			if (EPMapEnd > 0xFFFFFFFFULL || !Memory::IsValidAddress((u32)EPMapEnd))
+				EPMapEntries = 0;
+			for (u32 j = 0; j < EPMapEntries; j++)
+			{
+				const u8 *ep = ptr + EPMapOffset + j * PSMF_EP_ENTRY_SIZE;
+				PsmfEntry e;
+				e.index = ep[0];
+				e.picOffset = ep[1];
+				e.pts = ReadBE32(ep + 2);
+				e.offset = ReadBE32(ep + 6);
+				EPMap.push_back(e);
+			}
+		}
+		else if (streamId == PSMF_AUDIO_STREAM_ID)
+		{
+			stream.type = (privateStreamId & 0xF0) != 0 ? PSMF_PCM_STREAM : PSMF_ATRAC_STREAM;
+			stream.channel = privateStreamId & 0x0F;
+			audioChannels = entry[14];
+			audioFrequency = entry[15];
+		}
+		else
+		{
+			stream.type = PSMF_DATA_STREAM;
+			stream.channel = streamId & 0x0F;
+		}
+		streams.push_back(stream);
+	}
+	currentStream = -1;
+	return true;
+}
+
+static inline bool MatchesType(int streamType, int type)
+{
+	if (type == PSMF_AUDIO_STREAM)
+		return streamType == PSMF_ATRAC_STREAM || streamType == PSMF_PCM_STREAM;
+	return streamType == type;
+}
+
+int Psmf::FindStream(int type, int typeNum) const
+{
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		if (MatchesType(streams[i].type, type) && typeNum-- == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+int Psmf::CountStreams(int type) const
+{
+	int count = 0;
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		if (MatchesType(streams[i].type, type))
+			count++;
+	}
+	return count;
+}
+
+static Psmf *getPsmf(u32 psmfStruct)
+{
+	std::map<u32, Psmf *>::iterator iter = psmfMap.find(psmfStruct);
+	if (iter == psmfMap.end())
+		return 0;
+	return iter->second;
+}
+
+void __PsmfInit()
+{
+}
+
+void __PsmfDoState(PointerWrap &p)
+{
+	p.Do(psmfMap);
+	p.DoMarker("scePsmf");
+}
+
+void __PsmfShutdown()
+{
+	for (std::map<u32, Psmf *>::iterator it = psmfMap.begin(), end = psmfMap.end(); it != end; ++it)
+		delete it->second;
+	psmfMap.clear();
+}
 
 u32 scePsmfSetPsmf(u32 psmfStruct, u32 psmfData)
 {
-  INFO_LOG(HLE, "scePsmfSetPsmf(%08x, %08x)", psmfStruct, psmfData);
-  PsmfData data = {0};
-  data.version = Memory::Read_U32(psmfData + 4);
-  data.numStreams = 2;
-  Memory::Memcpy(psmfStruct, &data, sizeof(data));
-  return 0;
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+		psmf = new Psmf();
+
+	if (!psmf->Parse(psmfData))
+	{
+		ERROR_LOG(HLE, "scePsmfSetPsmf(%08x, %08x): invalid PSMF data", psmfStruct, psmfData);
+		delete psmf;
+		psmfMap.erase(psmfStruct);
+		return ERROR_PSMF_INVALID_PSMF;
+	}
+
+	INFO_LOG(HLE, "scePsmfSetPsmf(%08x, %08x): %i streams, %ix%i", psmfStruct, psmfData, (int)psmf->streams.size(), psmf->videoWidth, psmf->videoHeight);
+	psmfMap[psmfStruct] = psmf;
+
+	// The guest struct is opaque, but games sometimes peek at these.
+	Memory::Write_U32(psmf->version, psmfStruct);
+	Memory::Write_U32(psmfData, psmfStruct + 4);
+	return 0;
 }
 
 u32 scePsmfGetNumberOfStreams(u32 psmfStruct)
 {
-  PsmfData *data = (PsmfData *)Memory::GetPointer(psmfStruct);
-  INFO_LOG(HLE, "%i=scePsmfGetNumberOfStreams(%08x)", data->numStreams, psmfStruct);
-  return data->numStreams;
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetNumberOfStreams(%08x): invalid psmf", psmfStruct);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	INFO_LOG(HLE, "%i=scePsmfGetNumberOfStreams(%08x)", (int)psmf->streams.size(), psmfStruct);
+	return (u32)psmf->streams.size();
 }
 
 u32 scePsmfGetNumberOfSpecificStreams(u32 psmfStruct, u32 streamType)
 {
-  INFO_LOG(HLE, "scePsmfGetNumberOfSpecificStreams(%08x, %08x)", psmfStruct, streamType);
-  return 1;
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetNumberOfSpecificStreams(%08x, %08x): invalid psmf", psmfStruct, streamType);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	int count = psmf->CountStreams(streamType);
+	INFO_LOG(HLE, "%i=scePsmfGetNumberOfSpecificStreams(%08x, %08x)", count, psmfStruct, streamType);
+	return count;
+}
+
+u32 scePsmfSpecifyStreamWithStreamType(u32 psmfStruct, u32 streamType, u32 typeNum)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfSpecifyStreamWithStreamType(%08x, %08x, %i): invalid psmf", psmfStruct, streamType, typeNum);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	int stream = psmf->FindStream(streamType, typeNum);
+	INFO_LOG(HLE, "scePsmfSpecifyStreamWithStreamType(%08x, %08x, %i): stream %i", psmfStruct, streamType, typeNum, stream);
+	if (stream < 0)
+		return ERROR_PSMF_INVALID_ID;
+	psmf->currentStream = stream;
+	return 0;
+}
+
+u32 scePsmfSpecifyStream(u32 psmfStruct, int streamNum)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfSpecifyStream(%08x, %i): invalid psmf", psmfStruct, streamNum);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	INFO_LOG(HLE, "scePsmfSpecifyStream(%08x, %i)", psmfStruct, streamNum);
+	if (streamNum < 0 || streamNum >= (int)psmf->streams.size())
+		return ERROR_PSMF_INVALID_ID;
+	psmf->currentStream = streamNum;
+	return 0;
+}
+
+u32 scePsmfGetCurrentStreamType(u32 psmfStruct, u32 typeAddr, u32 channelAddr)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetCurrentStreamType(%08x, %08x, %08x): invalid psmf", psmfStruct, typeAddr, channelAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "scePsmfGetCurrentStreamType(%08x, %08x, %08x)", psmfStruct, typeAddr, channelAddr);
+	if (psmf->currentStream < 0)
+		return ERROR_PSMF_INVALID_ID;
+	const PsmfStream &stream = psmf->streams[psmf->currentStream];
+	if (Memory::IsValidAddress(typeAddr))
+		Memory::Write_U32(stream.type, typeAddr);
+	if (Memory::IsValidAddress(channelAddr))
+		Memory::Write_U32(stream.channel, channelAddr);
+	return 0;
+}
+
+u32 scePsmfGetCurrentStreamNumber(u32 psmfStruct)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetCurrentStreamNumber(%08x): invalid psmf", psmfStruct);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "%i=scePsmfGetCurrentStreamNumber(%08x)", psmf->currentStream, psmfStruct);
+	if (psmf->currentStream < 0)
+		return ERROR_PSMF_INVALID_ID;
+	return psmf->currentStream;
 }
 
-u32 scePsmfSpecifyStreamWithStreamType(u32 psmfStruct, u32 streamType) // possibly more params
+u32 scePsmfGetVideoInfo(u32 psmfStruct, u32 videoInfoAddr)
 {
-  INFO_LOG(HLE, "scePsmfSpecifyStreamWithStreamTypeFunction(%08x, %08x)", psmfStruct, streamType);
-  return 0;
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetVideoInfo(%08x, %08x): invalid psmf", psmfStruct, videoInfoAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	INFO_LOG(HLE, "scePsmfGetVideoInfo(%08x, %08x)", psmfStruct, videoInfoAddr);
+	if (!Memory::IsValidAddress(videoInfoAddr))
+		return ERROR_PSMF_INVALID_VALUE;
+	Memory::Write_U32(psmf->videoWidth, videoInfoAddr);
+	Memory::Write_U32(psmf->videoHeight, videoInfoAddr + 4);
+	return 0;
+}
+
+u32 scePsmfGetAudioInfo(u32 psmfStruct, u32 audioInfoAddr)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetAudioInfo(%08x, %08x): invalid psmf", psmfStruct, audioInfoAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	INFO_LOG(HLE, "scePsmfGetAudioInfo(%08x, %08x)", psmfStruct, audioInfoAddr);
+	if (!Memory::IsValidAddress(audioInfoAddr))
+		return ERROR_PSMF_INVALID_VALUE;
+	Memory::Write_U32(psmf->audioChannels, audioInfoAddr);
+	Memory::Write_U32(psmf->audioFrequency, audioInfoAddr + 4);
+	return 0;
+}
+
+u32 scePsmfGetPresentationStartTime(u32 psmfStruct, u32 startTimeAddr)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetPresentationStartTime(%08x, %08x): invalid psmf", psmfStruct, startTimeAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "scePsmfGetPresentationStartTime(%08x, %08x)", psmfStruct, startTimeAddr);
+	if (Memory::IsValidAddress(startTimeAddr))
+		Memory::Write_U32(psmf->presentationStartTime, startTimeAddr);
+	return 0;
+}
+
+u32 scePsmfGetPresentationEndTime(u32 psmfStruct, u32 endTimeAddr)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetPresentationEndTime(%08x, %08x): invalid psmf", psmfStruct, endTimeAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "scePsmfGetPresentationEndTime(%08x, %08x)", psmfStruct, endTimeAddr);
+	if (Memory::IsValidAddress(endTimeAddr))
+		Memory::Write_U32(psmf->presentationEndTime, endTimeAddr);
+	return 0;
+}
+
+u32 scePsmfGetNumberOfEPentries(u32 psmfStruct)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetNumberOfEPentries(%08x): invalid psmf", psmfStruct);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "%i=scePsmfGetNumberOfEPentries(%08x)", (int)psmf->EPMap.size(), psmfStruct);
+	return (u32)psmf->EPMap.size();
+}
+
+u32 scePsmfGetEPWithId(u32 psmfStruct, int epid, u32 entryAddr)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetEPWithId(%08x, %i, %08x): invalid psmf", psmfStruct, epid, entryAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "scePsmfGetEPWithId(%08x, %i, %08x)", psmfStruct, epid, entryAddr);
+	if (epid < 0 || epid >= (int)psmf->EPMap.size())
+		return ERROR_PSMF_INVALID_ID;
+	if (Memory::IsValidAddress(entryAddr))
+	{
+		const PsmfEntry &e = psmf->EPMap[epid];
+		Memory::Write_U32(e.pts, entryAddr);
+		Memory::Write_U32(e.offset, entryAddr + 4);
+		Memory::Write_U32(e.index, entryAddr + 8);
+		Memory::Write_U32(e.picOffset, entryAddr + 12);
+	}
+	return 0;
+}
+
+u32 scePsmfGetEPidWithTimestamp(u32 psmfStruct, u32 ts)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetEPidWithTimestamp(%08x, %i): invalid psmf", psmfStruct, ts);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "scePsmfGetEPidWithTimestamp(%08x, %i)", psmfStruct, ts);
+	if (psmf->EPMap.empty() || ts < psmf->presentationStartTime)
+		return ERROR_PSMF_INVALID_ID;
+
+	// The map is sorted by pts, so pick the last entry at or before ts.
+	int epid = 0;
+	for (size_t i = 0; i < psmf->EPMap.size(); i++)
+	{
+		if (psmf->EPMap[i].pts > ts)
+			break;
+		epid = (int)i;
+	}
+	return epid;
+}
+
+u32 scePsmfGetHeaderSize(u32 psmfStruct, u32 sizeAddr)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetHeaderSize(%08x, %08x): invalid psmf", psmfStruct, sizeAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "scePsmfGetHeaderSize(%08x, %08x)", psmfStruct, sizeAddr);
+	if (Memory::IsValidAddress(sizeAddr))
+		Memory::Write_U32(psmf->headerSize, sizeAddr);
+	return 0;
+}
+
+u32 scePsmfGetStreamSize(u32 psmfStruct, u32 sizeAddr)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetStreamSize(%08x, %08x): invalid psmf", psmfStruct, sizeAddr);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "scePsmfGetStreamSize(%08x, %08x)", psmfStruct, sizeAddr);
+	if (Memory::IsValidAddress(sizeAddr))
+		Memory::Write_U32(psmf->streamSize, sizeAddr);
+	return 0;
+}
+
+u32 scePsmfGetPsmfVersion(u32 psmfStruct)
+{
+	Psmf *psmf = getPsmf(psmfStruct);
+	if (!psmf)
+	{
+		ERROR_LOG(HLE, "scePsmfGetPsmfVersion(%08x): invalid psmf", psmfStruct);
+		return ERROR_PSMF_NOT_FOUND;
+	}
+	DEBUG_LOG(HLE, "%i=scePsmfGetPsmfVersion(%08x)", psmf->version, psmfStruct);
+	return psmf->version;
+}
+
+u32 scePsmfQueryStreamOffset(u32 bufferAddr, u32 offsetAddr)
+{
+	DEBUG_LOG(HLE, "scePsmfQueryStreamOffset(%08x, %08x)", bufferAddr, offsetAddr);
+	if (!Memory::IsValidAddress(bufferAddr) || Memory::Read_U32(bufferAddr) != PSMF_MAGIC)
+		return ERROR_PSMF_INVALID_PSMF;
+	if (Memory::IsValidAddress(offsetAddr))
+		Memory::Write_U32(ReadBE32(Memory::GetPointer(bufferAddr + PSMF_STREAM_OFFSET_OFFSET)), offsetAddr);
+	return 0;
+}
+
+u32 scePsmfQueryStreamSize(u32 bufferAddr, u32 sizeAddr)
+{
+	DEBUG_LOG(HLE, "scePsmfQueryStreamSize(%08x, %08x)", bufferAddr, sizeAddr);
+	if (!Memory::IsValidAddress(bufferAddr) || Memory::Read_U32(bufferAddr) != PSMF_MAGIC)
+		return ERROR_PSMF_INVALID_PSMF;
+	if (Memory::IsValidAddress(sizeAddr))
+		Memory::Write_U32(ReadBE32(Memory::GetPointer(bufferAddr + PSMF_STREAM_SIZE_OFFSET)), sizeAddr);
+	return 0;
 }
 
 const HLEFunction scePsmf[] =
 {
-  {0xc22c8327,&WrapU_UU<scePsmfSetPsmf>,"scePsmfSetPsmfFunction"},
-  {0xC7DB3A5B,0,"scePsmfGetCurrentStreamTypeFunction"},
-  {0x28240568,0,"scePsmfGetCurrentStreamNumberFunction"},
-  {0x1E6D9013,&WrapU_UU<scePsmfSpecifyStreamWithStreamType>,"scePsmfSpecifyStreamWithStreamTypeFunction"},
-  {0x4BC9BDE0,0,"scePsmfSpecifyStreamFunction"},
-  {0x76D3AEBA,0,"scePsmfGetPresentationStartTimeFunction"},
-  {0xBD8AE0D8,0,"scePsmfGetPresentationEndTimeFunction"},
-  {0xEAED89CD,&WrapU_U<scePsmfGetNumberOfStreams>,"scePsmfGetNumberOfStreamsFunction"},
-  {0x7491C438,0,"scePsmfGetNumberOfEPentriesFunction"},
-  {0x0BA514E5,0,"scePsmfGetVideoInfoFunction"},
-  {0xA83F7113,0,"scePsmfGetAudioInfoFunction"},
-  {0x971A3A90,0,"scePsmfCheckEPmapFunction"},
-  {0x68d42328,&WrapU_UU<scePsmfGetNumberOfSpecificStreams>,"scePsmfGetNumberOfSpecificStreamsFunction"},
-  {0x5b70fcc1,0,"scePsmfQueryStreamOffsetFunction"},
-  {0x9553cc91,0,"scePsmfQueryStreamSizeFunction"},
-  {0x0C120E1D,0,"scePsmfSpecifyStreamWithStreamTypeNumberFunction"},
-  {0xc7db3a5b,0,"scePsmfGetCurrentStreamTypeFunction"},
-  {0xB78EB9E9,0,"scePsmfGetHeaderSizeFunction"},
-  {0xA5EBFE81,0,"scePsmfGetStreamSizeFunction"},
-	{0xE1283895,0,"scePsmfGetPsmfVersionFunction"},
+	{0xc22c8327,&WrapU_UU<scePsmfSetPsmf>,"scePsmfSetPsmfFunction"},
+	{0xC7DB3A5B,&WrapU_UUU<scePsmfGetCurrentStreamType>,"scePsmfGetCurrentStreamTypeFunction"},
+	{0x28240568,&WrapU_U<scePsmfGetCurrentStreamNumber>,"scePsmfGetCurrentStreamNumberFunction"},
+	{0x1E6D9013,&WrapU_UUU<scePsmfSpecifyStreamWithStreamType>,"scePsmfSpecifyStreamWithStreamTypeFunction"},
+	{0x4BC9BDE0,&WrapU_UI<scePsmfSpecifyStream>,"scePsmfSpecifyStreamFunction"},
+	{0x76D3AEBA,&WrapU_UU<scePsmfGetPresentationStartTime>,"scePsmfGetPresentationStartTimeFunction"},
+	{0xBD8AE0D8,&WrapU_UU<scePsmfGetPresentationEndTime>,"scePsmfGetPresentationEndTimeFunction"},
+	{0xEAED89CD,&WrapU_U<scePsmfGetNumberOfStreams>,"scePsmfGetNumberOfStreamsFunction"},
+	{0x7491C438,&WrapU_U<scePsmfGetNumberOfEPentries>,"scePsmfGetNumberOfEPentriesFunction"},
+	{0x0BA514E5,&WrapU_UU<scePsmfGetVideoInfo>,"scePsmfGetVideoInfoFunction"},
+	{0xA83F7113,&WrapU_UU<scePsmfGetAudioInfo>,"scePsmfGetAudioInfoFunction"},
+	{0x971A3A90,0,"scePsmfCheckEPmapFunction"},
+	{0x68d42328,&WrapU_UU<scePsmfGetNumberOfSpecificStreams>,"scePsmfGetNumberOfSpecificStreamsFunction"},
+	{0x5b70fcc1,&WrapU_UU<scePsmfQueryStreamOffset>,"scePsmfQueryStreamOffsetFunction"},
+	{0x9553cc91,&WrapU_UU<scePsmfQueryStreamSize>,"scePsmfQueryStreamSizeFunction"},
+	{0x0C120E1D,0,"scePsmfSpecifyStreamWithStreamTypeNumberFunction"},
+	{0xB78EB9E9,&WrapU_UU<scePsmfGetHeaderSize>,"scePsmfGetHeaderSizeFunction"},
+	{0xA5EBFE81,&WrapU_UU<scePsmfGetStreamSize>,"scePsmfGetStreamSizeFunction"},
+	{0xE1283895,&WrapU_U<scePsmfGetPsmfVersion>,"scePsmfGetPsmfVersionFunction"},
+	{0x2673646B,0,"scePsmfVerifyPsmf"},
+	{0x4E624A34,&WrapU_UIU<scePsmfGetEPWithId>,"scePsmfGetEPWithId"},
+	{0x5F457515,&WrapU_UU<scePsmfGetEPidWithTimestamp>,"scePsmfGetEPidWithTimestampFunction"},
 };
 
 void scePsmfPlayerCreate() {
@@ -120,9 +611,6 @@ const HLEFunction scePsmfPlayer[] =
   {0xf8ef08a6,0,"scePsmfPlayerGetCurrentStatus"},
 	{0x2D0E4E0A,0,"scePsmfPlayerSetTempBufFunction"},
 	{0x58B83577,0,"scePsmfPlayerSetPsmfCBFunction"},
-	{0x2673646B,0,"scePsmfVerifyPsmf"},
-	{0x4E624A34,0,"scePsmfGetEPWithId"},
-	{0x5F457515,0,"scePsmfGetEPidWithTimestampFunction"},
 };
 
 void Register_scePsmf() {
@@ -17,5 +17,11 @@
 
 #pragma once
 
+class PointerWrap;
+
 void Register_scePsmf();
 void Register_scePsmfPlayer();
+
+void __PsmfInit();
+void __PsmfDoState(PointerWrap &p);
+void __PsmfShutdown();
@@ -30,6 +30,7 @@
 #include "sceKernel.h"
 #include "sceRtc.h"
 #include "../CoreTiming.h"
+#include "../Replay.h"
 
 // Grabbed from JPSCP
 // This is # of microseconds between January 1, 0001 and January 1, 1970.
@@ -66,6 +67,14 @@ void gettimeofday(timeval *tv, void *ignore)
 }
 #endif
 
+static void __RtcTimeOfDay(timeval *tv)
+{
+	gettimeofday(tv, NULL);
+	u64 us = Replay::ProcessTime(Replay::TIME_TIMEOFDAY, (u64)tv->tv_sec * 1000000ULL + tv->tv_usec);
+	tv->tv_sec = (long)(us / 1000000ULL);
+	tv->tv_usec = (long)(us % 1000000ULL);
+}
+
 void __RtcTmToPspTime(ScePspDateTime &t, tm *val)
 {
 	t.year = val->tm_year + 1900;
@@ -204,7 +213,7 @@ u32 sceRtcGetCurrentClock(u32 pspTimePtr, int tz)
 {
 	DEBUG_LOG(HLE, "sceRtcGetCurrentClock(%08x, %d)", pspTimePtr, tz);
 	timeval tv;
-	gettimeofday(&tv, NULL);
+	__RtcTimeOfDay(&tv);
 
 	time_t sec = (time_t) tv.tv_sec;
 	tm *utc = gmtime(&sec);
@@ -227,7 +236,7 @@ u32 sceRtcGetCurrentClockLocalTime(u32 pspTimePtr)
 {
 	DEBUG_LOG(HLE, "sceRtcGetCurrentClockLocalTime(%08x)", pspTimePtr);
 	timeval tv;
-	gettimeofday(&tv, NULL);
+	__RtcTimeOfDay(&tv);
 
 	time_t sec = (time_t) tv.tv_sec;
 	tm *local = localtime(&sec);
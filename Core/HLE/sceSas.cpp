@@ -25,6 +25,7 @@
 
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
+#include "ChunkFile.h"
 
 #include "sceSas.h"
 #include "sceKernel.h"
@@ -67,9 +68,10 @@ static const double f[5][2] =
 class VagDecoder
 {
 public:
-	void Start(u8 *data)
+	void Start(u32 dataAddr)
 	{
-		data_ = data;
+		startAddr_ = dataAddr;
+		data_ = Memory::GetPointer(dataAddr);
 		curSample = 28;
 		s_1 = 0.0;	// per block?
 		s_2 = 0.0;
@@ -93,10 +95,31 @@ public:
 		return *data_++;
 	}
 
+	void DoState(PointerWrap &p)
+	{
+		p.DoArray(samples, ARRAYSIZE(samples));
+		p.Do(curSample);
+
+		// data_ points into guest memory, keep it as an offset from where we started.
+		u32 readOffset = data_ != NULL ? (u32)(data_ - Memory::GetPointer(startAddr_)) : 0;
+		bool hasData = data_ != NULL;
+		p.Do(startAddr_);
+		p.Do(hasData);
+		p.Do(readOffset);
+		if (p.mode == p.MODE_READ)
+			data_ = hasData ? Memory::GetPointer(startAddr_) + readOffset : NULL;
+
+		p.Do(s_1);
+		p.Do(s_2);
+		p.Do(end_);
+		p.DoMarker("VagDecoder");
+	}
+
 private:
 	double samples[28];
 	int curSample;
 
+	u32 startAddr_;
 	u8 *data_;
 
 	// rolling state. start at 0, should probably reset to 0 on loops?
@@ -169,6 +192,35 @@ struct Voice
 	bool playing;
 
 	VagDecoder vag;
+
+	void DoState(PointerWrap &p)
+	{
+		p.Do(vagAddr);
+		p.Do(pcmAddr);
+		p.Do(samplePos);
+		p.Do(size);
+		p.Do(loop);
+		p.Do(freq);
+		p.Do(volumeLeft);
+		p.Do(volumeRight);
+		p.Do(volumeLeftSend);
+		p.Do(volumeRightSend);
+		p.Do(attackRate);
+		p.Do(decayRate);
+		p.Do(sustainRate);
+		p.Do(releaseRate);
+		p.Do(attackType);
+		p.Do(decayType);
+		p.Do(sustainType);
+		p.Do(sustainLevel);
+		p.Do(releaseType);
+		p.Do(pitch);
+		p.Do(setPaused);
+		p.Do(height);
+		p.Do(playing);
+		vag.DoState(p);
+		p.DoMarker("Voice");
+	}
 };
 
 class SasInstance
@@ -184,12 +236,39 @@ public:
 	int length;
 
 	void mix(u32 outAddr);
+
+	void DoState(PointerWrap &p)
+	{
+		int numVoices = NUM_VOICES;
+		p.Do(numVoices);
+		if (numVoices != NUM_VOICES)
+		{
+			ERROR_LOG(HLE, "Savestate failure: wrong number of SAS voices");
+			p.SetError(p.ERROR_FAILURE);
+			return;
+		}
+		for (int i = 0; i < NUM_VOICES; i++)
+			voices[i].DoState(p);
+		p.Do(waveformEffect);
+		p.Do(grainSize);
+		p.Do(maxVoices);
+		p.Do(sampleRate);
+		p.Do(outputMode);
+		p.Do(length);
+		p.DoMarker("SasInstance");
+	}
 };
 
 // TODO - allow more than one, associating each with one Core pointer (passed in to all the functions)
 // No known games use more than one instance of Sas though.
 SasInstance sas;	
 
+void __SasDoState(PointerWrap &p)
+{
+	sas.DoState(p);
+	p.DoMarker("sceSas");
+}
+
 // TODO: Make deterministic, by adding staging buffers that we pump out on a fixed CoreTiming-scheduled interval.
 
 void SasInstance::mix(u32 outAddr)
@@ -317,7 +396,7 @@ void sceSasSetKeyOn(u32 core, int voiceNum)
 {
 	DEBUG_LOG(HLE,"0=sceSasSetKeyOn(core=%08x, voiceNum=%i)", core, voiceNum);
 	Voice &v = sas.voices[voiceNum];
-	v.vag.Start(Memory::GetPointer(v.vagAddr));
+	v.vag.Start(v.vagAddr);
 	v.playing = true;
 	RETURN(0);
 }
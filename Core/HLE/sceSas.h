@@ -17,4 +17,7 @@
 
 #pragma once
 
+class PointerWrap;
+
 void Register_sceSasCore();
+void __SasDoState(PointerWrap &p);
@@ -55,6 +55,23 @@ void __UmdInit() {
 	driveCBId = -1;
 }
 
+void __UmdStatTimeout(u64 userdata, int cyclesLate);
+
+void __UmdDoState(PointerWrap &p)
+{
+	p.Do(umdActivated);
+	p.Do(umdStatus);
+	p.Do(umdErrorStat);
+	p.Do(driveCBId);
+
+	// The timeout event is registered on first use, CoreTiming needs it to exist when loading.
+	bool timerRegistered = umdStatTimer != 0;
+	p.Do(timerRegistered);
+	if (p.mode == p.MODE_READ && timerRegistered && umdStatTimer == 0)
+		umdStatTimer = CoreTiming::RegisterEvent("UmdTimeout", &__UmdStatTimeout);
+	p.DoMarker("sceUmd");
+}
+
 u8 __KernelUmdGetState()
 {
 	u8 state = UMD_PRESENT;
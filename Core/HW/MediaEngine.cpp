@@ -0,0 +1,237 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstring>
+
+#include "MediaEngine.h"
+
+#ifdef USE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+#endif
+
+MediaEngine::MediaEngine(int width, int height)
+	: width_(width), height_(height), thread_(0), busy_(false), exit_(false), newFrame_(false)
+{
+	y_.resize(width_ * height_);
+	cb_.resize(width_ * height_ / 4);
+	cr_.resize(width_ * height_ / 4);
+
+#ifdef USE_FFMPEG
+	codecCtx_ = 0;
+	frame_ = av_frame_alloc();
+	packet_ = av_packet_alloc();
+	const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+	if (codec)
+		codecCtx_ = avcodec_alloc_context3(codec);
+	if (codecCtx_)
+	{
+		// We're already off the emu thread, and extra decoder threads wouldn't survive a fork.
+		codecCtx_->thread_count = 1;
+		if (avcodec_open2(codecCtx_, codec, 0) < 0)
+			avcodec_free_context(&codecCtx_);
+	}
+	if (!codecCtx_)
+		ERROR_LOG(HLE, "MediaEngine: unable to open libavcodec's H.264 decoder");
+#else
+	static bool warned = false;
+	if (!warned)
+	{
+		WARN_LOG(HLE, "MediaEngine: built without USE_FFMPEG, videos will stay black");
+		warned = true;
+	}
+#endif
+
+	if (HasDecoder())
+		thread_ = new std::thread(ThreadFunc, (void *)this);
+}
+
+MediaEngine::~MediaEngine()
+{
+	if (thread_)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			exit_ = true;
+			cond_.notify_one();
+		}
+		thread_->join();
+		delete thread_;
+		thread_ = 0;
+	}
+
+#ifdef USE_FFMPEG
+	avcodec_free_context(&codecCtx_);
+	av_frame_free(&frame_);
+	av_packet_free(&packet_);
+#endif
+}
+
+bool MediaEngine::HasDecoder()
+{
+#ifdef USE_FFMPEG
+	return true;
+#else
+	return false;
+#endif
+}
+
+void MediaEngine::ThreadFunc(void *engine)
+{
+	Common::SetCurrentThreadName("MediaEngine");
+	((MediaEngine *)engine)->Run();
+}
+
+void MediaEngine::Run()
+{
+	std::unique_lock<std::mutex> guard(lock_);
+	while (true)
+	{
+		while (pending_.empty() && !exit_)
+			cond_.wait(guard);
+		if (exit_)
+			break;
+
+		std::vector<u8> au;
+		au.swap(pending_.front());
+		pending_.pop_front();
+		busy_ = true;
+
+		guard.unlock();
+		bool decoded = DecodeAu(au);
+		guard.lock();
+
+		if (decoded)
+			newFrame_ = true;
+		busy_ = false;
+		idleCond_.notify_all();
+	}
+}
+
+// Only the emu thread submits, so nothing new can be queued while it waits here.
+void MediaEngine::WaitIdle(std::unique_lock<std::mutex> &guard)
+{
+	while (thread_ != 0 && (busy_ || !pending_.empty()))
+		idleCond_.wait(guard);
+}
+
+void MediaEngine::SubmitAu(const std::vector<u8> &au)
+{
+	if (!thread_ || au.empty())
+		return;
+
+	std::lock_guard<std::mutex> guard(lock_);
+	pending_.push_back(au);
+	cond_.notify_one();
+}
+
+bool MediaEngine::TakeFrame(std::vector<u8> &y, std::vector<u8> &cb, std::vector<u8> &cr)
+{
+	std::unique_lock<std::mutex> guard(lock_);
+	WaitIdle(guard);
+	if (!newFrame_)
+		return false;
+
+	y.swap(y_);
+	cb.swap(cb_);
+	cr.swap(cr_);
+	newFrame_ = false;
+	return true;
+}
+
+void MediaEngine::Flush()
+{
+	std::unique_lock<std::mutex> guard(lock_);
+	pending_.clear();
+	WaitIdle(guard);
+	newFrame_ = false;
+#ifdef USE_FFMPEG
+	// The thread is idle and can't pick anything up while we hold the lock.
+	if (codecCtx_)
+		avcodec_flush_buffers(codecCtx_);
+#endif
+}
+
+void MediaEngine::BeforeFork()
+{
+	std::unique_lock<std::mutex> guard(lock_);
+	WaitIdle(guard);
+	guard.release();
+}
+
+void MediaEngine::AfterFork(bool child)
+{
+	if (child && thread_)
+	{
+		// As with the I/O thread, only the forking thread exists in the child.
+		thread_ = new std::thread(ThreadFunc, (void *)this);
+	}
+	lock_.unlock();
+}
+
+#ifdef USE_FFMPEG
+static void CopyPlane(const u8 *src, int srcStride, std::vector<u8> &dest, int destWidth, int destHeight, int width, int height)
+{
+	dest.resize(destWidth * destHeight);
+	for (int line = 0; line < height; line++)
+		memcpy(&dest[line * destWidth], src + line * srcStride, width);
+}
+#endif
+
+// Runs on the decode thread. The output planes are only touched here while the emu thread
+// is waiting in TakeFrame, or not looking at them at all.
+bool MediaEngine::DecodeAu(std::vector<u8> &au)
+{
+#ifdef USE_FFMPEG
+	if (!codecCtx_ || !frame_ || !packet_)
+		return false;
+
+	// libavcodec reads a little past the end of the packet.
+	size_t size = au.size();
+	au.resize(size + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+	packet_->data = &au[0];
+	packet_->size = (int)size;
+	if (avcodec_send_packet(codecCtx_, packet_) < 0)
+	{
+		WARN_LOG(HLE, "MediaEngine: decoder rejected a %i byte access unit", (int)size);
+		return false;
+	}
+
+	bool gotFrame = false;
+	while (avcodec_receive_frame(codecCtx_, frame_) == 0)
+	{
+		if (frame_->format != AV_PIX_FMT_YUV420P && frame_->format != AV_PIX_FMT_YUVJ420P)
+		{
+			WARN_LOG(HLE, "MediaEngine: unexpected pixel format %i", frame_->format);
+			continue;
+		}
+
+		int width = std::min(frame_->width, width_) & ~1;
+		int height = std::min(frame_->height, height_) & ~1;
+		CopyPlane(frame_->data[0], frame_->linesize[0], y_, width_, height_, width, height);
+		CopyPlane(frame_->data[1], frame_->linesize[1], cb_, width_ / 2, height_ / 2, width / 2, height / 2);
+		CopyPlane(frame_->data[2], frame_->linesize[2], cr_, width_ / 2, height_ / 2, width / 2, height / 2);
+		gotFrame = true;
+	}
+	return gotFrame;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "../../Globals.h"
+#include "../../Common/Thread.h"
+
+#ifdef USE_FFMPEG
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+#endif
+
+// Decodes AVC access units on a thread of its own, like the PSP's Media Engine does next
+// to the main CPU. The decoder is libavcodec, so without USE_FFMPEG nothing gets decoded.
+class MediaEngine
+{
+public:
+	MediaEngine(int width, int height);
+	~MediaEngine();
+
+	static bool HasDecoder();
+
+	// Queues an access unit and returns right away.
+	void SubmitAu(const std::vector<u8> &au);
+	// Waits for everything submitted so far, then swaps the newest picture (planar 4:2:0)
+	// into the planes. Returns false and leaves them alone if nothing new was decoded.
+	bool TakeFrame(std::vector<u8> &y, std::vector<u8> &cb, std::vector<u8> &cr);
+	// Drops queued access units and the reference pictures.
+	void Flush();
+
+	void BeforeFork();
+	void AfterFork(bool child);
+
+private:
+	static void ThreadFunc(void *engine);
+	void Run();
+	void WaitIdle(std::unique_lock<std::mutex> &guard);
+	bool DecodeAu(std::vector<u8> &au);
+
+	int width_;
+	int height_;
+
+	std::thread *thread_;
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::condition_variable idleCond_;
+	std::deque<std::vector<u8> > pending_;
+	bool busy_;
+	bool exit_;
+
+	// Newest decoded picture, handed over by TakeFrame.
+	std::vector<u8> y_;
+	std::vector<u8> cb_;
+	std::vector<u8> cr_;
+	bool newFrame_;
+
+#ifdef USE_FFMPEG
+	AVCodecContext *codecCtx_;
+	AVFrame *frame_;
+	AVPacket *packet_;
+#endif
+};
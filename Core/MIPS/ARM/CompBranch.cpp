@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 #include "../../HLE/HLE.h"
+#include "../../HLE/ReplaceTables.h"
 
 #include "../MIPS.h"
 #include "../MIPSCodeUtils.h"
@@ -353,4 +354,14 @@ void Jit::Comp_Syscall(u32 op)
 
 }
 
+void Jit::Comp_ReplacementFunc(u32 op)
+{
+	// Replacement_Call sets pc to ra, so exit the same way as a syscall.
+	FlushAll();
+	ARMABI_CallFunctionC((void *)&Replacement_Call, op);
+
+	WriteSyscallExit();
+	js.compiling = false;
+}
+
 }   // namespace Mipscomp
@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "Timer.h"
+
 #include "../../Core.h"
 #include "../../CoreTiming.h"
 #include "../MIPS.h"
@@ -94,6 +96,7 @@ void Jit::CompileAt(u32 addr)
 
 void Jit::Compile(u32 em_address)
 {
+	u64 start = Common::Timer::GetTimeNs();
 	if (GetSpaceLeft() < 0x10000 || blocks.IsFull())
 	{
 		ClearCache();
@@ -102,6 +105,9 @@ void Jit::Compile(u32 em_address)
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink, DoJit(em_address, b));
+
+	jitStats.blocksCompiled++;
+	jitStats.compileNs += Common::Timer::GetTimeNs() - start;
 }
 
 void Jit::RunLoopUntil(u64 globalticks)
@@ -132,7 +138,7 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 	while (js.compiling)
 	{
 		u32 inst = Memory::Read_Instruction(js.compilerPC);
-		js.downcountAmount += MIPSGetInstructionCycleEstimate(inst);
+		js.downcountAmount += MIPSGetInstructionCycles(inst, js.compilerPC);
 
 		MIPSCompileOp(inst);
 
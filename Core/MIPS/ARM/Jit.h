@@ -81,6 +81,7 @@ public:
 	void Comp_Jump(u32 op);
 	void Comp_JumpReg(u32 op);
 	void Comp_Syscall(u32 op);
+	void Comp_ReplacementFunc(u32 op);
 
 	void Comp_IType(u32 op);
 	void Comp_RType3(u32 op);
@@ -94,8 +95,9 @@ public:
 
 	JitBlockCache *GetBlockCache() { return &blocks; }
 	AsmRoutineManager &Asm() { return asm_; }
-private:
 	void ClearCache();
+
+private:
 	void FlushAll();
 
 	void WriteExit(u32 destination, int exit_num);
@@ -28,6 +28,7 @@
 #include "../MIPS.h"
 #include "../MIPSTables.h"
 #include "../MIPSAnalyst.h"
+#include "../../Debugger/GuestProfiler.h"
 
 #include "JitCache.h"
 #include "../JitCommon/JitCommon.h"
@@ -103,6 +104,7 @@ void JitBlockCache::Clear()
 {
 	for (int i = 0; i < num_blocks; i++)
 	{
+		GuestProfiler::AddBlockRuns(blocks[i].originalAddress, blocks[i].originalSize, blocks[i].runCount);
 		DestroyBlock(i, false);
 	}
 	links_to.clear();
@@ -162,6 +164,7 @@ int JitBlockCache::AllocateBlock(u32 em_address)
 	JitBlock &b = blocks[num_blocks];
 	b.invalid = false;
 	b.originalAddress = em_address;
+	b.runCount = 0;
 	b.exitAddress[0] = INVALID_EXIT;
 	b.exitAddress[1] = INVALID_EXIT;
 	b.exitPtrs[0] = 0;
@@ -365,7 +368,7 @@ void JitBlockCache::DestroyBlock(int block_num, bool invalidate)
 #ifdef JIT_UNLIMITED_ICACHE
 	Memory::Write_Opcode_JIT(b.originalAddress, b.originalFirstOpcode?b.originalFirstOpcode:JIT_ICACHE_INVALID_WORD);
 #else
-	if ((int)Memory::ReadUnchecked_U32(b.originalAddress) == block_num)
+	if (Memory::ReadUnchecked_U32(b.originalAddress) == (u32)MIPS_MAKE_EMUHACK(0, block_num))
 		Memory::WriteUnchecked_U32(b.originalFirstOpcode, b.originalAddress);
 #endif
 
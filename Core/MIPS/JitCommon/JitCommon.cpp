@@ -19,4 +19,5 @@
 
 namespace MIPSComp {
 	Jit *jit;
+	JitStats jitStats;
 }
@@ -34,13 +34,22 @@
 #define MIPS_MAKE_EMUHACK(subop, value) (MIPS_EMUHACK_OPCODE | ((subop) << 24) | (value))
 #define MIPS_IS_EMUHACK(op) (((op) & 0xFC000000) == MIPS_EMUHACK_OPCODE)  // masks away the subop
 
-#define MIPS_EMUHACK_GET_SUBOP(op) ((op) & 0x))
+#define MIPS_EMUHACK_GET_SUBOP(op) (((op) >> 24) & 3)
 #define MIPS_EMUHACK_GET_IMM24(op) ((op) & 0x00FFFFFF)
 
 // There are 2 bits available for sub-opcodes, 0x03000000.
 #define EMUOP_RUNBLOCK 0   // Runs a JIT block
 #define EMUOP_RETKERNEL 1  // Returns to the simulated PSP kernel from a thread
+#define EMUOP_CALL_REPLACEMENT 2  // Runs a native replacement of a guest function, see ReplaceTables
 
 namespace MIPSComp {
 extern Jit *jit;
+
+// Running totals, never reset.
+struct JitStats
+{
+	u32 blocksCompiled;
+	u64 compileNs;
+};
+extern JitStats jitStats;
 }
@@ -16,6 +16,7 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include "Common.h"
+#include "ChunkFile.h"
 #include "MIPS.h"
 #include "MIPSTables.h"
 #include "MIPSDebugInterface.h"
@@ -93,6 +94,38 @@ void MIPSState::Reset()
 	rng.Init(0x1337);
 }
 
+void GMRng::DoState(PointerWrap &p)
+{
+	p.Do(m_w);
+	p.Do(m_z);
+}
+
+void MIPSState::DoState(PointerWrap &p)
+{
+	// Reset the jit if we're loading, its blocks point at the old code.
+	if (p.mode == p.MODE_READ && MIPSComp::jit)
+		MIPSComp::jit->ClearCache();
+
+	p.DoArray(r, ARRAYSIZE(r));
+	p.DoArray(f, ARRAYSIZE(f));
+	p.DoArray(v, ARRAYSIZE(v));
+	p.DoArray(vfpuCtrl, ARRAYSIZE(vfpuCtrl));
+	p.DoArray(vfpuWriteMask, ARRAYSIZE(vfpuWriteMask));
+	p.Do(pc);
+	p.Do(nextPC);
+	p.Do(hi);
+	p.Do(lo);
+	p.Do(fpcond);
+	p.Do(fcr0);
+	p.Do(fcr31);
+	rng.DoState(p);
+	p.Do(inDelaySlot);
+	p.Do(llBit);
+	p.Do(exceptions);
+	p.Do(debugCount);
+	p.DoMarker("MIPSState");
+}
+
 void MIPSState::SetWriteMask(const bool wm[4])
 {
 	for (int i = 0; i < 4; i++)
@@ -20,6 +20,8 @@
 #include "../../Globals.h"
 #include "../CPU.h"
 
+class PointerWrap;
+
 enum
 {
 	MIPS_REG_ZERO=0,
@@ -92,6 +94,8 @@ public:
 		return (m_z << 16) + m_w;
 	}
 
+	void DoState(PointerWrap &p);
+
 private:
 	u32 m_w;
 	u32 m_z;
@@ -104,6 +108,7 @@ public:
 	~MIPSState();
 
 	void Reset();
+	void DoState(PointerWrap &p);
 
 	u32 r[32];
 	float f[32];
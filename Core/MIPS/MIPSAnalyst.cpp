@@ -233,24 +233,26 @@ namespace MIPSAnalyst
 		return true;
 	}
 
+	static u32 HashInstruction(u32 hash, u32 instr)
+	{
+		u32 validbits = 0xFFFFFFFF;
+		u32 flags = MIPSGetInfo(instr);
+		if (flags & IN_IMM16)
+			validbits&=~0xFFFF;
+		if (flags & IN_IMM26)
+			validbits&=~0x3FFFFFF;
+		hash = _rotl(hash,13);
+		return hash ^ (instr&validbits);
+	}
+
 	void HashFunctions()
 	{
 		for (vector<Function>::iterator iter = functions.begin(); iter!=functions.end(); iter++)
 		{
 			Function &f=*iter;
 			u32 hash = 0x1337babe;
-			for (u32 addr = f.start; addr <= f.end; addr++)
-			{
-				u32 validbits = 0xFFFFFFFF;
-				u32 instr = Memory::Read_Instruction(addr);
-				u32 flags = MIPSGetInfo(instr);
-				if (flags & IN_IMM16)
-					validbits&=~0xFFFF;
-				if (flags & IN_IMM26)
-					validbits&=~0x3FFFFFF;
-				hash = _rotl(hash,13);
-				hash ^= (instr&validbits);
-			}
+			for (u32 addr = f.start; addr <= f.end; addr += 4)
+				hash = HashInstruction(hash, Memory::Read_Instruction(addr));
 			f.hash=hash;
 			f.hasHash=true;
 		}
@@ -286,7 +288,8 @@ namespace MIPSAnalyst
 			}
 			if (op == MIPS_MAKE_JR_RA())
 			{
-				if (furthestBranch >= addr)
+				// A branch to the jr ra itself (an early return) doesn't go any further.
+				if (furthestBranch > addr)
 				{
 					looking = true;
 					addr+=4;
@@ -373,34 +376,46 @@ namespace MIPSAnalyst
 	}
 
 
+	static void NameFunctionByHash(u32 hash, u32 size, const char *name)
+	{
+		map<u32,Function*>::iterator iter = hashToFunction.find(hash);
+		if (iter != hashToFunction.end())
+		{
+			//yay, found a function!
+			Function &f = *(iter->second);
+			if (f.size==size)
+			{
+				strncpy(f.name, name, sizeof(f.name) - 1);
+				f.name[sizeof(f.name) - 1] = 0;
+				int n = symbolMap.GetSymbolNum(f.start);
+				if (n != -1)
+					symbolMap.SetSymbolName(n, f.name);
+			}
+		}
+	}
+
 	void LoadHashMap(const char *filename)
 	{
 		HashFunctions();
 		UpdateHashToFunctionMap();
 
 		FILE *file = fopen(filename, "rb");
-		int num;
+		if (!file)
+			return;
+		int num = 0;
 		fread(&num,4,1,file);
 		for (int i=0; i<num; i++)
 		{
 			HashMapFunc temp;
-			fread(&temp,sizeof(temp),1,file);
-			map<u32,Function*>::iterator iter = hashToFunction.find(temp.hash);
-			if (iter != hashToFunction.end())
-			{
-				//yay, found a function!
-				Function &f = *(iter->second);
-				if (f.size==temp.size)
-				{
-					strcpy(f.name, temp.name);
-					f.hash=temp.hash;
-					f.size=temp.size;
-				}
-			}
+			if (fread(&temp,sizeof(temp),1,file) != 1)
+				break;
+			temp.name[sizeof(temp.name) - 1] = 0;
+			NameFunctionByHash(temp.hash, temp.size, temp.name);
 		}
 
 		fclose(file);
 	}
+
 	void CompileLeafs()
 	{
 		/*
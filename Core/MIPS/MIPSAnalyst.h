@@ -51,6 +51,10 @@ namespace MIPSAnalyst
 	void ScanForFunctions(u32 startAddr, u32 endAddr);
 	void CompileLeafs();
 
+	// Function hash maps, so known functions can be named in stripped binaries.
+	void StoreHashMap(const char *filename);
+	void LoadHashMap(const char *filename);
+
 	std::vector<int> GetInputRegs(u32 op);
 	std::vector<int> GetOutputRegs(u32 op);
 
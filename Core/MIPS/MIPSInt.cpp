@@ -25,6 +25,7 @@
 #include "MIPSTables.h"
 
 #include "../HLE/HLE.h"
+#include "../HLE/ReplaceTables.h"
 #include "../System.h"
 
 #define R(i) (currentMIPS->r[i])
@@ -100,12 +101,15 @@ int MIPS_SingleStep()
 			mipsr4k.pc = mipsr4k.nextPC;
 			mipsr4k.inDelaySlot = false;
 		}
+		// The branch paid for this one.
+		return 0;
 	}
 	else
 	{
+		int cycles = MIPSGetInstructionCycles(op, mipsr4k.pc);
 		MIPSInterpret(op);
+		return cycles;
 	}
-	return 1;
 }
 
 
@@ -878,5 +882,12 @@ namespace MIPSInt
 		_dbg_assert_msg_(CPU,0,"Trying to interpret emuhack instruction that can't be interpreted");
 	}
 
+	void Int_ReplacementFunc(u32 op)
+	{
+		// Always the first op of a function, so never in a delay slot.
+		mipsr4k.inDelaySlot = false;
+		Replacement_Call(op);
+	}
+
 
 }
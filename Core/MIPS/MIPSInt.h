@@ -49,6 +49,7 @@ namespace MIPSInt
 	void Int_FPUComp(u32 op);
 	void Int_FPUBranch(u32 op);
 	void Int_Emuhack(u32 op);
+	void Int_ReplacementFunc(u32 op);
 	void Int_Special3(u32 op);
 	void Int_Interrupt(u32 op);
 	void Int_Cache(u32 op);
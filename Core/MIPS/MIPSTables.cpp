@@ -22,6 +22,7 @@
 #include "MIPSDisVFPU.h"
 #include "MIPSInt.h"
 #include "MIPSIntVFPU.h"
+#include "MIPSVFPUUtils.h"
 #include "MIPSCodeUtils.h"
 #include "../../Core/CoreTiming.h"
 #include "../Debugger/Breakpoints.h"
@@ -178,8 +179,8 @@ const MIPSInstruction tableSpecial[64] = /// 000000 ...... ...... .......... xxx
 	INSTR("srav",  &Jit::Comp_ShiftType, Dis_VarShiftType, Int_ShiftType, OUT_RD|IN_RT|IN_RS_SHIFT),
 
 	//8
-	INSTR("jr",    &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType,0),
-	INSTR("jalr",  &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType,0),
+	INSTR("jr",    &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType, DELAYSLOT),
+	INSTR("jalr",  &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType, DELAYSLOT),
 	INSTR("movz",  &Jit::Comp_RType3, Dis_RType3, Int_RType3, OUT_RD|IN_RS|IN_RT),
 	INSTR("movn",  &Jit::Comp_RType3, Dis_RType3, Int_RType3, OUT_RD|IN_RS|IN_RT),
 	INSTR("syscall", &Jit::Comp_Syscall, Dis_Syscall, Int_Syscall,0),
@@ -198,12 +199,12 @@ const MIPSInstruction tableSpecial[64] = /// 000000 ...... ...... .......... xxx
 	INSTR("clo",   &Jit::Comp_Generic, Dis_RType2, Int_RType2, OUT_RD|IN_RS|IN_RT),
 
 	//24
-	INSTR("mult",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
-	INSTR("multu", &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
-	INSTR("div",   &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
-	INSTR("divu",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
-	INSTR("madd",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
-	INSTR("maddu", &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
+	INSTR("mult",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_MUL),
+	INSTR("multu", &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_MUL),
+	INSTR("div",   &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_DIV),
+	INSTR("divu",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_DIV),
+	INSTR("madd",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_MUL),
+	INSTR("maddu", &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_MUL),
 	{-2},
 	{-2},
 
@@ -224,8 +225,8 @@ const MIPSInstruction tableSpecial[64] = /// 000000 ...... ...... .......... xxx
 	INSTR("sltu", &Jit::Comp_RType3, Dis_RType3, Int_RType3,IN_RS|IN_RT|OUT_RD),
 	INSTR("max",  &Jit::Comp_RType3, Dis_RType3, Int_RType3,IN_RS|IN_RT|OUT_RD),
 	INSTR("min",  &Jit::Comp_RType3, Dis_RType3, Int_RType3,IN_RS|IN_RT|OUT_RD),
-	INSTR("msub",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
-	INSTR("msubu", &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER),
+	INSTR("msub",  &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_MUL),
+	INSTR("msubu", &Jit::Comp_Generic, Dis_MulDivType, Int_MulDivType, IN_RS|IN_RT|OUT_OTHER|CYCLES_MUL),
 
 	//48
 	INSTR("tge",  &Jit::Comp_Generic, Dis_RType3, 0, 0),
@@ -250,8 +251,8 @@ const MIPSInstruction tableSpecial2[64] =
 	INSTR("add.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
 	INSTR("sub.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
 	INSTR("mul.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
-	INSTR("div.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
-	INSTR("sqrt.s", &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
+	INSTR("div.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, CYCLES_FPU_DIV),
+	INSTR("sqrt.s", &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, CYCLES_FPU_DIV),
 	INSTR("abs.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
 	INSTR("mov.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
 	INSTR("neg.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
@@ -327,10 +328,10 @@ const MIPSInstruction tableSpecial3[64] =
 
 const MIPSInstruction tableRegImm[32] = 
 {
-	INSTR("bltz",  &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS),
-	INSTR("bgez",  &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS),
-	INSTR("bltzl", &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS),
-	INSTR("bgezl", &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS),
+	INSTR("bltz",  &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|DELAYSLOT),
+	INSTR("bgez",  &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|DELAYSLOT),
+	INSTR("bltzl", &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|DELAYSLOT),
+	INSTR("bgezl", &Jit::Comp_RelBranchRI, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|DELAYSLOT),
 	{-2},
 	{-2},
 	{-2},
@@ -345,10 +346,10 @@ const MIPSInstruction tableRegImm[32] =
 	INSTR("tnei",  &Jit::Comp_Generic, Dis_Generic, 0, 0),
 	{-2},
 
-  INSTR("bltzal",  &Jit::Comp_Generic, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA),  
-  INSTR("bgezal",  &Jit::Comp_Generic, Dis_RelBranch,	Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA),
-  INSTR("bltzall", &Jit::Comp_Generic, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA), //L = likely
-  INSTR("bgezall", &Jit::Comp_Generic, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA),
+  INSTR("bltzal",  &Jit::Comp_Generic, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA|DELAYSLOT),  
+  INSTR("bgezal",  &Jit::Comp_Generic, Dis_RelBranch,	Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA|DELAYSLOT),
+  INSTR("bltzall", &Jit::Comp_Generic, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA|DELAYSLOT), //L = likely
+  INSTR("bgezall", &Jit::Comp_Generic, Dis_RelBranch, Int_RelBranchRI, IS_CONDBRANCH|IN_RS|OUT_RA|DELAYSLOT),
 	{-2},
 	{-2},
 	{-2},
@@ -384,10 +385,10 @@ const MIPSInstruction tableCop2[32] =
 
 const MIPSInstruction tableCop2BC2[4] = 
 {
-	INSTR("bvf", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH),
-	INSTR("bvt", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH),
-	INSTR("bvfl", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH),
-	INSTR("bvtl", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH),
+	INSTR("bvf", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH|DELAYSLOT),
+	INSTR("bvt", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH|DELAYSLOT),
+	INSTR("bvfl", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH|DELAYSLOT),
+	INSTR("bvtl", &Jit::Comp_VBranch, Dis_VBranch,Int_VBranch,IS_CONDBRANCH|DELAYSLOT),
 };
 
 const MIPSInstruction tableCop0[32] = 
@@ -467,10 +468,10 @@ MIPSInstruction tableCop1[32] =
 
 MIPSInstruction tableCop1BC[32] = 
 {
-	{-1,"bc1f",  &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG},
-	{-1,"bc1t",  &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG},
-	{-1,"bc1fl", &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG},
-	{-1,"bc1tl", &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG},
+	{-1,"bc1f",  &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG|DELAYSLOT},
+	{-1,"bc1t",  &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG|DELAYSLOT},
+	{-1,"bc1fl", &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG|DELAYSLOT},
+	{-1,"bc1tl", &Jit::Comp_FPUBranch, Dis_FPUBranch, Int_FPUBranch,IS_CONDBRANCH|IN_FPUFLAG|DELAYSLOT},
 	{-2},{-2},{-2},{-2},
 	{-2},{-2},{-2},{-2},{-2},{-2},{-2},{-2},
 	{-2},{-2},{-2},{-2},{-2},{-2},{-2},{-2},
@@ -484,18 +485,18 @@ MIPSInstruction tableVFPU0[8] =
 	INSTR("vsbn",&Jit::Comp_Generic, Dis_VectorSet3, 0, IS_VFPU), 
 	{-2}, {-2}, {-2}, {-2}, 
 	
-	INSTR("vdiv",&Jit::Comp_Generic, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
+	INSTR("vdiv",&Jit::Comp_Generic, Dis_VectorSet3, Int_VecDo3, IS_VFPU|CYCLES_VFPU_DIV),
 };
 
 MIPSInstruction tableVFPU1[8] = 
 {
 	INSTR("vmul",&Jit::Comp_Generic, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
-	INSTR("vdot",&Jit::Comp_Generic, Dis_VectorDot, Int_VDot, IS_VFPU), 
+	INSTR("vdot",&Jit::Comp_Generic, Dis_VectorDot, Int_VDot, IS_VFPU|CYCLES_VFPU_DOT), 
 	INSTR("vscl",&Jit::Comp_Generic, Dis_VScl, Int_VScl, IS_VFPU),
-	INSTR("vhdp",&Jit::Comp_Generic, Dis_Generic, 0, IS_VFPU), 
+	INSTR("vhdp",&Jit::Comp_Generic, Dis_Generic, 0, IS_VFPU|CYCLES_VFPU_DOT), 
 	{-2}, 
-	INSTR("vcrs",&Jit::Comp_Generic, Dis_Vcrs, Int_Vcrs, IS_VFPU), 
-	INSTR("vdet",&Jit::Comp_Generic, Dis_Generic, 0, IS_VFPU), 
+	INSTR("vcrs",&Jit::Comp_Generic, Dis_Vcrs, Int_Vcrs, IS_VFPU|CYCLES_VFPU_DOT), 
+	INSTR("vdet",&Jit::Comp_Generic, Dis_Generic, 0, IS_VFPU|CYCLES_VFPU_DOT), 
 	{-2},
 };
 
@@ -593,20 +594,20 @@ MIPSInstruction tableVFPU4[32] =  //110100 00000 xxxxx
 //8
 	{-2},{-2},{-2},{-2},{-2},{-2},{-2},{-2},
 //16
-	INSTR("vrcp", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
-	INSTR("vrsq", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
-	INSTR("vsin", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
-	INSTR("vcos", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
-	INSTR("vexp2", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
-	INSTR("vlog2", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
-	INSTR("vsqrt", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
-	INSTR("vasin", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
+	INSTR("vrcp", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
+	INSTR("vrsq", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
+	INSTR("vsin", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
+	INSTR("vcos", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
+	INSTR("vexp2", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
+	INSTR("vlog2", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
+	INSTR("vsqrt", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
+	INSTR("vasin", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
 //24
-	INSTR("vnrcp", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op,IS_VFPU),
+	INSTR("vnrcp", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op,IS_VFPU|CYCLES_VFPU_FUNC),
 	{-2},
-	INSTR("vnsin", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op,IS_VFPU), 
+	INSTR("vnsin", &Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op,IS_VFPU|CYCLES_VFPU_FUNC), 
 	{-2},
-	INSTR("vrexp2",&Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU),
+	INSTR("vrexp2",&Jit::Comp_Generic, Dis_VectorSet2, Int_VV2Op, IS_VFPU|CYCLES_VFPU_FUNC),
 	{-2},{-2},{-2},
 //32
 };
@@ -626,35 +627,35 @@ MIPSInstruction tableVFPU5[8] =  //110111 xxx
 MIPSInstruction tableVFPU6[32] =  //111100 xxx
 {
 //0
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU|CYCLES_VFPU_MATRIX),
+
+	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
 //8
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+
+	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
+	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU|CYCLES_VFPU_MATRIX),
 	//16
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|CYCLES_VFPU_DOT),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|CYCLES_VFPU_DOT),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|CYCLES_VFPU_DOT),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU|CYCLES_VFPU_DOT),
 //24
 	{-2},
 	{-2},
@@ -759,7 +760,7 @@ MIPSInstruction tableEMU[4] =
 {
 	INSTR("RUNBLOCK",&Jit::Comp_RunBlock,Dis_Emuhack,Int_Emuhack, 0xFFFFFFFF),
 	INSTR("RetKrnl", 0,Dis_Emuhack,Int_Emuhack, 0),
-	{-2},
+	INSTR("CallRepl",&Jit::Comp_ReplacementFunc,Dis_Emuhack,Int_ReplacementFunc, 0),
 	{-2},
 };
 
@@ -976,6 +977,9 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 #endif
 
 				bool wasInDelaySlot = curMips->inDelaySlot;
+				// The branch already paid for its delay slot.
+				if (!wasInDelaySlot)
+					CoreTiming::downcount -= MIPSGetInstructionCycles(op, curMips->pc);
 
 				MIPSInterpret(op);
 
@@ -987,7 +991,6 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 						curMips->pc = curMips->nextPC;
 						curMips->inDelaySlot = false;
 					}
-					CoreTiming::downcount -= 1;
 					goto again;
 				}
 			}
@@ -1012,6 +1015,34 @@ static inline void DelayBranchTo(MIPSState *curMips, u32 where)
 	curMips->inDelaySlot = true;
 }
 
+// Costs from MIPSGetInstructionCycles by pc, so the fast interpreter doesn't look up both
+// instructions again every time around a loop.  An entry is checked against both words it
+// depends on, so rewritten code just gets a new cost.
+struct CycleCacheEntry
+{
+	u32 pc;
+	u32 op;
+	u32 nextOp;
+	int cycles;
+};
+static const u32 CYCLE_CACHE_SIZE = 0x1000;
+static CycleCacheEntry cycleCache[CYCLE_CACHE_SIZE];
+
+static inline int GetCachedCycles(u32 op, u32 pc)
+{
+	u32 nextOp = Memory::ReadUnchecked_U32(pc + 4);
+	CycleCacheEntry &entry = cycleCache[(pc >> 2) & (CYCLE_CACHE_SIZE - 1)];
+	// Every instruction costs at least a cycle, so 0 is an empty entry.
+	if (entry.cycles == 0 || entry.pc != pc || entry.op != op || entry.nextOp != nextOp)
+	{
+		entry.pc = pc;
+		entry.op = op;
+		entry.nextOp = nextOp;
+		entry.cycles = MIPSGetInstructionCycles(op, pc);
+	}
+	return entry.cycles;
+}
+
 // Optimized interpreter loop that shortcuts the most common instructions.
 // For slow platforms without JITs.
 #define SIMM16 (s32)(s16)(op & 0xFFFF)
@@ -1027,6 +1058,9 @@ int MIPSInterpret_RunFastUntil(u64 globalTicks)
 			again:
 			bool wasInDelaySlot = curMips->inDelaySlot;
 			u32 op = Memory::ReadUnchecked_U32(curMips->pc);
+			// Same costs as MIPSGetInstructionCycles, which the plain ALU ops and stores
+			// handled here don't need at all.
+			int cycles = 1;
 			switch (op >> 29)
 			{
 			case 0x0:
@@ -1035,6 +1069,8 @@ int MIPSInterpret_RunFastUntil(u64 globalTicks)
 					int rs = _RS;
 					int rt = _RT;
 					u32 addr = curMips->pc + imm + 4;
+					if ((op >> 26) >= 4)
+						cycles = GetCachedCycles(op, curMips->pc);
 					switch (op >> 26) 
 					{
 					case 4:	if (R(rt) == R(rs))	DelayBranchTo(curMips, addr); else curMips->pc += 4; break; //beq
@@ -1074,6 +1110,7 @@ int MIPSInterpret_RunFastUntil(u64 globalTicks)
 					int rs = _RS;
 					int imm = (s16)(op & 0xFFFF);
 					u32 addr = R(rs) + imm;
+					cycles = GetCachedCycles(op, curMips->pc);
 					switch (op >> 26) 
 					{
 					case 32: R(rt) = (u32)(s32)(s8) Memory::ReadUnchecked_U8(addr); break; //lb
@@ -1108,9 +1145,13 @@ int MIPSInterpret_RunFastUntil(u64 globalTicks)
 				
 			default:
 				interpret:
+				cycles = GetCachedCycles(op, curMips->pc);
 				MIPSInterpret(op);
 			}
 
+			if (!wasInDelaySlot)
+				CoreTiming::downcount -= cycles;
+
 			if (curMips->inDelaySlot)
 			{
 				// The reason we have to check this is the delay slot hack in Int_Syscall.
@@ -1119,7 +1160,6 @@ int MIPSInterpret_RunFastUntil(u64 globalTicks)
 					curMips->pc = curMips->nextPC;
 					curMips->inDelaySlot = false;
 				}
-				CoreTiming::downcount -= 1;
 				goto again;
 			}
 		}
@@ -1159,12 +1199,54 @@ MIPSInterpretFunc MIPSGetInterpretFunc(u32 op)
 		return 0;
 }
 
-// TODO: Do something that makes sense here.
+// Rough Allegrex latencies.  The VFPU ones are per lane or per matrix element.
 int MIPSGetInstructionCycleEstimate(u32 op)
 {
-  u32 info = MIPSGetInfo(op);
-  if (info & DELAYSLOT)
-    return 2;
-  else
-    return 1;
+	u32 info = MIPSGetInfo(op);
+	switch (info & CYCLES_MASK)
+	{
+	case CYCLES_MUL:
+		return 5;
+	case CYCLES_DIV:
+		return 36;
+	case CYCLES_FPU_DIV:
+		return 28;
+	case CYCLES_VFPU_DOT:
+		return 2 + GetNumVectorElements(GetVecSize(op));
+	case CYCLES_VFPU_DIV:
+		return 14 * GetNumVectorElements(GetVecSize(op));
+	case CYCLES_VFPU_FUNC:
+		return 4 * GetNumVectorElements(GetVecSize(op));
+	case CYCLES_VFPU_MATRIX:
+		{
+			int side = GetMatrixSide(GetMtxSize(op));
+			return side * side;
+		}
+	default:
+		return 1;
+	}
+}
+
+static bool MIPSReadsReg(u32 op, u32 reg)
+{
+	u32 info = MIPSGetInfo(op);
+	if ((info & (IN_RS | IN_RS_ADDR | IN_RS_SHIFT)) && _RS == reg)
+		return true;
+	if ((info & IN_RT) && _RT == reg)
+		return true;
+	return false;
+}
+
+int MIPSGetInstructionCycles(u32 op, u32 pc)
+{
+	u32 info = MIPSGetInfo(op);
+	int cycles = MIPSGetInstructionCycleEstimate(op);
+	if (info & DELAYSLOT)
+		cycles += MIPSGetInstructionCycleEstimate(Memory::Read_Instruction(pc + 4));
+	else if ((info & (IN_MEM | OUT_RT)) == (IN_MEM | OUT_RT) && _RT != 0)
+	{
+		if (MIPSReadsReg(Memory::Read_Instruction(pc + 4), _RT))
+			cycles++;
+	}
+	return cycles;
 }
@@ -44,6 +44,16 @@
 #define OUT_OTHER 0x1000000
 #define OUT_FPUFLAG 0x2000000
 
+// Multi-cycle ops, see MIPSGetInstructionCycleEstimate.
+#define CYCLES_MASK        0x3C000000
+#define CYCLES_MUL         0x04000000
+#define CYCLES_DIV         0x08000000
+#define CYCLES_FPU_DIV     0x0C000000
+#define CYCLES_VFPU_DOT    0x10000000
+#define CYCLES_VFPU_DIV    0x14000000
+#define CYCLES_VFPU_FUNC   0x18000000
+#define CYCLES_VFPU_MATRIX 0x1C000000
+
 #ifndef CDECL
 #define CDECL
 #endif
@@ -60,7 +70,12 @@ int MIPSInterpret_RunFastUntil(u64 globalTicks);
 int MIPSInterpret_RunUntil(u64 globalTicks);
 MIPSInterpretFunc MIPSGetInterpretFunc(u32 op);
 
+// Cycles op takes on its own, not counting a delay slot or stalls.
 int MIPSGetInstructionCycleEstimate(u32 op);
+// What every cpu core charges for the instruction op at pc.  A branch pays for
+// its delay slot too, which is then free when it runs, and a load pays a stall
+// when the next instruction uses what it loaded.
+int MIPSGetInstructionCycles(u32 op, u32 pc);
 const char *MIPSGetName(u32 op);
 
 
@@ -16,6 +16,7 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include "../../HLE/HLE.h"
+#include "../../HLE/ReplaceTables.h"
 
 #include "../MIPS.h"
 #include "../MIPSCodeUtils.h"
@@ -432,4 +433,14 @@ void Jit::Comp_Syscall(u32 op)
 	js.compiling = false;
 }
 
+void Jit::Comp_ReplacementFunc(u32 op)
+{
+	// Replacement_Call sets pc to ra, so exit the same way as a syscall.
+	FlushAll();
+	ABI_CallFunctionC((void *)(&Replacement_Call), op);
+
+	WriteSyscallExit();
+	js.compiling = false;
+}
+
 }	 // namespace Mipscomp
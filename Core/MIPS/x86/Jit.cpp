@@ -15,12 +15,15 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "Timer.h"
+
 #include "../../Core.h"
 #include "../../CoreTiming.h"
 #include "../MIPS.h"
 #include "../MIPSCodeUtils.h"
 #include "../MIPSInt.h"
 #include "../MIPSTables.h"
+#include "../../Debugger/GuestProfiler.h"
 
 #include "RegCache.h"
 #include "Jit.h"
@@ -62,6 +65,7 @@ void Jit::CompileAt(u32 addr)
 
 void Jit::Compile(u32 em_address)
 {
+	u64 start = Common::Timer::GetTimeNs();
 	if (GetSpaceLeft() < 0x10000 || blocks.IsFull())
 	{
 		ClearCache();
@@ -70,6 +74,9 @@ void Jit::Compile(u32 em_address)
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink, DoJit(em_address, b));
+
+	jitStats.blocksCompiled++;
+	jitStats.compileNs += Common::Timer::GetTimeNs() - start;
 }
 
 void Jit::RunLoopUntil(u64 globalticks)
@@ -89,6 +96,16 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 
 	b->normalEntry = GetCodePtr();
 
+	if (GuestProfiler::IsCountingBlocks())
+	{
+#ifdef _M_X64
+		MOV(64, R(EAX), ImmPtr(&b->runCount));
+#else
+		MOV(32, R(EAX), ImmPtr(&b->runCount));
+#endif
+		ADD(32, MatR(EAX), Imm8(1));
+	}
+
 	// TODO: this needs work
 	MIPSAnalyst::AnalysisResults analysis; // = MIPSAnalyst::Analyze(em_address);
 
@@ -99,7 +116,7 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 	while (js.compiling)
 	{
 		u32 inst = Memory::Read_Instruction(js.compilerPC);
-		js.downcountAmount += MIPSGetInstructionCycleEstimate(inst);
+		js.downcountAmount += MIPSGetInstructionCycles(inst, js.compilerPC);
 
 		MIPSCompileOp(inst);
 
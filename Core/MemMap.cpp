@@ -123,7 +123,7 @@ bool AreMemoryBreakpointsActivated()
 u32 Read_Instruction(u32 address)
 {
 	u32 inst = Read_U32(address);	
-	if (MIPS_IS_EMUHACK(inst) && MIPSComp::jit)
+	if (MIPS_IS_EMUHACK(inst) && MIPS_EMUHACK_GET_SUBOP(inst) == EMUOP_RUNBLOCK && MIPSComp::jit)
 		return MIPSComp::jit->GetBlockCache()->GetOriginalFirstOp(inst & MIPS_EMUHACK_VALUE_MASK);
 	else
 		return inst;
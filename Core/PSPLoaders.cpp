@@ -29,6 +29,7 @@
 #include "StringUtil.h"
 
 #include "Host.h"
+#include "Config.h"
 
 #include "System.h"
 #include "PSPLoaders.h"
@@ -37,6 +38,7 @@
 #include "HLE/sceKernelThread.h"
 #include "HLE/sceKernelModule.h"
 #include "HLE/sceKernelMemory.h"
+#include "HLE/ReplaceTables.h"
 #include "ELF/ParamSFO.h"
 
 BlockDevice *constructBlockDevice(const char *filename)
@@ -44,17 +46,42 @@ BlockDevice *constructBlockDevice(const char *filename)
 	char firstInExtension = filename[strlen(filename)-3];
 	if (firstInExtension == 'c')
 	{
-		return new CISOFileBlockDevice(filename);
+		return new CISOFileBlockDevice(filename, g_Config.bCSOReadAhead);
 	}
 	else
 	{
+		// Mapping a whole UMD image needs the address space of a 64-bit host.
+		if (sizeof(void *) >= 8)
+		{
+			MmapFileBlockDevice *mapped = new MmapFileBlockDevice(filename);
+			if (mapped->IsMapped())
+				return mapped;
+			delete mapped;
+		}
 		return new FileBlockDevice(filename);
 	}
 }
 
 
+// Loading another executable into a running system (the headless test runner does) drops
+// the previous one's UMD.
+static void UnmountPreviousUmd()
+{
+	const char *prefixes[] = {"umd0:", "umd0:/"};
+	for (size_t i = 0; i < ARRAY_SIZE(prefixes); i++)
+	{
+		IFileSystem *previous = pspFileSystem.GetSystem(prefixes[i]);
+		if (previous)
+		{
+			pspFileSystem.Unmount(previous);
+			delete previous;
+		}
+	}
+}
+
 bool Load_PSP_ISO(const char *filename, std::string *error_string)
 {
+	UnmountPreviousUmd();
 	ISOFileSystem *umd2 = new ISOFileSystem(&pspFileSystem, constructBlockDevice(filename));
 
 	// Parse PARAM.SFO
@@ -84,6 +111,7 @@ bool Load_PSP_ISO(const char *filename, std::string *error_string)
 			sprintf(title, "%s : %s", data.discID.c_str(), data.title.c_str());
 			INFO_LOG(LOADER, "%s", title);
 			host->SetWindowTitle(title);
+			Replacement_SetDiscID(data.discID);
 		}
 		delete [] paramsfo;
 	}
@@ -123,6 +151,7 @@ bool Load_PSP_ELF_PBP(const char *filename, std::string *error_string)
 #ifdef _WIN32
 	path = ReplaceAll(path, "/", "\\");
 #endif
+	UnmountPreviousUmd();
 	DirectoryFileSystem *fs = new DirectoryFileSystem(&pspFileSystem, path);
 	pspFileSystem.Mount("umd0:/", fs);
 
@@ -0,0 +1,363 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Hash.h"
+
+#include "MemMap.h"
+#include "SaveState.h"
+#include "Replay.h"
+
+namespace Replay
+{
+
+enum Mode
+{
+	MODE_OFF,
+	MODE_RECORD,
+	MODE_PLAYBACK,
+};
+
+enum RecordType
+{
+	REC_CTRL,
+	REC_TIME,
+	REC_HASH,
+};
+
+static const u32 REPLAY_VERSION = 1;
+
+struct Header
+{
+	char magic[4];
+	u32 version;
+	u32 checksumFrames;
+	u32 numFrames;
+};
+
+// Every record starts with a type byte and the frame it happened in, then:
+// REC_CTRL: u32 buttons, u8 analog[2]  (only written when they change)
+// REC_TIME: u8 source, u64 value
+// REC_HASH: u64 hash of RAM
+static Mode mode = MODE_OFF;
+static std::string replayFilename;
+static std::vector<u8> data;
+static size_t readPos = 0;
+static int frame = 0;
+static int checksumFrames = 0;
+static int numFrames = 0;
+static int divergedFrame = -1;
+static int checksumsMatched = 0;
+
+static bool haveCtrl = false;
+static u32 lastButtons = 0;
+static u8 lastAnalog[2] = {128, 128};
+
+static void Reset()
+{
+	data.clear();
+	readPos = 0;
+	frame = 0;
+	numFrames = 0;
+	divergedFrame = -1;
+	checksumsMatched = 0;
+	haveCtrl = false;
+	lastButtons = 0;
+	lastAnalog[0] = 128;
+	lastAnalog[1] = 128;
+}
+
+static void Write(const void *ptr, size_t size)
+{
+	const u8 *p = (const u8 *)ptr;
+	data.insert(data.end(), p, p + size);
+}
+
+static void WriteRecordStart(RecordType type)
+{
+	u8 t = (u8)type;
+	u32 f = (u32)frame;
+	Write(&t, sizeof(t));
+	Write(&f, sizeof(f));
+}
+
+static bool Read(void *ptr, size_t size)
+{
+	if (readPos + size > data.size())
+		return false;
+	memcpy(ptr, &data[readPos], size);
+	readPos += size;
+	return true;
+}
+
+// Returns false at the end of the recording.
+static bool PeekRecord(RecordType &type, int &recordFrame)
+{
+	if (readPos + 5 > data.size())
+		return false;
+	type = (RecordType)data[readPos];
+	u32 f;
+	memcpy(&f, &data[readPos + 1], sizeof(f));
+	recordFrame = (int)f;
+	return true;
+}
+
+static void Diverge(const char *reason)
+{
+	if (divergedFrame != -1)
+		return;
+	divergedFrame = frame;
+	ERROR_LOG(COMMON, "Replay diverged at frame %d: %s", frame, reason);
+}
+
+static u64 HashRAM()
+{
+	// The jit's emuhacks would make every jit run look different from the interpreter.
+	SaveState::SetJitEmuhacks(false);
+	u64 hash = GetMurmurHash3(Memory::m_pRAM, Memory::RAM_SIZE, 0);
+	SaveState::SetJitEmuhacks(true);
+	return hash;
+}
+
+bool StartRecording(const std::string &filename, int checksumEvery)
+{
+	Reset();
+	mode = MODE_RECORD;
+	replayFilename = filename;
+	checksumFrames = checksumEvery;
+	return true;
+}
+
+bool StartPlayback(const std::string &filename)
+{
+	Reset();
+	mode = MODE_OFF;
+
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f)
+	{
+		ERROR_LOG(COMMON, "Unable to open replay %s", filename.c_str());
+		return false;
+	}
+
+	Header header;
+	bool success = fread(&header, sizeof(header), 1, f) == 1;
+	if (success && (memcmp(header.magic, "PPRP", 4) != 0 || header.version != REPLAY_VERSION))
+	{
+		ERROR_LOG(COMMON, "%s is not a replay from this version", filename.c_str());
+		success = false;
+	}
+	if (success)
+	{
+		u8 buf[65536];
+		size_t bytes;
+		while ((bytes = fread(buf, 1, sizeof(buf), f)) > 0)
+			data.insert(data.end(), buf, buf + bytes);
+	}
+	fclose(f);
+	if (!success)
+		return false;
+
+	mode = MODE_PLAYBACK;
+	replayFilename = filename;
+	checksumFrames = header.checksumFrames;
+	numFrames = header.numFrames;
+	return true;
+}
+
+void Stop()
+{
+	if (mode == MODE_RECORD)
+	{
+		FILE *f = fopen(replayFilename.c_str(), "wb");
+		if (f)
+		{
+			Header header;
+			memcpy(header.magic, "PPRP", 4);
+			header.version = REPLAY_VERSION;
+			header.checksumFrames = checksumFrames;
+			header.numFrames = frame;
+			bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+			if (success && !data.empty())
+				success = fwrite(&data[0], 1, data.size(), f) == data.size();
+			fclose(f);
+			if (success)
+			{
+				NOTICE_LOG(COMMON, "Recorded %d frames to %s", frame, replayFilename.c_str());
+			}
+			else
+			{
+				ERROR_LOG(COMMON, "Unable to write replay %s", replayFilename.c_str());
+			}
+		}
+		else
+		{
+			ERROR_LOG(COMMON, "Unable to write replay %s", replayFilename.c_str());
+		}
+	}
+	else if (mode == MODE_PLAYBACK)
+	{
+		if (divergedFrame == -1)
+		{
+			NOTICE_LOG(COMMON, "Replay matched through frame %d of %d, %d checksums", frame, numFrames, checksumsMatched);
+		}
+	}
+
+	mode = MODE_OFF;
+	data.clear();
+}
+
+bool IsActive()
+{
+	return mode != MODE_OFF;
+}
+
+bool IsRecording()
+{
+	return mode == MODE_RECORD;
+}
+
+bool HasEnded()
+{
+	return mode == MODE_PLAYBACK && frame >= numFrames;
+}
+
+int GetDivergedFrame()
+{
+	return divergedFrame;
+}
+
+int GetFrame()
+{
+	return frame;
+}
+
+void ProcessCtrl(u32 &buttons, u8 analog[2])
+{
+	if (mode == MODE_RECORD)
+	{
+		if (haveCtrl && buttons == lastButtons && analog[0] == lastAnalog[0] && analog[1] == lastAnalog[1])
+			return;
+		WriteRecordStart(REC_CTRL);
+		Write(&buttons, sizeof(buttons));
+		Write(analog, 2);
+		haveCtrl = true;
+		lastButtons = buttons;
+		lastAnalog[0] = analog[0];
+		lastAnalog[1] = analog[1];
+	}
+	else if (mode == MODE_PLAYBACK)
+	{
+		RecordType type;
+		int recordFrame;
+		while (PeekRecord(type, recordFrame) && type == REC_CTRL && recordFrame <= frame)
+		{
+			readPos += 5;
+			if (!Read(&lastButtons, sizeof(lastButtons)) || !Read(lastAnalog, 2))
+				break;
+			haveCtrl = true;
+		}
+		// Until the first sample, whatever the host has.
+		if (haveCtrl)
+		{
+			buttons = lastButtons;
+			analog[0] = lastAnalog[0];
+			analog[1] = lastAnalog[1];
+		}
+	}
+}
+
+u64 ProcessTime(TimeSource source, u64 hostValue)
+{
+	if (mode == MODE_RECORD)
+	{
+		WriteRecordStart(REC_TIME);
+		u8 s = (u8)source;
+		Write(&s, sizeof(s));
+		Write(&hostValue, sizeof(hostValue));
+	}
+	else if (mode == MODE_PLAYBACK)
+	{
+		RecordType type;
+		int recordFrame;
+		u8 s;
+		u64 value;
+		if (!PeekRecord(type, recordFrame) || type != REC_TIME || recordFrame != frame)
+		{
+			Diverge("time read that wasn't recorded");
+			return hostValue;
+		}
+		readPos += 5;
+		if (!Read(&s, sizeof(s)) || !Read(&value, sizeof(value)))
+			return hostValue;
+		if (s != (u8)source)
+		{
+			Diverge("time read from a different source");
+			return hostValue;
+		}
+		return value;
+	}
+	return hostValue;
+}
+
+void ProcessVblank()
+{
+	if (mode == MODE_OFF)
+		return;
+
+	frame++;
+	if (checksumFrames <= 0 || (frame % checksumFrames) != 0)
+		return;
+
+	u64 hash = HashRAM();
+	if (mode == MODE_RECORD)
+	{
+		WriteRecordStart(REC_HASH);
+		Write(&hash, sizeof(hash));
+		return;
+	}
+
+	// Past the end, the recording has nothing more to say.
+	if (frame > numFrames)
+		return;
+
+	RecordType type;
+	int recordFrame;
+	u64 expected;
+	// Reads from last frame would have consumed everything before this.
+	if (!PeekRecord(type, recordFrame) || type != REC_HASH || recordFrame != frame)
+	{
+		Diverge("input was read in a different order than recorded");
+		return;
+	}
+	readPos += 5;
+	if (!Read(&expected, sizeof(expected)))
+		return;
+	if (expected != hash)
+	{
+		char temp[64];
+		sprintf(temp, "RAM hash %016llx, expected %016llx", (unsigned long long)hash, (unsigned long long)expected);
+		Diverge(temp);
+	}
+	else if (divergedFrame == -1)
+		checksumsMatched++;
+}
+
+}	// namespace Replay
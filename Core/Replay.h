@@ -0,0 +1,58 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+
+#include "../Globals.h"
+
+// Records everything from the host that the game can observe, at the point it
+// observes it, so the run can be reproduced exactly.  A hash of RAM is logged
+// every few vblanks, and playback reports the first frame that doesn't match.
+// Everything else (CoreTiming, audio mixing) is already driven by guest time.
+namespace Replay
+{
+	enum TimeSource
+	{
+		// Microseconds since 1970, from gettimeofday and friends.
+		TIME_TIMEOFDAY,
+		TIME_LIBC_TIME,
+		TIME_LIBC_CLOCK,
+	};
+
+	// Both need to be called before PSP_Init, a replay starts at boot.
+	bool StartRecording(const std::string &filename, int checksumFrames);
+	bool StartPlayback(const std::string &filename);
+	// Writes out a recording and logs the result of a playback.
+	void Stop();
+
+	bool IsActive();
+	bool IsRecording();
+	// True once playback has passed the last recorded frame.
+	bool HasEnded();
+	// -1 until playback stops matching the recording.
+	int GetDivergedFrame();
+	int GetFrame();
+
+	// sceCtrl calls this when it samples input.  Playback replaces the values.
+	void ProcessCtrl(u32 &buttons, u8 analog[2]);
+	// Returns the time the game should see.
+	u64 ProcessTime(TimeSource source, u64 hostValue);
+	// Start of every vblank.
+	void ProcessVblank();
+};
@@ -0,0 +1,686 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#include "zlib.h"
+
+#include "ChunkFile.h"
+#include "FileUtil.h"
+#include "Thread.h"
+
+#include "SaveState.h"
+#include "Config.h"
+#include "Core.h"
+#include "MemMap.h"
+#include "MIPS/MIPS.h"
+#include "MIPS/JitCommon/JitCommon.h"
+#include "HLE/sceKernel.h"
+#include "FileSystems/MetaFileSystem.h"
+
+extern MetaFileSystem pspFileSystem;
+
+namespace SaveState
+{
+	// On disk: this header, then the zlib compressed state.
+	struct StateHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 compressedSize;
+		u32 uncompressedSize;
+	};
+
+	static const u32 STATE_MAGIC = 0x54535050;  // "PPST"
+	// Bump this whenever any DoState changes.
+	static const u32 STATE_VERSION = 4;
+
+	enum OperationType
+	{
+		SAVESTATE_SAVE,
+		SAVESTATE_LOAD,
+		SAVESTATE_VERIFY,
+		SAVESTATE_REWIND,
+	};
+
+	struct Operation
+	{
+		Operation(OperationType t, const std::string &f, Callback cb, void *cbUserData_)
+			: type(t), filename(f), callback(cb), cbUserData(cbUserData_)
+		{
+		}
+
+		OperationType type;
+		std::string filename;
+		Callback callback;
+		void *cbUserData;
+	};
+
+	// Compressing and writing happens here, so saving only costs the emu thread a memcpy of the state.
+	struct WriteJob
+	{
+		std::string filename;
+		std::vector<u8> data;
+		Callback callback;
+		void *cbUserData;
+	};
+
+	static std::mutex mutex;
+	static std::vector<Operation> pending;
+
+	static std::thread *writerThread = 0;
+	static std::mutex writerLock;
+	static std::condition_variable writerCond;
+	static std::deque<WriteJob *> writeQueue;
+	static bool writerExit = false;
+
+	// Rewind keeps the newest snapshot whole, and for each older one the delta that
+	// turns its successor back into it.
+	struct RewindEntry
+	{
+		u32 prevSize;
+		std::vector<u8> delta;
+	};
+
+	static std::deque<RewindEntry *> rewindRing;
+	static size_t rewindRingBytes = 0;
+	static std::vector<u8> rewindBase;
+	// The emu thread serializes into one while the rewind thread encodes the other.
+	static std::vector<u8> rewindBuffers[2];
+	static int rewindFill = 0;
+	static std::vector<u8> *rewindPending = 0;
+	static bool rewindBusy = false;
+	static int rewindFrames = 0;
+
+	static std::thread *rewindThread = 0;
+	static std::mutex rewindLock;
+	static std::condition_variable rewindCond;
+	static bool rewindExit = false;
+
+	// The whole emulated machine, in dependency order.
+	static void DoState(PointerWrap &p)
+	{
+		Memory::DoState(p);
+		mipsr4k.DoState(p);
+		__KernelDoState(p);
+		pspFileSystem.DoState(p);
+		p.DoMarker("SaveState");
+	}
+
+	static void ClearJit()
+	{
+		if (MIPSComp::jit)
+			MIPSComp::jit->ClearCache();
+	}
+
+	// Much cheaper than clearing the cache, which matters for rewind.
+	void SetJitEmuhacks(bool enable)
+	{
+		if (!MIPSComp::jit)
+			return;
+
+		JitBlockCache *blocks = MIPSComp::jit->GetBlockCache();
+		for (int i = 0; i < blocks->GetNumBlocks(); ++i)
+		{
+			JitBlock *b = blocks->GetBlock(i);
+			if (b->invalid)
+				continue;
+
+			u32 emuhack = MIPS_MAKE_EMUHACK(0, i);
+			u32 from = enable ? b->originalFirstOpcode : emuhack;
+			u32 to = enable ? emuhack : b->originalFirstOpcode;
+			if (Memory::ReadUnchecked_U32(b->originalAddress) == from)
+				Memory::WriteUnchecked_U32(to, b->originalAddress);
+		}
+	}
+
+	static bool SaveToRamInternal(std::vector<u8> &state)
+	{
+		u8 *ptr = 0;
+		PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
+		DoState(p);
+		if (p.error != PointerWrap::ERROR_NONE)
+			return false;
+
+		size_t sz = (size_t)ptr;
+		state.resize(sz);
+		ptr = &state[0];
+		p.SetMode(PointerWrap::MODE_WRITE);
+		DoState(p);
+		return p.error == PointerWrap::ERROR_NONE;
+	}
+
+	bool SaveToRam(std::vector<u8> &state)
+	{
+		// Emuhacks in RAM must not end up in the snapshot.
+		SetJitEmuhacks(false);
+		bool result = SaveToRamInternal(state);
+		SetJitEmuhacks(true);
+		return result;
+	}
+
+	static bool LoadFromRamInternal(std::vector<u8> &state)
+	{
+		if (state.empty())
+			return false;
+
+		u8 *ptr = &state[0];
+		PointerWrap p(&ptr, PointerWrap::MODE_READ);
+		DoState(p);
+		ClearJit();
+
+		if (p.error != PointerWrap::ERROR_NONE)
+			return false;
+		if ((size_t)(ptr - &state[0]) != state.size())
+		{
+			ERROR_LOG(COMMON, "Save state size mismatch: read %d of %d bytes", (int)(ptr - &state[0]), (int)state.size());
+			return false;
+		}
+		return true;
+	}
+
+	bool LoadFromRam(std::vector<u8> &state)
+	{
+		// A failed load leaves things half applied, so keep a way back.
+		std::vector<u8> backup;
+		bool haveBackup = SaveToRam(backup);
+
+		if (LoadFromRamInternal(state))
+			return true;
+
+		if (haveBackup && LoadFromRamInternal(backup))
+		{
+			WARN_LOG(COMMON, "Save state failed to load, restored previous state");
+		}
+		else
+		{
+			ERROR_LOG(COMMON, "Save state failed to load, and the previous state could not be restored");
+		}
+		return false;
+	}
+
+	static bool ReadStateFile(const std::string &filename, std::vector<u8> &state)
+	{
+		FILE *f = fopen(filename.c_str(), "rb");
+		if (!f)
+		{
+			ERROR_LOG(COMMON, "Unable to open save state %s", filename.c_str());
+			return false;
+		}
+
+		StateHeader header;
+		bool success = fread(&header, sizeof(header), 1, f) == 1;
+		if (success && (header.magic != STATE_MAGIC || header.version != STATE_VERSION))
+		{
+			ERROR_LOG(COMMON, "Save state %s is not a save state, or is from another version", filename.c_str());
+			success = false;
+		}
+
+		std::vector<u8> compressed;
+		if (success)
+		{
+			compressed.resize(header.compressedSize);
+			success = header.compressedSize != 0 && fread(&compressed[0], 1, header.compressedSize, f) == header.compressedSize;
+		}
+		fclose(f);
+
+		if (success)
+		{
+			state.resize(header.uncompressedSize);
+			uLongf destLen = header.uncompressedSize;
+			success = header.uncompressedSize != 0 && uncompress(&state[0], &destLen, &compressed[0], header.compressedSize) == Z_OK && destLen == header.uncompressedSize;
+			if (!success)
+				ERROR_LOG(COMMON, "Save state %s is corrupt", filename.c_str());
+		}
+		return success;
+	}
+
+	static bool WriteStateFile(const std::string &filename, const std::vector<u8> &state)
+	{
+		uLongf compressedSize = compressBound((uLong)state.size());
+		std::vector<u8> compressed(compressedSize);
+		if (compress2(&compressed[0], &compressedSize, &state[0], (uLong)state.size(), Z_BEST_SPEED) != Z_OK)
+		{
+			ERROR_LOG(COMMON, "Failed to compress save state");
+			return false;
+		}
+
+		// Write to a temporary and rename, so a crash never leaves half a state behind.
+		char suffix[32];
+		sprintf(suffix, ".%08x.tmp", (u32)time(0));
+		std::string tempPath = filename + suffix;
+		FILE *f = fopen(tempPath.c_str(), "wb");
+		if (!f)
+		{
+			ERROR_LOG(COMMON, "Unable to write save state %s", filename.c_str());
+			return false;
+		}
+
+		StateHeader header;
+		header.magic = STATE_MAGIC;
+		header.version = STATE_VERSION;
+		header.compressedSize = (u32)compressedSize;
+		header.uncompressedSize = (u32)state.size();
+
+		bool success = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(&compressed[0], 1, compressedSize, f) == compressedSize;
+		fclose(f);
+
+		if (success && !File::Rename(tempPath, filename))
+		{
+			// rename() won't replace an existing file on Windows.
+			File::Delete(filename);
+			success = File::Rename(tempPath, filename);
+		}
+		if (!success)
+			File::Delete(tempPath);
+		return success;
+	}
+
+	static void WriterThreadFunc()
+	{
+		Common::SetCurrentThreadName("SaveStateWriter");
+
+		std::unique_lock<std::mutex> guard(writerLock);
+		while (true)
+		{
+			while (writeQueue.empty() && !writerExit)
+				writerCond.wait(guard);
+			if (writeQueue.empty())
+				break;
+
+			WriteJob *job = writeQueue.front();
+			writeQueue.pop_front();
+
+			guard.unlock();
+			bool result = WriteStateFile(job->filename, job->data);
+			if (result)
+				INFO_LOG(COMMON, "Saved state to %s", job->filename.c_str());
+			if (job->callback)
+				job->callback(result, job->cbUserData);
+			delete job;
+			guard.lock();
+		}
+	}
+
+	// Both states are treated as zero padded to the longer one.  The delta is a series of
+	// runs: u32 count of unchanged bytes, u32 count of changed bytes, then those bytes XORed.
+	static void EncodeDelta(const std::vector<u8> &prev, const std::vector<u8> &cur, std::vector<u8> &out)
+	{
+		const size_t prevSize = prev.size(), curSize = cur.size();
+		const size_t common = std::min(prevSize, curSize);
+		const size_t n = std::max(prevSize, curSize);
+		const u8 *a = prevSize ? &prev[0] : 0;
+		const u8 *b = curSize ? &cur[0] : 0;
+#define DELTA_XOR_AT(i) ((u8)(((i) < prevSize ? a[i] : 0) ^ ((i) < curSize ? b[i] : 0)))
+
+		out.clear();
+		size_t i = 0;
+		while (i < n)
+		{
+			size_t same = i;
+			while (i < n)
+			{
+				// Most of RAM doesn't change between snapshots, so skip a word at a time.
+				if ((i & 7) == 0 && i + 8 <= common && *(const u64 *)(a + i) == *(const u64 *)(b + i))
+				{
+					i += 8;
+					continue;
+				}
+				if (DELTA_XOR_AT(i) != 0)
+					break;
+				++i;
+			}
+			if (i == n && same == i)
+				break;
+
+			size_t changed = i;
+			while (i < n)
+			{
+				if (DELTA_XOR_AT(i) != 0)
+				{
+					++i;
+					continue;
+				}
+				// Short gaps are cheaper to keep in the run than to start a new one.
+				size_t j = i;
+				while (j < n && j - i < 8 && DELTA_XOR_AT(j) == 0)
+					++j;
+				if (j - i >= 8 || j == n)
+					break;
+				i = j;
+			}
+
+			u32 header[2] = {(u32)(changed - same), (u32)(i - changed)};
+			size_t pos = out.size();
+			out.resize(pos + sizeof(header) + (i - changed));
+			memcpy(&out[pos], header, sizeof(header));
+			u8 *dest = &out[pos + sizeof(header)];
+			for (size_t k = changed; k < i; ++k)
+				*dest++ = DELTA_XOR_AT(k);
+		}
+#undef DELTA_XOR_AT
+	}
+
+	static void DecodeDelta(const std::vector<u8> &cur, const RewindEntry &entry, std::vector<u8> &prev)
+	{
+		prev.resize(entry.prevSize);
+		size_t common = std::min(prev.size(), cur.size());
+		if (common)
+			memcpy(&prev[0], &cur[0], common);
+		if (prev.size() > common)
+			memset(&prev[common], 0, prev.size() - common);
+
+		const u8 *d = entry.delta.empty() ? 0 : &entry.delta[0];
+		const u8 *end = d + entry.delta.size();
+		size_t pos = 0;
+		while (d < end)
+		{
+			u32 header[2];
+			memcpy(header, d, sizeof(header));
+			d += sizeof(header);
+			pos += header[0];
+			for (u32 k = 0; k < header[1]; ++k, ++pos)
+			{
+				if (pos < prev.size())
+					prev[pos] ^= d[k];
+			}
+			d += header[1];
+		}
+	}
+
+	static void RewindThreadFunc()
+	{
+		Common::SetCurrentThreadName("Rewind");
+
+		std::unique_lock<std::mutex> guard(rewindLock);
+		while (true)
+		{
+			while (!rewindPending && !rewindExit)
+				rewindCond.wait(guard);
+			if (rewindExit)
+				break;
+
+			std::vector<u8> *state = rewindPending;
+			rewindPending = 0;
+			rewindBusy = true;
+			guard.unlock();
+
+			// Only this thread touches the base and the ring while busy.
+			RewindEntry *entry = 0;
+			if (!rewindBase.empty())
+			{
+				entry = new RewindEntry();
+				entry->prevSize = (u32)rewindBase.size();
+				EncodeDelta(rewindBase, *state, entry->delta);
+			}
+			rewindBase.swap(*state);
+
+			guard.lock();
+			if (entry)
+			{
+				rewindRing.push_back(entry);
+				rewindRingBytes += entry->delta.size();
+			}
+			size_t budget = (size_t)std::max(g_Config.iRewindMemoryBudget, 1) * 1024 * 1024;
+			while (rewindRingBytes > budget && !rewindRing.empty())
+			{
+				rewindRingBytes -= rewindRing.front()->delta.size();
+				delete rewindRing.front();
+				rewindRing.pop_front();
+			}
+			rewindBusy = false;
+			rewindCond.notify_all();
+		}
+	}
+
+	// Called every frame on the emu thread.  Costs a serialization (basically a memcpy)
+	// every iRewindFlipFrequency frames, or nothing if the rewind thread is behind.
+	static void RewindSnapshot()
+	{
+		if (!rewindThread || g_Config.iRewindFlipFrequency <= 0)
+			return;
+		if (++rewindFrames < g_Config.iRewindFlipFrequency)
+			return;
+
+		{
+			std::lock_guard<std::mutex> guard(rewindLock);
+			// Still working on the previous two, skip rather than wait.
+			if (rewindPending)
+				return;
+		}
+
+		// The other buffer is the one the rewind thread may be encoding right now.
+		std::vector<u8> &state = rewindBuffers[rewindFill];
+		if (!SaveToRam(state))
+			return;
+
+		std::lock_guard<std::mutex> guard(rewindLock);
+		rewindPending = &state;
+		rewindFill ^= 1;
+		rewindFrames = 0;
+		rewindCond.notify_one();
+	}
+
+	static bool RewindLoad()
+	{
+		std::unique_lock<std::mutex> guard(rewindLock);
+		while (rewindPending || rewindBusy)
+			rewindCond.wait(guard);
+
+		if (rewindBase.empty())
+			return false;
+		if (!LoadFromRam(rewindBase))
+			return false;
+
+		// The next rewind goes one snapshot further back.
+		if (!rewindRing.empty())
+		{
+			RewindEntry *entry = rewindRing.back();
+			rewindRing.pop_back();
+			rewindRingBytes -= entry->delta.size();
+
+			std::vector<u8> prev;
+			DecodeDelta(rewindBase, *entry, prev);
+			rewindBase.swap(prev);
+			delete entry;
+		}
+		rewindFrames = 0;
+		return true;
+	}
+
+	static void RewindClear()
+	{
+		std::lock_guard<std::mutex> guard(rewindLock);
+		for (size_t i = 0; i < rewindRing.size(); ++i)
+			delete rewindRing[i];
+		rewindRing.clear();
+		rewindRingBytes = 0;
+		rewindBase.clear();
+		rewindBuffers[0].clear();
+		rewindBuffers[1].clear();
+		rewindPending = 0;
+		rewindFrames = 0;
+	}
+
+	bool CanRewind()
+	{
+		std::lock_guard<std::mutex> guard(rewindLock);
+		return !rewindBase.empty() || rewindPending != 0;
+	}
+
+	static void Enqueue(const Operation &op)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		pending.push_back(op);
+	}
+
+	void Save(const std::string &filename, Callback callback, void *cbUserData)
+	{
+		Enqueue(Operation(SAVESTATE_SAVE, filename, callback, cbUserData));
+	}
+
+	void Load(const std::string &filename, Callback callback, void *cbUserData)
+	{
+		Enqueue(Operation(SAVESTATE_LOAD, filename, callback, cbUserData));
+	}
+
+	void Rewind(Callback callback, void *cbUserData)
+	{
+		Enqueue(Operation(SAVESTATE_REWIND, std::string(""), callback, cbUserData));
+	}
+
+	void Verify(Callback callback, void *cbUserData)
+	{
+		Enqueue(Operation(SAVESTATE_VERIFY, std::string(""), callback, cbUserData));
+	}
+
+	void Process()
+	{
+		std::vector<Operation> operations;
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			operations.swap(pending);
+		}
+
+		if (operations.empty())
+		{
+			RewindSnapshot();
+			return;
+		}
+
+		for (size_t i = 0; i < operations.size(); ++i)
+		{
+			Operation &op = operations[i];
+			bool result;
+
+			switch (op.type)
+			{
+			case SAVESTATE_SAVE:
+				{
+					WriteJob *job = new WriteJob();
+					job->filename = op.filename;
+					job->callback = op.callback;
+					job->cbUserData = op.cbUserData;
+					if (!SaveToRam(job->data))
+					{
+						ERROR_LOG(COMMON, "Unable to save state to %s", op.filename.c_str());
+						delete job;
+						if (op.callback)
+							op.callback(false, op.cbUserData);
+						break;
+					}
+
+					std::lock_guard<std::mutex> guard(writerLock);
+					writeQueue.push_back(job);
+					writerCond.notify_one();
+				}
+				break;
+
+			case SAVESTATE_LOAD:
+				{
+					INFO_LOG(COMMON, "Loading state from %s", op.filename.c_str());
+					std::vector<u8> state;
+					result = ReadStateFile(op.filename, state) && LoadFromRam(state);
+					if (op.callback)
+						op.callback(result, op.cbUserData);
+				}
+				break;
+
+			case SAVESTATE_VERIFY:
+				{
+					std::vector<u8> state;
+					result = SaveToRam(state);
+					if (result)
+					{
+						SetJitEmuhacks(false);
+						u8 *ptr = &state[0];
+						PointerWrap p(&ptr, PointerWrap::MODE_VERIFY);
+						DoState(p);
+						result = p.error == PointerWrap::ERROR_NONE;
+						SetJitEmuhacks(true);
+					}
+					INFO_LOG(COMMON, "Save state verification %s", result ? "passed" : "failed");
+					if (op.callback)
+						op.callback(result, op.cbUserData);
+				}
+				break;
+
+			case SAVESTATE_REWIND:
+				result = RewindLoad();
+				if (result)
+					INFO_LOG(COMMON, "Rewound state");
+				if (op.callback)
+					op.callback(result, op.cbUserData);
+				break;
+
+			default:
+				ERROR_LOG(COMMON, "Save state: unknown operation %d", (int)op.type);
+				break;
+			}
+		}
+	}
+
+	void Init()
+	{
+		writerExit = false;
+		if (!writerThread)
+			writerThread = new std::thread(WriterThreadFunc);
+
+		RewindClear();
+		rewindExit = false;
+		if (!rewindThread && g_Config.iRewindFlipFrequency > 0)
+			rewindThread = new std::thread(RewindThreadFunc);
+	}
+
+	void Shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			pending.clear();
+		}
+
+		if (writerThread)
+		{
+			// Finishes writing whatever is queued first.
+			{
+				std::lock_guard<std::mutex> guard(writerLock);
+				writerExit = true;
+				writerCond.notify_one();
+			}
+			writerThread->join();
+			delete writerThread;
+			writerThread = 0;
+		}
+
+		if (rewindThread)
+		{
+			{
+				std::lock_guard<std::mutex> guard(rewindLock);
+				rewindExit = true;
+				rewindCond.notify_one();
+			}
+			rewindThread->join();
+			delete rewindThread;
+			rewindThread = 0;
+		}
+		RewindClear();
+	}
+};
@@ -0,0 +1,55 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../Globals.h"
+
+namespace SaveState
+{
+	typedef void (*Callback)(bool status, void *cbUserData);
+
+	void Init();
+	void Shutdown();
+
+	// These queue the operation, it happens in Process() at the end of the next frame.
+	// Save's callback runs on the writer thread once the file is on disk, the others
+	// run on the emu thread.
+	void Save(const std::string &filename, Callback callback = 0, void *cbUserData = 0);
+	void Load(const std::string &filename, Callback callback = 0, void *cbUserData = 0);
+	// Goes back to the newest rewind snapshot, then the one before it on the next call.
+	void Rewind(Callback callback = 0, void *cbUserData = 0);
+	// Saves and checks that a second pass reproduces the same state, for debugging.
+	void Verify(Callback callback = 0, void *cbUserData = 0);
+
+	// True once a rewind snapshot exists.  Snapshots are taken every
+	// g_Config.iRewindFlipFrequency frames, deltas are kept within iRewindMemoryBudget.
+	bool CanRewind();
+
+	// Synchronous and uncompressed. Only call from the emu thread, between frames.
+	bool SaveToRam(std::vector<u8> &state);
+	bool LoadFromRam(std::vector<u8> &state);
+
+	// Puts the original opcodes back where the jit left emuhacks, or the reverse.
+	void SetJitEmuhacks(bool enable);
+
+	// Runs any queued operations. The emu thread calls this when coreState is CORE_NEXTFRAME.
+	void Process();
+};
@@ -37,6 +37,7 @@
 #include "CoreParameter.h"
 #include "FileSystems/MetaFileSystem.h"
 #include "Loaders.h"
+#include "SaveState.h"
 
 
 MetaFileSystem pspFileSystem;
@@ -63,7 +64,12 @@ bool PSP_Init(const CoreParameter &coreParam, std::string *error_string)
 
 	// TODO: Check Game INI here for settings, patches and cheats, and modify coreParameter accordingly
 
-	if (!LoadFile(coreParameter.fileToStart.c_str(), error_string))
+	if (coreParameter.fileToStart.empty())
+	{
+		// Boot without anything to run, PSP_LoadExecutable brings it in later.
+		__KernelInit();
+	}
+	else if (!LoadFile(coreParameter.fileToStart.c_str(), error_string))
 	{
 		pspFileSystem.UnmountAll();
 		CoreTiming::ClearPendingEvents();
@@ -79,6 +85,8 @@ bool PSP_Init(const CoreParameter &coreParam, std::string *error_string)
 	shaderManager.DirtyShader();
 	shaderManager.DirtyUniform(DIRTY_ALL);
 
+	SaveState::Init();
+
 	// Setup JIT here.
 	if (coreParameter.startPaused)
 		coreState = CORE_STEPPING;
@@ -87,6 +95,12 @@ bool PSP_Init(const CoreParameter &coreParam, std::string *error_string)
 	return true;
 }
 
+bool PSP_LoadExecutable(const std::string &filename, std::string *error_string)
+{
+	coreParameter.fileToStart = filename;
+	return LoadFile(filename.c_str(), error_string);
+}
+
 bool PSP_IsInited()
 {
 	return currentCPU != 0;
@@ -94,6 +108,7 @@ bool PSP_IsInited()
 
 void PSP_Shutdown()
 {
+	SaveState::Shutdown();
 	pspFileSystem.UnmountAll();
 
 	TextureCache_Clear(true);
@@ -109,6 +124,9 @@ void PSP_Shutdown()
 	__KernelShutdown();
 	HLEShutdown();
 	Memory::Shutdown() ;
+	// Its code points into this run's memory, the next PSP_Init makes a new one.
+	delete MIPSComp::jit;
+	MIPSComp::jit = 0;
 	currentCPU = 0;
 }
 
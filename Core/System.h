@@ -25,6 +25,8 @@
 extern MetaFileSystem pspFileSystem;
 
 bool PSP_Init(const CoreParameter &coreParam, std::string *error_string);
+// Loads and starts an executable, replacing whatever was running.
+bool PSP_LoadExecutable(const std::string &filename, std::string *error_string);
 bool PSP_IsInited();
 void PSP_Shutdown();
 void PSP_HWAdvance(int cycles);
@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
 #include "../../Core/MemMap.h"
 #include "../../Core/Host.h"
 #include "../../Core/Config.h"
@@ -99,6 +100,30 @@ void GLES_GPU::BeginFrame()
 	currentRenderVfb_ = 0;
 }
 
+void GLES_GPU::DoState(PointerWrap &p)
+{
+	p.Do(dcontext);
+	p.Do(dlIdGenerator);
+	p.Do(dlQueue);
+	p.Do(prev);
+	p.DoArray(stack, ARRAYSIZE(stack));
+	p.Do(stackptr);
+	p.Do(finished);
+	p.Do(interruptsEnabled_);
+
+	if (p.mode == p.MODE_READ)
+	{
+		// Textures may have changed under us, and the GL state needs to match gstate again.
+		TextureCache_Clear(true);
+		currentRenderVfb_ = 0;
+		shaderManager.DirtyShader();
+		shaderManager.DirtyUniform(DIRTY_ALL);
+		gstate_c.textureChanged = true;
+		ReapplyGfxState();
+	}
+	p.DoMarker("GLES_GPU");
+}
+
 void GLES_GPU::SetDisplayFramebuffer(u32 framebuf, u32 stride, int format)
 {
 	if (framebuf & 0x04000000) {
@@ -428,7 +453,7 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff)
 	case GE_CMD_CALL: 
 		{
 			u32 retval = dcontext.pc + 4;
-			if (stackptr == ARRAY_SIZE(stack)) {
+			if (stackptr == ARRAYSIZE(stack)) {
 				ERROR_LOG(G3D, "CALL: Stack full!");
 			} else {
 				stack[stackptr++] = retval;
@@ -47,6 +47,7 @@ public:
 	virtual void CopyDisplayToOutput();
 	virtual void BeginFrame();
 	virtual void UpdateStats();
+	virtual void DoState(PointerWrap &p);
 
 private:
 	// TransformPipeline.cpp
@@ -220,6 +220,7 @@ void GLES_GPU::TransformAndDrawPrim(void *verts, void *inds, int prim, int verte
 		}
 	}
 	gpuStats.numDrawCalls++;
+	gpuStats.numTotalDrawCalls++;
 	gpuStats.numVertsTransformed += vertexCount;
 
 	if (bytesRead)
@@ -19,6 +19,8 @@
 
 #include "../Globals.h"
 
+class PointerWrap;
+
 class GPUInterface
 {
 public:
@@ -47,4 +49,7 @@ public:
 
 	// Internal hack to avoid interrupts from "PPGe" drawing (utility UI, etc)
 	virtual void EnableInterrupts(bool enable) = 0;
+
+	// Saves the display list state. Host side caches are simply rebuilt after loading.
+	virtual void DoState(PointerWrap &p) = 0;
 };
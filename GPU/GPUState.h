@@ -308,6 +308,10 @@ struct GPUStatistics
 	int numVertexShaders;
 	int numFragmentShaders;
 	int numShaders;
+
+	// Running totals, not reset per frame
+	int numTotalDrawCalls;
+	int numTexturesDecoded;
 };
 
 void InitGfxState();
@@ -19,6 +19,7 @@
 #include "NullGpu.h"
 #include "../GPUState.h"
 #include "../ge_constants.h"
+#include "ChunkFile.h"
 #include "../../Core/MemMap.h"
 #include "../../Core/HLE/sceKernelInterrupt.h"
 
@@ -46,6 +47,19 @@ static bool finished;
 
 static int dlIdGenerator = 1;
 
+void NullGPU::DoState(PointerWrap &p)
+{
+	p.Do(dcontext);
+	p.Do(dlQueue);
+	p.Do(prev);
+	p.DoArray(stack, ARRAYSIZE(stack));
+	p.Do(stackptr);
+	p.Do(finished);
+	p.Do(dlIdGenerator);
+	p.Do(interruptsEnabled_);
+	p.DoMarker("NullGPU");
+}
+
 bool NullGPU::ProcessDLQueue()
 {
 	std::vector<DisplayList>::iterator iter = dlQueue.begin();
@@ -40,6 +40,7 @@ public:
 	virtual void SetDisplayFramebuffer(u32 framebuf, u32 stride, int format) {}
 	virtual void CopyDisplayToOutput() {}
 	virtual void UpdateStats();
+	virtual void DoState(PointerWrap &p);
 
 private:
 	bool ProcessDLQueue();
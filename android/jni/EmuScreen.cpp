@@ -28,6 +28,7 @@
 #include "../../Core/Core.h"
 #include "../../Core/Host.h"
 #include "../../Core/System.h"
+#include "../../Core/SaveState.h"
 #include "../../Core/MIPS/MIPS.h"
 #include "../../GPU/GLES/TextureCache.h"
 #include "../../GPU/GLES/ShaderManager.h"
@@ -165,6 +166,7 @@ void EmuScreen::render()
 	}
 	// Hopefully coreState is now CORE_NEXTFRAME
 	if (coreState == CORE_NEXTFRAME) {
+		SaveState::Process();
 		// set back to running for the next frame
 		coreState = CORE_RUNNING;
 	}
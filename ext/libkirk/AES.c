@@ -32,6 +32,20 @@
 
 #include "AES.h"
 
+/* AES-NI is only used when the compiler can target it per function, so the
+   rest of the file still builds for plain x86. */
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)) && \
+	(defined(_MSC_VER) || defined(__clang__) || (__GNUC__ * 100 + __GNUC_MINOR__ >= 409))
+#define AES_HW_X86
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#ifdef __GNUC__
+#define AES_HW_TARGET __attribute__((target("aes,sse2")))
+#else
+#define AES_HW_TARGET
+#endif
+#endif
+
 #undef FULL_UNROLL
 
 
@@ -1284,13 +1298,159 @@ int AES_set_key(AES_ctx *ctx, const u8 *key, int bits)
 	return rijndael_set_key((rijndael_ctx *)ctx, key, bits);
 }
 
+static int aes_hw = 0;
+
+void AES_set_hw_accel(int enable)
+{
+#ifdef AES_HW_X86
+	aes_hw = enable;
+#endif
+}
+
+#ifdef AES_HW_X86
+
+/* The software schedules hold big-endian words; AES-NI wants the raw bytes.
+   The decrypt schedule is already in equivalent inverse cipher form, which is
+   exactly what AESDEC expects. */
+AES_HW_TARGET static void aes_hw_load_schedule(const u32 *rk, int Nr, __m128i *keys)
+{
+	u8 buf[16];
+	int r, i;
+	for (r = 0; r <= Nr; r++)
+	{
+		for (i = 0; i < 4; i++)
+			PUTU32(buf + 4 * i, rk[4 * r + i]);
+		keys[r] = _mm_loadu_si128((const __m128i *)buf);
+	}
+}
+
+AES_HW_TARGET static __m128i aes_hw_encrypt_block(const __m128i *keys, int Nr, __m128i b)
+{
+	int r;
+	b = _mm_xor_si128(b, keys[0]);
+	for (r = 1; r < Nr; r++)
+		b = _mm_aesenc_si128(b, keys[r]);
+	return _mm_aesenclast_si128(b, keys[Nr]);
+}
+
+AES_HW_TARGET static __m128i aes_hw_decrypt_block(const __m128i *keys, int Nr, __m128i b)
+{
+	int r;
+	b = _mm_xor_si128(b, keys[0]);
+	for (r = 1; r < Nr; r++)
+		b = _mm_aesdec_si128(b, keys[r]);
+	return _mm_aesdeclast_si128(b, keys[Nr]);
+}
+
+AES_HW_TARGET static void aes_hw_encrypt(AES_ctx *ctx, const u8 *src, u8 *dst)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	aes_hw_load_schedule(ctx->ek, ctx->Nr, keys);
+	_mm_storeu_si128((__m128i *)dst, aes_hw_encrypt_block(keys, ctx->Nr, _mm_loadu_si128((const __m128i *)src)));
+}
+
+AES_HW_TARGET static void aes_hw_decrypt(AES_ctx *ctx, const u8 *src, u8 *dst)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	aes_hw_load_schedule(ctx->dk, ctx->Nr, keys);
+	_mm_storeu_si128((__m128i *)dst, aes_hw_decrypt_block(keys, ctx->Nr, _mm_loadu_si128((const __m128i *)src)));
+}
+
+/* Same zero-IV chaining as the software version below. */
+AES_HW_TARGET static void aes_hw_cbc_encrypt(AES_ctx *ctx, const u8 *src, u8 *dst, int blocks)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	__m128i chain = _mm_setzero_si128();
+	int i;
+	aes_hw_load_schedule(ctx->ek, ctx->Nr, keys);
+	for (i = 0; i < blocks; i++)
+	{
+		chain = aes_hw_encrypt_block(keys, ctx->Nr, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + 16 * i)), chain));
+		_mm_storeu_si128((__m128i *)(dst + 16 * i), chain);
+	}
+}
+
+/* CBC decryption has no dependency between blocks, so four are kept in
+   flight to hide the AESDEC latency. Works in place. */
+AES_HW_TARGET static void aes_hw_cbc_decrypt(AES_ctx *ctx, const u8 *src, u8 *dst, int blocks)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	__m128i prev = _mm_setzero_si128();
+	const int Nr = ctx->Nr;
+	int i = 0, r;
+	aes_hw_load_schedule(ctx->dk, Nr, keys);
+
+	for (; i + 4 <= blocks; i += 4)
+	{
+		__m128i c0 = _mm_loadu_si128((const __m128i *)(src + 16 * i));
+		__m128i c1 = _mm_loadu_si128((const __m128i *)(src + 16 * i + 16));
+		__m128i c2 = _mm_loadu_si128((const __m128i *)(src + 16 * i + 32));
+		__m128i c3 = _mm_loadu_si128((const __m128i *)(src + 16 * i + 48));
+		__m128i b0 = _mm_xor_si128(c0, keys[0]);
+		__m128i b1 = _mm_xor_si128(c1, keys[0]);
+		__m128i b2 = _mm_xor_si128(c2, keys[0]);
+		__m128i b3 = _mm_xor_si128(c3, keys[0]);
+		for (r = 1; r < Nr; r++)
+		{
+			b0 = _mm_aesdec_si128(b0, keys[r]);
+			b1 = _mm_aesdec_si128(b1, keys[r]);
+			b2 = _mm_aesdec_si128(b2, keys[r]);
+			b3 = _mm_aesdec_si128(b3, keys[r]);
+		}
+		b0 = _mm_aesdeclast_si128(b0, keys[Nr]);
+		b1 = _mm_aesdeclast_si128(b1, keys[Nr]);
+		b2 = _mm_aesdeclast_si128(b2, keys[Nr]);
+		b3 = _mm_aesdeclast_si128(b3, keys[Nr]);
+		_mm_storeu_si128((__m128i *)(dst + 16 * i), _mm_xor_si128(b0, prev));
+		_mm_storeu_si128((__m128i *)(dst + 16 * i + 16), _mm_xor_si128(b1, c0));
+		_mm_storeu_si128((__m128i *)(dst + 16 * i + 32), _mm_xor_si128(b2, c1));
+		_mm_storeu_si128((__m128i *)(dst + 16 * i + 48), _mm_xor_si128(b3, c2));
+		prev = c3;
+	}
+	for (; i < blocks; i++)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + 16 * i));
+		_mm_storeu_si128((__m128i *)(dst + 16 * i), _mm_xor_si128(aes_hw_decrypt_block(keys, Nr, c), prev));
+		prev = c;
+	}
+}
+
+/* CBC-MAC over the first n-1 blocks, then the prepared last block. */
+AES_HW_TARGET static void aes_hw_cmac(AES_ctx *ctx, const u8 *input, int blocks, const u8 *last, u8 *mac)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	__m128i x = _mm_setzero_si128();
+	int i;
+	aes_hw_load_schedule(ctx->ek, ctx->Nr, keys);
+	for (i = 0; i < blocks; i++)
+		x = aes_hw_encrypt_block(keys, ctx->Nr, _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)(input + 16 * i))));
+	x = aes_hw_encrypt_block(keys, ctx->Nr, _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)last)));
+	_mm_storeu_si128((__m128i *)mac, x);
+}
+
+#endif
+
 void AES_decrypt(AES_ctx *ctx, const u8 *src, u8 *dst)
 {
+#ifdef AES_HW_X86
+	if (aes_hw)
+	{
+		aes_hw_decrypt(ctx, src, dst);
+		return;
+	}
+#endif
 	rijndaelDecrypt(ctx->dk, ctx->Nr, src, dst);
 }
 
 void AES_encrypt(AES_ctx *ctx, const u8 *src, u8 *dst)
 {
+#ifdef AES_HW_X86
+	if (aes_hw)
+	{
+		aes_hw_encrypt(ctx, src, dst);
+		return;
+	}
+#endif
 	rijndaelEncrypt(ctx->ek, ctx->Nr, src, dst);
 }
 
@@ -1309,6 +1469,14 @@ void AES_cbc_encrypt(AES_ctx *ctx, u8 *src, u8 *dst, int size)
 	u8 block_buff[16];
 	
 	int i;
+#ifdef AES_HW_X86
+	if (aes_hw)
+	{
+		if (size > 0)
+			aes_hw_cbc_encrypt(ctx, src, dst, (size + 15) / 16);
+		return;
+	}
+#endif
 	for(i = 0; i < size; i+=16)
 	{
 		//step 1: copy block to dst
@@ -1330,6 +1498,13 @@ void AES_cbc_decrypt(AES_ctx *ctx, u8 *src, u8 *dst, int size)
 	u8 block_buff[16];
 	u8 block_buff_previous[16];
 	int i;
+#ifdef AES_HW_X86
+	if (aes_hw)
+	{
+		aes_hw_cbc_decrypt(ctx, src, dst, size > 16 ? (size + 15) / 16 : 1);
+		return;
+	}
+#endif
 	
 	memcpy(block_buff, src, 16);
 	memcpy(block_buff_previous, src, 16);
@@ -1448,6 +1623,14 @@ void AES_CMAC (AES_ctx *ctx, unsigned char *input, int length, unsigned char *ma
         xor_128(padded,K2,M_last);
     }
 
+#ifdef AES_HW_X86
+    if (aes_hw)
+    {
+        aes_hw_cmac(ctx, input, n - 1, M_last, mac);
+        return;
+    }
+#endif
+
     for ( i=0; i<16; i++ ) X[i] = 0;
     for ( i=0; i<n-1; i++ ) 
     {
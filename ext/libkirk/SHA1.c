@@ -40,6 +40,20 @@ effort (for example the reengineering of a great many Capstone chips).
 #include <stdio.h>
 #include <string.h>
 
+/* The SHA extensions need compiler support for per-function targets. */
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)) && \
+	((defined(_MSC_VER) && _MSC_VER >= 1900) || defined(__clang__) || (__GNUC__ * 100 + __GNUC_MINOR__ >= 409))
+#define SHA_HW_X86
+#include <immintrin.h>
+#ifdef __GNUC__
+#define SHA_HW_TARGET __attribute__((target("sha,sse2")))
+#else
+#define SHA_HW_TARGET
+#endif
+#endif
+
+static int sha_hw = 0;
+
 static void SHAtoByte(BYTE *output, UINT4 *input, unsigned int len);
 
 /* The SHS block size and message digest sizes, in bytes */
@@ -245,6 +259,99 @@ static void SHSTransform( digest, data )
     digest[ 4 ] += E;
     }
 
+void SHA_set_hw_accel(int enable)
+{
+#ifdef SHA_HW_X86
+    sha_hw = enable;
+#endif
+}
+
+#ifdef SHA_HW_X86
+
+/* One round group: four rounds of function f on message vector m, with
+   the E value rotated in from the previous ABCD. */
+#define SHA_HW_ROUNDS(f, m) \
+    E1 = _mm_sha1nexte_epu32( E0, m ); \
+    E0 = ABCD; \
+    ABCD = _mm_sha1rnds4_epu32( ABCD, E1, f );
+
+/* Message schedule for W[t+12..t+15] while W[t..t+3] is being consumed. */
+#define SHA_HW_SCHEDULE(m0, m1, m2, m3) \
+    m1 = _mm_sha1msg2_epu32( m1, m0 ); \
+    m3 = _mm_sha1msg1_epu32( m3, m0 ); \
+    m2 = _mm_xor_si128( m2, m0 );
+
+/* Same contract as SHSTransform: data holds the block already converted to
+   host-order words. */
+SHA_HW_TARGET static void SHSTransformHW( UINT4 *digest, UINT4 *data )
+{
+    __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+    __m128i MSG0, MSG1, MSG2, MSG3;
+
+    /* The instructions keep A in the top lane. */
+    ABCD = _mm_shuffle_epi32( _mm_loadu_si128( ( const __m128i * )digest ), 0x1B );
+    E0 = _mm_set_epi32( ( int )digest[ 4 ], 0, 0, 0 );
+    ABCD_SAVE = ABCD;
+    E0_SAVE = E0;
+
+    MSG0 = _mm_shuffle_epi32( _mm_loadu_si128( ( const __m128i * )( data + 0 ) ), 0x1B );
+    MSG1 = _mm_shuffle_epi32( _mm_loadu_si128( ( const __m128i * )( data + 4 ) ), 0x1B );
+    MSG2 = _mm_shuffle_epi32( _mm_loadu_si128( ( const __m128i * )( data + 8 ) ), 0x1B );
+    MSG3 = _mm_shuffle_epi32( _mm_loadu_si128( ( const __m128i * )( data + 12 ) ), 0x1B );
+
+    /* Rounds 0-15 */
+    E1 = _mm_add_epi32( E0, MSG0 );
+    E0 = ABCD;
+    ABCD = _mm_sha1rnds4_epu32( ABCD, E1, 0 );
+    SHA_HW_ROUNDS( 0, MSG1 );
+    MSG0 = _mm_sha1msg1_epu32( MSG0, MSG1 );
+    SHA_HW_ROUNDS( 0, MSG2 );
+    MSG1 = _mm_sha1msg1_epu32( MSG1, MSG2 );
+    MSG0 = _mm_xor_si128( MSG0, MSG2 );
+    SHA_HW_ROUNDS( 0, MSG3 ); SHA_HW_SCHEDULE( MSG3, MSG0, MSG1, MSG2 );
+
+    /* Rounds 16-79 */
+    SHA_HW_ROUNDS( 0, MSG0 ); SHA_HW_SCHEDULE( MSG0, MSG1, MSG2, MSG3 );
+    SHA_HW_ROUNDS( 1, MSG1 ); SHA_HW_SCHEDULE( MSG1, MSG2, MSG3, MSG0 );
+    SHA_HW_ROUNDS( 1, MSG2 ); SHA_HW_SCHEDULE( MSG2, MSG3, MSG0, MSG1 );
+    SHA_HW_ROUNDS( 1, MSG3 ); SHA_HW_SCHEDULE( MSG3, MSG0, MSG1, MSG2 );
+    SHA_HW_ROUNDS( 1, MSG0 ); SHA_HW_SCHEDULE( MSG0, MSG1, MSG2, MSG3 );
+    SHA_HW_ROUNDS( 1, MSG1 ); SHA_HW_SCHEDULE( MSG1, MSG2, MSG3, MSG0 );
+    SHA_HW_ROUNDS( 2, MSG2 ); SHA_HW_SCHEDULE( MSG2, MSG3, MSG0, MSG1 );
+    SHA_HW_ROUNDS( 2, MSG3 ); SHA_HW_SCHEDULE( MSG3, MSG0, MSG1, MSG2 );
+    SHA_HW_ROUNDS( 2, MSG0 ); SHA_HW_SCHEDULE( MSG0, MSG1, MSG2, MSG3 );
+    SHA_HW_ROUNDS( 2, MSG1 ); SHA_HW_SCHEDULE( MSG1, MSG2, MSG3, MSG0 );
+    SHA_HW_ROUNDS( 2, MSG2 ); SHA_HW_SCHEDULE( MSG2, MSG3, MSG0, MSG1 );
+    SHA_HW_ROUNDS( 3, MSG3 ); SHA_HW_SCHEDULE( MSG3, MSG0, MSG1, MSG2 );
+    SHA_HW_ROUNDS( 3, MSG0 ); SHA_HW_SCHEDULE( MSG0, MSG1, MSG2, MSG3 );
+    SHA_HW_ROUNDS( 3, MSG1 );
+    MSG2 = _mm_sha1msg2_epu32( MSG2, MSG1 );
+    MSG3 = _mm_xor_si128( MSG3, MSG1 );
+    SHA_HW_ROUNDS( 3, MSG2 );
+    MSG3 = _mm_sha1msg2_epu32( MSG3, MSG2 );
+    SHA_HW_ROUNDS( 3, MSG3 );
+
+    E0 = _mm_sha1nexte_epu32( E0, E0_SAVE );
+    ABCD = _mm_add_epi32( ABCD, ABCD_SAVE );
+
+    _mm_storeu_si128( ( __m128i * )digest, _mm_shuffle_epi32( ABCD, 0x1B ) );
+    digest[ 4 ] = ( UINT4 )_mm_cvtsi128_si32( _mm_shuffle_epi32( E0, 0xFF ) );
+}
+
+#endif
+
+static void SHSTransformDispatch( UINT4 *digest, UINT4 *data )
+{
+#ifdef SHA_HW_X86
+    if( sha_hw )
+        {
+        SHSTransformHW( digest, data );
+        return;
+        }
+#endif
+    SHSTransform( digest, data );
+}
+
 /* When run on a little-endian CPU we need to perform byte reversal on an
    array of long words. */
 
@@ -292,7 +399,7 @@ void SHAUpdate(SHA_CTX *shsInfo, BYTE *buffer, int count)
             }
         memcpy( p, buffer, dataCount );
         longReverse( shsInfo->data, SHS_DATASIZE, shsInfo->Endianness);
-        SHSTransform( shsInfo->digest, shsInfo->data );
+        SHSTransformDispatch( shsInfo->digest, shsInfo->data );
         buffer += dataCount;
         count -= dataCount;
         }
@@ -302,7 +409,7 @@ void SHAUpdate(SHA_CTX *shsInfo, BYTE *buffer, int count)
         {
         memcpy( (POINTER)shsInfo->data, (POINTER)buffer, SHS_DATASIZE );
         longReverse( shsInfo->data, SHS_DATASIZE, shsInfo->Endianness );
-        SHSTransform( shsInfo->digest, shsInfo->data );
+        SHSTransformDispatch( shsInfo->digest, shsInfo->data );
         buffer += SHS_DATASIZE;
         count -= SHS_DATASIZE;
         }
@@ -337,7 +444,7 @@ void SHAFinal(BYTE *output, SHA_CTX *shsInfo)
         /* Two lots of padding:  Pad the first block to 64 bytes */
         memset( dataPtr, 0, count );
         longReverse( shsInfo->data, SHS_DATASIZE, shsInfo->Endianness );
-        SHSTransform( shsInfo->digest, shsInfo->data );
+        SHSTransformDispatch( shsInfo->digest, shsInfo->data );
 
         /* Now fill the next block with 56 bytes */
         memset( (POINTER)shsInfo->data, 0, SHS_DATASIZE - 8 );
@@ -351,7 +458,7 @@ void SHAFinal(BYTE *output, SHA_CTX *shsInfo)
     shsInfo->data[ 15 ] = shsInfo->countLo;
 
     longReverse( shsInfo->data, SHS_DATASIZE - 8, shsInfo->Endianness );
-    SHSTransform( shsInfo->digest, shsInfo->data );
+    SHSTransformDispatch( shsInfo->digest, shsInfo->data );
 
 	/* Output to an array of bytes */
 	SHAtoByte(output, shsInfo->digest, SHS_DIGESTSIZE);
@@ -39,6 +39,8 @@ typedef struct
 void SHAInit(SHA_CTX *);
 void SHAUpdate(SHA_CTX *, BYTE *buffer, int count);
 void SHAFinal(BYTE *output, SHA_CTX *);
+/* Use the x86 SHA extensions for the block transform when available. */
+void SHA_set_hw_accel(int enable);
 
 #endif /* end _SHA_H_ */
 
@@ -3,15 +3,38 @@
 // To build on non-windows systems, just run CMake in the SDL directory, it will build both a normal ppsspp and the headless version.
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #include "../Core/Config.h"
 #include "../Core/Core.h"
 #include "../Core/CoreTiming.h"
 #include "../Core/System.h"
+#include "../Core/SaveState.h"
 #include "../Core/MIPS/MIPS.h"
 #include "../Core/Host.h"
+#include "../Core/HLE/HLE.h"
+#include "../Core/HLE/sceIo.h"
+#include "../Core/HLE/sceKernelModule.h"
+#include "../Core/HLE/sceMpeg.h"
+#include "../Core/Debugger/GuestProfiler.h"
+#include "../Core/MemMap.h"
+#include "../Core/Replay.h"
+#include "../Core/FramePacer.h"
+#include "../Core/MIPS/JitCommon/JitCommon.h"
+#include "../GPU/GPUState.h"
 #include "Log.h"
 #include "LogManager.h"
+#include "Timer.h"
+#include "SelfTest.h"
+#include "TestRunner.h"
 
 // TODO: Get rid of this junk
 class HeadlessHost : public Host
@@ -69,19 +92,525 @@ public:
 	}
 };
 
+static std::string profileFilename;
+static std::string guestProfileFilename;
+static std::string benchFilename;
+
+struct FrameSample
+{
+	u64 wallNs;
+	u64 cycles;
+	u64 jitNs;
+	u32 jitBlocks;
+	int drawCalls;
+	int texturesDecoded;
+};
+
+// Everything is a running total, frames are the difference between two of these.
+struct BenchCounters
+{
+	u64 wallNs;
+	u64 cycles;
+	u64 jitNs;
+	u32 jitBlocks;
+	int drawCalls;
+	int texturesDecoded;
+
+	void Read()
+	{
+		wallNs = Common::Timer::GetTimeNs();
+		cycles = CoreTiming::GetTicks();
+		jitNs = MIPSComp::jitStats.compileNs;
+		jitBlocks = MIPSComp::jitStats.blocksCompiled;
+		drawCalls = gpuStats.numTotalDrawCalls;
+		texturesDecoded = gpuStats.numTexturesDecoded;
+	}
+};
+
+static std::vector<FrameSample> benchFrames;
+static BenchCounters benchLast;
+static int benchWarmupFrames = 0;
+static int benchSeenFrames = 0;
+static const char *benchStopReason = "exit";
+
+static void benchFrameDone()
+{
+	BenchCounters now;
+	now.Read();
+	if (benchSeenFrames++ >= benchWarmupFrames)
+	{
+		FrameSample sample;
+		sample.wallNs = now.wallNs - benchLast.wallNs;
+		sample.cycles = now.cycles - benchLast.cycles;
+		sample.jitNs = now.jitNs - benchLast.jitNs;
+		sample.jitBlocks = now.jitBlocks - benchLast.jitBlocks;
+		sample.drawCalls = std::max(0, now.drawCalls - benchLast.drawCalls);
+		sample.texturesDecoded = std::max(0, now.texturesDecoded - benchLast.texturesDecoded);
+		benchFrames.push_back(sample);
+	}
+	benchLast = now;
+}
+
+// Nearest rank, values must be sorted.
+static double percentile(const std::vector<double> &values, int pct)
+{
+	if (values.empty())
+		return 0.0;
+	size_t rank = (values.size() * pct + 99) / 100;
+	return values[rank == 0 ? 0 : rank - 1];
+}
+
+static void writeBenchMetric(FILE *f, const char *name, std::vector<double> values, bool last)
+{
+	std::sort(values.begin(), values.end());
+	double total = 0.0;
+	for (size_t i = 0; i < values.size(); i++)
+		total += values[i];
+	double mean = values.empty() ? 0.0 : total / values.size();
+	fprintf(f, "    \"%s\": {\"total\": %.4f, \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+		name, total, mean, values.empty() ? 0.0 : values.front(),
+		percentile(values, 50), percentile(values, 90), percentile(values, 99),
+		values.empty() ? 0.0 : values.back(), last ? "" : ",");
+}
+
+static void writeBench()
+{
+	FILE *f = fopen(benchFilename.c_str(), "w");
+	if (!f)
+	{
+		fprintf(stderr, "Unable to write benchmark results to %s\n", benchFilename.c_str());
+		return;
+	}
+
+	std::vector<double> wallMs, cycles, jitMs, jitBlocks, drawCalls, texturesDecoded;
+	for (size_t i = 0; i < benchFrames.size(); i++)
+	{
+		const FrameSample &s = benchFrames[i];
+		wallMs.push_back(s.wallNs / 1000000.0);
+		cycles.push_back((double)s.cycles);
+		jitMs.push_back(s.jitNs / 1000000.0);
+		jitBlocks.push_back(s.jitBlocks);
+		drawCalls.push_back(s.drawCalls);
+		texturesDecoded.push_back(s.texturesDecoded);
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"frames\": %d,\n", (int)benchFrames.size());
+	fprintf(f, "  \"warmup_frames\": %d,\n", std::min(benchSeenFrames, benchWarmupFrames));
+	fprintf(f, "  \"stop_reason\": \"%s\",\n", benchStopReason);
+	fprintf(f, "  \"metrics\": {\n");
+	writeBenchMetric(f, "wall_ms", wallMs, false);
+	writeBenchMetric(f, "guest_cycles", cycles, false);
+	writeBenchMetric(f, "jit_compile_ms", jitMs, false);
+	writeBenchMetric(f, "jit_blocks", jitBlocks, false);
+	writeBenchMetric(f, "draw_calls", drawCalls, false);
+	writeBenchMetric(f, "textures_decoded", texturesDecoded, true);
+	fprintf(f, "  },\n");
+	fprintf(f, "  \"per_frame\": [\n");
+	for (size_t i = 0; i < benchFrames.size(); i++)
+	{
+		const FrameSample &s = benchFrames[i];
+		fprintf(f, "    [%.4f, %llu, %.4f, %u, %d, %d]%s\n",
+			s.wallNs / 1000000.0, (unsigned long long)s.cycles, s.jitNs / 1000000.0,
+			s.jitBlocks, s.drawCalls, s.texturesDecoded, i + 1 < benchFrames.size() ? "," : "");
+	}
+	fprintf(f, "  ],\n");
+	fprintf(f, "  \"per_frame_columns\": [\"wall_ms\", \"guest_cycles\", \"jit_compile_ms\", \"jit_blocks\", \"draw_calls\", \"textures_decoded\"]\n");
+	fprintf(f, "}\n");
+	fclose(f);
+}
+
+// Also runs from atexit, in case something calls exit() on the way out.
+static void dumpProfile()
+{
+	static bool dumped = false;
+	if (dumped)
+		return;
+	dumped = true;
+
+	if (!benchFilename.empty())
+		writeBench();
+	if (!profileFilename.empty())
+		hleProfilerDump(profileFilename);
+	if (!guestProfileFilename.empty())
+	{
+		GuestProfiler::Stop();
+		GuestProfiler::WriteFlatProfile(guestProfileFilename);
+		GuestProfiler::WriteCollapsedStacks(guestProfileFilename + ".folded");
+	}
+}
+
+// Returns false if it was stopped by the timeout.
+static bool runUntilExit(int maxFrames, double timeoutSeconds)
+{
+	coreState = CORE_RUNNING;
+
+	u64 startNs = Common::Timer::GetTimeNs();
+	u64 timeoutNs = (u64)(timeoutSeconds * 1000000000.0);
+	int numFrames = 0;
+	benchLast.Read();
+
+	while (coreState == CORE_RUNNING)
+	{
+		// Run for a frame at a time, just because.
+		u64 nowTicks = CoreTiming::GetTicks();
+		u64 frameTicks = usToCycles(1000000/60);
+		mipsr4k.RunLoopUntil(nowTicks + frameTicks);
+
+		// If we were rendering, this might be a nice time to do something about it.
+		if (coreState == CORE_NEXTFRAME)
+		{
+			SaveState::Process();
+			coreState = CORE_RUNNING;
+
+			numFrames++;
+			if (!benchFilename.empty())
+				benchFrameDone();
+			if (maxFrames > 0 && numFrames >= maxFrames)
+			{
+				benchStopReason = "frames";
+				break;
+			}
+			if (Replay::HasEnded())
+				break;
+		}
+
+		if (timeoutNs != 0 && Common::Timer::GetTimeNs() - startNs >= timeoutNs)
+		{
+			benchStopReason = "timeout";
+			return false;
+		}
+	}
+	return true;
+}
+
+static CoreParameter testCoreParameter;
+static bool testBooted = false;
+static std::vector<u8> testBootState;
+
+// Each worker boots once with nothing loaded, and resets back to that before every other test.
+static TestRunStatus runTest(const std::string &filename, double timeoutSeconds, std::string &output)
+{
+	if (!testBooted)
+	{
+		CoreParameter coreParameter = testCoreParameter;
+		coreParameter.fileToStart = "";
+		if (!PSP_Init(coreParameter, &output))
+			return TESTRUN_ERROR;
+		if (!SaveState::SaveToRam(testBootState))
+		{
+			output = "Unable to snapshot the booted state";
+			PSP_Shutdown();
+			return TESTRUN_ERROR;
+		}
+		testBooted = true;
+	}
+	else
+	{
+		// The snapshot doesn't know about host files the last test left open, drop them first.
+		__IoRemountMemstick();
+		if (!SaveState::LoadFromRam(testBootState))
+		{
+			output = "Unable to restore the booted state";
+			return TESTRUN_ERROR;
+		}
+	}
+
+	ClearEmuDebugOutput();
+	if (!PSP_LoadExecutable(filename, &output))
+		return TESTRUN_ERROR;
+
+	bool finished = runUntilExit(0, timeoutSeconds);
+	output = EmuDebugOutput();
+	return finished ? TESTRUN_OK : TESTRUN_TIMEOUT;
+}
+
+struct RepeatStats
+{
+	int runs;
+	int timeouts;
+	int failures;
+	// Runs whose output differs from the first run's.
+	int differentOutput;
+	u64 resetNs;
+	u64 runNs;
+	u64 maxRunNs;
+};
+
+static void addRepeatRun(RepeatStats &stats, u64 resetNs, u64 runNs, bool finished, const std::string &output, const std::string &firstOutput)
+{
+	stats.resetNs += resetNs;
+	stats.runNs += runNs;
+	stats.maxRunNs = std::max(stats.maxRunNs, runNs);
+	if (!finished)
+		stats.timeouts++;
+	if (stats.runs != 0 && output != firstOutput)
+		stats.differentOutput++;
+	stats.runs++;
+}
+
+// Takes the freshly booted state and resets back to it before each run.
+static void runRepeatedInProcess(int runs, int maxFrames, double timeoutSeconds, RepeatStats &stats)
+{
+	std::vector<u8> snapshot;
+	if (!SaveState::SaveToRam(snapshot))
+	{
+		fprintf(stderr, "Unable to snapshot the booted state\n");
+		stats.failures = runs;
+		return;
+	}
+
+	std::string firstOutput;
+	for (int i = 0; i < runs; i++)
+	{
+		u64 resetStart = Common::Timer::GetTimeNs();
+		if (i != 0 && !SaveState::LoadFromRam(snapshot))
+		{
+			fprintf(stderr, "Unable to restore the booted state\n");
+			stats.failures += runs - i;
+			return;
+		}
+		ClearEmuDebugOutput();
+
+		u64 runStart = Common::Timer::GetTimeNs();
+		bool finished = runUntilExit(maxFrames, timeoutSeconds);
+		u64 runEnd = Common::Timer::GetTimeNs();
+
+		if (i == 0)
+			firstOutput = EmuDebugOutput();
+		addRepeatRun(stats, runStart - resetStart, runEnd - runStart, finished, EmuDebugOutput(), firstOutput);
+	}
+}
+
+#ifndef _WIN32
+// Each run is a fork of this process, so kernel objects, CoreTiming and the rest of
+// the heap come back for free.  Guest memory is a shared mapping though (for the
+// mirrors), so it's put back after each child, which is why runs are sequential.
+static void runRepeatedForked(int runs, int maxFrames, double timeoutSeconds, RepeatStats &stats)
+{
+	std::vector<u8> ram(Memory::m_pRAM, Memory::m_pRAM + Memory::RAM_SIZE);
+	std::vector<u8> vram(Memory::m_pVRAM, Memory::m_pVRAM + Memory::VRAM_SIZE);
+	std::vector<u8> scratchpad(Memory::m_pScratchPad, Memory::m_pScratchPad + Memory::SCRATCHPAD_SIZE);
+
+	std::string firstOutput;
+	for (int i = 0; i < runs; i++)
+	{
+		int fds[2];
+		if (pipe(fds) != 0)
+		{
+			fprintf(stderr, "Unable to create a pipe: %s\n", strerror(errno));
+			stats.failures += runs - i;
+			return;
+		}
+
+		u64 resetStart = Common::Timer::GetTimeNs();
+		fflush(stdout);
+		fflush(stderr);
+		__IoBeforeFork();
+		__MpegBeforeFork();
+		pid_t pid = fork();
+		__MpegAfterFork(pid == 0);
+		__IoAfterFork(pid == 0);
+		if (pid == 0)
+		{
+			close(fds[0]);
+			bool finished = runUntilExit(maxFrames, timeoutSeconds);
+			const std::string &output = EmuDebugOutput();
+			size_t pos = 0;
+			while (pos < output.size())
+			{
+				ssize_t written = write(fds[1], output.data() + pos, output.size() - pos);
+				if (written < 0 && errno == EINTR)
+					continue;
+				if (written <= 0)
+					break;
+				pos += written;
+			}
+			fflush(stdout);
+			// Skips atexit and the core shutdown, which would tear down the shared memory.
+			_exit(finished ? 0 : 2);
+		}
+		close(fds[1]);
+		if (pid < 0)
+		{
+			close(fds[0]);
+			fprintf(stderr, "Unable to fork: %s\n", strerror(errno));
+			stats.failures += runs - i;
+			return;
+		}
+
+		u64 runStart = Common::Timer::GetTimeNs();
+		std::string output;
+		char buf[4096];
+		ssize_t bytes;
+		while ((bytes = read(fds[0], buf, sizeof(buf))) != 0)
+		{
+			if (bytes > 0)
+				output.append(buf, bytes);
+			else if (errno != EINTR)
+				break;
+		}
+		close(fds[0]);
+		int status = 0;
+		waitpid(pid, &status, 0);
+		u64 runEnd = Common::Timer::GetTimeNs();
+
+		memcpy(Memory::m_pRAM, &ram[0], ram.size());
+		memcpy(Memory::m_pVRAM, &vram[0], vram.size());
+		memcpy(Memory::m_pScratchPad, &scratchpad[0], scratchpad.size());
+
+		bool exited = WIFEXITED(status);
+		if (!exited || (WEXITSTATUS(status) != 0 && WEXITSTATUS(status) != 2))
+			stats.failures++;
+		if (i == 0)
+			firstOutput = output;
+		// Forking is the reset, restoring memory is part of it too.
+		u64 restoreNs = Common::Timer::GetTimeNs() - runEnd;
+		addRepeatRun(stats, runStart - resetStart + restoreNs, runEnd - runStart, !exited || WEXITSTATUS(status) != 2, output, firstOutput);
+	}
+}
+#endif
+
+static void printRepeatStats(const RepeatStats &stats)
+{
+	int runs = std::max(stats.runs, 1);
+	fprintf(stderr, "%d runs, %d timed out, %d failed, %d with different output\n", stats.runs, stats.timeouts, stats.failures, stats.differentOutput);
+	fprintf(stderr, "reset: %.3f ms avg, run: %.3f ms avg, %.3f ms worst, %.1f runs/s\n",
+		stats.resetNs / 1000000.0 / runs, stats.runNs / 1000000.0 / runs, stats.maxRunNs / 1000000.0,
+		stats.resetNs + stats.runNs == 0 ? 0.0 : stats.runs * 1000000000.0 / (stats.resetNs + stats.runNs));
+}
+
+// Boots the executable over and over and times the loader, without running anything.
+// The module cache is on as usual, so only the first boot pays for decryption.
+static bool benchLoad(const CoreParameter &coreParameter, int runs)
+{
+	std::vector<double> bootMs, loadMs, decryptMs;
+	u32 cacheHits = moduleLoadStats.cacheHits;
+	for (int i = 0; i < runs; i++)
+	{
+		ModuleLoadStats before = moduleLoadStats;
+		std::string error_string;
+		u64 start = Common::Timer::GetTimeNs();
+		if (!PSP_Init(coreParameter, &error_string))
+		{
+			fprintf(stderr, "Failed to start %s. Error: %s\n", coreParameter.fileToStart.c_str(), error_string.c_str());
+			return false;
+		}
+		u64 end = Common::Timer::GetTimeNs();
+		PSP_Shutdown();
+
+		bootMs.push_back((end - start) / 1000000.0);
+		loadMs.push_back((moduleLoadStats.loadNs - before.loadNs) / 1000000.0);
+		decryptMs.push_back((moduleLoadStats.decryptNs - before.decryptNs) / 1000000.0);
+	}
+	cacheHits = moduleLoadStats.cacheHits - cacheHits;
+
+	std::vector<double> sorted = loadMs;
+	std::sort(sorted.begin(), sorted.end());
+	fprintf(stderr, "%d boots, %u decrypted modules from the cache\n", runs, cacheHits);
+	fprintf(stderr, "module load: %.3f ms p50, %.3f ms p90, %.3f ms first\n", percentile(sorted, 50), percentile(sorted, 90), loadMs.empty() ? 0.0 : loadMs[0]);
+
+	if (!benchFilename.empty())
+	{
+		FILE *f = fopen(benchFilename.c_str(), "w");
+		if (!f)
+		{
+			fprintf(stderr, "Unable to write benchmark results to %s\n", benchFilename.c_str());
+			return false;
+		}
+		fprintf(f, "{\n");
+		fprintf(f, "  \"boots\": %d,\n", runs);
+		fprintf(f, "  \"module_cache_hits\": %u,\n", cacheHits);
+		fprintf(f, "  \"metrics\": {\n");
+		writeBenchMetric(f, "boot_ms", bootMs, false);
+		writeBenchMetric(f, "module_load_ms", loadMs, false);
+		writeBenchMetric(f, "decrypt_ms", decryptMs, true);
+		fprintf(f, "  }\n");
+		fprintf(f, "}\n");
+		fclose(f);
+	}
+	return true;
+}
+
+// Every core charges the same cycles for the same code, so a test that doesn't
+// depend on host timing should exit on the same tick with the same output on each.
+static bool compareCores(const CoreParameter &coreParameter, int maxFrames, double timeoutSeconds)
+{
+	static const CPUCore cores[] = {CPU_INTERPRETER, CPU_FASTINTERPRETER, CPU_JIT};
+	static const char *names[] = {"interpreter", "fast interpreter", "jit"};
+	const int numCores = ARRAY_SIZE(cores);
+
+	u64 ticks[numCores];
+	std::string outputs[numCores];
+	for (int i = 0; i < numCores; i++)
+	{
+		CoreParameter param = coreParameter;
+		param.cpuCore = cores[i];
+		std::string error_string;
+		if (!PSP_Init(param, &error_string))
+		{
+			fprintf(stderr, "Failed to start %s with the %s. Error: %s\n", param.fileToStart.c_str(), names[i], error_string.c_str());
+			return false;
+		}
+
+		bool finished = runUntilExit(maxFrames, timeoutSeconds);
+		ticks[i] = CoreTiming::GetTicks();
+		outputs[i] = EmuDebugOutput();
+		PSP_Shutdown();
+
+		fprintf(stderr, "%s: %llu cycles%s\n", names[i], (unsigned long long)ticks[i], finished ? "" : ", timed out");
+	}
+
+	bool same = true;
+	for (int i = 1; i < numCores; i++)
+	{
+		if (ticks[i] != ticks[0])
+		{
+			fprintf(stderr, "The %s took %lld cycles more than the %s\n", names[i], (long long)(ticks[i] - ticks[0]), names[0]);
+			same = false;
+		}
+		if (outputs[i] != outputs[0])
+		{
+			fprintf(stderr, "The %s printed something different from the %s\n", names[i], names[0]);
+			same = false;
+		}
+	}
+	return same;
+}
+
 void printUsage(const char *progname, const char *reason)
 {
 	if (reason != NULL)
 		fprintf(stderr, "Error: %s\n\n", reason);
 	fprintf(stderr, "PPSSPP Headless\n");
 	fprintf(stderr, "This is primarily meant for non-inactive test tool.\n\n");
-	fprintf(stderr, "Usage: %s [options] file.elf\n\n", progname);
+	fprintf(stderr, "Usage: %s [options] file.elf\n", progname);
+	fprintf(stderr, "       %s [options] test.prx... or directory...\n\n", progname);
 	fprintf(stderr, "Options:\n");
 	fprintf(stderr, "  -m, --mount umd.cso   mount iso on umd:\n");
 	fprintf(stderr, "  -l, --log             full log output, not just emulated printfs\n");
 	fprintf(stderr, "  -f                    use the fast interpreter\n");
 	fprintf(stderr, "  -j                    use jit (overrides -f)\n");
 	fprintf(stderr, "  -c, --compare         compare with output in file.expected\n");
+	fprintf(stderr, "  -p, --profile file    write HLE syscall stats on exit, .csv or JSON\n");
+	fprintf(stderr, "  --guest-profile file  write a guest function profile on exit, and file.folded\n");
+	fprintf(stderr, "  --frames N            stop after N frames\n");
+	fprintf(stderr, "  --timeout seconds     stop after this much host time\n");
+	fprintf(stderr, "  --warmup N            leave the first N frames out of --bench results\n");
+	fprintf(stderr, "  --bench file          write per frame timings and a JSON summary on exit\n");
+	fprintf(stderr, "  --bench-load N        boot N times and time the module loader, JSON to --bench\n");
+	fprintf(stderr, "  --repeat N            run N times, resetting to the booted state in between\n");
+	fprintf(stderr, "  --reset state|fork    reset by restoring a state in memory, or by forking\n");
+	fprintf(stderr, "  --record file         record input and RAM checksums for --replay\n");
+	fprintf(stderr, "  --replay file         play back a recording, report where it diverges\n");
+	fprintf(stderr, "  --checksum-frames N   hash RAM every N frames while recording, default 60\n");
+	fprintf(stderr, "  --compare-cores       run with each cpu core, check they end on the same cycle\n");
+	fprintf(stderr, "  --selftest            check emulator internals, no executable needed\n");
+	fprintf(stderr, "\nWith several tests or a directory, compares each with its .expected file:\n");
+	fprintf(stderr, "  --workers N           run tests in N processes, default is one per cpu\n");
+	fprintf(stderr, "  --timeout seconds     per test, default 5\n");
+	fprintf(stderr, "  --junit file          write JUnit XML results\n");
+	fprintf(stderr, "  --teamcity            print TeamCity service messages\n");
 	fprintf(stderr, "\nSee headless.txt for details.\n");
 }
 
@@ -92,9 +621,26 @@ int main(int argc, const char* argv[])
 	bool fastInterpreter = false;
 	bool autoCompare = false;
 	
-	const char *bootFilename = 0;
+	std::vector<std::string> bootFilenames;
 	const char *mountIso = 0;
 	bool readMount = false;
+	bool readProfile = false;
+	bool readGuestProfile = false;
+	int maxFrames = 0;
+	double timeoutSeconds = 0.0;
+	bool runnerMode = false;
+	int numRuns = 1;
+	bool forkReset = false;
+	std::string recordFilename;
+	std::string replayFilename;
+	int checksumFrames = 60;
+	bool checkCores = false;
+	bool selfTest = false;
+	int loadRuns = 0;
+	TestRunnerOptions runnerOptions;
+	runnerOptions.numWorkers = 0;
+	runnerOptions.timeoutSeconds = 5.0;
+	runnerOptions.teamcity = false;
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -104,8 +650,74 @@ int main(int argc, const char* argv[])
 			readMount = false;
 			continue;
 		}
+		if (readProfile)
+		{
+			profileFilename = argv[i];
+			readProfile = false;
+			continue;
+		}
+		if (readGuestProfile)
+		{
+			guestProfileFilename = argv[i];
+			readGuestProfile = false;
+			continue;
+		}
+		if (!strcmp(argv[i], "--frames") || !strcmp(argv[i], "--timeout") || !strcmp(argv[i], "--warmup") || !strcmp(argv[i], "--bench") || !strcmp(argv[i], "--workers") || !strcmp(argv[i], "--junit") || !strcmp(argv[i], "--repeat") || !strcmp(argv[i], "--reset")
+			|| !strcmp(argv[i], "--record") || !strcmp(argv[i], "--replay") || !strcmp(argv[i], "--checksum-frames") || !strcmp(argv[i], "--bench-load"))
+		{
+			if (i + 1 >= argc)
+			{
+				std::string reason = "Missing argument after " + std::string(argv[i]);
+				printUsage(argv[0], reason.c_str());
+				return 1;
+			}
+			const char *value = argv[++i];
+			if (!strcmp(argv[i - 1], "--frames"))
+				maxFrames = atoi(value);
+			else if (!strcmp(argv[i - 1], "--timeout"))
+				timeoutSeconds = atof(value);
+			else if (!strcmp(argv[i - 1], "--warmup"))
+				benchWarmupFrames = atoi(value);
+			else if (!strcmp(argv[i - 1], "--workers"))
+			{
+				runnerOptions.numWorkers = atoi(value);
+				runnerMode = true;
+			}
+			else if (!strcmp(argv[i - 1], "--repeat"))
+				numRuns = atoi(value);
+			else if (!strcmp(argv[i - 1], "--record"))
+				recordFilename = value;
+			else if (!strcmp(argv[i - 1], "--replay"))
+				replayFilename = value;
+			else if (!strcmp(argv[i - 1], "--checksum-frames"))
+				checksumFrames = atoi(value);
+			else if (!strcmp(argv[i - 1], "--bench-load"))
+				loadRuns = atoi(value);
+			else if (!strcmp(argv[i - 1], "--reset"))
+			{
+				if (!strcmp(value, "fork"))
+					forkReset = true;
+				else if (strcmp(value, "state"))
+				{
+					printUsage(argv[0], "--reset must be state or fork");
+					return 1;
+				}
+			}
+			else if (!strcmp(argv[i - 1], "--junit"))
+			{
+				runnerOptions.junitFilename = value;
+				runnerMode = true;
+			}
+			else
+				benchFilename = value;
+			continue;
+		}
 		if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--mount"))
 			readMount = true;
+		else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--profile"))
+			readProfile = true;
+		else if (!strcmp(argv[i], "--guest-profile"))
+			readGuestProfile = true;
 		else if (!strcmp(argv[i], "-l") || !strcmp(argv[i], "--log"))
 			fullLog = true;
 		else if (!strcmp(argv[i], "-j"))
@@ -114,19 +726,28 @@ int main(int argc, const char* argv[])
 			fastInterpreter = true;
 		else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--compare"))
 			autoCompare = true;
-		else if (bootFilename == 0)
-			bootFilename = argv[i];
-		else
+		else if (!strcmp(argv[i], "--compare-cores"))
+			checkCores = true;
+		else if (!strcmp(argv[i], "--selftest"))
+			selfTest = true;
+		else if (!strcmp(argv[i], "--teamcity"))
 		{
-			if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h"))
-				printUsage(argv[0], NULL);
-			else
-			{
-				std::string reason = "Unexpected argument " + std::string(argv[i]);
-				printUsage(argv[0], reason.c_str());
-			}
+			runnerOptions.teamcity = true;
+			runnerMode = true;
+		}
+		else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h"))
+		{
+			printUsage(argv[0], NULL);
+			return 1;
+		}
+		else if (argv[i][0] == '-')
+		{
+			std::string reason = "Unexpected argument " + std::string(argv[i]);
+			printUsage(argv[0], reason.c_str());
 			return 1;
 		}
+		else
+			bootFilenames.push_back(argv[i]);
 	}
 
 	if (readMount)
@@ -134,16 +755,30 @@ int main(int argc, const char* argv[])
 		printUsage(argv[0], "Missing argument after -m");
 		return 1;
 	}
-	if (!bootFilename)
+	if (readProfile)
+	{
+		printUsage(argv[0], "Missing argument after -p");
+		return 1;
+	}
+	if (readGuestProfile)
+	{
+		printUsage(argv[0], "Missing argument after --guest-profile");
+		return 1;
+	}
+	if (bootFilenames.empty() && !selfTest)
 	{
 		printUsage(argv[0], argc <= 1 ? NULL : "No executable specified");
 		return 1;
 	}
+	if (bootFilenames.size() > 1 || (!bootFilenames.empty() && File::IsDirectory(bootFilenames[0])))
+		runnerMode = true;
 
 	host = new HeadlessHost();
 
 	LogManager::Init();
 	LogManager *logman = LogManager::GetInstance();
+	// Keep log lines in order with the test's own stdout output.
+	logman->SetAsync(false);
 	
 	PrintfLogger *printfLogger = new PrintfLogger();
 
@@ -155,8 +790,11 @@ int main(int argc, const char* argv[])
 		logman->AddListener(type, printfLogger);
 	}
 
+	if (selfTest)
+		return RunSelfTests() == 0 ? 0 : 1;
+
 	CoreParameter coreParameter;
-	coreParameter.fileToStart = bootFilename;
+	coreParameter.fileToStart = bootFilenames[0];
 	coreParameter.mountIso = mountIso ? mountIso : "";
 	coreParameter.startPaused = false;
 	coreParameter.cpuCore = useJit ? CPU_JIT : (fastInterpreter ? CPU_FASTINTERPRETER : CPU_INTERPRETER);
@@ -168,6 +806,47 @@ int main(int argc, const char* argv[])
 	g_Config.bEnableSound = false;
 	g_Config.bFirstRun = false;
 	g_Config.bIgnoreBadMemAccess = true;
+	g_Config.bModuleCache = true;
+	// Same as the default config, so tests run with replacements like games do.
+	g_Config.bFuncReplacements = true;
+	// Tests should run as fast as they can.
+	g_Config.iSpeedPercent = 0;
+	FramePacer::SetMode(FramePacer::PACE_UNTHROTTLED);
+
+	if (runnerMode)
+	{
+		std::vector<TestInfo> tests;
+		TestRunner_FindTests(bootFilenames, tests);
+		if (runnerOptions.numWorkers <= 0)
+			runnerOptions.numWorkers = TestRunner_NumCPUs();
+		if (timeoutSeconds > 0.0)
+			runnerOptions.timeoutSeconds = timeoutSeconds;
+
+		testCoreParameter = coreParameter;
+		int result = TestRunner_Run(tests, runnerOptions, &runTest) == 0 ? 0 : 1;
+		// Only set when the tests ran in this process.
+		if (testBooted)
+			PSP_Shutdown();
+		return result;
+	}
+
+	if (checkCores)
+		return compareCores(coreParameter, maxFrames, timeoutSeconds) ? 0 : 1;
+	if (loadRuns > 0)
+		return benchLoad(coreParameter, loadRuns) ? 0 : 1;
+
+	if (!profileFilename.empty())
+		hleProfilerEnable(true);
+	if (!profileFilename.empty() || !guestProfileFilename.empty() || !benchFilename.empty())
+		atexit(&dumpProfile);
+
+	if (!recordFilename.empty())
+		Replay::StartRecording(recordFilename, checksumFrames);
+	else if (!replayFilename.empty() && !Replay::StartPlayback(replayFilename))
+	{
+		fprintf(stderr, "Unable to load replay %s\n", replayFilename.c_str());
+		return 1;
+	}
 
 	std::string error_string;
 
@@ -177,27 +856,51 @@ int main(int argc, const char* argv[])
 		return 1;
 	}
 
-	coreState = CORE_RUNNING;
+	if (!guestProfileFilename.empty())
+		GuestProfiler::Start(useJit);
 
-	while (coreState == CORE_RUNNING)
+	if (numRuns > 1)
 	{
-		// Run for a frame at a time, just because.
-		u64 nowTicks = CoreTiming::GetTicks();
-		u64 frameTicks = usToCycles(1000000/60);
-		mipsr4k.RunLoopUntil(nowTicks + frameTicks);
-
-		// If we were rendering, this might be a nice time to do something about it.
-		if (coreState == CORE_NEXTFRAME)
-			coreState = CORE_RUNNING;
+		RepeatStats stats;
+		memset(&stats, 0, sizeof(stats));
+#ifdef _WIN32
+		if (forkReset)
+			fprintf(stderr, "fork() isn't available, resetting from a state instead\n");
+		runRepeatedInProcess(numRuns, maxFrames, timeoutSeconds, stats);
+#else
+		if (forkReset)
+			runRepeatedForked(numRuns, maxFrames, timeoutSeconds, stats);
+		else
+			runRepeatedInProcess(numRuns, maxFrames, timeoutSeconds, stats);
+#endif
+		printRepeatStats(stats);
 	}
+	else
+		runUntilExit(maxFrames, timeoutSeconds);
 
-	// NOTE: we won't get here until I've gotten rid of the exit(0) in sceExitProcess or whatever it's called
+	// The jit's block counts go away with it.
+	dumpProfile();
+
+	int exitCode = 0;
+	if (!replayFilename.empty())
+	{
+		int diverged = Replay::GetDivergedFrame();
+		if (diverged >= 0)
+		{
+			fprintf(stderr, "Replay diverged at frame %d\n", diverged);
+			exitCode = 1;
+		}
+		else
+			fprintf(stderr, "Replay matched through frame %d\n", Replay::GetFrame());
+	}
+	Replay::Stop();
 
 	PSP_Shutdown();
 
 	if (autoCompare)
 	{
-		std::string expect_filename = std::string(bootFilename).substr(strlen(bootFilename - 4)) + ".expected";
+		const std::string &bootFilename = bootFilenames[0];
+		std::string expect_filename = bootFilename.substr(0, bootFilename.size() - 4) + ".expected";
 		if (File::Exists(expect_filename))
 		{
 			// TODO: Do the compare here
@@ -208,6 +911,6 @@ int main(int argc, const char* argv[])
 		}
 	}
 
-	return 0;
+	return exitCode;
 }
 
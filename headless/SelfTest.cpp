@@ -0,0 +1,341 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+extern "C"
+{
+#include "../ext/libkirk/AES.h"
+#include "../ext/libkirk/SHA1.h"
+}
+
+#include "../Common/CPUDetect.h"
+#include "../Core/Config.h"
+#include "../Core/MemMap.h"
+#include "../Core/Debugger/SymbolMap.h"
+#include "../Core/HLE/ReplaceTables.h"
+#include "../Core/HLE/sceKernel.h"
+#include "../Core/HLE/sceKernelSemaphore.h"
+#include "../Core/MIPS/MIPS.h"
+#include "../Core/MIPS/MIPSTables.h"
+#include "../Core/MIPS/JitCommon/JitCommon.h"
+
+#include "SelfTest.h"
+
+#define CHECK(x) \
+	do { \
+		if (!(x)) \
+		{ \
+			fprintf(stderr, "  %s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+			passed = false; \
+		} \
+	} while (false)
+
+// A deleted object's UID has to stay invalid, even once its slot is reused.
+static bool TestKernelObjectReuse()
+{
+	bool passed = true;
+	const u32 unknown = SCE_KERNEL_ERROR_UNKNOWN_SEMID;
+	int baseCount = kernelObjects.GetCount();
+
+	SceUID first = sceKernelCreateSema("selftest", 0, 0, 1, 0);
+	CHECK(first > 0);
+	CHECK(kernelObjects.GetCount() == baseCount + 1);
+	CHECK(sceKernelDeleteSema(first) == 0);
+	CHECK(kernelObjects.GetCount() == baseCount);
+	CHECK((u32)sceKernelSignalSema(first, 1) == unknown);
+	CHECK((u32)sceKernelDeleteSema(first) == unknown);
+
+	SceUID second = sceKernelCreateSema("selftest", 0, 0, 1, 0);
+	CHECK(second > 0 && second != first);
+	CHECK(sceKernelSignalSema(second, 1) == 0);
+	CHECK((u32)sceKernelSignalSema(first, 1) == unknown);
+	CHECK(sceKernelDeleteSema(second) == 0);
+	CHECK(kernelObjects.GetCount() == baseCount);
+
+	// Fill most of the table twice, so the high slots get freed and reused too.
+	static SceUID uids[4000];
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = 0; i < 4000; i++)
+			uids[i] = sceKernelCreateSema("selftest", 0, 0, 1, 0);
+		CHECK(kernelObjects.GetCount() == baseCount + 4000);
+		for (int i = 0; i < 4000; i++)
+			CHECK(sceKernelDeleteSema(uids[i]) == 0);
+		CHECK(kernelObjects.GetCount() == baseCount);
+		CHECK((u32)sceKernelSignalSema(uids[3999], 1) == unknown);
+	}
+
+	kernelObjects.Clear();
+	return passed;
+}
+
+static std::vector<u8> FromHex(const char *hex)
+{
+	std::vector<u8> bytes;
+	for (size_t i = 0; hex[i] && hex[i + 1]; i += 2)
+	{
+		unsigned int byte;
+		sscanf(hex + i, "%2x", &byte);
+		bytes.push_back((u8)byte);
+	}
+	return bytes;
+}
+
+static bool BytesMatch(const u8 *data, const char *hex)
+{
+	std::vector<u8> expected = FromHex(hex);
+	return memcmp(data, &expected[0], expected.size()) == 0;
+}
+
+// Deterministic filler for comparing the backends on more than the fixed vectors.
+static void FillPseudoRandom(std::vector<u8> &data, u32 seed)
+{
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = (u8)(seed >> 16);
+	}
+}
+
+static bool HaveAesHw()
+{
+#ifndef ARM
+	return cpu_info.bAES;
+#else
+	return false;
+#endif
+}
+
+static bool HaveShaHw()
+{
+#ifndef ARM
+	return cpu_info.bSHA;
+#else
+	return false;
+#endif
+}
+
+// FIPS-197, SP 800-38A and RFC 4493 vectors through the portable libkirk AES, and through
+// AES-NI too when the cpu has it.  Then both backends have to agree on longer CBC runs.
+static bool TestAesVectors()
+{
+	bool passed = true;
+	static const char *cbcKey = "2b7e151628aed2a6abf7158809cf4f3c";
+	static const char *cbcPlain = "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+		"30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+	static const char *cbcCipher = "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+		"73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7";
+	static const struct { int length; const char *mac; } cmacVectors[] = {
+		{0, "bb1d6929e95937287fa37d129b756746"},
+		{16, "070a16b46b4d4144f79bdd9dd04a287c"},
+		{40, "dfa66747de9ae63030ca32611497c827"},
+		{64, "51f0bebf7e3b9d92fc49741779363cfe"},
+	};
+
+	std::vector<u8> big(0x1000 + 0x30), bigOut[2], bigBack[2];
+	FillPseudoRandom(big, 0x50535021);
+	AES_ctx bigCtx;
+	AES_set_key(&bigCtx, &FromHex(cbcKey)[0], 128);
+
+	int backends = HaveAesHw() ? 2 : 1;
+	for (int hw = 0; hw < backends; hw++)
+	{
+		AES_set_hw_accel(hw);
+
+		AES_ctx ctx;
+		u8 block[16];
+		AES_set_key(&ctx, &FromHex("000102030405060708090a0b0c0d0e0f")[0], 128);
+		AES_encrypt(&ctx, &FromHex("00112233445566778899aabbccddeeff")[0], block);
+		CHECK(BytesMatch(block, "69c4e0d86a7b0430d8cdb78070b4c55a"));
+		AES_decrypt(&ctx, &FromHex("69c4e0d86a7b0430d8cdb78070b4c55a")[0], block);
+		CHECK(BytesMatch(block, "00112233445566778899aabbccddeeff"));
+
+		// libkirk's CBC has no IV, so the vector's IV goes into the first block by hand.
+		std::vector<u8> plain = FromHex(cbcPlain);
+		std::vector<u8> iv = FromHex("000102030405060708090a0b0c0d0e0f");
+		for (int i = 0; i < 16; i++)
+			plain[i] ^= iv[i];
+		std::vector<u8> cipher(plain.size());
+		AES_set_key(&ctx, &FromHex(cbcKey)[0], 128);
+		AES_cbc_encrypt(&ctx, &plain[0], &cipher[0], (int)plain.size());
+		CHECK(BytesMatch(&cipher[0], cbcCipher));
+		std::vector<u8> back(cipher.size());
+		AES_cbc_decrypt(&ctx, &cipher[0], &back[0], (int)cipher.size());
+		CHECK(memcmp(&back[0], &plain[0], plain.size()) == 0);
+
+		std::vector<u8> message = FromHex(cbcPlain);
+		for (size_t i = 0; i < sizeof(cmacVectors) / sizeof(cmacVectors[0]); i++)
+		{
+			u8 mac[16];
+			AES_CMAC(&ctx, &message[0], cmacVectors[i].length, mac);
+			CHECK(BytesMatch(mac, cmacVectors[i].mac));
+		}
+
+		bigOut[hw].resize(big.size());
+		bigBack[hw].resize(big.size());
+		AES_cbc_encrypt(&bigCtx, &big[0], &bigOut[hw][0], (int)big.size());
+		AES_cbc_decrypt(&bigCtx, &bigOut[hw][0], &bigBack[hw][0], (int)big.size());
+		CHECK(bigBack[hw] == big);
+	}
+	if (backends == 2)
+		CHECK(bigOut[0] == bigOut[1]);
+	else
+		printf("  no AES-NI, only the portable code was checked\n");
+
+	AES_set_hw_accel(HaveAesHw());
+	return passed;
+}
+
+static void Sha1(const u8 *data, int length, u8 *digest)
+{
+	SHA_CTX ctx;
+	SHAInit(&ctx);
+	SHAUpdate(&ctx, (BYTE *)data, length);
+	SHAFinal(digest, &ctx);
+}
+
+// FIPS 180 vectors, then every length up to a few blocks through both transforms.
+static bool TestShaVectors()
+{
+	bool passed = true;
+	static const char *abc = "abc";
+	static const char *twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+	std::vector<u8> data(200);
+	FillPseudoRandom(data, 0x53484131);
+	std::vector<u8> digests[2];
+
+	int backends = HaveShaHw() ? 2 : 1;
+	for (int hw = 0; hw < backends; hw++)
+	{
+		SHA_set_hw_accel(hw);
+
+		u8 digest[20];
+		Sha1((const u8 *)abc, (int)strlen(abc), digest);
+		CHECK(BytesMatch(digest, "a9993e364706816aba3e25717850c26c9cd0d89d"));
+		Sha1((const u8 *)twoBlocks, (int)strlen(twoBlocks), digest);
+		CHECK(BytesMatch(digest, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"));
+
+		std::vector<u8> million(1000000, 'a');
+		Sha1(&million[0], (int)million.size(), digest);
+		CHECK(BytesMatch(digest, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"));
+
+		for (int length = 0; length <= (int)data.size(); length++)
+		{
+			Sha1(&data[0], length, digest);
+			digests[hw].insert(digests[hw].end(), digest, digest + 20);
+		}
+	}
+	if (backends == 2)
+		CHECK(digests[0] == digests[1]);
+	else
+		printf("  no SHA extensions, only the portable code was checked\n");
+
+	SHA_set_hw_accel(HaveShaHw());
+	return passed;
+}
+
+// Replacements are on by default, so check that a scanned memcpy gets replaced, that a loop of
+// the same shape with another stride doesn't, and that the interpreter runs the native one.
+static bool TestFuncReplacement()
+{
+	bool passed = true;
+	static const u32 memcpyCode[] =
+	{
+		0x10c00008, 0x00801021, 0x00801821, 0x90a80000, 0x24c6ffff, 0xa0680000,
+		0x24a50001, 0x14c0fffb, 0x24630001, 0x03e00008, 0x00000000,
+	};
+	const int count = sizeof(memcpyCode) / sizeof(memcpyCode[0]);
+	const u32 copyAddr = 0x08900000;
+	const u32 stridedAddr = 0x08900100;
+	const u32 returnAddr = 0x08900200;
+	const u32 src = 0x08910000;
+	const u32 dest = 0x08910100;
+
+	bool oldReplacements = g_Config.bFuncReplacements;
+	MIPSState *oldMIPS = currentMIPS;
+	g_Config.bFuncReplacements = true;
+	Memory::Init();
+	currentMIPS = &mipsr4k;
+	mipsr4k.Reset();
+	symbolMap.ResetSymbolMap();
+	Replacement_Init();
+
+	for (int i = 0; i < count; i++)
+	{
+		Memory::Write_U32(memcpyCode[i], copyAddr + i * 4);
+		// addiu a1, a1, 2 instead of 1.
+		Memory::Write_U32(i == 6 ? 0x24a50002 : memcpyCode[i], stridedAddr + i * 4);
+	}
+	symbolMap.AddSymbol("z_un_08900000", copyAddr, count * 4, ST_FUNCTION);
+	symbolMap.AddSymbol("z_un_08900100", stridedAddr, count * 4, ST_FUNCTION);
+	Replacement_ApplyToModule(copyAddr, 0x200);
+
+	u32 op = Memory::Read_U32(copyAddr);
+	CHECK(MIPS_IS_EMUHACK(op));
+	CHECK(Memory::Read_U32(stridedAddr) == memcpyCode[0]);
+
+	static const char text[] = "replaced";
+	for (size_t i = 0; i < sizeof(text); i++)
+		Memory::Write_U8(text[i], src + (u32)i);
+	mipsr4k.r[MIPS_REG_A0] = dest;
+	mipsr4k.r[MIPS_REG_A1] = src;
+	mipsr4k.r[MIPS_REG_A2] = sizeof(text);
+	mipsr4k.r[MIPS_REG_RA] = returnAddr;
+	mipsr4k.pc = copyAddr;
+	if (MIPS_IS_EMUHACK(op))
+		MIPSInterpret(op);
+	CHECK(mipsr4k.pc == returnAddr);
+	CHECK(mipsr4k.r[MIPS_REG_V0] == dest);
+	CHECK(memcmp(Memory::GetPointer(dest), text, sizeof(text)) == 0);
+
+	Replacement_Shutdown();
+	symbolMap.ResetSymbolMap();
+	Memory::Shutdown();
+	currentMIPS = oldMIPS;
+	g_Config.bFuncReplacements = oldReplacements;
+	return passed;
+}
+
+struct SelfTest
+{
+	const char *name;
+	bool (*func)();
+};
+
+static const SelfTest selfTests[] = {
+	{"kernel object reuse", &TestKernelObjectReuse},
+	{"libkirk AES", &TestAesVectors},
+	{"libkirk SHA-1", &TestShaVectors},
+	{"function replacement", &TestFuncReplacement},
+};
+
+int RunSelfTests()
+{
+	int failed = 0;
+	for (size_t i = 0; i < sizeof(selfTests) / sizeof(selfTests[0]); i++)
+	{
+		bool passed = selfTests[i].func();
+		printf("%s: %s\n", selfTests[i].name, passed ? "passed" : "FAILED");
+		if (!passed)
+			failed++;
+	}
+	return failed;
+}
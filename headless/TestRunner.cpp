@@ -0,0 +1,628 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "FileUtil.h"
+#include "Timer.h"
+
+#include "TestRunner.h"
+
+enum TestStatus
+{
+	TEST_PASSED,
+	TEST_FAILED,
+	TEST_TIMEOUT,
+	TEST_ERROR,
+	// The worker died while running it.
+	TEST_CRASHED,
+};
+
+static const char *statusNames[] = {"passed", "failed", "timeout", "error", "crashed"};
+
+struct TestResult
+{
+	TestStatus status;
+	double seconds;
+	std::string message;
+};
+
+static bool EndsWith(const std::string &str, const char *suffix)
+{
+	size_t len = strlen(suffix);
+	return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+static std::string StripSpaces(const std::string &str)
+{
+	size_t start = str.find_first_not_of(" \t\r\n");
+	if (start == std::string::npos)
+		return "";
+	size_t end = str.find_last_not_of(" \t\r\n");
+	return str.substr(start, end - start + 1);
+}
+
+static void SplitLines(const std::string &str, std::vector<std::string> &lines)
+{
+	size_t pos = 0;
+	while (pos < str.size())
+	{
+		size_t end = str.find('\n', pos);
+		if (end == std::string::npos)
+			end = str.size();
+		lines.push_back(StripSpaces(str.substr(pos, end - pos)));
+		pos = end + 1;
+	}
+}
+
+// Same rules as test.py: whitespace around lines doesn't matter.
+static bool CompareOutput(const std::string &expected, const std::string &output, std::string &message)
+{
+	std::vector<std::string> expectedLines, outputLines;
+	SplitLines(StripSpaces(expected), expectedLines);
+	SplitLines(StripSpaces(output), outputLines);
+
+	char temp[32];
+	bool different = false;
+	for (size_t i = 0; i < std::min(expectedLines.size(), outputLines.size()); i++)
+	{
+		if (expectedLines[i] != outputLines[i])
+		{
+			sprintf(temp, "%d", (int)i + 1);
+			message += "E" + std::string(temp) + " < " + expectedLines[i] + "\n";
+			message += "O" + std::string(temp) + " > " + outputLines[i] + "\n";
+			different = true;
+		}
+	}
+	if (expectedLines.size() != outputLines.size())
+	{
+		for (size_t i = outputLines.size(); i < expectedLines.size(); i++)
+		{
+			sprintf(temp, "%d", (int)i + 1);
+			message += "E" + std::string(temp) + " < " + expectedLines[i] + "\n";
+		}
+		for (size_t i = expectedLines.size(); i < outputLines.size(); i++)
+		{
+			sprintf(temp, "%d", (int)i + 1);
+			message += "O" + std::string(temp) + " > " + outputLines[i] + "\n";
+		}
+		message += "*** Different number of lines!\n";
+		different = true;
+	}
+	return !different;
+}
+
+static void AddTest(const std::string &base, const std::string &filename, std::vector<TestInfo> &tests)
+{
+	TestInfo info;
+	info.name = base;
+	info.filename = filename;
+	info.expectedFilename = base + ".expected";
+	tests.push_back(info);
+}
+
+static void FindTestsInTree(const File::FSTEntry &entry, std::vector<TestInfo> &tests)
+{
+	for (size_t i = 0; i < entry.children.size(); i++)
+	{
+		const File::FSTEntry &child = entry.children[i];
+		if (child.isDirectory)
+			FindTestsInTree(child, tests);
+		else if (EndsWith(child.physicalName, ".expected"))
+		{
+			std::string base = child.physicalName.substr(0, child.physicalName.size() - strlen(".expected"));
+			// Like test.py, prefer the prx.
+			AddTest(base, File::Exists(base + ".prx") ? base + ".prx" : base + ".elf", tests);
+		}
+	}
+}
+
+static bool TestInfoCompare(const TestInfo &a, const TestInfo &b)
+{
+	return a.name < b.name;
+}
+
+void TestRunner_FindTests(const std::vector<std::string> &args, std::vector<TestInfo> &tests)
+{
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		const std::string &arg = args[i];
+		if (File::IsDirectory(arg))
+		{
+			File::FSTEntry root;
+			File::ScanDirectoryTree(arg, root);
+			std::vector<TestInfo> found;
+			FindTestsInTree(root, found);
+			std::sort(found.begin(), found.end(), TestInfoCompare);
+			tests.insert(tests.end(), found.begin(), found.end());
+		}
+		else if (EndsWith(arg, ".prx") || EndsWith(arg, ".elf") || EndsWith(arg, ".pbp"))
+			AddTest(arg.substr(0, arg.size() - 4), arg, tests);
+		else
+			AddTest(arg, File::Exists(arg + ".prx") ? arg + ".prx" : arg + ".elf", tests);
+	}
+}
+
+int TestRunner_NumCPUs()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+static TestResult RunOneTest(const TestInfo &test, const TestRunnerOptions &options, RunTestFunc runTest)
+{
+	TestResult result;
+	result.seconds = 0.0;
+
+	if (!File::Exists(test.filename))
+	{
+		result.status = TEST_ERROR;
+		result.message = "PRX/ELF missing";
+		return result;
+	}
+
+	std::string expected;
+	if (!File::ReadFileToString(true, test.expectedFilename.c_str(), expected))
+	{
+		result.status = TEST_ERROR;
+		result.message = "Expects file missing";
+		return result;
+	}
+
+	std::string output;
+	u64 start = Common::Timer::GetTimeNs();
+	TestRunStatus status = runTest(test.filename, options.timeoutSeconds, output);
+	result.seconds = (Common::Timer::GetTimeNs() - start) / 1000000000.0;
+
+	if (status == TESTRUN_ERROR)
+	{
+		result.status = TEST_ERROR;
+		result.message = "Failed to run test: " + output;
+	}
+	else if (status == TESTRUN_TIMEOUT)
+	{
+		char temp[64];
+		sprintf(temp, "Test exceeded limit of %g seconds.", options.timeoutSeconds);
+		result.status = TEST_TIMEOUT;
+		result.message = temp;
+	}
+	else if (CompareOutput(expected, output, result.message))
+		result.status = TEST_PASSED;
+	else
+		result.status = TEST_FAILED;
+	return result;
+}
+
+static std::string TeamCityEscape(const std::string &str)
+{
+	std::string escaped;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		switch (str[i])
+		{
+		case '|': escaped += "||"; break;
+		case '\'': escaped += "|'"; break;
+		case '[': escaped += "|["; break;
+		case ']': escaped += "|]"; break;
+		case '\n': escaped += "|n"; break;
+		case '\r': escaped += "|r"; break;
+		default: escaped += str[i]; break;
+		}
+	}
+	return escaped;
+}
+
+static std::string XmlEscape(const std::string &str)
+{
+	std::string escaped;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		switch (str[i])
+		{
+		case '&': escaped += "&amp;"; break;
+		case '<': escaped += "&lt;"; break;
+		case '>': escaped += "&gt;"; break;
+		case '"': escaped += "&quot;"; break;
+		default:
+			// Not allowed in XML 1.0 at all.
+			if ((u8)str[i] >= 0x20 || str[i] == '\n' || str[i] == '\t')
+				escaped += str[i];
+			break;
+		}
+	}
+	return escaped;
+}
+
+// Results arrive in completion order when running in parallel.
+static void ReportResult(const TestInfo &test, const TestResult &result, const TestRunnerOptions &options)
+{
+	if (result.status == TEST_PASSED)
+		printf("  %s - passed!\n", test.name.c_str());
+	else
+	{
+		printf("  %s - %s\n", test.name.c_str(), statusNames[result.status]);
+		std::string message = StripSpaces(result.message);
+		if (!message.empty())
+			printf("%s\n", message.c_str());
+	}
+
+	if (options.teamcity)
+	{
+		std::string name = TeamCityEscape(test.name);
+		printf("##teamcity[testStarted name='%s']\n", name.c_str());
+		if (result.status != TEST_PASSED)
+			printf("##teamcity[testFailed name='%s' message='%s' details='%s']\n", name.c_str(), statusNames[result.status], TeamCityEscape(result.message).c_str());
+		printf("##teamcity[testFinished name='%s' duration='%d']\n", name.c_str(), (int)(result.seconds * 1000.0));
+	}
+	fflush(stdout);
+}
+
+static bool WriteJUnit(const std::string &filename, const std::vector<TestInfo> &tests, const std::vector<TestResult> &results)
+{
+	FILE *f = fopen(filename.c_str(), "w");
+	if (!f)
+	{
+		fprintf(stderr, "Unable to write %s\n", filename.c_str());
+		return false;
+	}
+
+	int failures = 0, errors = 0;
+	double seconds = 0.0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		if (results[i].status == TEST_FAILED)
+			failures++;
+		else if (results[i].status != TEST_PASSED)
+			errors++;
+		seconds += results[i].seconds;
+	}
+
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(f, "<testsuite name=\"pspautotests\" tests=\"%d\" failures=\"%d\" errors=\"%d\" time=\"%.3f\">\n", (int)tests.size(), failures, errors, seconds);
+	for (size_t i = 0; i < tests.size(); i++)
+	{
+		const TestResult &result = results[i];
+		std::string name = XmlEscape(tests[i].name);
+		fprintf(f, "  <testcase classname=\"pspautotests\" name=\"%s\" time=\"%.3f\"", name.c_str(), result.seconds);
+		if (result.status == TEST_PASSED)
+		{
+			fprintf(f, "/>\n");
+			continue;
+		}
+		const char *tag = result.status == TEST_FAILED ? "failure" : "error";
+		fprintf(f, ">\n    <%s message=\"%s\">%s</%s>\n  </testcase>\n", tag, statusNames[result.status], XmlEscape(result.message).c_str(), tag);
+	}
+	fprintf(f, "</testsuite>\n");
+	fclose(f);
+	return true;
+}
+
+#ifndef _WIN32
+
+// Worker to parent records are "index\tstatus\tmilliseconds\tmessage\n".
+static std::string EscapeRecord(const std::string &str)
+{
+	std::string escaped;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		switch (str[i])
+		{
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\t': escaped += "\\t"; break;
+		default: escaped += str[i]; break;
+		}
+	}
+	return escaped;
+}
+
+static std::string UnescapeRecord(const std::string &str)
+{
+	std::string unescaped;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if (str[i] != '\\' || i + 1 == str.size())
+		{
+			unescaped += str[i];
+			continue;
+		}
+		char c = str[++i];
+		unescaped += c == 'n' ? '\n' : (c == 't' ? '\t' : c);
+	}
+	return unescaped;
+}
+
+static bool WriteAll(int fd, const std::string &data)
+{
+	size_t pos = 0;
+	while (pos < data.size())
+	{
+		ssize_t written = write(fd, data.data() + pos, data.size() - pos);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		pos += written;
+	}
+	return true;
+}
+
+struct Worker
+{
+	pid_t pid;
+	int fd;
+	// Test indices still to run, in order, so the front one is the current test.
+	std::vector<int> queue;
+	std::string buffer;
+	u64 lastResultNs;
+};
+
+static void RunWorker(int fd, const std::vector<int> &queue, const std::vector<TestInfo> &tests, const TestRunnerOptions &options, RunTestFunc runTest)
+{
+	// The emulator prints test output too, keep it out of the report.
+	int devNull = open("/dev/null", O_WRONLY);
+	if (devNull >= 0)
+	{
+		dup2(devNull, STDOUT_FILENO);
+		close(devNull);
+	}
+
+	for (size_t i = 0; i < queue.size(); i++)
+	{
+		TestResult result = RunOneTest(tests[queue[i]], options, runTest);
+		char header[64];
+		sprintf(header, "%d\t%d\t%d\t", queue[i], (int)result.status, (int)(result.seconds * 1000.0));
+		if (!WriteAll(fd, header + EscapeRecord(result.message) + "\n"))
+			break;
+	}
+	close(fd);
+	// Skips atexit handlers and the stdio buffers copied from the parent.
+	_exit(0);
+}
+
+static bool StartWorker(Worker &worker, std::vector<Worker> &workers, const std::vector<TestInfo> &tests, const TestRunnerOptions &options, RunTestFunc runTest)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0)
+	{
+		close(fds[0]);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			if (workers[i].fd >= 0)
+				close(workers[i].fd);
+		}
+		RunWorker(fds[1], worker.queue, tests, options, runTest);
+	}
+
+	close(fds[1]);
+	worker.pid = pid;
+	worker.fd = fds[0];
+	worker.buffer.clear();
+	worker.lastResultNs = Common::Timer::GetTimeNs();
+	return true;
+}
+
+static void ParseRecords(Worker &worker, const std::vector<TestInfo> &tests, std::vector<TestResult> &results, const TestRunnerOptions &options)
+{
+	size_t end;
+	while ((end = worker.buffer.find('\n')) != std::string::npos)
+	{
+		std::string line = worker.buffer.substr(0, end);
+		worker.buffer.erase(0, end + 1);
+
+		int index, status, ms, offset = 0;
+		if (sscanf(line.c_str(), "%d\t%d\t%d\t%n", &index, &status, &ms, &offset) < 3 || offset == 0)
+			continue;
+		if (index < 0 || index >= (int)tests.size() || worker.queue.empty() || worker.queue[0] != index)
+			continue;
+
+		TestResult &result = results[index];
+		result.status = (TestStatus)status;
+		result.seconds = ms / 1000.0;
+		result.message = UnescapeRecord(line.substr(offset));
+		ReportResult(tests[index], result, options);
+
+		worker.queue.erase(worker.queue.begin());
+		worker.lastResultNs = Common::Timer::GetTimeNs();
+	}
+}
+
+static void RunParallel(const std::vector<TestInfo> &tests, std::vector<TestResult> &results, const TestRunnerOptions &options, RunTestFunc runTest)
+{
+	int numWorkers = std::max(1, std::min(options.numWorkers, (int)tests.size()));
+	std::vector<Worker> workers(numWorkers);
+	for (int i = 0; i < numWorkers; i++)
+	{
+		workers[i].pid = -1;
+		workers[i].fd = -1;
+	}
+	// Interleaved, so slow directories don't all land on one worker.
+	for (size_t i = 0; i < tests.size(); i++)
+		workers[i % numWorkers].queue.push_back((int)i);
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		if (!StartWorker(workers[i], workers, tests, options, runTest))
+		{
+			fprintf(stderr, "Unable to start test worker: %s\n", strerror(errno));
+			workers[i].queue.clear();
+		}
+	}
+
+	// The worker enforces the timeout itself, this is for hangs outside the emulator loop.
+	u64 hangNs = (u64)((options.timeoutSeconds + 10.0) * 1000000000.0);
+	bool done = false;
+	while (!done)
+	{
+		std::vector<pollfd> fds;
+		std::vector<int> fdWorkers;
+		for (int i = 0; i < numWorkers; i++)
+		{
+			if (workers[i].fd < 0)
+				continue;
+			pollfd p = {workers[i].fd, POLLIN, 0};
+			fds.push_back(p);
+			fdWorkers.push_back(i);
+		}
+		if (fds.empty())
+			break;
+
+		if (poll(&fds[0], fds.size(), 1000) < 0 && errno != EINTR)
+			break;
+
+		u64 now = Common::Timer::GetTimeNs();
+		for (size_t i = 0; i < fds.size(); i++)
+		{
+			Worker &worker = workers[fdWorkers[i]];
+			bool finished = false;
+			std::string reason;
+
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				char buf[4096];
+				ssize_t bytes = read(worker.fd, buf, sizeof(buf));
+				if (bytes > 0)
+				{
+					worker.buffer.append(buf, bytes);
+					ParseRecords(worker, tests, results, options);
+				}
+				else if (bytes == 0 || errno != EINTR)
+					finished = true;
+			}
+			else if (options.timeoutSeconds > 0.0 && now - worker.lastResultNs > hangNs)
+			{
+				kill(worker.pid, SIGKILL);
+				reason = "Worker stopped responding and was killed";
+				finished = true;
+			}
+
+			if (!finished)
+				continue;
+
+			close(worker.fd);
+			worker.fd = -1;
+			int status = 0;
+			waitpid(worker.pid, &status, 0);
+			worker.pid = -1;
+
+			if (worker.queue.empty())
+				continue;
+
+			// Whatever it was running took it down, blame that and carry on with the rest.
+			if (reason.empty())
+			{
+				char temp[64];
+				if (WIFSIGNALED(status))
+					sprintf(temp, "Worker died with signal %d", WTERMSIG(status));
+				else
+					sprintf(temp, "Worker exited with status %d", WEXITSTATUS(status));
+				reason = temp;
+			}
+			int index = worker.queue[0];
+			results[index].status = TEST_CRASHED;
+			results[index].seconds = (now - worker.lastResultNs) / 1000000000.0;
+			results[index].message = reason;
+			ReportResult(tests[index], results[index], options);
+			worker.queue.erase(worker.queue.begin());
+
+			if (!worker.queue.empty() && !StartWorker(worker, workers, tests, options, runTest))
+			{
+				fprintf(stderr, "Unable to restart test worker: %s\n", strerror(errno));
+				for (size_t j = 0; j < worker.queue.size(); j++)
+				{
+					results[worker.queue[j]].status = TEST_CRASHED;
+					results[worker.queue[j]].message = "No worker to run it";
+				}
+				worker.queue.clear();
+			}
+		}
+	}
+}
+
+#endif
+
+int TestRunner_Run(const std::vector<TestInfo> &tests, const TestRunnerOptions &options, RunTestFunc runTest)
+{
+	TestResult initial;
+	initial.status = TEST_CRASHED;
+	initial.seconds = 0.0;
+	initial.message = "Never ran";
+	std::vector<TestResult> results(tests.size(), initial);
+
+#ifdef _WIN32
+	if (options.numWorkers > 1)
+		printf("Parallel workers need fork(), running tests one at a time.\n");
+	for (size_t i = 0; i < tests.size(); i++)
+	{
+		results[i] = RunOneTest(tests[i], options, runTest);
+		ReportResult(tests[i], results[i], options);
+	}
+#else
+	RunParallel(tests, results, options, runTest);
+#endif
+
+	std::vector<std::string> failed;
+	for (size_t i = 0; i < tests.size(); i++)
+	{
+		if (results[i].status != TEST_PASSED)
+			failed.push_back(tests[i].name);
+	}
+
+	printf("%d tests passed, %d tests failed.\n", (int)(tests.size() - failed.size()), (int)failed.size());
+	if (!failed.empty())
+	{
+		printf("Failed tests:\n");
+		for (size_t i = 0; i < failed.size(); i++)
+			printf("  %s\n", failed[i].c_str());
+	}
+
+	if (!options.junitFilename.empty())
+		WriteJUnit(options.junitFilename, tests, results);
+	return (int)failed.size();
+}
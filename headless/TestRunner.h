@@ -0,0 +1,61 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runs many pspautotests style tests (test.prx next to test.expected) in one go.
+// Each worker process runs its share of the tests one after another, resetting
+// the emulator in between, so process startup is only paid once per worker.
+// Workers are forked children, on Windows the tests run in this process instead.
+
+enum TestRunStatus
+{
+	TESTRUN_OK,
+	TESTRUN_TIMEOUT,
+	// The emulator couldn't start the test, output holds the reason.
+	TESTRUN_ERROR,
+};
+
+// Boots filename, runs it until it exits or timeoutSeconds of host time pass,
+// and returns what it printed.
+typedef TestRunStatus (*RunTestFunc)(const std::string &filename, double timeoutSeconds, std::string &output);
+
+struct TestInfo
+{
+	// The path without extension, like test.py's names.
+	std::string name;
+	std::string filename;
+	std::string expectedFilename;
+};
+
+struct TestRunnerOptions
+{
+	int numWorkers;
+	double timeoutSeconds;
+	bool teamcity;
+	std::string junitFilename;
+};
+
+// Arguments can be test executables, names without extension, or directories
+// to search for .expected files.
+void TestRunner_FindTests(const std::vector<std::string> &args, std::vector<TestInfo> &tests);
+int TestRunner_NumCPUs();
+// Returns the number of tests that didn't pass.
+int TestRunner_Run(const std::vector<TestInfo> &tests, const TestRunnerOptions &options, RunTestFunc runTest);
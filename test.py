@@ -135,6 +135,16 @@ test_broken = [
 ]
 
 
+# Run under every cpu core with --compare-cores, which fails if the cycle counts or output
+# differ.  Plain cpu tests, so timer events can't switch threads at core-specific points.
+tests_compare_cores = [
+  "cpu/cpu_alu/cpu_alu",
+  "cpu/lsu/lsu",
+  "cpu/fpu/fpu",
+  "cpu/vfpu/base/vfpu",
+  "string/string",
+]
+
 # These are the tests we ignore (not important, or impossible to run)
 tests_ignored = [
   "kirk/kirk",
@@ -271,6 +281,41 @@ def run_tests(test_list, args):
   print("Ran " + PPSSPP_EXE)
 
 
+# Checks built into headless that don't need a test executable.
+def run_selftest():
+  tcprint("##teamcity[testStarted name='selftest' captureStandardOutput='true']")
+  c = Command([PPSSPP_EXE, "--selftest"])
+  c.run(TIMEOUT * 4)
+  print(c.output.strip())
+  if c.timeout or c.process.returncode != 0:
+    print("Self test failed!")
+    tcprint("##teamcity[testFailed name='selftest' message='Self test failed']")
+    tcprint("##teamcity[testFinished name='selftest']")
+    return False
+  tcprint("##teamcity[testFinished name='selftest']")
+  return True
+
+
+def run_compare_cores():
+  passed = True
+  for test in tests_compare_cores:
+    elf_filename = TEST_ROOT + test + ".prx"
+    if not os.path.exists(elf_filename):
+      elf_filename = TEST_ROOT + test + ".elf"
+    name = "compare-cores " + test
+    tcprint("##teamcity[testStarted name='%s' captureStandardOutput='true']" % name)
+    c = Command([PPSSPP_EXE, elf_filename, "--compare-cores"])
+    c.run(TIMEOUT * 3)
+    if c.timeout or c.process.returncode != 0:
+      print("Cores disagree on " + test + "!")
+      tcprint("##teamcity[testFailed name='%s' message='Cores disagree']" % name)
+      passed = False
+    else:
+      print("  " + name + " - passed!")
+    tcprint("##teamcity[testFinished name='%s']" % name)
+  return passed
+
+
 def main():
   global teamcity_mode
   init()
@@ -290,6 +335,8 @@ def main():
     else:
       tests = tests_next + tests_good
 
+  run_selftest()
+  run_compare_cores()
   run_tests(tests, args)
 
 main()